@@ -1,8 +1,10 @@
 
 #include "gstegladaptation.h"
 #include "gsteglglessink.h"
+#include "gsteglprogramcache.h"
 #include <gst/video/video.h>
 #include <string.h>
+#include <stdio.h>
 
 #define GST_CAT_DEFAULT egladaption_debug
 GST_DEBUG_CATEGORY (egladaption_debug);
@@ -18,16 +20,18 @@ GST_DEBUG_CATEGORY (egladaption_debug);
 /**
  * @param position(in): 顶点位置
  * @param texpos(in): 纹理位置
+ * @param u_transformation: 顶点变换矩阵（GstVideoAffineTransformationMeta），不需要变换时为单位矩阵
  * @param opos(out): 把顶点位置输出到片段着色器程序中
 */
 static const char *vert_COPY_prog = {
       "attribute vec3 position;"
       "attribute vec2 texpos;"
+      "uniform mat4 u_transformation;"
       "varying vec2 opos;"
       "void main(void)"
       "{"
       " opos = texpos;"
-      " gl_Position = vec4(position, 1.0);"
+      " gl_Position = u_transformation * vec4(position, 1.0);"
       "}"
 };
 
@@ -40,32 +44,75 @@ static const char *vert_COPY_prog_no_tex = {
       "}"
 };
 
-/* Paint all black */
-static const char *frag_BLACK_prog = {
+/* ROI 框（实例化绘制，每个实例一个框）
+ * corner: xy 为角点（0/1），z 为 1 表示外边，0 表示内边
+ * box: 每个实例的 左、下、右、上（NDC），color: 每个实例的颜色
+ * line_width: 线宽（NDC），线条以框的边为中心 */
+static const char *vert_ROI_prog = {
+      "attribute vec3 corner;"
+      "attribute vec4 box;"
+      "attribute vec4 color;"
+      "uniform vec2 line_width;"
+      "varying vec4 ocolor;"
+      "void main(void)"
+      "{"
+      " vec2 dir = corner.xy * 2.0 - 1.0;"
+      " vec2 pos = mix(box.xy, box.zw, corner.xy)"
+      "     + dir * line_width * (corner.z - 0.5);"
+      " ocolor = color;"
+      " gl_Position = vec4(pos, 0.0, 1.0);"
+      "}"
+};
+
+static const char *frag_ROI_prog = {
   "precision mediump float;"
+      "varying vec4 ocolor;"
       "void main(void)"
       "{"
-      " gl_FragColor = vec4(0.0, 0.0, 0.0, 1.0);"
+      " gl_FragColor = ocolor;"
+      "}"
+};
+
+/* 拼接：每个实例是一个格子，从纹理数组的 layer 层采样（需要 GLSL ES 3.00） */
+static const char *vert_MOSAIC_prog = {
+  "#version 300 es\n"
+      "in vec2 corner;"
+      "in vec4 rect;"
+      "in vec4 crop;"
+      "in float layer;"
+      "out vec3 opos;"
+      "void main(void)"
+      "{"
+      " gl_Position = vec4(mix(rect.xy, rect.zw, corner), 0.0, 1.0);"
+      " opos = vec3(mix(crop.xy, crop.zw, corner), layer);"
       "}"
 };
 
-/* 以下全部都是不同视频格式转RGB视频格式的着色语言，会在编译着色程序前使用 */
+static const char *frag_MOSAIC_prog = {
+  "#version 300 es\n"
+      "precision mediump float;"
+      "precision mediump sampler2DArray;"
+      "in vec3 opos;"
+      "uniform sampler2DArray tex;"
+      "out vec4 color;"
+      "void main(void)"
+      "{"
+      " color = texture(tex, opos);"
+      "}"
+};
 
-/* 这个是没有使用OES扩展的，片段着色器程序 */
-static const char *frag_COPY_prog = {
+/* Paint all black */
+static const char *frag_BLACK_prog = {
   "precision mediump float;"
-      "varying vec2 opos;"
-      "uniform sampler2D tex;"
-      "uniform vec2 tex_scale0;"
-      "uniform vec2 tex_scale1;"
-      "uniform vec2 tex_scale2;"
       "void main(void)"
       "{"
-      " vec4 t = texture2D(tex, opos / tex_scale0);"
-      " gl_FragColor = vec4(t.rgb, 1.0);"
+      " gl_FragColor = vec4(0.0, 0.0, 0.0, 1.0);"
       "}"
 };
 
+/* 以下全部都是不同视频格式转RGB视频格式的着色语言，会在编译着色程序前使用
+ * 非OES的格式转换程序由 shader_formats 表生成（gst_egl_adaptation_generate_frag_prog） */
+
 /* 这个是使用OES扩展的，片段着色器程序 */
 static const char *frag_COPY_externel_oes_prog = {
   "#extension GL_OES_EGL_image_external : require\n"
@@ -81,98 +128,134 @@ static const char *frag_COPY_externel_oes_prog = {
       "}"
 };
 
-
-/* Channel reordering for XYZ <-> ZYX conversion */
-static const char *frag_REORDER_prog = {
+/* 生成的格式转换程序的公共部分，每个平面一个 sampler（tex0, tex1, tex2） */
+static const char *frag_CONVERT_prologue = {
   "precision mediump float;"
       "varying vec2 opos;"
-      "uniform sampler2D tex;"
+      "uniform sampler2D tex0, tex1, tex2;"
       "uniform vec2 tex_scale0;"
       "uniform vec2 tex_scale1;"
       "uniform vec2 tex_scale2;"
-      "void main(void)"
-      "{"
-      " vec4 t = texture2D(tex, opos / tex_scale0);"
-      " gl_FragColor = vec4(t.%c, t.%c, t.%c, 1.0);"
-      "}"
 };
 
-/* Packed YUV converters */
-
-/** AYUV to RGB conversion */
-static const char *frag_AYUV_prog = {
-      "precision mediump float;"
-      "varying vec2 opos;"
-      "uniform sampler2D tex;"
-      "uniform vec2 tex_scale0;"
-      "uniform vec2 tex_scale1;"
-      "uniform vec2 tex_scale2;"
+/* YUV (BT.601, limited range) -> RGB */
+static const char *frag_CONVERT_bt601 = {
       "const vec3 offset = vec3(-0.0625, -0.5, -0.5);"
       "const vec3 rcoeff = vec3(1.164, 0.000, 1.596);"
       "const vec3 gcoeff = vec3(1.164,-0.391,-0.813);"
       "const vec3 bcoeff = vec3(1.164, 2.018, 0.000);"
-      "void main(void) {"
-      "  float r,g,b;"
-      "  vec3 yuv;"
-      "  yuv  = texture2D(tex,opos / tex_scale0).gba;"
-      "  yuv += offset;"
-      "  r = dot(yuv, rcoeff);"
-      "  g = dot(yuv, gcoeff);"
-      "  b = dot(yuv, bcoeff);"
-      "  gl_FragColor=vec4(r,g,b,1.0);"
-      "}"
 };
 
-/* Planar YUV converters */
-
-/** YUV to RGB conversion */
-static const char *frag_PLANAR_YUV_prog = {
-      "precision mediump float;"
+/* 高质量缩放：可分离滤波的一遍（水平或者垂直由 dir 决定）
+ * 输入纹理必须已经是RGB，缩小时滤波核按 factor 展宽（防止锯齿）
+ * %s 为滤波核（const float support 和 float weight (float x)）
+ */
+static const char *frag_SCALE_prog = {
+      "precision highp float;"
       "varying vec2 opos;"
-      "uniform sampler2D Ytex,Utex,Vtex;"
+      "uniform sampler2D tex;"
       "uniform vec2 tex_scale0;"
-      "uniform vec2 tex_scale1;"
-      "uniform vec2 tex_scale2;"
-      "const vec3 offset = vec3(-0.0625, -0.5, -0.5);"
-      "const vec3 rcoeff = vec3(1.164, 0.000, 1.596);"
-      "const vec3 gcoeff = vec3(1.164,-0.391,-0.813);"
-      "const vec3 bcoeff = vec3(1.164, 2.018, 0.000);"
-      "void main(void) {"
-      "  float r,g,b;"
-      "  vec3 yuv;"
-      "  yuv.x=texture2D(Ytex,opos / tex_scale0).r;"
-      "  yuv.y=texture2D(Utex,opos / tex_scale1).r;"
-      "  yuv.z=texture2D(Vtex,opos / tex_scale2).r;"
-      "  yuv += offset;"
-      "  r = dot(yuv, rcoeff);"
-      "  g = dot(yuv, gcoeff);"
-      "  b = dot(yuv, bcoeff);"
-      "  gl_FragColor=vec4(r,g,b,1.0);"
+      "uniform vec2 texel;"
+      "uniform vec2 dir;"
+      "uniform float factor;"
+      "%s"
+      "void main(void)"
+      "{"
+      " vec2 pos = opos / tex_scale0;"
+      " float center = dot(pos, dir) / dot(texel, dir) - 0.5;"
+      " float radius = support * factor;"
+      " float first = floor(center - radius) + 1.0;"
+      " vec4 sum = vec4(0.0);"
+      " float wsum = 0.0;"
+      " for (int i = 0; i < 64; i++) {"
+      "   float p = first + float(i);"
+      "   if (p >= center + radius)"
+      "     break;"
+      "   float w = weight((p - center) / factor);"
+      "   sum += w * texture2D(tex, pos + dir * texel * (p - center));"
+      "   wsum += w;"
+      " }"
+      " gl_FragColor = vec4(sum.rgb / wsum, 1.0);"
       "}"
 };
 
-/** NV12/NV21 to RGB conversion */
-static const char *frag_NV12_NV21_prog = {
-      "precision mediump float;"
+/* 去隔行（输入为 fbo[0] 中已经转换成RGBA的视频帧，可能已经旋转）
+ * line: 当前像素在源视频中的行号，field: 需要保留的场
+ * mode: 0 直接拷贝，1 bob（复制上一行），2 linear（上下两行插值），3 blend（[1 2 1] 滤波） */
+static const char *frag_DEINTERLACE_prog = {
+      "precision highp float;"
       "varying vec2 opos;"
-      "uniform sampler2D Ytex,UVtex;"
-      "uniform vec2 tex_scale0;"
-      "uniform vec2 tex_scale1;"
-      "uniform vec2 tex_scale2;"
-      "const vec3 offset = vec3(-0.0625, -0.5, -0.5);"
-      "const vec3 rcoeff = vec3(1.164, 0.000, 1.596);"
-      "const vec3 gcoeff = vec3(1.164,-0.391,-0.813);"
-      "const vec3 bcoeff = vec3(1.164, 2.018, 0.000);"
-      "void main(void) {"
-      "  float r,g,b;"
-      "  vec3 yuv;"
-      "  yuv.x=texture2D(Ytex,opos / tex_scale0).r;"
-      "  yuv.yz=texture2D(UVtex,opos / tex_scale1).%c%c;"
-      "  yuv += offset;"
-      "  r = dot(yuv, rcoeff);"
-      "  g = dot(yuv, gcoeff);"
-      "  b = dot(yuv, bcoeff);"
-      "  gl_FragColor=vec4(r,g,b,1.0);"
+      "uniform sampler2D tex;"
+      "uniform vec3 line_coef;"
+      "uniform vec2 line_step;"
+      "uniform float lines;"
+      "uniform float line_offset;"
+      "uniform float field;"
+      "uniform float mode;"
+      "void main(void)"
+      "{"
+      " vec4 c = texture2D(tex, opos);"
+      " float line = floor(dot(vec3(opos, 1.0), line_coef) * lines) + line_offset;"
+      " bool keep = abs(mod(line, 2.0) - field) < 0.5;"
+      " if (mode > 2.5) {"
+      "   c = 0.5 * c + 0.25 * (texture2D(tex, opos - line_step)"
+      "       + texture2D(tex, opos + line_step));"
+      " } else if (mode > 1.5) {"
+      "   if (!keep)"
+      "     c = 0.5 * (texture2D(tex, opos - line_step)"
+      "         + texture2D(tex, opos + line_step));"
+      " } else if (mode > 0.5) {"
+      "   if (!keep)"
+      "     c = texture2D(tex, opos - line_step);"
+      " }"
+      " gl_FragColor = vec4(c.rgb, 1.0);"
+      "}"
+};
+
+/* 叠加层（字幕/OSD），像素为预乘alpha的 ARGB（小端内存中为 BGRA），
+ * global_alpha: GstVideoOverlayRectangle 的全局透明度 */
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define OVERLAY_SWIZZLE "bgra"
+#else
+#define OVERLAY_SWIZZLE "gbar"
+#endif
+static const char *frag_OVERLAY_prog = {
+  "precision mediump float;"
+      "varying vec2 opos;"
+      "uniform sampler2D tex;"
+      "uniform float global_alpha;"
+      "void main(void)"
+      "{"
+      " gl_FragColor = texture2D(tex, opos)." OVERLAY_SWIZZLE " * global_alpha;"
+      "}"
+};
+
+/* Catmull-Rom (a = -0.5) */
+static const char *frag_SCALE_bicubic_weight = {
+      "const float support = 2.0;"
+      "float weight(float x)"
+      "{"
+      " x = abs(x);"
+      " if (x < 1.0)"
+      "   return (1.5 * x - 2.5) * x * x + 1.0;"
+      " if (x < 2.0)"
+      "   return ((-0.5 * x + 2.5) * x - 4.0) * x + 2.0;"
+      " return 0.0;"
+      "}"
+};
+
+/* Lanczos-3 */
+static const char *frag_SCALE_lanczos_weight = {
+      "const float support = 3.0;"
+      "const float pi = 3.14159265;"
+      "float weight(float x)"
+      "{"
+      " x = abs(x);"
+      " if (x < 0.0001)"
+      "   return 1.0;"
+      " if (x >= 3.0)"
+      "   return 0.0;"
+      " return 3.0 * sin(pi * x) * sin(pi * x / 3.0) / (pi * pi * x * x);"
       "}"
 };
 /* *INDENT-ON* */
@@ -201,7 +284,7 @@ GstCaps *
 gst_egl_adaptation_fill_supported_fbuffer_configs (GstEglAdaptationContext *
     ctx)
 {
-  GstCaps *caps = NULL, *copy1, *copy2;
+  GstCaps *caps = NULL, *copy1, *copy2, *copy3;
   guint i, n;
 
   GST_DEBUG_OBJECT (ctx->element,
@@ -253,6 +336,7 @@ gst_egl_adaptation_fill_supported_fbuffer_configs (GstEglAdaptationContext *
 
     copy1 = gst_caps_copy (caps);
     copy2 = gst_caps_copy (caps);
+    copy3 = gst_caps_copy (caps);
 
     #ifndef HAVE_IOS
     n = gst_caps_get_size (caps);
@@ -271,7 +355,16 @@ gst_egl_adaptation_fill_supported_fbuffer_configs (GstEglAdaptationContext *
       gst_caps_set_features (copy1, i, features);
     }
 
+    n = gst_caps_get_size (copy3);
+    for (i = 0; i < n; i++) { /* video/x-raw(memory:SystemMemory, meta:GstVideoOverlayComposition) */
+      GstCapsFeatures *features =
+          gst_caps_features_new (GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY,
+          GST_CAPS_FEATURE_META_GST_VIDEO_OVERLAY_COMPOSITION, NULL);
+      gst_caps_set_features (copy3, i, features);
+    }
+
     gst_caps_append (caps, copy1);
+    gst_caps_append (caps, copy3);
     gst_caps_append (caps, copy2);
 
     n = gst_caps_get_size (caps);
@@ -293,6 +386,13 @@ gst_egl_adaptation_fill_supported_fbuffer_configs (GstEglAdaptationContext *
       gst_caps_set_features (caps, i, features);
     }
 
+#if !defined(HAVE_IOS) && GST_CHECK_VERSION(1,24,0)
+    /* video/x-raw(memory:DMABuf), format=DMA_DRM：每个平面导入成 EGLImage */
+    if (gst_egl_dmabuf_import_supported (ctx->display))
+      gst_caps_append (caps, gst_caps_from_string (GST_VIDEO_DMA_DRM_CAPS_MAKE
+              ", drm-format = (string) " GST_EGL_DMABUF_DRM_FORMATS));
+#endif
+
   } else {
     GST_INFO_OBJECT (ctx->element,
         "EGL display doesn't support RGBA8888 config");
@@ -301,78 +401,209 @@ gst_egl_adaptation_fill_supported_fbuffer_configs (GstEglAdaptationContext *
   return caps;
 }
 
+gboolean
+got_gl_error (const char *wtf)
+{
+  GLuint error = GL_NO_ERROR;
+
+  if ((error = glGetError ()) != GL_NO_ERROR) {
+    GST_CAT_ERROR (GST_CAT_DEFAULT, "GL ERROR: %s returned 0x%04x", wtf, error);
+    g_print ("GL ERROR: %s returned 0x%04x", wtf, error);
+    return TRUE;
+  }
+  return FALSE;
+}
+
 /**
- * @brief: 清理顶点数据，删除着色器程序，删除EGLSurface和上下文
+ * GstEglSharedProgram:
+ * 同一共享组（共享 egl_share_context 的所有上下文）中共用的着色程序链接结果（shared_programs 的值）
+ * 只共享二进制（gst_egl_program_binary_get），每个上下文用 glProgramBinary 创建自己的程序对象，
+ * uniform 是程序对象的状态，不同的 sink 不会互相覆盖
+ * @binary: 链接好的程序二进制，编译完成之前为 NULL
+ * @refcount: 持有该程序的实例（着色程序槽位或者预编译的引用）个数
+ * @ready: 编译（链接）已经完成，还在编译时其他实例等待而不是重复编译
+ */
+typedef struct
+{
+  GBytes *binary;
+  gint refcount;
+  gboolean ready;
+} GstEglSharedProgram;
+
+static GMutex shared_programs_lock;
+static GCond shared_programs_cond;
+static GHashTable *shared_programs;     /* 共享组 + 顶点 + 片段着色程序源代码 -> GstEglSharedProgram */
+
+static void
+shared_program_free (GstEglSharedProgram * entry)
+{
+  if (entry->binary)
+    g_bytes_unref (entry->binary);
+  g_free (entry);
+}
+
+/**
+ * @brief: 共享着色程序的键，没有共享上下文（不在共享组中）或者驱动不支持程序二进制时返回 NULL
+ *         （需要当前线程绑定了上下文）
 */
-void
-gst_egl_adaptation_cleanup (GstEglAdaptationContext * ctx)
+static gchar *
+shared_program_key (GstEglAdaptationContext * ctx, const gchar * vert_text,
+    const gchar * frag_text)
 {
-  gint i;
+  GstEglGlesSink *sink = (GstEglGlesSink *) ctx->element;
 
-  if (ctx->have_vbo) {
-    glDeleteBuffers (1, &ctx->position_buffer);
-    glDeleteBuffers (1, &ctx->index_buffer);
-    ctx->have_vbo = FALSE;
-  }
+  if (!sink->egl_share_context)
+    return NULL;
 
-  if (ctx->have_texture) {
-    glDeleteTextures (ctx->n_textures, ctx->texture);
-    ctx->have_texture = FALSE;
-    ctx->n_textures = 0;
-  }
+#ifndef HAVE_IOS
+  if (!gst_egl_program_cache_supported ())
+    return NULL;
+#else
+  return NULL;
+#endif
+
+  return g_strdup_printf ("%p\n%s\n%s", sink->egl_share_context, vert_text,
+      frag_text);
+}
 
-  for (i = 0; i < 2; i++) {
-    if (ctx->glslprogram[i]) {
-      glUseProgram (0);
-      glDetachShader (ctx->glslprogram[i], ctx->fragshader[i]);
-      glDetachShader (ctx->glslprogram[i], ctx->vertshader[i]);
-      glDeleteProgram (ctx->glslprogram[i]);
-      glDeleteShader (ctx->fragshader[i]);
-      glDeleteShader (ctx->vertshader[i]);
-      ctx->glslprogram[i] = 0;
-      ctx->fragshader[i] = 0;
-      ctx->vertshader[i] = 0;
+/**
+ * @brief: 取得（引用）共享着色程序的二进制，还在编译中时等待编译完成
+ * @return: 二进制（调用者 g_bytes_unref），没有登记时返回 NULL
+*/
+static GBytes *
+shared_program_acquire (const gchar * key)
+{
+  GstEglSharedProgram *entry;
+  GBytes *binary = NULL;
+
+  g_mutex_lock (&shared_programs_lock);
+  if (shared_programs) {
+    while ((entry = g_hash_table_lookup (shared_programs, key)) &&
+        !entry->ready)
+      g_cond_wait (&shared_programs_cond, &shared_programs_lock);
+
+    if (entry) {
+      entry->refcount++;
+      binary = g_bytes_ref (entry->binary);
     }
   }
+  g_mutex_unlock (&shared_programs_lock);
 
-  gst_egl_adaptation_context_make_current (ctx, FALSE);
-
-  gst_egl_adaptation_destroy_surface (ctx);
-  gst_egl_adaptation_destroy_context (ctx);
+  return binary;
 }
 
-gboolean
-got_gl_error (const char *wtf)
+/**
+ * @brief: 登记为正在编译（调用者负责编译并 shared_program_publish）
+ * @return: 已经登记过时返回 FALSE
+*/
+static gboolean
+shared_program_reserve (const gchar * key)
 {
-  GLuint error = GL_NO_ERROR;
+  gboolean ret = FALSE;
 
-  if ((error = glGetError ()) != GL_NO_ERROR) {
-    GST_CAT_ERROR (GST_CAT_DEFAULT, "GL ERROR: %s returned 0x%04x", wtf, error);
-    g_print ("GL ERROR: %s returned 0x%04x", wtf, error);
-    return TRUE;
+  g_mutex_lock (&shared_programs_lock);
+  if (!shared_programs)
+    shared_programs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+        (GDestroyNotify) shared_program_free);
+
+  if (!g_hash_table_contains (shared_programs, key)) {
+    g_hash_table_insert (shared_programs, g_strdup (key),
+        g_new0 (GstEglSharedProgram, 1));
+    ret = TRUE;
   }
-  return FALSE;
+  g_mutex_unlock (&shared_programs_lock);
+
+  return ret;
+}
+
+/**
+ * @brief: 发布编译结果（调用者持有一个引用），@binary 为 NULL 表示编译失败，删除登记
+*/
+static void
+shared_program_publish (const gchar * key, GBytes * binary)
+{
+  GstEglSharedProgram *entry;
+
+  g_mutex_lock (&shared_programs_lock);
+  entry = g_hash_table_lookup (shared_programs, key);
+  if (binary) {
+    entry->binary = g_bytes_ref (binary);
+    entry->refcount = 1;
+    entry->ready = TRUE;
+  } else {
+    g_hash_table_remove (shared_programs, key);
+  }
+  g_cond_broadcast (&shared_programs_cond);
+  g_mutex_unlock (&shared_programs_lock);
+}
+
+/**
+ * @brief: 释放共享着色程序的引用，没有实例使用时删除登记（不需要当前上下文）
+*/
+static void
+shared_program_release (const gchar * key)
+{
+  GstEglSharedProgram *entry;
+
+  g_mutex_lock (&shared_programs_lock);
+  entry = g_hash_table_lookup (shared_programs, key);
+  if (entry && --entry->refcount == 0)
+    g_hash_table_remove (shared_programs, key);
+  g_mutex_unlock (&shared_programs_lock);
+}
+
+/**
+ * @brief: 链接前把 position/texpos 绑定到固定位置（VAO 使用的位置，也是程序缓存键的一部分），
+ *         所有链接着色程序的路径都要调用
+ * @note: 没有这些属性的程序会忽略绑定
+*/
+static void
+bind_attrib_locations (GLuint prog)
+{
+  glBindAttribLocation (prog, GST_EGL_POSITION_ATTRIB, "position");
+  glBindAttribLocation (prog, GST_EGL_TEXPOS_ATTRIB, "texpos");
 }
 
 /**
  * @brief: 编译着色器程序
+ * @param cache_dir: 着色程序二进制缓存目录，NULL 表示不使用缓存
+ * @param retrievable: 链接之后要用 gst_egl_program_binary_get 取出二进制（共享给其他上下文）
  * @param prog(out): 着色程序对象标识ID
  * @param vert(out): 顶点着色器程序ID
  * @param frag(out): 片段着色器程序ID
  * @param vert_text(in): 顶点着色程序源代码
  * @param frag_text(in): 片段着色程序源代码
+ * @note: 设置了 @cache_dir 时先从二进制缓存加载（此时 @vert 和 @frag 为 0），
+ *        没有缓存或缓存过期时编译，链接成功后写入缓存
 */
 static gboolean
-create_shader_program (GstEglAdaptationContext * ctx, GLuint * prog,
-    GLuint * vert, GLuint * frag, const gchar * vert_text,
-    const gchar * frag_text)
+build_shader_program (GstElement * element, const gchar * cache_dir,
+    gboolean retrievable, GLuint * prog, GLuint * vert, GLuint * frag,
+    const gchar * vert_text, const gchar * frag_text)
 {
   GLint test;
   GLchar *info_log;
+  gchar *cache_key = NULL;
+
+  *prog = 0;
+  *vert = 0;
+  *frag = 0;
+
+#ifndef HAVE_IOS
+  if (cache_dir && gst_egl_program_cache_supported ()) {
+    cache_key = gst_egl_program_cache_key (vert_text, frag_text);
+    *prog = gst_egl_program_cache_load (element, cache_dir,
+        cache_key);
+    if (*prog) {
+      g_free (cache_key);
+      return TRUE;
+    }
+  }
+#endif
 
   /* Build shader program for video texture rendering */
   *vert = glCreateShader (GL_VERTEX_SHADER);
-  GST_DEBUG_OBJECT (ctx->element, "Sending %s to handle %d", vert_text, *vert);
+  GST_DEBUG_OBJECT (element, "Sending %s to handle %d", vert_text, *vert);
   glShaderSource (*vert, 1, &vert_text, NULL);
   if (got_gl_error ("glShaderSource vertex"))
     goto HANDLE_ERROR;
@@ -383,19 +614,19 @@ create_shader_program (GstEglAdaptationContext * ctx, GLuint * prog,
 
   glGetShaderiv (*vert, GL_COMPILE_STATUS, &test);
   if (test != GL_FALSE)
-    GST_DEBUG_OBJECT (ctx->element, "Successfully compiled vertex shader");
+    GST_DEBUG_OBJECT (element, "Successfully compiled vertex shader");
   else {
-    GST_ERROR_OBJECT (ctx->element, "Couldn't compile vertex shader");
+    GST_ERROR_OBJECT (element, "Couldn't compile vertex shader");
     glGetShaderiv (*vert, GL_INFO_LOG_LENGTH, &test);
     info_log = g_new0 (GLchar, test);
     glGetShaderInfoLog (*vert, test, NULL, info_log);
-    GST_INFO_OBJECT (ctx->element, "Compilation info log:\n%s", info_log);
+    GST_INFO_OBJECT (element, "Compilation info log:\n%s", info_log);
     g_free (info_log);
     goto HANDLE_ERROR;
   }
 
   *frag = glCreateShader (GL_FRAGMENT_SHADER);
-  GST_DEBUG_OBJECT (ctx->element, "Sending %s to handle %d", frag_text, *frag);
+  GST_DEBUG_OBJECT (element, "Sending %s to handle %d", frag_text, *frag);
   glShaderSource (*frag, 1, &frag_text, NULL);
   if (got_gl_error ("glShaderSource fragment"))
     goto HANDLE_ERROR;
@@ -406,13 +637,13 @@ create_shader_program (GstEglAdaptationContext * ctx, GLuint * prog,
 
   glGetShaderiv (*frag, GL_COMPILE_STATUS, &test);
   if (test != GL_FALSE)
-    GST_DEBUG_OBJECT (ctx->element, "Successfully compiled fragment shader");
+    GST_DEBUG_OBJECT (element, "Successfully compiled fragment shader");
   else {
-    GST_ERROR_OBJECT (ctx->element, "Couldn't compile fragment shader");
+    GST_ERROR_OBJECT (element, "Couldn't compile fragment shader");
     glGetShaderiv (*frag, GL_INFO_LOG_LENGTH, &test);
     info_log = g_new0 (GLchar, test);
     glGetShaderInfoLog (*frag, test, NULL, info_log);
-    GST_INFO_OBJECT (ctx->element, "Compilation info log:\n%s", info_log);
+    GST_INFO_OBJECT (element, "Compilation info log:\n%s", info_log);
     g_free (info_log);
     goto HANDLE_ERROR;
   }
@@ -426,19 +657,33 @@ create_shader_program (GstEglAdaptationContext * ctx, GLuint * prog,
   glAttachShader (*prog, *frag);
   if (got_gl_error ("glAttachShader fragments"))
     goto HANDLE_ERROR;
+  bind_attrib_locations (*prog);
+#ifndef HAVE_IOS
+  if (cache_key || retrievable)
+    glProgramParameteri (*prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
   glLinkProgram (*prog);
   glGetProgramiv (*prog, GL_LINK_STATUS, &test);
   if (test != GL_FALSE) {
-    GST_DEBUG_OBJECT (ctx->element, "GLES: Successfully linked program");
+    GST_DEBUG_OBJECT (element, "GLES: Successfully linked program");
   } else {
-    GST_ERROR_OBJECT (ctx->element, "Couldn't link program");
+    GST_ERROR_OBJECT (element, "Couldn't link program");
     goto HANDLE_ERROR;
   }
 
+#ifndef HAVE_IOS
+  if (cache_key) {
+    gst_egl_program_cache_store (element, cache_dir,
+        cache_key, *prog);
+    g_free (cache_key);
+  }
+#endif
+
   return TRUE;
 
 HANDLE_ERROR:
   {
+    g_free (cache_key);
     if (*frag && *prog)
       glDetachShader (*prog, *frag);
     if (*vert && *prog)
@@ -457,6 +702,202 @@ HANDLE_ERROR:
   }
 }
 
+/**
+ * @brief: 编译着色程序 glslprogram[index]
+ *         在共享组中时先查找其他实例（或者预编译线程）已经链接好的相同程序的二进制，
+ *         没有时自己编译并登记二进制，之后的实例用 glProgramBinary 直接创建
+ * @param vert_text(in): 顶点着色程序源代码
+ * @param frag_text(in): 片段着色程序源代码
+ * @note: 从共享二进制创建的程序没有着色器对象（vertshader/fragshader 为 0）
+*/
+static gboolean
+create_shader_program (GstEglAdaptationContext * ctx, gint index,
+    const gchar * vert_text, const gchar * frag_text)
+{
+  gchar *key;
+  GBytes *binary = NULL;
+  gboolean ret;
+
+  key = shared_program_key (ctx, vert_text, frag_text);
+  if (key) {
+    while (!(binary = shared_program_acquire (key))
+        && !shared_program_reserve (key));
+  }
+
+  if (binary) {
+#ifndef HAVE_IOS
+    ctx->glslprogram[index] = gst_egl_program_binary_load (binary);
+#endif
+    g_bytes_unref (binary);
+    ctx->vertshader[index] = 0;
+    ctx->fragshader[index] = 0;
+
+    if (ctx->glslprogram[index]) {
+      GST_DEBUG_OBJECT (ctx->element, "Created program %u from shared binary",
+          ctx->glslprogram[index]);
+      ctx->program_key[index] = key;
+      return TRUE;
+    }
+
+    /* 驱动不接受时自己编译，不再参与共享 */
+    GST_WARNING_OBJECT (ctx->element, "Shared program binary rejected");
+    shared_program_release (key);
+    g_free (key);
+    key = NULL;
+  }
+
+  ret = build_shader_program (ctx->element, ctx->program_cache_dir,
+      key != NULL, &ctx->glslprogram[index], &ctx->vertshader[index],
+      &ctx->fragshader[index], vert_text, frag_text);
+
+  if (key) {
+#ifndef HAVE_IOS
+    if (ret)
+      binary = gst_egl_program_binary_get (ctx->glslprogram[index]);
+#endif
+    shared_program_publish (key, binary);
+    if (binary) {
+      g_bytes_unref (binary);
+    } else {
+      g_free (key);
+      key = NULL;
+    }
+  }
+  ctx->program_key[index] = key;
+
+  return ret;
+}
+
+/**
+ * @brief: 删除着色程序 glslprogram[index]（共享的程序同时释放共享二进制的引用）
+*/
+static void
+delete_shader_program (GstEglAdaptationContext * ctx, gint index)
+{
+  if (!ctx->glslprogram[index])
+    return;
+
+  glUseProgram (0);
+  /* 从二进制缓存加载的程序和从共享二进制创建的程序没有着色器对象 */
+  if (ctx->fragshader[index])
+    glDetachShader (ctx->glslprogram[index], ctx->fragshader[index]);
+  if (ctx->vertshader[index])
+    glDetachShader (ctx->glslprogram[index], ctx->vertshader[index]);
+  glDeleteProgram (ctx->glslprogram[index]);
+  if (ctx->program_key[index])
+    shared_program_release (ctx->program_key[index]);
+  glDeleteShader (ctx->fragshader[index]);
+  glDeleteShader (ctx->vertshader[index]);
+  g_free (ctx->program_key[index]);
+  ctx->program_key[index] = NULL;
+  ctx->glslprogram[index] = 0;
+  ctx->fragshader[index] = 0;
+  ctx->vertshader[index] = 0;
+}
+
+/**
+ * @brief: 清理顶点数据，删除着色器程序，删除EGLSurface和上下文
+*/
+void
+gst_egl_adaptation_cleanup (GstEglAdaptationContext * ctx)
+{
+  gint i;
+
+  if (ctx->have_vbo) {
+    glBindVertexArray (0);
+    glDeleteVertexArrays (G_N_ELEMENTS (ctx->quad_vao), ctx->quad_vao);
+    glDeleteBuffers (1, &ctx->position_buffer);
+    glDeleteBuffers (1, &ctx->index_buffer);
+    memset (ctx->quad_vao, 0, sizeof (ctx->quad_vao));
+    ctx->have_vbo = FALSE;
+  }
+
+  if (ctx->overlay_buffer) {
+    glDeleteBuffers (1, &ctx->overlay_buffer);
+    ctx->overlay_buffer = 0;
+  }
+
+  if (ctx->roi_corner_buffer) {
+    glDeleteBuffers (1, &ctx->roi_corner_buffer);
+    glDeleteBuffers (1, &ctx->roi_instance_buffer);
+    ctx->roi_corner_buffer = 0;
+    ctx->roi_instance_buffer = 0;
+  }
+
+  if (ctx->mosaic_corner_buffer) {
+    glDeleteBuffers (1, &ctx->mosaic_corner_buffer);
+    glDeleteBuffers (1, &ctx->mosaic_instance_buffer);
+    ctx->mosaic_corner_buffer = 0;
+    ctx->mosaic_instance_buffer = 0;
+  }
+
+  if (ctx->mosaic_texture) {
+    glDeleteFramebuffers (1, &ctx->mosaic_fbo);
+    glDeleteTextures (1, &ctx->mosaic_texture);
+    ctx->mosaic_fbo = 0;
+    ctx->mosaic_texture = 0;
+    ctx->mosaic_layers = 0;
+    ctx->mosaic_width = 0;
+    ctx->mosaic_height = 0;
+  }
+
+  if (ctx->have_texture) {
+    /* 直接上传时 texture[0] 是UI线程的 egl-share-texture，不能删除 */
+    if (ctx->direct_upload)
+      glDeleteTextures (ctx->n_textures - 1, ctx->texture + 1);
+    else
+      glDeleteTextures (ctx->n_textures, ctx->texture);
+    ctx->have_texture = FALSE;
+    ctx->n_textures = 0;
+  }
+  ctx->direct_upload = FALSE;
+  /* EGLImage 纹理缓存中的纹理由 sink 删除 */
+  memset (ctx->image_texture, 0, sizeof (ctx->image_texture));
+
+  /* egl-share-texture 属于UI线程，只删除FBO和自己的输出纹理 */
+  if (ctx->output_fbo) {
+    glBindFramebuffer (GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers (1, &ctx->output_fbo);
+    ctx->output_fbo = 0;
+  }
+  if (ctx->share_fbo) {
+    glBindFramebuffer (GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers (1, &ctx->share_fbo);
+    ctx->share_fbo = 0;
+  }
+  if (ctx->output_texture)
+    glDeleteTextures (1, &ctx->output_texture);
+  ctx->share_texture = 0;
+  ctx->atlas = FALSE;
+  ctx->target_fbo = 0;
+  ctx->output_texture = 0;
+  ctx->output_width = 0;
+  ctx->output_height = 0;
+
+  for (i = 0; i < G_N_ELEMENTS (ctx->fbo); i++) {
+    if (ctx->fbo[i]) {
+      glDeleteFramebuffers (1, &ctx->fbo[i]);
+      glDeleteTextures (1, &ctx->fbo_texture[i]);
+      ctx->fbo[i] = 0;
+      ctx->fbo_texture[i] = 0;
+      ctx->fbo_width[i] = 0;
+      ctx->fbo_height[i] = 0;
+    }
+  }
+
+  for (i = 0; i < G_N_ELEMENTS (ctx->glslprogram); i++)
+    delete_shader_program (ctx, i);
+  ctx->scaling_method = GST_EGL_SCALING_METHOD_BILINEAR;
+
+  /* 之后释放的对象属于要销毁的上下文，由下一个上下文丢弃或删除（共享上下文时） */
+  gst_egl_garbage_drain (ctx->garbage);
+
+  gst_egl_adaptation_context_make_current (ctx, FALSE);
+
+  gst_egl_adaptation_destroy_surface (ctx);
+  gst_egl_adaptation_destroy_context (ctx);
+}
+
 #if 0
 static gint
 _test_opengles (GstEglAdaptationContext * ctx){
@@ -528,26 +969,333 @@ _test_opengles (GstEglAdaptationContext * ctx){
 
 }
 #endif
+/* 格式转换使用的颜色矩阵 */
+typedef enum
+{
+  GST_EGL_SHADER_MATRIX_RGB,    /* 直接输出RGB */
+  GST_EGL_SHADER_MATRIX_BT601   /* YUV (BT.601, limited range) -> RGB */
+} GstEglShaderMatrix;
+
 /**
- * @brief: 1. 创建 EGLSurface
- *         2. 当前线程绑定 EGLContext 
- *         3. 编译着色器程序并获取相关顶点属性和uniform标识ID
- *         4. 生成纹理
- * @param format: 视频帧的格式
- * @param tex_external_oes: 如果使用的Jetson（GPU和CPU共享内存设备），这个就赋值TRUE（我认为CUDA也可以使用部分扩展，因为未读完整个代码，该部分未详细解释）
-*/
-gboolean
-gst_egl_adaptation_init_surface (GstEglAdaptationContext * ctx,
-    GstVideoFormat format, gboolean tex_external_oes)
+ * GstEglShaderFormat:
+ * 视频格式的转换程序描述（shader_formats 表的一行）
+ * @n_planes: 平面（纹理、sampler）个数，平面 i 使用 sampler texi 和 tex_scalei
+ * @components: 每个平面纹理的分量个数（1: LUMINANCE/R8，2: LUMINANCE_ALPHA/RG8，3: RGB，4: RGBA）
+ * @swizzle: 每个平面取的分量，按平面顺序拼接成 vec3（RGB 或 YUV）；
+ *           单平面格式在支持纹理 swizzle 时由 GL_TEXTURE_SWIZZLE_* 完成，着色程序只取 rgb
+ * @matrix: 拼接结果到RGB的转换
+ */
+typedef struct
 {
-  GLboolean ret;
-  const gchar *texnames[3] = { NULL, };
-  gchar *frag_prog = NULL;
-  gboolean free_frag_prog = FALSE;
-  gint i;
-  GLint target;
+  GstVideoFormat format;
+  gint n_planes;
+  gint components[3];
+  const gchar *swizzle[3];
+  GstEglShaderMatrix matrix;
+} GstEglShaderFormat;
+
+/* 增加一个格式只需要增加一行（还需要在 fill_supported_fbuffer_configs 和上传代码中支持） */
+static const GstEglShaderFormat shader_formats[] = {
+  /* 一般是RGBA，所以一般只创建一个纹理 */
+  {GST_VIDEO_FORMAT_RGBA, 1, {4}, {"rgb"}, GST_EGL_SHADER_MATRIX_RGB},
+  {GST_VIDEO_FORMAT_RGBx, 1, {4}, {"rgb"}, GST_EGL_SHADER_MATRIX_RGB},
+  {GST_VIDEO_FORMAT_RGB, 1, {3}, {"rgb"}, GST_EGL_SHADER_MATRIX_RGB},
+  {GST_VIDEO_FORMAT_RGB16, 1, {3}, {"rgb"}, GST_EGL_SHADER_MATRIX_RGB},
+  {GST_VIDEO_FORMAT_BGRA, 1, {4}, {"bgr"}, GST_EGL_SHADER_MATRIX_RGB},
+  {GST_VIDEO_FORMAT_BGRx, 1, {4}, {"bgr"}, GST_EGL_SHADER_MATRIX_RGB},
+  {GST_VIDEO_FORMAT_BGR, 1, {3}, {"bgr"}, GST_EGL_SHADER_MATRIX_RGB},
+  {GST_VIDEO_FORMAT_ARGB, 1, {4}, {"gba"}, GST_EGL_SHADER_MATRIX_RGB},
+  {GST_VIDEO_FORMAT_xRGB, 1, {4}, {"gba"}, GST_EGL_SHADER_MATRIX_RGB},
+  {GST_VIDEO_FORMAT_ABGR, 1, {4}, {"abg"}, GST_EGL_SHADER_MATRIX_RGB},
+  {GST_VIDEO_FORMAT_xBGR, 1, {4}, {"abg"}, GST_EGL_SHADER_MATRIX_RGB},
+  {GST_VIDEO_FORMAT_AYUV, 1, {4}, {"gba"}, GST_EGL_SHADER_MATRIX_BT601},
+  {GST_VIDEO_FORMAT_I420, 3, {1, 1, 1}, {"r", "r", "r"},
+      GST_EGL_SHADER_MATRIX_BT601},
+  {GST_VIDEO_FORMAT_YV12, 3, {1, 1, 1}, {"r", "r", "r"},
+      GST_EGL_SHADER_MATRIX_BT601},
+  {GST_VIDEO_FORMAT_Y444, 3, {1, 1, 1}, {"r", "r", "r"},
+      GST_EGL_SHADER_MATRIX_BT601},
+  {GST_VIDEO_FORMAT_Y42B, 3, {1, 1, 1}, {"r", "r", "r"},
+      GST_EGL_SHADER_MATRIX_BT601},
+  {GST_VIDEO_FORMAT_Y41B, 3, {1, 1, 1}, {"r", "r", "r"},
+      GST_EGL_SHADER_MATRIX_BT601},
+  /* UV 平面上传为 LUMINANCE_ALPHA（或者模拟 LUMINANCE_ALPHA 的 RG8）：U 在 r，V 在 a */
+  {GST_VIDEO_FORMAT_NV12, 2, {1, 2}, {"r", "ra"}, GST_EGL_SHADER_MATRIX_BT601},
+  {GST_VIDEO_FORMAT_NV21, 2, {1, 2}, {"r", "ar"}, GST_EGL_SHADER_MATRIX_BT601},
+};
 
-  GST_DEBUG_OBJECT (ctx->element, "Enter EGL surface setup");
+static const gchar *shader_texnames[3] = { "tex0", "tex1", "tex2" };
+
+static const GstEglShaderFormat *
+gst_egl_adaptation_find_shader_format (GstVideoFormat format)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (shader_formats); i++) {
+    if (shader_formats[i].format == format)
+      return &shader_formats[i];
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief: 单平面格式的分量顺序是否由纹理 swizzle 完成
+*/
+static gboolean
+gst_egl_adaptation_swizzle_on_texture (const GstEglShaderFormat * desc,
+    gboolean texture_swizzle)
+{
+  return texture_swizzle && desc->n_planes == 1;
+}
+
+/**
+ * @brief: 根据格式描述生成片段着色程序：逐个平面采样拼成 vec3，
+ *         再按颜色矩阵转换成RGB
+ * @param texture_swizzle: 支持 GL_TEXTURE_SWIZZLE_*，所有字节序的单平面RGB格式共用同一个拷贝程序
+ * @return: 片段着色程序源代码，需要 g_free
+*/
+static gchar *
+gst_egl_adaptation_generate_frag_prog (const GstEglShaderFormat * desc,
+    gboolean texture_swizzle)
+{
+  static const gchar *components = "xyz";
+  GString *str;
+  gint i, n = 0;
+
+  str = g_string_new (frag_CONVERT_prologue);
+  if (desc->matrix == GST_EGL_SHADER_MATRIX_BT601)
+    g_string_append (str, frag_CONVERT_bt601);
+
+  g_string_append (str, "void main(void){ vec3 c;");
+  for (i = 0; i < desc->n_planes; i++) {
+    const gchar *swizzle = desc->swizzle[i];
+    gint len;
+
+    if (gst_egl_adaptation_swizzle_on_texture (desc, texture_swizzle))
+      swizzle = "rgb";
+    len = strlen (swizzle);
+
+    g_assert (n + len <= 3);
+    g_string_append_printf (str, " c.%.*s = texture2D(tex%d, opos / tex_scale%d).%s;",
+        len, components + n, i, i, swizzle);
+    n += len;
+  }
+
+  switch (desc->matrix) {
+    case GST_EGL_SHADER_MATRIX_BT601:
+      g_string_append (str, " c += offset;"
+          " gl_FragColor = vec4(dot(c, rcoeff), dot(c, gcoeff), dot(c, bcoeff), 1.0);");
+      break;
+    case GST_EGL_SHADER_MATRIX_RGB:
+    default:
+      g_string_append (str, " gl_FragColor = vec4(c, 1.0);");
+      break;
+  }
+  g_string_append (str, "}");
+
+  return g_string_free (str, FALSE);
+}
+
+/**
+ * @brief: 根据视频格式选择片段着色程序（格式转换成RGB）
+ * @param texture_swizzle: 支持 GL_TEXTURE_SWIZZLE_*（gst_egl_adaptation_query_texture_swizzle）
+ * @param n_textures(out): 需要的纹理个数
+ * @param texnames(out): 每个纹理在着色程序中的 sampler 名字
+ * @return: 片段着色程序源代码，需要 g_free
+*/
+static gchar *
+gst_egl_adaptation_get_frag_prog (GstVideoFormat format,
+    gboolean tex_external_oes, gboolean texture_swizzle, gint * n_textures,
+    const gchar ** texnames)
+{
+  const GstEglShaderFormat *desc;
+  gint i;
+
+  /* 如果使用扩展，就执行。（Jetson肯定执行） */
+  if (tex_external_oes) {
+    *n_textures = 1;
+    texnames[0] = "tex";
+    return g_strdup (frag_COPY_externel_oes_prog);
+  }
+
+  desc = gst_egl_adaptation_find_shader_format (format);
+  g_assert (desc != NULL);
+
+  *n_textures = desc->n_planes;
+  for (i = 0; i < desc->n_planes; i++)
+    texnames[i] = shader_texnames[i];
+
+  return gst_egl_adaptation_generate_frag_prog (desc, texture_swizzle);
+}
+
+/**
+ * @brief: 编译视频格式 @format 转换成RGB的着色程序（顶点着色程序和 glslprogram[0] 相同），
+ *         给没有 GstEglAdaptationContext 的元素使用（eglglescompositor）
+ * @note: 不使用纹理 swizzle，单/双通道平面需要上传成 LUMINANCE/LUMINANCE_ALPHA；
+ *        链接之后删除着色器对象，调用者负责 glDeleteProgram
+ * @param n_textures(out): 需要的纹理个数
+ * @param texnames(out): 每个纹理在着色程序中的 sampler 名字
+ * @return: 程序ID，失败时为0
+*/
+GLuint
+gst_egl_adaptation_build_format_program (GstElement * element,
+    const gchar * cache_dir, GstVideoFormat format, gint * n_textures,
+    const gchar ** texnames)
+{
+  GLuint prog, vert, frag;
+  gchar *frag_prog;
+  gboolean ret;
+
+  if (!gst_egl_adaptation_find_shader_format (format))
+    return 0;
+
+  frag_prog = gst_egl_adaptation_get_frag_prog (format, FALSE, FALSE,
+      n_textures, texnames);
+  ret = build_shader_program (element, cache_dir, FALSE, &prog, &vert, &frag,
+      vert_COPY_prog, frag_prog);
+  g_free (frag_prog);
+  if (!ret)
+    return 0;
+
+  if (vert) {
+    glDetachShader (prog, vert);
+    glDeleteShader (vert);
+  }
+  if (frag) {
+    glDetachShader (prog, frag);
+    glDeleteShader (frag);
+  }
+
+  return prog;
+}
+
+/**
+ * @brief: 当前上下文是否是 GLES3（支持 GL_R8/GL_RG8 和 GL_TEXTURE_SWIZZLE_*），
+ *         需要当前线程已经绑定egl上下文
+*/
+gboolean
+gst_egl_adaptation_query_texture_swizzle (void)
+{
+#ifndef HAVE_IOS
+  const gchar *version = (const gchar *) glGetString (GL_VERSION);
+  gint major = 0;
+
+  if (version && sscanf (version, "OpenGL ES %d", &major) == 1)
+    return major >= 3;
+#endif
+  return FALSE;
+}
+
+/**
+ * @brief: 单/双通道平面纹理的格式
+ *         GLES3 使用 GL_R8/GL_RG8（很多驱动用较慢的方式模拟 LUMINANCE/LUMINANCE_ALPHA），
+ *         纹理 swizzle（gst_egl_adaptation_init_surface 中设置）让采样结果和 LUMINANCE/LUMINANCE_ALPHA 一样
+ * @param n_components: 1 或者 2
+*/
+void
+gst_egl_adaptation_plane_format (gboolean texture_swizzle, gint n_components,
+    GLint * internal_format, GLenum * format)
+{
+#ifndef HAVE_IOS
+  if (texture_swizzle) {
+    *internal_format = n_components == 1 ? GL_R8 : GL_RG8;
+    *format = n_components == 1 ? GL_RED : GL_RG;
+    return;
+  }
+#endif
+  *internal_format = n_components == 1 ? GL_LUMINANCE : GL_LUMINANCE_ALPHA;
+  *format = n_components == 1 ? GL_LUMINANCE : GL_LUMINANCE_ALPHA;
+}
+
+#ifndef HAVE_IOS
+static GLint
+swizzle_channel (gchar c)
+{
+  switch (c) {
+    case 'r':
+      return GL_RED;
+    case 'g':
+      return GL_GREEN;
+    case 'b':
+      return GL_BLUE;
+    default:
+      return GL_ALPHA;
+  }
+}
+
+/**
+ * @brief: 设置平面 @plane 纹理（当前绑定到 @target）的 swizzle：
+ *         单平面格式完成分量重排，R8/RG8 平面模拟 LUMINANCE/LUMINANCE_ALPHA，
+ *         其他情况恢复默认（共享纹理可能还保留着之前格式的 swizzle）
+*/
+static void
+gst_egl_adaptation_set_texture_swizzle (GstVideoFormat format, gint plane,
+    GLenum target)
+{
+  const GstEglShaderFormat *desc;
+  GLint swizzle[4] = { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA };
+
+  desc = gst_egl_adaptation_find_shader_format (format);
+  if (desc && gst_egl_adaptation_swizzle_on_texture (desc, TRUE)
+      && desc->components[0] > 2) {
+    swizzle[0] = swizzle_channel (desc->swizzle[0][0]);
+    swizzle[1] = swizzle_channel (desc->swizzle[0][1]);
+    swizzle[2] = swizzle_channel (desc->swizzle[0][2]);
+  } else if (desc && desc->components[plane] <= 2) {
+    swizzle[1] = swizzle[2] = GL_RED;
+    swizzle[3] = desc->components[plane] == 1 ? GL_ONE : GL_GREEN;
+  }
+
+  glTexParameteri (target, GL_TEXTURE_SWIZZLE_R, swizzle[0]);
+  glTexParameteri (target, GL_TEXTURE_SWIZZLE_G, swizzle[1]);
+  glTexParameteri (target, GL_TEXTURE_SWIZZLE_B, swizzle[2]);
+  glTexParameteri (target, GL_TEXTURE_SWIZZLE_A, swizzle[3]);
+}
+#endif
+
+/**
+ * @brief: 设置平面 @plane 纹理（当前绑定到 @target）的过滤、环绕方式和 swizzle，
+ *         texture[i] 和 EGLImage 纹理缓存中的纹理使用相同的参数
+*/
+void
+gst_egl_adaptation_init_plane_texture (GstEglAdaptationContext * ctx,
+    GstVideoFormat format, gint plane, GLenum target)
+{
+  /* Set 2D resizing params */
+  glTexParameteri (target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri (target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  /* If these are not set the texture image unit will return
+   * (R, G, B, A) = black on glTexImage2D for non-POT width/height
+   * frames. For a deeper explanation take a look at the OpenGL ES
+   * documentation for glTexParameter */
+  glTexParameteri (target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri (target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+#ifndef HAVE_IOS
+  if (ctx->texture_swizzle && target == GL_TEXTURE_2D)
+    gst_egl_adaptation_set_texture_swizzle (format, plane, target);
+#endif
+}
+
+/**
+ * @brief: 1. 创建 EGLSurface
+ *         2. 当前线程绑定 EGLContext 
+ *         3. 编译着色器程序并获取相关顶点属性和uniform标识ID
+ *         4. 生成纹理
+ * @param format: 视频帧的格式
+ * @param tex_external_oes: 如果使用的Jetson（GPU和CPU共享内存设备），这个就赋值TRUE（我认为CUDA也可以使用部分扩展，因为未读完整个代码，该部分未详细解释）
+*/
+gboolean
+gst_egl_adaptation_init_surface (GstEglAdaptationContext * ctx,
+    GstVideoFormat format, gboolean tex_external_oes)
+{
+  GLboolean ret;
+  const gchar *texnames[3] = { NULL, };
+  gchar *frag_prog;
+  gint i;
+  GLint target;
+
+  GST_DEBUG_OBJECT (ctx->element, "Enter EGL surface setup");
 
   /* 创建 EGLSurface */
   if (!gst_egl_adaptation_create_surface (ctx)) {
@@ -582,101 +1330,31 @@ gst_egl_adaptation_init_surface (GstEglAdaptationContext * ctx,
     goto HANDLE_ERROR;
   }
 
+  ctx->texture_swizzle = gst_egl_adaptation_query_texture_swizzle ();
+
   /* Build shader program for video texture rendering */
   g_print ("format = %d\n", format);
-  switch (format) {
-          
-    case GST_VIDEO_FORMAT_AYUV:
-      frag_prog = (gchar *) frag_AYUV_prog;
-      free_frag_prog = FALSE;  /* FALSE表面 frag_prog 是字符串常量，不需要内存释放，如果 g_strdup_printf，则需要释放*/
-      ctx->n_textures = 1;
-      texnames[0] = "tex";
-      break;
-    case GST_VIDEO_FORMAT_Y444:
-    case GST_VIDEO_FORMAT_I420:
-    case GST_VIDEO_FORMAT_YV12:
-    case GST_VIDEO_FORMAT_Y42B:
-    case GST_VIDEO_FORMAT_Y41B:
-      frag_prog = (gchar *) frag_PLANAR_YUV_prog;
-      free_frag_prog = FALSE;
-      ctx->n_textures = 3;
-      texnames[0] = "Ytex";
-      texnames[1] = "Utex";
-      texnames[2] = "Vtex";
-      break;
-    case GST_VIDEO_FORMAT_NV12:
-      frag_prog = g_strdup_printf (frag_NV12_NV21_prog, 'r', 'a'); /* free_frag_prog 赋值TRUE，需要 g_free (frag_prog) */
-      free_frag_prog = TRUE;
-      ctx->n_textures = 2;
-      texnames[0] = "Ytex";
-      texnames[1] = "UVtex";
-      break;
-    case GST_VIDEO_FORMAT_NV21:
-      frag_prog = g_strdup_printf (frag_NV12_NV21_prog, 'a', 'r');
-      free_frag_prog = TRUE;
-      ctx->n_textures = 2;
-      texnames[0] = "Ytex";
-      texnames[1] = "UVtex";
-      break;
-    case GST_VIDEO_FORMAT_BGR:
-    case GST_VIDEO_FORMAT_BGRx:
-    case GST_VIDEO_FORMAT_BGRA:
-      frag_prog = g_strdup_printf (frag_REORDER_prog, 'b', 'g', 'r');
-      free_frag_prog = TRUE;
-      ctx->n_textures = 1;
-      texnames[0] = "tex";
-      break;
-    case GST_VIDEO_FORMAT_xRGB:
-    case GST_VIDEO_FORMAT_ARGB:
-      frag_prog = g_strdup_printf (frag_REORDER_prog, 'g', 'b', 'a');
-      free_frag_prog = TRUE;
-      ctx->n_textures = 1;
-      texnames[0] = "tex";
-      break;
-    case GST_VIDEO_FORMAT_xBGR:
-    case GST_VIDEO_FORMAT_ABGR:
-      frag_prog = g_strdup_printf (frag_REORDER_prog, 'a', 'b', 'g');
-      free_frag_prog = TRUE;
-      ctx->n_textures = 1;
-      texnames[0] = "tex";
-      break;
-    case GST_VIDEO_FORMAT_RGB:
-    case GST_VIDEO_FORMAT_RGBx:
-    case GST_VIDEO_FORMAT_RGBA: /* 一般是RGBA，所以一般只创建一个纹理 */
-    case GST_VIDEO_FORMAT_RGB16:
-      frag_prog = (gchar *) frag_COPY_prog;
-      free_frag_prog = FALSE;
-      ctx->n_textures = 1;
-      g_print ("format = %d\n", format);
-      texnames[0] = "tex";
-      break;
-    default:
-      g_assert_not_reached ();
-      break;
-  }
+  frag_prog = gst_egl_adaptation_get_frag_prog (format, tex_external_oes,
+      ctx->texture_swizzle, &ctx->n_textures, texnames);
 
-  /* 如果使用扩展，就执行。（Jetson肯定执行） */
-  if (tex_external_oes) {
-    frag_prog = (gchar *) frag_COPY_externel_oes_prog;
-    free_frag_prog = FALSE;
-    ctx->n_textures = 1;
-    texnames[0] = "tex";
-  }
-  
   /* 编译着色器程序 */
-  if (!create_shader_program (ctx,
-          &ctx->glslprogram[0],
-          &ctx->vertshader[0],
-          &ctx->fragshader[0], vert_COPY_prog, frag_prog)) { /* 着色程序编译失败执行 */
-    if (free_frag_prog)
-      g_free (frag_prog);
-    frag_prog = NULL;
+  if (!create_shader_program (ctx, 0, vert_COPY_prog, frag_prog)) { /* 着色程序编译失败执行 */
+    g_free (frag_prog);
     goto HANDLE_ERROR;
   }
-
-  if (free_frag_prog)  /* 如果 frag_prog 是通过 g_strdup_printf, 需要释放 */
-    g_free (frag_prog);
-  frag_prog = NULL;
+  g_free (frag_prog);
+
+  /* 只是拷贝RGB的格式（分量顺序由纹理 swizzle 完成的也是），高质量缩放时不需要先转换格式 */
+  ctx->direct_rgb = !tex_external_oes && (format == GST_VIDEO_FORMAT_RGB
+      || format == GST_VIDEO_FORMAT_RGBx || format == GST_VIDEO_FORMAT_RGBA
+      || format == GST_VIDEO_FORMAT_RGB16);
+  if (!tex_external_oes && ctx->texture_swizzle) {
+    const GstEglShaderFormat *desc =
+        gst_egl_adaptation_find_shader_format (format);
+
+    ctx->direct_rgb = desc->matrix == GST_EGL_SHADER_MATRIX_RGB
+        && gst_egl_adaptation_swizzle_on_texture (desc, TRUE);
+  }
 
   /* 获取着色程序中相关变量的ID */
   ctx->position_loc[0] = glGetAttribLocation (ctx->glslprogram[0], "position");
@@ -687,19 +1365,25 @@ gst_egl_adaptation_init_surface (GstEglAdaptationContext * ctx,
       glGetUniformLocation (ctx->glslprogram[0], "tex_scale1");
   ctx->tex_scale_loc[0][2] =
       glGetUniformLocation (ctx->glslprogram[0], "tex_scale2");
+  ctx->transform_loc[0] =
+      glGetUniformLocation (ctx->glslprogram[0], "u_transformation");
 
+  /* 纹理单元固定，只需要设置一次；tex_scale 在绘制时发现改变才设置 */
+  glUseProgram (ctx->glslprogram[0]);
   for (i = 0; i < ctx->n_textures; i++) {
     ctx->tex_loc[0][i] =
         glGetUniformLocation (ctx->glslprogram[0], texnames[i]);
+    glUniform1i (ctx->tex_loc[0][i], i);
   }
+  for (i = 0; i < 3; i++)
+    ctx->tex_scale[i] = -1;
+  if (got_gl_error ("glUniform1i"))
+    goto HANDLE_ERROR;
 
   /* 交换Buffer前一帧buffer不能保留才会执行 */
   if (!ctx->buffer_preserved) {
     /* Build shader program for black borders */
-    if (!create_shader_program (ctx,
-            &ctx->glslprogram[1],
-            &ctx->vertshader[1],
-            &ctx->fragshader[1], vert_COPY_prog_no_tex, frag_BLACK_prog))
+    if (!create_shader_program (ctx, 1, vert_COPY_prog_no_tex, frag_BLACK_prog))
       goto HANDLE_ERROR;
 
     ctx->position_loc[1] =
@@ -717,8 +1401,34 @@ gst_egl_adaptation_init_surface (GstEglAdaptationContext * ctx,
       target = GL_TEXTURE_2D;
     }
     GstEglGlesSink *sink = (GstEglGlesSink *)ctx->element;
-    // glGenTextures (ctx->n_textures, ctx->texture);
-    ctx->texture[0] = sink->egl_share_texture;
+
+    /* 视频帧不能直接作为 egl-share-texture 的最终画面时（图集、需要格式转换、多个平面、
+     * OES 纹理、dmabuf、指定了输出尺寸、拼接、旋转或者关闭了 passthrough），上传到自己的纹理，
+     * 通过输出FBO绘制成RGBA，每一帧再复制到 egl-share-texture；否则直接上传到
+     * egl-share-texture，之后的帧需要去隔行、变换、叠加层或者ROI框时由
+     * gst_egl_adaptation_leave_direct_upload 切换到输出FBO */
+    ctx->output_texture = 0;
+    ctx->share_texture = 0;
+    ctx->atlas = FALSE;
+    ctx->direct_upload = FALSE;
+    if (sink->egl_share_texture) {
+      ctx->atlas = sink->atlas_x >= 0 && sink->atlas_y >= 0;
+      if (ctx->atlas || tex_external_oes || !ctx->direct_rgb
+          || ctx->n_textures > 1 || sink->using_dmabuf
+          || !sink->passthrough || sink->mosaic
+          || sink->output_width || sink->output_height
+          || sink->rotate_method != GST_VIDEO_ORIENTATION_IDENTITY) {
+        ctx->share_texture = sink->egl_share_texture;
+        glGenTextures (1, &ctx->output_texture);
+      } else {
+        ctx->direct_upload = TRUE;
+      }
+    }
+
+    if (ctx->direct_upload)
+      ctx->texture[0] = sink->egl_share_texture;
+    else
+      glGenTextures (ctx->n_textures, ctx->texture);
 
     g_print ("ctx->texture[0] = %d\n", ctx->texture[0]);
     if (got_gl_error ("glGenTextures"))
@@ -731,15 +1441,7 @@ gst_egl_adaptation_init_surface (GstEglAdaptationContext * ctx,
       if (got_gl_error ("glBindTexture"))
         goto HANDLE_ERROR;
 
-      /* Set 2D resizing params */
-      glTexParameteri (target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-      glTexParameteri (target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-      /* If these are not set the texture image unit will return
-       * (R, G, B, A) = black on glTexImage2D for non-POT width/height
-       * frames. For a deeper explanation take a look at the OpenGL ES
-       * documentation for glTexParameter */
-      glTexParameteri (target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-      glTexParameteri (target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      gst_egl_adaptation_init_plane_texture (ctx, format, i, target);
       if (got_gl_error ("glTexParameteri"))
         goto HANDLE_ERROR_LOCKED;
     }
@@ -802,6 +1504,9 @@ gst_egl_adaptation_context_new (GstElement * element)
   GstEglAdaptationContext *ctx = g_new0 (GstEglAdaptationContext, 1);
 
   ctx->element = gst_object_ref (element);
+  g_mutex_init (&ctx->precompile_lock);
+  ctx->precompiled = g_ptr_array_new_with_free_func (g_free);
+  ctx->garbage = gst_egl_garbage_new (element);
 
   gst_egl_adaptation_init (ctx);
   return ctx;
@@ -814,6 +1519,10 @@ void
 gst_egl_adaptation_context_free (GstEglAdaptationContext * ctx)
 {
   gst_egl_adaptation_deinit (ctx);
+  g_free (ctx->program_cache_dir);
+  g_ptr_array_unref (ctx->precompiled);
+  gst_egl_garbage_unref (ctx->garbage);
+  g_mutex_clear (&ctx->precompile_lock);
   if (GST_OBJECT_REFCOUNT(ctx->element))
     gst_object_unref (ctx->element);
   g_free (ctx);
@@ -842,3 +1551,633 @@ gst_egl_adaptation_reset_window (GstEglAdaptationContext * ctx,
 
   return TRUE;
 }
+
+/**
+ * @brief: 编译高质量缩放的着色程序 glslprogram[2]（需要当前线程已经绑定egl上下文）
+ * @param method: 缩放方式，BILINEAR不需要额外的着色程序
+*/
+gboolean
+gst_egl_adaptation_init_scaler (GstEglAdaptationContext * ctx,
+    GstEglScalingMethod method)
+{
+  gchar *frag_prog;
+  gboolean ret;
+
+  if (ctx->scaling_method == method)
+    return TRUE;
+
+  /* 删除之前缩放方式对应的着色程序 */
+  delete_shader_program (ctx, 2);
+  ctx->scaling_method = GST_EGL_SCALING_METHOD_BILINEAR;
+
+  if (method == GST_EGL_SCALING_METHOD_BILINEAR)
+    return TRUE;
+
+  frag_prog = g_strdup_printf (frag_SCALE_prog,
+      method == GST_EGL_SCALING_METHOD_LANCZOS ?
+      frag_SCALE_lanczos_weight : frag_SCALE_bicubic_weight);
+  ret = create_shader_program (ctx, 2, vert_COPY_prog, frag_prog);
+  g_free (frag_prog);
+
+  if (!ret) {
+    GST_ERROR_OBJECT (ctx->element, "Couldn't build scaling program");
+    return FALSE;
+  }
+
+  ctx->position_loc[2] = glGetAttribLocation (ctx->glslprogram[2], "position");
+  ctx->texpos_loc[2] = glGetAttribLocation (ctx->glslprogram[2], "texpos");
+  ctx->scale_tex_loc = glGetUniformLocation (ctx->glslprogram[2], "tex");
+  ctx->scale_tex_scale_loc =
+      glGetUniformLocation (ctx->glslprogram[2], "tex_scale0");
+  ctx->scale_texel_loc = glGetUniformLocation (ctx->glslprogram[2], "texel");
+  ctx->scale_dir_loc = glGetUniformLocation (ctx->glslprogram[2], "dir");
+  ctx->scale_factor_loc = glGetUniformLocation (ctx->glslprogram[2], "factor");
+  ctx->transform_loc[2] =
+      glGetUniformLocation (ctx->glslprogram[2], "u_transformation");
+
+  ctx->scaling_method = method;
+
+  return TRUE;
+}
+
+/**
+ * @brief: 编译去隔行的着色程序 glslprogram[3]（需要当前线程已经绑定egl上下文）
+ *         已经编译过时直接返回
+*/
+gboolean
+gst_egl_adaptation_init_deinterlace (GstEglAdaptationContext * ctx)
+{
+  if (ctx->glslprogram[3])
+    return TRUE;
+
+  if (!create_shader_program (ctx, 3, vert_COPY_prog, frag_DEINTERLACE_prog)) {
+    GST_ERROR_OBJECT (ctx->element, "Couldn't build deinterlace program");
+    return FALSE;
+  }
+
+  ctx->position_loc[3] = glGetAttribLocation (ctx->glslprogram[3], "position");
+  ctx->texpos_loc[3] = glGetAttribLocation (ctx->glslprogram[3], "texpos");
+  ctx->transform_loc[3] =
+      glGetUniformLocation (ctx->glslprogram[3], "u_transformation");
+  ctx->deint_tex_loc = glGetUniformLocation (ctx->glslprogram[3], "tex");
+  ctx->deint_line_coef_loc =
+      glGetUniformLocation (ctx->glslprogram[3], "line_coef");
+  ctx->deint_line_step_loc =
+      glGetUniformLocation (ctx->glslprogram[3], "line_step");
+  ctx->deint_lines_loc = glGetUniformLocation (ctx->glslprogram[3], "lines");
+  ctx->deint_line_offset_loc =
+      glGetUniformLocation (ctx->glslprogram[3], "line_offset");
+  ctx->deint_field_loc = glGetUniformLocation (ctx->glslprogram[3], "field");
+  ctx->deint_mode_loc = glGetUniformLocation (ctx->glslprogram[3], "mode");
+
+  return TRUE;
+}
+
+/**
+ * @brief: 编译叠加层（GstVideoOverlayComposition）着色程序 glslprogram[4]，
+ *         并创建叠加层四边形使用的顶点缓冲（只在第一次使用时创建）
+*/
+gboolean
+gst_egl_adaptation_init_overlay (GstEglAdaptationContext * ctx)
+{
+  if (ctx->glslprogram[4])
+    return TRUE;
+
+  if (!create_shader_program (ctx, 4, vert_COPY_prog, frag_OVERLAY_prog)) {
+    GST_ERROR_OBJECT (ctx->element, "Couldn't build overlay program");
+    return FALSE;
+  }
+
+  ctx->position_loc[4] = glGetAttribLocation (ctx->glslprogram[4], "position");
+  ctx->texpos_loc[4] = glGetAttribLocation (ctx->glslprogram[4], "texpos");
+  ctx->transform_loc[4] =
+      glGetUniformLocation (ctx->glslprogram[4], "u_transformation");
+  ctx->overlay_tex_loc = glGetUniformLocation (ctx->glslprogram[4], "tex");
+  ctx->overlay_alpha_loc =
+      glGetUniformLocation (ctx->glslprogram[4], "global_alpha");
+
+  if (!ctx->overlay_buffer) {
+    glGenBuffers (1, &ctx->overlay_buffer);
+    if (got_gl_error ("glGenBuffers"))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+#ifndef HAVE_IOS
+typedef struct
+{
+  gchar *key;
+  const gchar *vert_text;
+  gchar *frag_text;
+  GLuint prog, vert, frag;
+  gchar *cache_key;
+  gboolean published;
+} GstEglPrecompileJob;
+
+/**
+ * @brief: 在后台线程（当前线程绑定了和渲染上下文共享的上下文）中编译 shader_formats 中所有格式的着色程序
+ *         支持 GL_KHR_parallel_shader_compile 时先提交所有的编译和链接，由驱动并行完成，
+ *         再按完成的顺序发布到共享组，configure_caps 只需要取出已经链接好的程序
+ * @note: 共享组中已经有的程序（其他实例编译的）跳过
+*/
+void
+gst_egl_adaptation_precompile_programs (GstEglAdaptationContext * ctx)
+{
+  PFNGLMAXSHADERCOMPILERTHREADSKHRPROC max_shader_compiler_threads = NULL;
+  const gchar *glexts;
+  GstEglPrecompileJob *jobs;
+  gboolean parallel = FALSE, use_cache, texture_swizzle;
+  guint i, n_jobs, n_formats, remaining;
+  GBytes *binary = NULL;
+  GLint status;
+
+  glexts = (const gchar *) glGetString (GL_EXTENSIONS);
+  if (glexts && strstr (glexts, "GL_KHR_parallel_shader_compile")) {
+    max_shader_compiler_threads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)
+        eglGetProcAddress ("glMaxShaderCompilerThreadsKHR");
+    if (max_shader_compiler_threads) {
+      max_shader_compiler_threads (0xffffffff);
+      parallel = TRUE;
+    }
+  }
+  use_cache = ctx->program_cache_dir && gst_egl_program_cache_supported ();
+  texture_swizzle = gst_egl_adaptation_query_texture_swizzle ();
+
+  /* 所有格式 + OES + 黑边，相同的源代码（比如 RGBA 和 RGBx，支持纹理 swizzle 时所有单平面RGB格式）只编译一次 */
+  n_formats = G_N_ELEMENTS (shader_formats);
+  n_jobs = n_formats + 2;
+  jobs = g_new0 (GstEglPrecompileJob, n_jobs);
+  for (i = 0; i < n_formats; i++) {
+    jobs[i].vert_text = vert_COPY_prog;
+    jobs[i].frag_text =
+        gst_egl_adaptation_generate_frag_prog (&shader_formats[i],
+        texture_swizzle);
+  }
+  jobs[i].vert_text = vert_COPY_prog;
+  jobs[i].frag_text = g_strdup (frag_COPY_externel_oes_prog);
+  i++;
+  jobs[i].vert_text = vert_COPY_prog_no_tex;
+  jobs[i].frag_text = g_strdup (frag_BLACK_prog);
+
+  /* 先登记为正在编译，configure_caps 需要这些程序时会等待 */
+  for (i = 0; i < n_jobs; i++) {
+    jobs[i].key = shared_program_key (ctx, jobs[i].vert_text,
+        jobs[i].frag_text);
+    if (!jobs[i].key || !shared_program_reserve (jobs[i].key))
+      jobs[i].published = TRUE;
+  }
+
+  /* 提交编译和链接 */
+  for (i = 0; i < n_jobs; i++) {
+    GstEglPrecompileJob *job = &jobs[i];
+
+    if (job->published)
+      continue;
+
+    if (use_cache) {
+      job->cache_key = gst_egl_program_cache_key (job->vert_text,
+          job->frag_text);
+      job->prog = gst_egl_program_cache_load (ctx->element,
+          ctx->program_cache_dir, job->cache_key);
+      if (job->prog)
+        continue;
+    }
+
+    job->vert = glCreateShader (GL_VERTEX_SHADER);
+    glShaderSource (job->vert, 1, &job->vert_text, NULL);
+    glCompileShader (job->vert);
+    job->frag = glCreateShader (GL_FRAGMENT_SHADER);
+    glShaderSource (job->frag, 1, (const gchar **) &job->frag_text, NULL);
+    glCompileShader (job->frag);
+
+    job->prog = glCreateProgram ();
+    glAttachShader (job->prog, job->vert);
+    glAttachShader (job->prog, job->frag);
+    bind_attrib_locations (job->prog);
+    glProgramParameteri (job->prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+        GL_TRUE);
+    glLinkProgram (job->prog);
+  }
+  got_gl_error ("precompile");
+
+  /* 按完成的顺序发布 */
+  remaining = 0;
+  for (i = 0; i < n_jobs; i++)
+    remaining += !jobs[i].published;
+
+  while (remaining > 0) {
+    guint done = 0;
+
+    for (i = 0; i < n_jobs; i++) {
+      GstEglPrecompileJob *job = &jobs[i];
+
+      if (job->published)
+        continue;
+
+      if (parallel && job->vert) {
+        status = GL_FALSE;
+        glGetProgramiv (job->prog, GL_COMPLETION_STATUS_KHR, &status);
+        if (status == GL_FALSE)
+          continue;
+      }
+
+      if (job->vert) {
+        glGetProgramiv (job->prog, GL_LINK_STATUS, &status);
+        if (status == GL_FALSE) {
+          GST_ERROR_OBJECT (ctx->element, "Couldn't precompile program");
+          glDeleteProgram (job->prog);
+          job->prog = 0;
+        }
+        glDeleteShader (job->vert);
+        glDeleteShader (job->frag);
+      }
+
+      /* 只共享二进制，这个上下文中的程序对象不再需要 */
+      if (job->prog) {
+        binary = gst_egl_program_binary_get (job->prog);
+        if (binary && job->vert && job->cache_key)
+          gst_egl_program_cache_store_binary (ctx->element,
+              ctx->program_cache_dir, job->cache_key, binary);
+        glDeleteProgram (job->prog);
+        job->prog = 0;
+      }
+
+      /* 发布之后 ctx->precompiled 持有一个引用，直到 close 时 precompile_release */
+      shared_program_publish (job->key, binary);
+      if (binary) {
+        g_bytes_unref (binary);
+        binary = NULL;
+        g_mutex_lock (&ctx->precompile_lock);
+        g_ptr_array_add (ctx->precompiled, job->key);
+        g_mutex_unlock (&ctx->precompile_lock);
+        job->key = NULL;
+      }
+
+      job->published = TRUE;
+      done++;
+      remaining--;
+    }
+
+    if (done == 0)
+      g_usleep (1000);
+  }
+
+  GST_DEBUG_OBJECT (ctx->element, "Precompiled %u programs%s",
+      ctx->precompiled->len, parallel ? " (parallel)" : "");
+
+  for (i = 0; i < n_jobs; i++) {
+    g_free (jobs[i].key);
+    g_free (jobs[i].frag_text);
+    g_free (jobs[i].cache_key);
+  }
+  g_free (jobs);
+}
+
+/**
+ * @brief: 释放预编译发布的共享程序引用（close 时预编译线程退出之后调用），
+ *         没有被任何实例使用的二进制在这里释放，不需要 GL 上下文
+*/
+void
+gst_egl_adaptation_precompile_release (GstEglAdaptationContext * ctx)
+{
+  guint i;
+
+  g_mutex_lock (&ctx->precompile_lock);
+  for (i = 0; i < ctx->precompiled->len; i++)
+    shared_program_release (g_ptr_array_index (ctx->precompiled, i));
+  g_ptr_array_set_size (ctx->precompiled, 0);
+  g_mutex_unlock (&ctx->precompile_lock);
+}
+
+/**
+ * @brief: 编译 ROI 框着色程序 glslprogram[5]，创建框的顶点缓冲（一个闭合的环形三角形带）
+ *         和每帧重新填充的实例缓冲
+*/
+gboolean
+gst_egl_adaptation_init_roi (GstEglAdaptationContext * ctx)
+{
+  /* 左下，右下，右上，左上，回到左下；每个角点先外后内 */
+  static const GLfloat corners[] = {
+    0, 0, 1, 0, 0, 0,
+    1, 0, 1, 1, 0, 0,
+    1, 1, 1, 1, 1, 0,
+    0, 1, 1, 0, 1, 0,
+    0, 0, 1, 0, 0, 0
+  };
+
+  if (ctx->glslprogram[5])
+    return TRUE;
+
+  if (!create_shader_program (ctx, 5, vert_ROI_prog, frag_ROI_prog)) {
+    GST_ERROR_OBJECT (ctx->element, "Couldn't build ROI program");
+    return FALSE;
+  }
+
+  ctx->position_loc[5] = glGetAttribLocation (ctx->glslprogram[5], "corner");
+  ctx->roi_box_loc = glGetAttribLocation (ctx->glslprogram[5], "box");
+  ctx->roi_color_loc = glGetAttribLocation (ctx->glslprogram[5], "color");
+  ctx->roi_line_width_loc =
+      glGetUniformLocation (ctx->glslprogram[5], "line_width");
+
+  glGenBuffers (1, &ctx->roi_corner_buffer);
+  glGenBuffers (1, &ctx->roi_instance_buffer);
+  glBindBuffer (GL_ARRAY_BUFFER, ctx->roi_corner_buffer);
+  glBufferData (GL_ARRAY_BUFFER, sizeof (corners), corners, GL_STATIC_DRAW);
+  glBindBuffer (GL_ARRAY_BUFFER, ctx->position_buffer);
+  if (got_gl_error ("glBufferData"))
+    return FALSE;
+
+  return TRUE;
+}
+
+/**
+ * @brief: 编译拼接着色程序 glslprogram[6]，创建格子的顶点缓冲（单位正方形）
+ *         和布局改变时重新填充的实例缓冲
+*/
+gboolean
+gst_egl_adaptation_init_mosaic (GstEglAdaptationContext * ctx)
+{
+  static const GLfloat corners[] = {
+    0, 0,
+    1, 0,
+    0, 1,
+    1, 1
+  };
+
+  if (ctx->glslprogram[6])
+    return TRUE;
+
+  if (!create_shader_program (ctx, 6, vert_MOSAIC_prog, frag_MOSAIC_prog)) {
+    GST_ERROR_OBJECT (ctx->element, "Couldn't build mosaic program");
+    return FALSE;
+  }
+
+  ctx->position_loc[6] = glGetAttribLocation (ctx->glslprogram[6], "corner");
+  ctx->mosaic_rect_loc = glGetAttribLocation (ctx->glslprogram[6], "rect");
+  ctx->mosaic_crop_loc = glGetAttribLocation (ctx->glslprogram[6], "crop");
+  ctx->mosaic_layer_loc = glGetAttribLocation (ctx->glslprogram[6], "layer");
+  ctx->mosaic_tex_loc = glGetUniformLocation (ctx->glslprogram[6], "tex");
+
+  glGenBuffers (1, &ctx->mosaic_corner_buffer);
+  glGenBuffers (1, &ctx->mosaic_instance_buffer);
+  glBindBuffer (GL_ARRAY_BUFFER, ctx->mosaic_corner_buffer);
+  glBufferData (GL_ARRAY_BUFFER, sizeof (corners), corners, GL_STATIC_DRAW);
+  glBindBuffer (GL_ARRAY_BUFFER, ctx->position_buffer);
+  if (got_gl_error ("glBufferData"))
+    return FALSE;
+
+  return TRUE;
+}
+
+/**
+ * @brief: 拼接布局改变时调用：纹理数组的层数或者尺寸不够时重新分配（只增大），
+ *         然后把所有层清成黑色
+ * @note: 返回时绑定的是 target_fbo
+*/
+gboolean
+gst_egl_adaptation_setup_mosaic (GstEglAdaptationContext * ctx, gint layers,
+    gint width, gint height)
+{
+  gint i;
+
+  if (!ctx->mosaic_texture) {
+    glGenTextures (1, &ctx->mosaic_texture);
+    glGenFramebuffers (1, &ctx->mosaic_fbo);
+    if (got_gl_error ("glGenFramebuffers"))
+      return FALSE;
+  }
+
+  if (layers > ctx->mosaic_layers || width > ctx->mosaic_width
+      || height > ctx->mosaic_height) {
+    layers = MAX (layers, ctx->mosaic_layers);
+    width = MAX (width, ctx->mosaic_width);
+    height = MAX (height, ctx->mosaic_height);
+
+    GST_DEBUG_OBJECT (ctx->element, "Resizing mosaic texture to %dx%d, "
+        "%d layers", width, height, layers);
+
+    glBindTexture (GL_TEXTURE_2D_ARRAY, ctx->mosaic_texture);
+    glTexImage3D (GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, layers, 0,
+        GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri (GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri (GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri (GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri (GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    if (got_gl_error ("glTexImage3D"))
+      return FALSE;
+
+    ctx->mosaic_layers = layers;
+    ctx->mosaic_width = width;
+    ctx->mosaic_height = height;
+  }
+
+  glBindFramebuffer (GL_FRAMEBUFFER, ctx->mosaic_fbo);
+  glClearColor (0.0, 0.0, 0.0, 1.0);
+  for (i = 0; i < ctx->mosaic_layers; i++) {
+    glFramebufferTextureLayer (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        ctx->mosaic_texture, 0, i);
+    glClear (GL_COLOR_BUFFER_BIT);
+  }
+  glBindFramebuffer (GL_FRAMEBUFFER, ctx->target_fbo);
+
+  return !got_gl_error ("glClear");
+}
+#endif
+
+/**
+ * @brief: 创建（或者调整大小）离屏渲染使用的 fbo[index] 和对应的RGBA纹理
+ *         尺寸没有变化时直接返回
+ * @param filter: 纹理的采样方式，滤波时总是在像素中心采样，使用 GL_NEAREST 就可以；
+ *                需要直接缩放绘制到surface的纹理使用 GL_LINEAR
+*/
+gboolean
+gst_egl_adaptation_setup_fbo (GstEglAdaptationContext * ctx, gint index,
+    gint width, gint height, GLint filter)
+{
+  GLenum status;
+
+  if (ctx->fbo[index] && ctx->fbo_width[index] == width
+      && ctx->fbo_height[index] == height)
+    return TRUE;
+
+  if (!ctx->fbo[index]) {
+    glGenFramebuffers (1, &ctx->fbo[index]);
+    glGenTextures (1, &ctx->fbo_texture[index]);
+    if (got_gl_error ("glGenFramebuffers"))
+      return FALSE;
+  }
+
+  GST_DEBUG_OBJECT (ctx->element, "Resizing fbo %d to %dx%d", index, width,
+      height);
+
+  glBindTexture (GL_TEXTURE_2D, ctx->fbo_texture[index]);
+  glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
+      GL_UNSIGNED_BYTE, NULL);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  if (got_gl_error ("glTexImage2D"))
+    return FALSE;
+
+  glBindFramebuffer (GL_FRAMEBUFFER, ctx->fbo[index]);
+  glFramebufferTexture2D (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+      ctx->fbo_texture[index], 0);
+  status = glCheckFramebufferStatus (GL_FRAMEBUFFER);
+  glBindFramebuffer (GL_FRAMEBUFFER, ctx->target_fbo);
+
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    GST_ERROR_OBJECT (ctx->element, "fbo %d is incomplete: 0x%04x", index,
+        status);
+    return FALSE;
+  }
+
+  ctx->fbo_width[index] = width;
+  ctx->fbo_height[index] = height;
+
+  return TRUE;
+}
+
+/**
+ * @brief: 没有使用输出FBO时只记录输出尺寸（surfaceless 时作为 surface 的尺寸）；
+ *         否则创建 output_fbo，尺寸变化时重新分配 output_texture（RGBA8），并绑定 output_fbo
+ * @note: 不是图集时 egl-share-texture 的存储也在这里按输出尺寸分配
+*/
+gboolean
+gst_egl_adaptation_setup_output (GstEglAdaptationContext * ctx, gint width,
+    gint height)
+{
+  GLenum status;
+
+  ctx->target_fbo = ctx->output_fbo;
+
+  if (!ctx->output_texture) {
+    ctx->output_width = width;
+    ctx->output_height = height;
+    return TRUE;
+  }
+
+  if (!ctx->output_fbo) {
+    glGenFramebuffers (1, &ctx->output_fbo);
+    if (got_gl_error ("glGenFramebuffers"))
+      return FALSE;
+    ctx->target_fbo = ctx->output_fbo;
+  } else if (ctx->output_width == width && ctx->output_height == height) {
+    glBindFramebuffer (GL_FRAMEBUFFER, ctx->output_fbo);
+    return TRUE;
+  }
+
+  GST_DEBUG_OBJECT (ctx->element, "Resizing output texture %u to %dx%d",
+      ctx->output_texture, width, height);
+
+  glBindTexture (GL_TEXTURE_2D, ctx->output_texture);
+  glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
+      GL_UNSIGNED_BYTE, NULL);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  if (got_gl_error ("glTexImage2D"))
+    return FALSE;
+
+  if (ctx->share_texture && !ctx->atlas) {
+    glBindTexture (GL_TEXTURE_2D, ctx->share_texture);
+    glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
+        GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    if (got_gl_error ("glTexImage2D"))
+      return FALSE;
+  }
+
+  glBindFramebuffer (GL_FRAMEBUFFER, ctx->output_fbo);
+  glFramebufferTexture2D (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+      ctx->output_texture, 0);
+  status = glCheckFramebufferStatus (GL_FRAMEBUFFER);
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    GST_ERROR_OBJECT (ctx->element, "Output fbo is incomplete: 0x%04x",
+        status);
+    glBindFramebuffer (GL_FRAMEBUFFER, 0);
+    return FALSE;
+  }
+
+  ctx->output_width = width;
+  ctx->output_height = height;
+
+  return TRUE;
+}
+
+/**
+ * @brief: 把输出纹理（output_width x output_height）上下翻转之后复制到 share_texture 的 (@x, @y)，
+ *         翻转之后第一行在 t=0，和直接上传到 egl-share-texture 时相同；
+ *         图集时只写图集中的这个区域，其他sink的区域不受影响
+ * @note: 返回时绑定的是 target_fbo
+*/
+gboolean
+gst_egl_adaptation_blit_output (GstEglAdaptationContext * ctx, gint x, gint y)
+{
+  GLenum status;
+
+  if (!ctx->share_fbo) {
+    glGenFramebuffers (1, &ctx->share_fbo);
+    if (got_gl_error ("glGenFramebuffers"))
+      return FALSE;
+
+    glBindFramebuffer (GL_DRAW_FRAMEBUFFER, ctx->share_fbo);
+    glFramebufferTexture2D (GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_TEXTURE_2D, ctx->share_texture, 0);
+    status = glCheckFramebufferStatus (GL_DRAW_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+      GST_ERROR_OBJECT (ctx->element, "Share fbo is incomplete: 0x%04x%s",
+          status, ctx->atlas ? " (the atlas texture needs storage)" : "");
+      glBindFramebuffer (GL_FRAMEBUFFER, ctx->target_fbo);
+      glDeleteFramebuffers (1, &ctx->share_fbo);
+      ctx->share_fbo = 0;
+      return FALSE;
+    }
+  } else {
+    glBindFramebuffer (GL_DRAW_FRAMEBUFFER, ctx->share_fbo);
+  }
+
+  glBindFramebuffer (GL_READ_FRAMEBUFFER, ctx->output_fbo);
+  glBlitFramebuffer (0, 0, ctx->output_width, ctx->output_height, x,
+      y + ctx->output_height, x + ctx->output_width, y, GL_COLOR_BUFFER_BIT,
+      GL_NEAREST);
+  glBindFramebuffer (GL_FRAMEBUFFER, ctx->target_fbo);
+
+  return !got_gl_error ("glBlitFramebuffer");
+}
+
+/**
+ * @brief: 直接上传到 egl-share-texture 时改为使用输出FBO：之后的帧上传到自己的 texture[0]，
+ *         绘制到 output_texture 再复制到 egl-share-texture，去隔行、变换、叠加层和ROI框才能生效
+ * @note: 只在上传新的一帧之前调用（这一帧会重新填充 texture[0]）；
+ *        重新配置caps（重新创建纹理）之前不会切换回直接上传，效果时有时无时不会反复分配纹理
+*/
+gboolean
+gst_egl_adaptation_leave_direct_upload (GstEglAdaptationContext * ctx,
+    GstVideoFormat format)
+{
+  if (!ctx->direct_upload)
+    return TRUE;
+
+  GST_DEBUG_OBJECT (ctx->element, "Switching from direct upload to the "
+      "output fbo");
+
+  ctx->share_texture = ctx->texture[0];
+  ctx->direct_upload = FALSE;
+  glGenTextures (1, &ctx->texture[0]);
+  glGenTextures (1, &ctx->output_texture);
+  if (got_gl_error ("glGenTextures"))
+    return FALSE;
+
+  glActiveTexture (GL_TEXTURE0);
+  glBindTexture (GL_TEXTURE_2D, ctx->texture[0]);
+  gst_egl_adaptation_init_plane_texture (ctx, format, 0, GL_TEXTURE_2D);
+
+  return !got_gl_error ("glTexParameteri");
+}
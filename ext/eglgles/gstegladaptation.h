@@ -59,6 +59,8 @@
 
 #include <gst/egl/egl.h>
 
+#include "gsteglgarbage.h"
+
 #if defined (USE_EGL_RPI) && defined(__GNUC__)
 #pragma GCC reset_options
 #pragma GCC diagnostic pop
@@ -66,6 +68,11 @@
 
 G_BEGIN_DECLS
 
+/* 所有着色程序的 position/texpos 属性在链接前绑定到固定位置，
+ * 这样 position_array 的四边形可以预先建立VAO，和使用的着色程序无关 */
+#define GST_EGL_POSITION_ATTRIB 0
+#define GST_EGL_TEXPOS_ATTRIB 1
+
 typedef struct _GstEglAdaptationContext GstEglAdaptationContext;
 typedef struct _GstEglGlesImageFmt GstEglGlesImageFmt; /* 没有使用 */
 
@@ -75,6 +82,39 @@ typedef struct _GstEaglContext GstEaglContext;
 typedef struct _GstEglGlesRenderContext GstEglGlesRenderContext;  /* EGLConfig、EGLContext、EGLSurface（egl配置、上下文、表面） */
 #endif
 
+/**
+ * GstEglScalingMethod:
+ * 视频纹理缩放到 display_region 时使用的滤波方式
+ * @GST_EGL_SCALING_METHOD_BILINEAR: 一遍绘制，直接使用 GL_LINEAR 采样（缩小倍数大时会有锯齿）
+ * @GST_EGL_SCALING_METHOD_BICUBIC: 两遍可分离 bicubic (Catmull-Rom) 滤波
+ * @GST_EGL_SCALING_METHOD_LANCZOS: 两遍可分离 Lanczos-3 滤波
+ */
+typedef enum
+{
+  GST_EGL_SCALING_METHOD_BILINEAR,
+  GST_EGL_SCALING_METHOD_BICUBIC,
+  GST_EGL_SCALING_METHOD_LANCZOS
+} GstEglScalingMethod;
+
+/* 缩小倍数的上限，超过该倍数滤波核不再继续变宽（着色器中循环次数有上限） */
+#define GST_EGL_SCALE_MAX_FACTOR 8.0
+
+/**
+ * GstEglDeinterlaceMethod:
+ * 隔行视频的去隔行方式（只对 interlaced 的 caps/buffer 生效）
+ * @GST_EGL_DEINTERLACE_METHOD_NONE: 不处理（weave，直接显示两场交织的帧）
+ * @GST_EGL_DEINTERLACE_METHOD_BOB: 只保留一场，缺失的行复制上一行
+ * @GST_EGL_DEINTERLACE_METHOD_LINEAR: 只保留一场，缺失的行由上下两行插值
+ * @GST_EGL_DEINTERLACE_METHOD_BLEND: 两场混合（垂直方向 [1 2 1] 滤波）
+ */
+typedef enum
+{
+  GST_EGL_DEINTERLACE_METHOD_NONE,
+  GST_EGL_DEINTERLACE_METHOD_BOB,
+  GST_EGL_DEINTERLACE_METHOD_LINEAR,
+  GST_EGL_DEINTERLACE_METHOD_BLEND
+} GstEglDeinterlaceMethod;
+
 typedef struct _coord5
 {
   float x;
@@ -89,12 +129,13 @@ typedef struct _coord5
  * @GstEGLGLESImageData:
  * 只有有在创建空GstBuffer的时候才会调用
  * 而且创建的这个空GstBuffer只是为了回复别人查询，并不是真正的GstBuffer
+ * 内存释放时纹理加入 @garbage，由渲染线程删除
 */
 typedef struct
 {
   GLuint texture;
-  EGLDisplay display;
-  EGLContext eglcontext;
+  GstEglGarbage *garbage;
+  guint epoch; /* 创建纹理时的上下文代数 */
 } GstEGLGLESImageData;
 
 /*
@@ -123,15 +164,17 @@ struct _GstEglAdaptationContext
   EGLNativeWindowType window, used_window; /* 如果使用Xlib库，其实 typedef Window   EGLNativeWindowType;（这两个变量是相等的） */
 #endif
   
-  GLuint fragshader[2]; /* fragshader[0]表示正常片段着色程序ID， fragshader[1]表示不能保留前一帧buffer相关的片段着色程序ID（一般不会被复制） */
-  GLuint vertshader[2]; /* vertshader[0]表示正常顶点着色程序ID， vertshader[1]表示不能保留前一帧buffer相关的顶点着色程序ID（一般不会被复制） */
-  GLuint glslprogram[2]; /* glslprogram[0]表示正常整个着色程序的ID， glslprogram[1]表示不能保留前一帧buffer相关的整个着色程序ID（一般不会被复制） */
+  GLuint fragshader[7]; /* fragshader[0]表示正常片段着色程序ID， fragshader[1]表示不能保留前一帧buffer相关的片段着色程序ID（一般不会被复制），fragshader[2]表示高质量缩放，fragshader[3]表示去隔行，fragshader[4]表示叠加层，fragshader[5]表示ROI框，fragshader[6]表示拼接（mosaic） */
+  GLuint vertshader[7]; /* vertshader[0]表示正常顶点着色程序ID， vertshader[1]表示不能保留前一帧buffer相关的顶点着色程序ID（一般不会被复制），vertshader[2]表示高质量缩放，vertshader[3]表示去隔行，vertshader[4]表示叠加层，vertshader[5]表示ROI框，vertshader[6]表示拼接（mosaic） */
+  GLuint glslprogram[7]; /* glslprogram[0]表示正常整个着色程序的ID， glslprogram[1]表示不能保留前一帧buffer相关的整个着色程序ID（一般不会被复制），glslprogram[2]表示高质量缩放（可分离滤波），glslprogram[3]表示去隔行，glslprogram[4]表示叠加层（字幕/OSD），glslprogram[5]表示ROI框（实例化绘制），glslprogram[6]表示拼接（一次实例化绘制所有格子） */
+  gchar *program_key[7]; /* 共享着色程序的键（同一共享组中相同源代码的程序只编译一次），NULL 表示私有程序 */
   GLuint texture[4]; /* RGBA只使用texture[0]，RGB/Y, U/UV, V */
+  GLuint image_texture[4]; /* EGLImage 输入时当前帧采样的纹理（EGLImage 纹理缓存中的），为 0 时采样 texture[i] */
 
 
   /* shader vars */
-  GLuint position_loc[2]; /* position_loc[0]表示顶点位置属性ID */
-  GLuint texpos_loc[1]; /* texpos_loc[0]表示顶点纹理位置属性ID */
+  GLuint position_loc[7]; /* position_loc[0]表示顶点位置属性ID（position_loc[5]为ROI框的角点，position_loc[6]为拼接格子的角点） */
+  GLuint texpos_loc[7]; /* texpos_loc[0]表示顶点纹理位置属性ID（texpos_loc[1]不使用） */
   /* tex_scale_loc[0][0]表示uniform vec2 tex_scale0  
    * tex_scale_loc[0][1]表示uniform vec2 tex_scale1
    * tex_scale_loc[0][2]表示uniform vec2 tex_scale2
@@ -139,9 +182,60 @@ struct _GstEglAdaptationContext
   GLuint tex_scale_loc[1][3]; /* [frame] RGB/Y, U/UV, V */
   /* tex_loc[0][0]表示纹理的ID（以前还没用过该变量） */
   GLuint tex_loc[1][3]; /* [frame] RGB/Y, U/UV, V */
-  coord5 position_array[16];    /* 4 x Frame x-normal,y-normal, 4x Frame x-normal,y-flip, 4 x Border1, 4 x Border2 */
+  GLuint transform_loc[7]; /* uniform mat4 u_transformation（transform_loc[1]不使用） */
+  /* 高质量缩放着色程序（glslprogram[2]）中的 uniform */
+  GLuint scale_tex_loc; /* uniform sampler2D tex */
+  GLuint scale_tex_scale_loc; /* uniform vec2 tex_scale0 */
+  GLuint scale_texel_loc; /* uniform vec2 texel，源纹理一个像素对应的纹理坐标大小 */
+  GLuint scale_dir_loc; /* uniform vec2 dir，(1,0)水平滤波，(0,1)垂直滤波 */
+  GLuint scale_factor_loc; /* uniform float factor，缩小倍数（放大时为1） */
+  GstEglScalingMethod scaling_method; /* glslprogram[2]对应的缩放方式，BILINEAR表示没有编译 */
+  /* 去隔行着色程序（glslprogram[3]）中的 uniform */
+  GLuint deint_tex_loc; /* uniform sampler2D tex */
+  GLuint deint_line_coef_loc; /* uniform vec3 line_coef，纹理坐标 -> 源视频中的归一化行位置 */
+  GLuint deint_line_step_loc; /* uniform vec2 line_step，源视频中下一行对应的纹理坐标偏移 */
+  GLuint deint_lines_loc; /* uniform float lines，源视频（裁剪后）的行数 */
+  GLuint deint_line_offset_loc; /* uniform float line_offset，裁剪区域的起始行 */
+  GLuint deint_field_loc; /* uniform float field，保留的场（0: 顶场，1: 底场） */
+  GLuint deint_mode_loc; /* uniform float mode，GstEglDeinterlaceMethod，NONE 表示直接拷贝 */
+  /* 叠加层着色程序（glslprogram[4]）中的 uniform */
+  GLuint overlay_tex_loc; /* uniform sampler2D tex */
+  GLuint overlay_alpha_loc; /* uniform float global_alpha */
+  unsigned int overlay_buffer; /* 叠加层四边形的顶点缓冲（每个矩形4个coord5，每帧重新填充） */
+  /* ROI框着色程序（glslprogram[5]）中的 attribute/uniform */
+  GLuint roi_box_loc; /* attribute vec4 box（每个实例） */
+  GLuint roi_color_loc; /* attribute vec4 color（每个实例） */
+  GLuint roi_line_width_loc; /* uniform vec2 line_width */
+  unsigned int roi_corner_buffer; /* 框的10个角点（环形三角形带） */
+  unsigned int roi_instance_buffer; /* 每帧的实例数据：box + color */
+  /* 拼接着色程序（glslprogram[6]）中的 attribute/uniform */
+  GLuint mosaic_tex_loc; /* uniform sampler2DArray tex */
+  GLuint mosaic_rect_loc; /* attribute vec4 rect（每个实例，格子在输出中的位置） */
+  GLuint mosaic_crop_loc; /* attribute vec4 crop（每个实例，格子在纹理层中的区域） */
+  GLuint mosaic_layer_loc; /* attribute float layer（每个实例，纹理数组的层） */
+  unsigned int mosaic_corner_buffer; /* 格子的4个角点（三角形带） */
+  unsigned int mosaic_instance_buffer; /* 布局改变时重新填充：rect + crop + layer */
+  GLuint mosaic_texture; /* GL_TEXTURE_2D_ARRAY，每个格子一层 */
+  GLuint mosaic_fbo; /* 颜色附件是 mosaic_texture 的某一层 */
+  gint mosaic_layers;
+  gint mosaic_width;
+  gint mosaic_height;
+
+  /* fbo[0]: 非RGB格式先转换成RGBA（裁剪后的原始尺寸）
+   * fbo[1]: 水平滤波后的中间结果（display_region.w x 裁剪高度）
+   * fbo[2]: 去隔行之后的结果（裁剪后的原始尺寸） */
+  GLuint fbo[3];
+  GLuint fbo_texture[3];
+  gint fbo_width[3];
+  gint fbo_height[3];
+
+  coord5 position_array[32];    /* 4 x Frame x-normal,y-normal, 4x Frame x-normal,y-flip, 4 x Border1, 4 x Border2,
+                                 * 4 x Fullscreen x-normal,y-normal, 4 x Fullscreen x-normal,y-flip,
+                                 * 4 x Fullscreen identity, 4 x Frame identity */
   unsigned short index_array[4];
   unsigned int position_buffer, index_buffer;
+  GLuint quad_vao[8]; /* position_array 中每个四边形一个VAO（属性在固定位置，绑定之后直接绘制） */
+  gfloat tex_scale[3]; /* glslprogram[0] 当前的 tex_scale，负数表示需要重新设置 */
   gint n_textures; /* 一共有多少个纹理，一般视频格式都是RGBA，所以只创建一个纹理texture[0] */
 
 
@@ -154,8 +248,40 @@ struct _GstEglAdaptationContext
   gboolean have_texture; /* 是否成功创建纹理 glGenTextures */
   gboolean have_surface; /* 是否成功创建并赋值了surface */
   gboolean buffer_preserved; /* 根据系统特性，是否能保存交换buffer前的一帧buffer */
+  gboolean texture_swizzle; /* GLES3：单/双通道平面使用 GL_R8/GL_RG8，单平面格式的分量顺序由 GL_TEXTURE_SWIZZLE_* 完成 */
+  gboolean direct_rgb; /* glslprogram[0]只是拷贝RGB（不需要格式转换），缩放时可以直接对 texture[0] 滤波 */
+  gboolean surfaceless; /* EGL_KHR_surfaceless_context：没有创建 EGLSurface（EGL_NO_SURFACE） */
+
+  /* 输出FBO：视频帧不能直接作为最终画面时，绘制到 output_fbo（颜色附件是自己的 output_texture），
+   * 这时 surface_width/surface_height 就是输出纹理的尺寸；output_fbo 为0时绘制到 EGLSurface */
+  GLuint output_texture; /* 0 表示不使用输出FBO */
+  GLuint output_fbo;
+  GLuint target_fbo; /* 当前视频帧绘制的目标（output_fbo，拼接时是 mosaic_fbo），离屏渲染之后恢复 */
+  gint output_width;
+  gint output_height;
+  /* 每一帧把 output_texture 上下翻转之后复制到 share_texture（egl-share-texture），
+   * 第一行在 t=0，和直接上传时相同。图集时 egl-share-texture 由多个sink共用，只写自己的子区域，
+   * 存储由UI线程分配；否则存储由 sink 按输出尺寸分配 */
+  GLuint share_texture; /* 0 表示不复制 */
+  GLuint share_fbo; /* 颜色附件是 share_texture */
+  gboolean atlas;
+  gboolean direct_upload; /* texture[0] 就是 egl-share-texture，上传的帧就是最终画面 */
+
+  /* 这一帧改变的区域（x, y, w, h，surface坐标，原点在左下），w 为0表示没有改变；
+   * 交换时传给 eglSwapBuffersWithDamage，交换之后清空 */
+  EGLint damage[4];
+  PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC swap_buffers_with_damage; /* EGL_KHR/EXT_swap_buffers_with_damage，NULL 表示不支持 */
 
   EGLContext egl_context;
+
+  GstEglGarbage *garbage; /* 其他线程释放的 GL 对象，渲染线程每帧删除 */
+
+  gchar *program_cache_dir; /* 着色程序二进制缓存目录，NULL 表示不使用缓存 */
+
+  /* 后台预编译（gst_egl_adaptation_precompile_start） */
+  GThread *precompile_thread; /* 编译完成后就退出，close 时 join */
+  GMutex precompile_lock;
+  GPtrArray *precompiled; /* 预编译发布的共享着色程序的键，持有引用直到 close */
 };
 
 GST_DEBUG_CATEGORY_EXTERN (egladaption_debug);
@@ -169,6 +295,9 @@ void gst_egl_adaptation_deinit (GstEglAdaptationContext * ctx);
 
 gboolean gst_egl_adaptation_create_surface (GstEglAdaptationContext * ctx);
 void gst_egl_adaptation_query_buffer_preserved (GstEglAdaptationContext * ctx);
+void gst_egl_adaptation_add_damage (GstEglAdaptationContext * ctx, gint x, gint y, gint width, gint height);
+gboolean gst_egl_adaptation_blit_output (GstEglAdaptationContext * ctx, gint x, gint y);
+gboolean gst_egl_adaptation_leave_direct_upload (GstEglAdaptationContext * ctx, GstVideoFormat format);
 void gst_egl_adaptation_query_par (GstEglAdaptationContext * ctx);
 void gst_egl_adaptation_destroy_surface (GstEglAdaptationContext * ctx);
 void gst_egl_adaptation_destroy_context (GstEglAdaptationContext * ctx);
@@ -208,6 +337,25 @@ gboolean gst_egl_adaptation_context_swap_buffers (GstEglAdaptationContext * ctx,
 
 gboolean gst_egl_adaptation_reset_window (GstEglAdaptationContext * ctx, GstVideoFormat format, gboolean tex_external_oes);
 
+gboolean gst_egl_adaptation_init_scaler (GstEglAdaptationContext * ctx, GstEglScalingMethod method);
+gboolean gst_egl_adaptation_init_deinterlace (GstEglAdaptationContext * ctx);
+gboolean gst_egl_adaptation_init_overlay (GstEglAdaptationContext * ctx);
+#ifndef HAVE_IOS
+gboolean gst_egl_adaptation_init_roi (GstEglAdaptationContext * ctx);
+gboolean gst_egl_adaptation_init_mosaic (GstEglAdaptationContext * ctx);
+gboolean gst_egl_adaptation_setup_mosaic (GstEglAdaptationContext * ctx, gint layers, gint width, gint height);
+gboolean gst_egl_adaptation_precompile_start (GstEglAdaptationContext * ctx);
+void gst_egl_adaptation_precompile_stop (GstEglAdaptationContext * ctx);
+void gst_egl_adaptation_precompile_programs (GstEglAdaptationContext * ctx);
+void gst_egl_adaptation_precompile_release (GstEglAdaptationContext * ctx);
+#endif
+gboolean gst_egl_adaptation_setup_fbo (GstEglAdaptationContext * ctx, gint index, gint width, gint height, GLint filter);
+gboolean gst_egl_adaptation_setup_output (GstEglAdaptationContext * ctx, gint width, gint height);
+gboolean gst_egl_adaptation_query_texture_swizzle (void);
+void gst_egl_adaptation_plane_format (gboolean texture_swizzle, gint n_components, GLint * internal_format, GLenum * format);
+void gst_egl_adaptation_init_plane_texture (GstEglAdaptationContext * ctx, GstVideoFormat format, gint plane, GLenum target);
+GLuint gst_egl_adaptation_build_format_program (GstElement * element, const gchar * cache_dir, GstVideoFormat format, gint * n_textures, const gchar ** texnames);
+
 #ifndef HAVE_IOS
 /* TODO: The goal is to move this function to gstegl lib (or
  * splitted between gstegl lib and gstgl lib) in order to be used in
@@ -215,8 +363,14 @@ gboolean gst_egl_adaptation_reset_window (GstEglAdaptationContext * ctx, GstVide
  * So it has to be independent of GstEglAdaptationContext */
 GstBuffer *
 gst_egl_image_allocator_alloc_eglimage (GstAllocator * allocator,
-    GstEGLDisplay * display, EGLContext eglcontext, GstVideoFormat format,
-    gint width, gint height);
+    GstEGLDisplay * display, EGLContext eglcontext, GstEglGarbage * garbage,
+    GstVideoFormat format, gint width, gint height);
+void gst_egl_image_allocator_enable_recycling (GstEGLDisplay * display);
+void gst_egl_image_allocator_release_recycled (GstEGLDisplay * display);
+gboolean gst_egl_image_allocator_recycle_buffer (GstBuffer * buffer);
+GstBuffer *gst_egl_image_allocator_take_recycled (GstEGLDisplay * display,
+    GstEglGarbage * garbage, GstVideoFormat format, gint width, gint height);
+void gst_egl_image_allocator_drop_recycled (GstEglGarbage * garbage);
 #endif
 
 G_END_DECLS
@@ -85,11 +85,23 @@ got_egl_error (const char *wtf)
 void
 gst_egl_adaptation_init_exts (GstEglAdaptationContext * ctx)
 {
-#ifndef GST_DISABLE_GST_DEBUG
   const char *eglexts;
+#ifndef GST_DISABLE_GST_DEBUG
   unsigned const char *glexts;
+#endif
 
   eglexts = eglQueryString (gst_egl_display_get (ctx->display), EGL_EXTENSIONS);
+
+  /* 交换时只提交改变的区域 */
+  ctx->swap_buffers_with_damage = NULL;
+  if (eglexts && strstr (eglexts, "EGL_KHR_swap_buffers_with_damage"))
+    ctx->swap_buffers_with_damage = (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)
+        eglGetProcAddress ("eglSwapBuffersWithDamageKHR");
+  else if (eglexts && strstr (eglexts, "EGL_EXT_swap_buffers_with_damage"))
+    ctx->swap_buffers_with_damage = (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)
+        eglGetProcAddress ("eglSwapBuffersWithDamageEXT");
+
+#ifndef GST_DISABLE_GST_DEBUG
   glexts = glGetString (GL_EXTENSIONS);
 
   GST_DEBUG_OBJECT (ctx->element, "Available EGL extensions: %s\n",
@@ -208,7 +220,8 @@ gst_egl_adaptation_context_make_current (GstEglAdaptationContext * ctx,
 {
   g_assert (ctx->display != NULL);
 
-  if (bind && ctx->eglglesctx->surface && ctx->eglglesctx->eglcontext) {
+  if (bind && (ctx->eglglesctx->surface || ctx->surfaceless)
+      && ctx->eglglesctx->eglcontext) {
     EGLContext *cur_ctx = eglGetCurrentContext ();
 
     if (cur_ctx == ctx->eglglesctx->eglcontext) {
@@ -257,17 +270,23 @@ gst_egl_adaptation_context_make_current (GstEglAdaptationContext * ctx,
 /* XXX: Lock eglgles context? */
 /**
  * @brief: 查询 EGLSurface 的长宽，赋值给 ctx->surface_width 和 ctx->surface_height
+ * @note: 使用输出FBO或者没有 EGLSurface（surfaceless）时，使用输出纹理的尺寸
 */
 gboolean
 gst_egl_adaptation_update_surface_dimensions (GstEglAdaptationContext * ctx)
 {
   gint width, height;
 
-  /* Save surface dims */
-  eglQuerySurface (gst_egl_display_get (ctx->display),
-      ctx->eglglesctx->surface, EGL_WIDTH, &width);
-  eglQuerySurface (gst_egl_display_get (ctx->display),
-      ctx->eglglesctx->surface, EGL_HEIGHT, &height);
+  if (ctx->output_texture || ctx->surfaceless) {
+    width = ctx->output_width;
+    height = ctx->output_height;
+  } else {
+    /* Save surface dims */
+    eglQuerySurface (gst_egl_display_get (ctx->display),
+        ctx->eglglesctx->surface, EGL_WIDTH, &width);
+    eglQuerySurface (gst_egl_display_get (ctx->display),
+        ctx->eglglesctx->surface, EGL_HEIGHT, &height);
+  }
 
   if (width != ctx->surface_width || height != ctx->surface_height) {
     ctx->surface_width = width;
@@ -298,14 +317,51 @@ gst_egl_adaptation_context_swap_buffers (GstEglAdaptationContext * ctx, gchar* w
     register_presentation_feedback(own_window_data, buf);
   }
 #endif
-  gboolean ret = eglSwapBuffers (gst_egl_display_get (ctx->display),
-      ctx->eglglesctx->surface);
+  gboolean ret;
+
+  if (ctx->swap_buffers_with_damage && ctx->damage[2] > 0
+      && ctx->damage[3] > 0) {
+    ret = ctx->swap_buffers_with_damage (gst_egl_display_get (ctx->display),
+        ctx->eglglesctx->surface, ctx->damage, 1);
+  } else {
+    ret = eglSwapBuffers (gst_egl_display_get (ctx->display),
+        ctx->eglglesctx->surface);
+  }
+  memset (ctx->damage, 0, sizeof (ctx->damage));
   if (ret == EGL_FALSE) {
     got_egl_error ("eglSwapBuffers");
   }
   return ret;
 }
 
+/**
+ * @brief: 把一个矩形（surface坐标，原点在左下）合并到这一帧的改变区域
+*/
+void
+gst_egl_adaptation_add_damage (GstEglAdaptationContext * ctx, gint x, gint y,
+    gint width, gint height)
+{
+  gint x2, y2;
+
+  if (width <= 0 || height <= 0)
+    return;
+
+  if (ctx->damage[2] <= 0 || ctx->damage[3] <= 0) {
+    ctx->damage[0] = x;
+    ctx->damage[1] = y;
+    ctx->damage[2] = width;
+    ctx->damage[3] = height;
+    return;
+  }
+
+  x2 = MAX (ctx->damage[0] + ctx->damage[2], x + width);
+  y2 = MAX (ctx->damage[1] + ctx->damage[3], y + height);
+  ctx->damage[0] = MIN (ctx->damage[0], x);
+  ctx->damage[1] = MIN (ctx->damage[1], y);
+  ctx->damage[2] = x2 - ctx->damage[0];
+  ctx->damage[3] = y2 - ctx->damage[1];
+}
+
 /**
  * @brief: eglChooseConfig 根据 eglChooseConfig 选择配置
  * @param num_configs(out): 给ctx->eglglesctx->config赋值了几组配置
@@ -341,10 +397,26 @@ _gst_egl_choose_config (GstEglAdaptationContext * ctx, gboolean try_only,
 
 /**
  * @brief: eglCreateWindowSurface 创建一个egl表面
+ * @note: 支持 EGL_KHR_surfaceless_context 时不创建表面（绘制到输出FBO），
+ *        否则创建一个 pbuffer 只是为了能够 eglMakeCurrent
 */
 gboolean
 gst_egl_adaptation_create_surface (GstEglAdaptationContext * ctx)
 {
+  const char *eglexts;
+
+  eglexts = eglQueryString (gst_egl_display_get (ctx->display), EGL_EXTENSIONS);
+  if (eglexts && strstr (eglexts, "EGL_KHR_surfaceless_context")) {
+    GST_INFO_OBJECT (ctx->element, "Using a surfaceless context");
+    ctx->eglglesctx->surface = EGL_NO_SURFACE;
+    ctx->surfaceless = TRUE;
+    return TRUE;
+  }
+
+  GST_INFO_OBJECT (ctx->element, "EGL_KHR_surfaceless_context not available, "
+      "falling back to a pbuffer surface");
+  ctx->surfaceless = FALSE;
+
   // ctx->eglglesctx->surface =
   //     eglCreateWindowSurface (gst_egl_display_get (ctx->display),
   //     ctx->eglglesctx->config, ctx->used_window, NULL);
@@ -379,6 +451,9 @@ gst_egl_adaptation_query_buffer_preserved (GstEglAdaptationContext * ctx)
   EGLint swap_behavior;
 
   ctx->buffer_preserved = FALSE;
+  if (ctx->surfaceless)
+    return;
+
   if (eglQuerySurface (gst_egl_display_get (ctx->display),
           ctx->eglglesctx->surface, EGL_SWAP_BEHAVIOR, &swap_behavior)) {
     GST_DEBUG_OBJECT (ctx->element, "Buffer swap behavior %x", swap_behavior);
@@ -415,7 +490,8 @@ gst_egl_adaptation_query_par (GstEglAdaptationContext * ctx)
    * XXX: 将其设置为一个属性或进行一次性检查。
    * 目前在每帧调用一次。
    * */
-  if (ctx->eglglesctx->egl_major == 1 && ctx->eglglesctx->egl_minor < 2) {
+  if (ctx->surfaceless ||
+      (ctx->eglglesctx->egl_major == 1 && ctx->eglglesctx->egl_minor < 2)) {
     GST_DEBUG_OBJECT (ctx->element, "Can't query PAR. Using default: %dx%d",
         EGL_DISPLAY_SCALING, EGL_DISPLAY_SCALING);
     ctx->pixel_aspect_ratio_n = EGL_DISPLAY_SCALING;
@@ -474,6 +550,8 @@ gst_egl_adaptation_create_egl_context (GstEglAdaptationContext * ctx)
   GST_DEBUG_OBJECT (ctx->element, "EGL Context: %p",
       ctx->eglglesctx->eglcontext);
 
+  gst_egl_garbage_attach (ctx->garbage, sink->egl_share_context);
+
   return TRUE;
 }
 
@@ -491,20 +569,82 @@ gst_egl_adaptation_context_get_egl_context (GstEglAdaptationContext * ctx)
 
 /**
  * @brief: 该函数只有在创建GstBuffer的时候才会调用，而且创建的这个空GstBuffer只是为了回复别人查询，并不是真正的GstBuffer
+ *         最后一个引用可能在任何线程释放，这里不能设置当前上下文，纹理交给渲染线程删除
 */
 static void
 gst_egl_gles_image_data_free (GstEGLGLESImageData * data)
 {
-  if (!eglMakeCurrent (data->display,
-      EGL_NO_SURFACE, EGL_NO_SURFACE, data->eglcontext)) {
-      got_egl_error ("eglMakeCurrent");
-      g_slice_free (GstEGLGLESImageData, data);
-      return;
-  }
-  glDeleteTextures (1, &data->texture);
+  gst_egl_garbage_push (data->garbage, data->epoch, GST_EGL_GARBAGE_TEXTURE,
+      data->texture);
+  gst_egl_garbage_unref (data->garbage);
   g_slice_free (GstEGLGLESImageData, data);
 }
 
+/*
+ * GstEGLImageOwner:
+ * 用纹理创建 EGLImage 的 buffer 的 qdata。纹理属于 @garbage 所在 sink 的上下文
+ * （代数 @epoch），这样的 buffer 只能回收给同一个 sink、同一个上下文的缓冲池
+ */
+typedef struct
+{
+  GstEglGarbage *garbage;
+  guint epoch;
+} GstEGLImageOwner;
+
+static GQuark
+gst_egl_image_owner_quark (void)
+{
+  static GQuark quark = 0;
+
+  if (!quark)
+    quark = g_quark_from_static_string ("GstEGLImageOwner");
+
+  return quark;
+}
+
+static void
+gst_egl_image_owner_free (GstEGLImageOwner * owner)
+{
+  gst_egl_garbage_unref (owner->garbage);
+  g_slice_free (GstEGLImageOwner, owner);
+}
+
+static void
+gst_egl_image_owner_set (GstBuffer * buffer, GstEglGarbage * garbage)
+{
+  GstEGLImageOwner *owner;
+
+  owner = g_slice_new (GstEGLImageOwner);
+  owner->garbage = gst_egl_garbage_ref (garbage);
+  owner->epoch = gst_egl_garbage_get_epoch (garbage);
+  gst_mini_object_set_qdata (GST_MINI_OBJECT_CAST (buffer),
+      gst_egl_image_owner_quark (), owner,
+      (GDestroyNotify) gst_egl_image_owner_free);
+}
+
+static GstEGLImageOwner *
+gst_egl_image_owner_get (GstBuffer * buffer)
+{
+  return gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (buffer),
+      gst_egl_image_owner_quark ());
+}
+
+/**
+ * @brief: 分配上游可以直接写入的 EGLImage 内存（udmabuf，见 gst_egl_image_allocator_alloc）。
+ *         导入的 R8/GR88 平面采样结果和 LUMINANCE/LUMINANCE_ALPHA 不同，需要纹理 swizzle 模拟，
+ *         不支持 swizzle（GLES2）时返回 NULL，使用纹理创建的 EGLImage
+*/
+static GstMemory *
+gst_egl_adaptation_alloc_mappable (GstAllocator * allocator,
+    GstEGLDisplay * display, gboolean texture_swizzle,
+    GstVideoGLTextureType type, gint width, gint height, gsize * size)
+{
+  if (!texture_swizzle)
+    return NULL;
+
+  return gst_egl_image_allocator_alloc (allocator, display, type, width,
+      height, size);
+}
 
 /**
  * @brief: 获取Buffer，但是该该Buffer中的GstMemory的图片是EGLImageKHR，
@@ -513,8 +653,8 @@ gst_egl_gles_image_data_free (GstEGLGLESImageData * data)
 */
 GstBuffer *
 gst_egl_image_allocator_alloc_eglimage (GstAllocator * allocator,
-    GstEGLDisplay * display, EGLContext eglcontext, GstVideoFormat format,
-    gint width, gint height)
+    GstEGLDisplay * display, EGLContext eglcontext, GstEglGarbage * garbage,
+    GstVideoFormat format, gint width, gint height)
 {
   GstEGLGLESImageData *data = NULL;
   GstBuffer *buffer;
@@ -525,18 +665,29 @@ gst_egl_image_allocator_alloc_eglimage (GstAllocator * allocator,
   GstMemory *mem[3] = { NULL, NULL, NULL }; /* 新建GstBuffer，然后把该mem添加到该Buffer中，然后返回 */
   guint n_mem;
   GstMemoryFlags flags = 0;
+  gboolean texture_swizzle; /* GLES3 时单/双通道平面使用 R8/RG8 */
+  GLint internal_format;
+  GLenum plane_format;
 
   memset (stride, 0, sizeof (stride));
   memset (offset, 0, sizeof (offset));
 
-  /* 表示该内存块不能映射到用户可访问的指针地址空间（因为可能返回的，通过当前上下文创建的EGLImageKHR） */
-  if (!gst_egl_image_memory_is_mappable ())
-    flags |= GST_MEMORY_FLAG_NOT_MAPPABLE;
+  /* 表示该内存块不能映射到用户可访问的指针地址空间（回退路径是通过当前上下文的纹理创建的EGLImageKHR，
+   * 只有 gst_egl_image_allocator_alloc 分配的 udmabuf 内存可以映射） */
+  flags |= GST_MEMORY_FLAG_NOT_MAPPABLE;
   /* See https://bugzilla.gnome.org/show_bug.cgi?id=695203 */
   flags |= GST_MEMORY_FLAG_NO_SHARE;
 
 
   gst_video_info_set_format (&info, format, width, height);
+  texture_swizzle = gst_egl_adaptation_query_texture_swizzle ();
+
+  /* 之前的缓冲池（seek、重新连接、caps 改变）释放的同样格式和尺寸的 buffer，
+   * 不需要重新创建 EGLImage */
+  buffer = gst_egl_image_allocator_take_recycled (display, garbage, format,
+      width, height);
+  if (buffer)
+    return buffer;
 
   switch (format) {
     case GST_VIDEO_FORMAT_RGB:
@@ -545,17 +696,18 @@ gst_egl_image_allocator_alloc_eglimage (GstAllocator * allocator,
       EGLImageKHR image;
 
       mem[0] =
-          gst_egl_image_allocator_alloc (allocator, display,
-          GST_VIDEO_GL_TEXTURE_TYPE_RGB, GST_VIDEO_INFO_WIDTH (&info),
-          GST_VIDEO_INFO_HEIGHT (&info), &size);
-      if (mem[0]) {  /* gst_egl_image_allocator_alloc这返回的是NULL */
+          gst_egl_adaptation_alloc_mappable (allocator, display,
+          texture_swizzle, GST_VIDEO_GL_TEXTURE_TYPE_RGB,
+          GST_VIDEO_INFO_WIDTH (&info), GST_VIDEO_INFO_HEIGHT (&info),
+          &size);
+      if (mem[0]) {  /* udmabuf 内存，上游可以直接写入 */
         stride[0] = size / GST_VIDEO_INFO_HEIGHT (&info);
         n_mem = 1;
         GST_MINI_OBJECT_FLAG_SET (mem[0], GST_MEMORY_FLAG_NO_SHARE);
-      } else { /* 所以会执行该部分 */
+      } else { /* 不支持 udmabuf/dmabuf 导入时，用纹理创建 EGLImage */
         data = g_slice_new0 (GstEGLGLESImageData);
-        data->display = gst_egl_display_get (display);
-        data->eglcontext = eglcontext;
+        data->garbage = gst_egl_garbage_ref (garbage);
+        data->epoch = gst_egl_garbage_get_epoch (garbage);
 
         stride[0] = GST_ROUND_UP_4 (GST_VIDEO_INFO_WIDTH (&info) * 3);
         size = stride[0] * GST_VIDEO_INFO_HEIGHT (&info);
@@ -607,17 +759,18 @@ gst_egl_image_allocator_alloc_eglimage (GstAllocator * allocator,
       gsize size;
 
       mem[0] =
-          gst_egl_image_allocator_alloc (allocator, display,
-          GST_VIDEO_GL_TEXTURE_TYPE_RGB, GST_VIDEO_INFO_WIDTH (&info),
-          GST_VIDEO_INFO_HEIGHT (&info), &size);
+          gst_egl_adaptation_alloc_mappable (allocator, display,
+          texture_swizzle, GST_VIDEO_GL_TEXTURE_TYPE_RGB16,
+          GST_VIDEO_INFO_WIDTH (&info), GST_VIDEO_INFO_HEIGHT (&info),
+          &size);
       if (mem[0]) {
         stride[0] = size / GST_VIDEO_INFO_HEIGHT (&info);
         n_mem = 1;
         GST_MINI_OBJECT_FLAG_SET (mem[0], GST_MEMORY_FLAG_NO_SHARE);
       } else {
         data = g_slice_new0 (GstEGLGLESImageData);
-        data->display = gst_egl_display_get (display);
-        data->eglcontext = eglcontext;
+        data->garbage = gst_egl_garbage_ref (garbage);
+        data->epoch = gst_egl_garbage_get_epoch (garbage);
 
         stride[0] = GST_ROUND_UP_4 (GST_VIDEO_INFO_WIDTH (&info) * 2);
         size = stride[0] * GST_VIDEO_INFO_HEIGHT (&info);
@@ -671,19 +824,21 @@ gst_egl_image_allocator_alloc_eglimage (GstAllocator * allocator,
       gsize size[2];
 
       mem[0] =
-          gst_egl_image_allocator_alloc (allocator, display,
-          GST_VIDEO_GL_TEXTURE_TYPE_LUMINANCE, GST_VIDEO_INFO_COMP_WIDTH (&info,
-              0), GST_VIDEO_INFO_COMP_HEIGHT (&info, 0), &size[0]);
+          gst_egl_adaptation_alloc_mappable (allocator, display,
+          texture_swizzle, GST_VIDEO_GL_TEXTURE_TYPE_LUMINANCE,
+          GST_VIDEO_INFO_COMP_WIDTH (&info, 0),
+          GST_VIDEO_INFO_COMP_HEIGHT (&info, 0), &size[0]);
       mem[1] =
-          gst_egl_image_allocator_alloc (allocator, display,
-          GST_VIDEO_GL_TEXTURE_TYPE_LUMINANCE_ALPHA,
+          gst_egl_adaptation_alloc_mappable (allocator, display,
+          texture_swizzle, GST_VIDEO_GL_TEXTURE_TYPE_LUMINANCE_ALPHA,
           GST_VIDEO_INFO_COMP_WIDTH (&info, 1),
           GST_VIDEO_INFO_COMP_HEIGHT (&info, 1), &size[1]);
 
       if (mem[0] && mem[1]) {
-        stride[0] = size[0] / GST_VIDEO_INFO_HEIGHT (&info);
+        /* 各平面单独一个 GstMemory，offset 按 buffer 中所有内存依次累加 */
+        stride[0] = size[0] / GST_VIDEO_INFO_COMP_HEIGHT (&info, 0);
         offset[1] = size[0];
-        stride[1] = size[1] / GST_VIDEO_INFO_HEIGHT (&info);
+        stride[1] = size[1] / GST_VIDEO_INFO_COMP_HEIGHT (&info, 1);
         n_mem = 2;
         GST_MINI_OBJECT_FLAG_SET (mem[0], GST_MEMORY_FLAG_NO_SHARE);
         GST_MINI_OBJECT_FLAG_SET (mem[1], GST_MEMORY_FLAG_NO_SHARE);
@@ -702,8 +857,8 @@ gst_egl_image_allocator_alloc_eglimage (GstAllocator * allocator,
 
         for (i = 0; i < 2; i++) {
           data = g_slice_new0 (GstEGLGLESImageData);
-          data->display = gst_egl_display_get (display);
-          data->eglcontext = eglcontext;
+          data->garbage = gst_egl_garbage_ref (garbage);
+          data->epoch = gst_egl_garbage_get_epoch (garbage);
 
           glGenTextures (1, &data->texture);
           if (got_gl_error ("glGenTextures"))
@@ -726,16 +881,12 @@ gst_egl_image_allocator_alloc_eglimage (GstAllocator * allocator,
           if (got_gl_error ("glTexParameteri"))
             goto mem_error;
 
-          if (i == 0)
-            glTexImage2D (GL_TEXTURE_2D, 0, GL_LUMINANCE,
-                GST_VIDEO_INFO_COMP_WIDTH (&info, i),
-                GST_VIDEO_INFO_COMP_HEIGHT (&info, i), 0, GL_LUMINANCE,
-                GL_UNSIGNED_BYTE, NULL);
-          else
-            glTexImage2D (GL_TEXTURE_2D, 0, GL_LUMINANCE_ALPHA,
-                GST_VIDEO_INFO_COMP_WIDTH (&info, i),
-                GST_VIDEO_INFO_COMP_HEIGHT (&info, i), 0, GL_LUMINANCE_ALPHA,
-                GL_UNSIGNED_BYTE, NULL);
+          gst_egl_adaptation_plane_format (texture_swizzle, i == 0 ? 1 : 2,
+              &internal_format, &plane_format);
+          glTexImage2D (GL_TEXTURE_2D, 0, internal_format,
+              GST_VIDEO_INFO_COMP_WIDTH (&info, i),
+              GST_VIDEO_INFO_COMP_HEIGHT (&info, i), 0, plane_format,
+              GL_UNSIGNED_BYTE, NULL);
 
           if (got_gl_error ("glTexImage2D"))
             goto mem_error;
@@ -770,24 +921,27 @@ gst_egl_image_allocator_alloc_eglimage (GstAllocator * allocator,
       gsize size[3];
 
       mem[0] =
-          gst_egl_image_allocator_alloc (allocator, display,
-          GST_VIDEO_GL_TEXTURE_TYPE_LUMINANCE, GST_VIDEO_INFO_COMP_WIDTH (&info,
-              0), GST_VIDEO_INFO_COMP_HEIGHT (&info, 0), &size[0]);
+          gst_egl_adaptation_alloc_mappable (allocator, display,
+          texture_swizzle, GST_VIDEO_GL_TEXTURE_TYPE_LUMINANCE,
+          GST_VIDEO_INFO_COMP_WIDTH (&info, 0),
+          GST_VIDEO_INFO_COMP_HEIGHT (&info, 0), &size[0]);
       mem[1] =
-          gst_egl_image_allocator_alloc (allocator, display,
-          GST_VIDEO_GL_TEXTURE_TYPE_LUMINANCE, GST_VIDEO_INFO_COMP_WIDTH (&info,
-              1), GST_VIDEO_INFO_COMP_HEIGHT (&info, 1), &size[1]);
+          gst_egl_adaptation_alloc_mappable (allocator, display,
+          texture_swizzle, GST_VIDEO_GL_TEXTURE_TYPE_LUMINANCE,
+          GST_VIDEO_INFO_COMP_WIDTH (&info, 1),
+          GST_VIDEO_INFO_COMP_HEIGHT (&info, 1), &size[1]);
       mem[2] =
-          gst_egl_image_allocator_alloc (allocator, display,
-          GST_VIDEO_GL_TEXTURE_TYPE_LUMINANCE, GST_VIDEO_INFO_COMP_WIDTH (&info,
-              2), GST_VIDEO_INFO_COMP_HEIGHT (&info, 2), &size[2]);
+          gst_egl_adaptation_alloc_mappable (allocator, display,
+          texture_swizzle, GST_VIDEO_GL_TEXTURE_TYPE_LUMINANCE,
+          GST_VIDEO_INFO_COMP_WIDTH (&info, 2),
+          GST_VIDEO_INFO_COMP_HEIGHT (&info, 2), &size[2]);
 
       if (mem[0] && mem[1] && mem[2]) {
-        stride[0] = size[0] / GST_VIDEO_INFO_HEIGHT (&info);
+        stride[0] = size[0] / GST_VIDEO_INFO_COMP_HEIGHT (&info, 0);
         offset[1] = size[0];
-        stride[1] = size[1] / GST_VIDEO_INFO_HEIGHT (&info);
-        offset[2] = size[1];
-        stride[2] = size[2] / GST_VIDEO_INFO_HEIGHT (&info);
+        stride[1] = size[1] / GST_VIDEO_INFO_COMP_HEIGHT (&info, 1);
+        offset[2] = size[0] + size[1];
+        stride[2] = size[2] / GST_VIDEO_INFO_COMP_HEIGHT (&info, 2);
         n_mem = 3;
         GST_MINI_OBJECT_FLAG_SET (mem[0], GST_MEMORY_FLAG_NO_SHARE);
         GST_MINI_OBJECT_FLAG_SET (mem[1], GST_MEMORY_FLAG_NO_SHARE);
@@ -813,8 +967,8 @@ gst_egl_image_allocator_alloc_eglimage (GstAllocator * allocator,
 
         for (i = 0; i < 3; i++) {
           data = g_slice_new0 (GstEGLGLESImageData);
-          data->display = gst_egl_display_get (display);
-          data->eglcontext = eglcontext;
+          data->garbage = gst_egl_garbage_ref (garbage);
+          data->epoch = gst_egl_garbage_get_epoch (garbage);
 
           glGenTextures (1, &data->texture);
           if (got_gl_error ("glGenTextures"))
@@ -837,9 +991,11 @@ gst_egl_image_allocator_alloc_eglimage (GstAllocator * allocator,
           if (got_gl_error ("glTexParameteri"))
             goto mem_error;
 
-          glTexImage2D (GL_TEXTURE_2D, 0, GL_LUMINANCE,
+          gst_egl_adaptation_plane_format (texture_swizzle, 1,
+              &internal_format, &plane_format);
+          glTexImage2D (GL_TEXTURE_2D, 0, internal_format,
               GST_VIDEO_INFO_COMP_WIDTH (&info, i),
-              GST_VIDEO_INFO_COMP_HEIGHT (&info, i), 0, GL_LUMINANCE,
+              GST_VIDEO_INFO_COMP_HEIGHT (&info, i), 0, plane_format,
               GL_UNSIGNED_BYTE, NULL);
 
           if (got_gl_error ("glTexImage2D"))
@@ -876,17 +1032,18 @@ gst_egl_image_allocator_alloc_eglimage (GstAllocator * allocator,
       EGLImageKHR image;
 
       mem[0] =
-          gst_egl_image_allocator_alloc (allocator, display,
-          GST_VIDEO_GL_TEXTURE_TYPE_RGBA, GST_VIDEO_INFO_WIDTH (&info),
-          GST_VIDEO_INFO_HEIGHT (&info), &size);
+          gst_egl_adaptation_alloc_mappable (allocator, display,
+          texture_swizzle, GST_VIDEO_GL_TEXTURE_TYPE_RGBA,
+          GST_VIDEO_INFO_WIDTH (&info), GST_VIDEO_INFO_HEIGHT (&info),
+          &size);
       if (mem[0]) {
         stride[0] = size / GST_VIDEO_INFO_HEIGHT (&info);
         n_mem = 1;
         GST_MINI_OBJECT_FLAG_SET (mem[0], GST_MEMORY_FLAG_NO_SHARE);
       } else {
         data = g_slice_new0 (GstEGLGLESImageData);
-        data->display = gst_egl_display_get (display);
-        data->eglcontext = eglcontext;
+        data->garbage = gst_egl_garbage_ref (garbage);
+        data->epoch = gst_egl_garbage_get_epoch (garbage);
 
         stride[0] = GST_ROUND_UP_4 (GST_VIDEO_INFO_WIDTH (&info) * 4);
         size = stride[0] * GST_VIDEO_INFO_HEIGHT (&info);
@@ -947,6 +1104,9 @@ gst_egl_image_allocator_alloc_eglimage (GstAllocator * allocator,
   for (i = 0; i < n_mem; i++)
     gst_buffer_append_memory (buffer, mem[i]);
 
+  if (GST_MEMORY_FLAG_IS_SET (mem[0], GST_MEMORY_FLAG_NOT_MAPPABLE))
+    gst_egl_image_owner_set (buffer, garbage);
+
   return buffer;
 
 mem_error:
@@ -967,6 +1127,202 @@ mem_error:
   }
 }
 
+/*
+ * GstEGLImageRecycleList:
+ * 一个 EGLDisplay 回收的 EGLImage buffer（同一个显示的多个 sink 共用）。缓冲池释放 buffer 时放到这里（最多
+ * GST_EGL_IMAGE_RECYCLE_MAX 个），之后的缓冲池分配同样格式和尺寸的 buffer 时直接取出，
+ * udmabuf/纹理和 EGLImage 都不需要重新创建。udmabuf buffer 可以交给任何 sink；
+ * 用纹理创建的 EGLImage 属于分配它的 sink 的上下文（GstEGLImageOwner），只交给同一个 sink
+ * 同一个上下文的缓冲池，sink 的渲染线程退出时由 gst_egl_image_allocator_drop_recycled 释放
+ */
+#define GST_EGL_IMAGE_RECYCLE_MAX 16
+
+typedef struct
+{
+  gint users; /* gst_egl_image_allocator_enable_recycling 的次数 */
+  GQueue buffers;
+} GstEGLImageRecycleList;
+
+static GMutex recycle_lock;
+static GHashTable *recycle_lists; /* EGLDisplay -> GstEGLImageRecycleList */
+
+/**
+ * @brief: 开始回收 @display 的 EGLImage buffer（打开 sink 时调用），
+ *         和 gst_egl_image_allocator_release_recycled 成对调用
+*/
+void
+gst_egl_image_allocator_enable_recycling (GstEGLDisplay * display)
+{
+  GstEGLImageRecycleList *list;
+
+  g_mutex_lock (&recycle_lock);
+  if (!recycle_lists)
+    recycle_lists = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  list = g_hash_table_lookup (recycle_lists, gst_egl_display_get (display));
+  if (!list) {
+    list = g_slice_new0 (GstEGLImageRecycleList);
+    g_queue_init (&list->buffers);
+    g_hash_table_insert (recycle_lists, gst_egl_display_get (display), list);
+  }
+  list->users++;
+  g_mutex_unlock (&recycle_lock);
+}
+
+/**
+ * @brief: 停止回收 @display 的 buffer，最后一个使用者释放时销毁回收的 buffer
+*/
+void
+gst_egl_image_allocator_release_recycled (GstEGLDisplay * display)
+{
+  GstEGLImageRecycleList *list;
+  GQueue buffers = G_QUEUE_INIT;
+  GstBuffer *buffer;
+
+  g_mutex_lock (&recycle_lock);
+  list = recycle_lists ? g_hash_table_lookup (recycle_lists,
+      gst_egl_display_get (display)) : NULL;
+  if (list && --list->users == 0) {
+    g_hash_table_remove (recycle_lists, gst_egl_display_get (display));
+    buffers = list->buffers;
+    g_slice_free (GstEGLImageRecycleList, list);
+  }
+  g_mutex_unlock (&recycle_lock);
+
+  while ((buffer = g_queue_pop_head (&buffers)))
+    gst_buffer_unref (buffer);
+}
+
+/**
+ * @brief: 缓冲池释放 EGLImage buffer 时调用，显示开启了回收并且没有超过上限时保留
+ * @return: TRUE 表示 @buffer 被保留（调用者不再拥有），FALSE 时调用者正常释放
+*/
+gboolean
+gst_egl_image_allocator_recycle_buffer (GstBuffer * buffer)
+{
+  GstEGLImageRecycleList *list;
+  GstEGLDisplay *display;
+  GstMemory *mem;
+  gboolean kept = FALSE;
+
+  if (gst_buffer_n_memory (buffer) == 0 || !gst_buffer_get_video_meta (buffer))
+    return FALSE;
+
+  mem = gst_buffer_peek_memory (buffer, 0);
+  if (!gst_is_egl_image_memory (mem))
+    return FALSE;
+
+  /* 用纹理创建的 EGLImage 只有知道属于哪个上下文时才能回收 */
+  if (GST_MEMORY_FLAG_IS_SET (mem, GST_MEMORY_FLAG_NOT_MAPPABLE) &&
+      !gst_egl_image_owner_get (buffer))
+    return FALSE;
+
+  display = gst_egl_image_memory_get_display (mem);
+
+  g_mutex_lock (&recycle_lock);
+  list = recycle_lists ? g_hash_table_lookup (recycle_lists,
+      gst_egl_display_get (display)) : NULL;
+  if (list && list->buffers.length < GST_EGL_IMAGE_RECYCLE_MAX) {
+    g_queue_push_tail (&list->buffers, buffer);
+    kept = TRUE;
+  }
+  g_mutex_unlock (&recycle_lock);
+
+  gst_egl_display_unref (display);
+
+  return kept;
+}
+
+/**
+ * @brief: 取出一个回收的、格式和尺寸相同的 buffer：udmabuf buffer，或者 @garbage 所在的 sink
+ *         在当前上下文中用纹理创建的 buffer。这个 sink 在之前的上下文中创建的 buffer 同时释放
+ * @return: 没有时返回 NULL
+*/
+GstBuffer *
+gst_egl_image_allocator_take_recycled (GstEGLDisplay * display,
+    GstEglGarbage * garbage, GstVideoFormat format, gint width, gint height)
+{
+  GstEGLImageRecycleList *list;
+  GstBuffer *buffer = NULL, *buf;
+  GQueue stale = G_QUEUE_INIT;
+  GList *l, *next;
+  guint epoch;
+
+  epoch = gst_egl_garbage_get_epoch (garbage);
+
+  g_mutex_lock (&recycle_lock);
+  list = recycle_lists ? g_hash_table_lookup (recycle_lists,
+      gst_egl_display_get (display)) : NULL;
+  for (l = list ? list->buffers.head : NULL; l; l = next) {
+    GstVideoMeta *vmeta;
+    GstEGLImageOwner *owner;
+
+    buf = l->data;
+    vmeta = gst_buffer_get_video_meta (buf);
+    owner = gst_egl_image_owner_get (buf);
+    next = l->next;
+    if (owner && owner->garbage != garbage)
+      continue;
+    if (owner && owner->epoch != epoch) {
+      /* 上下文已经重建，纹理不再有效 */
+      g_queue_delete_link (&list->buffers, l);
+      g_queue_push_tail (&stale, buf);
+      continue;
+    }
+
+    if (vmeta->format == format && (gint) vmeta->width == width &&
+        (gint) vmeta->height == height) {
+      g_queue_delete_link (&list->buffers, l);
+      buffer = buf;
+      break;
+    }
+  }
+  g_mutex_unlock (&recycle_lock);
+
+  while ((buf = g_queue_pop_head (&stale)))
+    gst_buffer_unref (buf);
+
+  if (buffer)
+    GST_DEBUG ("Reusing recycled EGLImage buffer %p (%s %dx%d)", buffer,
+        gst_video_format_to_string (format), width, height);
+
+  return buffer;
+}
+
+/**
+ * @brief: 释放回收列表中 @garbage 所在的 sink 用纹理创建的 buffer。渲染线程退出时、
+ *         最后一次删除纹理之前调用，之后上下文销毁，这些纹理不能再使用
+*/
+void
+gst_egl_image_allocator_drop_recycled (GstEglGarbage * garbage)
+{
+  GstEGLImageRecycleList *list;
+  GHashTableIter iter;
+  GQueue dropped = G_QUEUE_INIT;
+  GstBuffer *buffer;
+  GList *l, *next;
+
+  g_mutex_lock (&recycle_lock);
+  if (recycle_lists) {
+    g_hash_table_iter_init (&iter, recycle_lists);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) & list)) {
+      for (l = list->buffers.head; l; l = next) {
+        GstEGLImageOwner *owner = gst_egl_image_owner_get (l->data);
+
+        next = l->next;
+        if (owner && owner->garbage == garbage) {
+          g_queue_push_tail (&dropped, l->data);
+          g_queue_delete_link (&list->buffers, l);
+        }
+      }
+    }
+  }
+  g_mutex_unlock (&recycle_lock);
+
+  while ((buffer = g_queue_pop_head (&dropped)))
+    gst_buffer_unref (buffer);
+}
+
 /**
  * @brief: 销毁X11窗口，本质就是 
  *         XDestroyWindow (own_window_data->display, ctx->used_window);
@@ -1052,6 +1408,131 @@ gst_egl_adaptation_init (GstEglAdaptationContext * ctx)
   ctx->eglglesctx = g_new0 (GstEglGlesRenderContext, 1);
 }
 
+/**
+ * @brief: 预编译线程：创建一个和UI上下文（也就是渲染上下文）共享的上下文，编译所有着色程序，
+ *         发布二进制之后销毁这个上下文并退出，二进制的引用由 ctx->precompiled 持有到 close
+ * @note: 支持 EGL_KHR_surfaceless_context 时不创建表面；否则需要 pbuffer，
+ *        UI的 egl-config 没有 EGL_PBUFFER_BIT 时另外选择一个配置
+*/
+static gpointer
+gst_egl_adaptation_precompile_thread_func (gpointer data)
+{
+  GstEglAdaptationContext *ctx = data;
+  GstEglGlesSink *sink = (GstEglGlesSink *) ctx->element;
+  EGLDisplay display = sink->egl_display;
+  EGLConfig config = sink->egl_config;
+  EGLContext context;
+  EGLSurface surface = EGL_NO_SURFACE;
+  EGLint surface_type = 0, n_configs = 0;
+  const char *eglexts;
+  gboolean surfaceless;
+  EGLint con_attribs[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 3,
+    EGL_CONTEXT_MINOR_VERSION, 2,
+    EGL_NONE
+  };
+  EGLint config_attrs[] = {
+    EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+    EGL_NONE
+  };
+  EGLint surface_attrs[] = {
+    EGL_WIDTH, 1,
+    EGL_HEIGHT, 1,
+    EGL_NONE
+  };
+
+  eglBindAPI (EGL_OPENGL_ES_API);
+
+  eglexts = eglQueryString (display, EGL_EXTENSIONS);
+  surfaceless = eglexts && strstr (eglexts, "EGL_KHR_surfaceless_context");
+  if (!surfaceless) {
+    eglGetConfigAttrib (display, config, EGL_SURFACE_TYPE, &surface_type);
+    if (!(surface_type & EGL_PBUFFER_BIT) &&
+        (!eglChooseConfig (display, config_attrs, &config, 1, &n_configs) ||
+            n_configs < 1)) {
+      got_egl_error ("eglChooseConfig");
+      GST_WARNING_OBJECT (ctx->element, "No pbuffer config, not precompiling");
+      goto done;
+    }
+  }
+
+  context = eglCreateContext (display, config, sink->egl_share_context,
+      con_attribs);
+  if (context == EGL_NO_CONTEXT) {
+    got_egl_error ("eglCreateContext");
+    GST_WARNING_OBJECT (ctx->element, "Couldn't create precompile context");
+    goto done;
+  }
+
+  if (!surfaceless) {
+    surface = eglCreatePbufferSurface (display, config, surface_attrs);
+    if (surface == EGL_NO_SURFACE) {
+      got_egl_error ("eglCreatePbufferSurface");
+      eglDestroyContext (display, context);
+      goto done;
+    }
+  }
+
+  if (!eglMakeCurrent (display, surface, surface, context)) {
+    got_egl_error ("eglMakeCurrent");
+    if (surface != EGL_NO_SURFACE)
+      eglDestroySurface (display, surface);
+    eglDestroyContext (display, context);
+    goto done;
+  }
+
+  gst_egl_adaptation_precompile_programs (ctx);
+
+  eglMakeCurrent (display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  if (surface != EGL_NO_SURFACE)
+    eglDestroySurface (display, surface);
+  eglDestroyContext (display, context);
+
+done:
+  eglReleaseThread ();
+  return NULL;
+}
+
+/**
+ * @brief: 启动预编译线程（在 open 时调用）
+ *         需要UI提供 egl-display、egl-config 和共享上下文，否则编译好的程序渲染线程无法使用
+*/
+gboolean
+gst_egl_adaptation_precompile_start (GstEglAdaptationContext * ctx)
+{
+  GstEglGlesSink *sink = (GstEglGlesSink *) ctx->element;
+
+  if (ctx->precompile_thread)
+    return TRUE;
+
+  if (sink->egl_display == EGL_NO_DISPLAY || !sink->egl_config ||
+      sink->egl_share_context == EGL_NO_CONTEXT) {
+    GST_DEBUG_OBJECT (ctx->element, "No shared EGL context, not precompiling");
+    return FALSE;
+  }
+
+  ctx->precompile_thread = g_thread_try_new ("eglglessink-precompile",
+      gst_egl_adaptation_precompile_thread_func, ctx, NULL);
+
+  return ctx->precompile_thread != NULL;
+}
+
+/**
+ * @brief: 等待预编译线程退出（在 close 时，渲染线程退出之后调用），
+ *         然后释放预编译发布的共享程序引用
+*/
+void
+gst_egl_adaptation_precompile_stop (GstEglAdaptationContext * ctx)
+{
+  if (ctx->precompile_thread) {
+    g_thread_join (ctx->precompile_thread);
+    ctx->precompile_thread = NULL;
+  }
+
+  gst_egl_adaptation_precompile_release (ctx);
+}
+
 /**
  * @brief: GstEglGlesRenderContext（egl配置、上下文、表面）释放内存
 */
@@ -1069,6 +1550,9 @@ gst_egl_adaptation_destroy_surface (GstEglAdaptationContext * ctx)
         ctx->eglglesctx->surface);
     ctx->eglglesctx->surface = NULL;
     ctx->have_surface = FALSE;
+  } else if (ctx->surfaceless) {
+    ctx->surfaceless = FALSE;
+    ctx->have_surface = FALSE;
   }
 }
 
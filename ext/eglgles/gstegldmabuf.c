@@ -0,0 +1,412 @@
+/*
+ * GStreamer EGL/GLES Sink DMABuf import
+ * Copyright (c) 2015-2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "gstegldmabuf.h"
+
+#include <string.h>
+#include <gst/allocators/allocators.h>
+
+#ifndef HAVE_IOS
+
+#define GST_CAT_DEFAULT egladaption_debug
+
+/* DRM fourcc（drm_fourcc.h 中的 fourcc_code 和 GST_MAKE_FOURCC 相同），不依赖 libdrm */
+#define GST_EGL_DRM_FORMAT_R8 GST_MAKE_FOURCC ('R', '8', ' ', ' ')
+#define GST_EGL_DRM_FORMAT_GR88 GST_MAKE_FOURCC ('G', 'R', '8', '8')
+#define GST_EGL_DRM_FORMAT_RGB565 GST_MAKE_FOURCC ('R', 'G', '1', '6')
+#define GST_EGL_DRM_FORMAT_BGR888 GST_MAKE_FOURCC ('B', 'G', '2', '4')
+#define GST_EGL_DRM_FORMAT_ABGR8888 GST_MAKE_FOURCC ('A', 'B', '2', '4')
+#define GST_EGL_DRM_FORMAT_MOD_LINEAR 0
+
+/* 缓存的 EGLImage 会保持 dmabuf 不被释放，超过这个数量时全部清空 */
+#define GST_EGL_DMABUF_CACHE_MAX 64
+
+/*
+ * 缓存由 sink 和每个导入过的 GstMemory 共同引用，内存可能在缓存释放之后才释放
+ */
+struct _GstEglDmabufCache
+{
+  gint ref_count;
+  GMutex lock; /* 保护 @images，内存可能在任何线程释放 */
+  GstElement *element; /* 用于日志 */
+  GstEGLDisplay *display;
+  gboolean modifiers; /* EGL_EXT_image_dma_buf_import_modifiers */
+  GHashTable *images; /* GstEglDmabufImage（键和值是同一个结构） */
+};
+
+/*
+ * GstEglDmabufImage:
+ * 一个平面的导入参数和导入的 EGLImage；dmabuf 由 GstMemory 区分。fd 会被复用，
+ * 4.x 内核上所有 dmabuf 的 inode 都相同，都不能用来区分 dmabuf。
+ * 内存释放时它的 EGLImage 从缓存中删除，缓存中的内存地址不会被重用
+ */
+typedef struct
+{
+  GstMemory *mem;
+  guint64 offset;
+  gint stride;
+  gint width;
+  gint height;
+  guint32 fourcc;
+  guint64 modifier;
+
+  GstEGLDisplay *display;
+  EGLImageKHR image;
+} GstEglDmabufImage;
+
+static guint
+gst_egl_dmabuf_image_hash (gconstpointer key)
+{
+  const GstEglDmabufImage *img = key;
+
+  return (guint) (g_direct_hash (img->mem) * 31 + img->offset) ^
+      (guint) img->stride ^ img->fourcc;
+}
+
+static gboolean
+gst_egl_dmabuf_image_equal (gconstpointer a, gconstpointer b)
+{
+  const GstEglDmabufImage *ia = a;
+  const GstEglDmabufImage *ib = b;
+
+  return ia->mem == ib->mem && ia->offset == ib->offset &&
+      ia->stride == ib->stride && ia->width == ib->width &&
+      ia->height == ib->height && ia->fourcc == ib->fourcc &&
+      ia->modifier == ib->modifier;
+}
+
+static void
+gst_egl_dmabuf_image_free (GstEglDmabufImage * img)
+{
+  gst_egl_display_image_destroy (img->display, img->image);
+  g_slice_free (GstEglDmabufImage, img);
+}
+
+/*
+ * GstEglDmabufMemory:
+ * 导入过的 GstMemory 的 qdata。所有缓存共用一个 quark，qdata 是这个结构的链表，
+ * 每个缓存一项（多个 sink 可以导入同一个内存）
+ */
+typedef struct
+{
+  GstEglDmabufCache *cache;
+  GstMemory *mem;
+} GstEglDmabufMemory;
+
+static GMutex memory_lock; /* 保护内存 qdata 中的链表 */
+
+static GQuark
+gst_egl_dmabuf_memory_quark (void)
+{
+  static GQuark quark = 0;
+
+  if (!quark)
+    quark = g_quark_from_static_string ("GstEglDmabufMemory");
+
+  return quark;
+}
+
+static void
+gst_egl_dmabuf_cache_unref (GstEglDmabufCache * cache)
+{
+  if (!g_atomic_int_dec_and_test (&cache->ref_count))
+    return;
+
+  g_hash_table_unref (cache->images);
+  gst_egl_display_unref (cache->display);
+  g_mutex_clear (&cache->lock);
+  g_slice_free (GstEglDmabufCache, cache);
+}
+
+static gboolean
+gst_egl_dmabuf_image_is_in (gpointer key, gpointer value, gpointer mem)
+{
+  return ((GstEglDmabufImage *) key)->mem == mem;
+}
+
+/**
+ * @brief: GstMemory 释放时调用（任何线程），销毁这个内存在缓存中的 EGLImage
+*/
+static void
+gst_egl_dmabuf_memory_free (GstEglDmabufMemory * dmem)
+{
+  GstEglDmabufCache *cache = dmem->cache;
+
+  g_mutex_lock (&cache->lock);
+  g_hash_table_foreach_remove (cache->images, gst_egl_dmabuf_image_is_in,
+      dmem->mem);
+  g_mutex_unlock (&cache->lock);
+
+  gst_egl_dmabuf_cache_unref (cache);
+  g_slice_free (GstEglDmabufMemory, dmem);
+}
+
+static void
+gst_egl_dmabuf_memory_list_free (GSList * list)
+{
+  g_slist_free_full (list, (GDestroyNotify) gst_egl_dmabuf_memory_free);
+}
+
+/**
+ * @brief: 在 @mem 的 qdata 中记录 @cache（已经记录时什么也不做），内存释放时清除它的 EGLImage
+*/
+static void
+gst_egl_dmabuf_cache_watch_memory (GstEglDmabufCache * cache, GstMemory * mem)
+{
+  GstMiniObject *obj = GST_MINI_OBJECT_CAST (mem);
+  GstEglDmabufMemory *dmem;
+  GQuark quark = gst_egl_dmabuf_memory_quark ();
+  GSList *list, *l;
+
+  g_mutex_lock (&memory_lock);
+  list = gst_mini_object_get_qdata (obj, quark);
+  for (l = list; l; l = l->next) {
+    if (((GstEglDmabufMemory *) l->data)->cache == cache) {
+      g_mutex_unlock (&memory_lock);
+      return;
+    }
+  }
+
+  dmem = g_slice_new (GstEglDmabufMemory);
+  dmem->cache = cache;
+  dmem->mem = mem;
+  g_atomic_int_inc (&cache->ref_count);
+
+  /* 替换 qdata 会调用旧值的 destroy，先取出链表 */
+  list = gst_mini_object_steal_qdata (obj, quark);
+  list = g_slist_prepend (list, dmem);
+  gst_mini_object_set_qdata (obj, quark, list,
+      (GDestroyNotify) gst_egl_dmabuf_memory_list_free);
+  g_mutex_unlock (&memory_lock);
+}
+
+/**
+ * @brief: 平面的 DRM 格式：按像素跨度选择，采样的分量就是内存中的字节顺序
+ *         （和系统内存路径用 GL_RGBA/GL_RGB/GL_RG/GL_R 上传原始字节一样）
+*/
+static guint32
+gst_egl_dmabuf_plane_fourcc (const GstVideoInfo * info, gint pstride)
+{
+  switch (pstride) {
+    case 1:
+      return GST_EGL_DRM_FORMAT_R8;
+    case 2:
+      return GST_VIDEO_INFO_FORMAT (info) == GST_VIDEO_FORMAT_RGB16 ?
+          GST_EGL_DRM_FORMAT_RGB565 : GST_EGL_DRM_FORMAT_GR88;
+    case 3:
+      return GST_EGL_DRM_FORMAT_BGR888;
+    case 4:
+      return GST_EGL_DRM_FORMAT_ABGR8888;
+    default:
+      return 0;
+  }
+}
+
+/**
+ * @brief: EGL 是否支持导入 dmabuf（EGL_EXT_image_dma_buf_import）
+*/
+gboolean
+gst_egl_dmabuf_import_supported (GstEGLDisplay * display)
+{
+  const gchar *exts;
+
+  if (!display)
+    return FALSE;
+
+  exts = eglQueryString (gst_egl_display_get (display), EGL_EXTENSIONS);
+  return exts && strstr (exts, "EGL_EXT_image_dma_buf_import") != NULL;
+}
+
+/**
+ * @return: 不支持导入 dmabuf 时返回NULL
+*/
+GstEglDmabufCache *
+gst_egl_dmabuf_cache_new (GstElement * element, GstEGLDisplay * display)
+{
+  GstEglDmabufCache *cache;
+  const gchar *exts;
+
+  if (!gst_egl_dmabuf_import_supported (display))
+    return NULL;
+
+  exts = eglQueryString (gst_egl_display_get (display), EGL_EXTENSIONS);
+
+  cache = g_slice_new0 (GstEglDmabufCache);
+  cache->ref_count = 1;
+  g_mutex_init (&cache->lock);
+  cache->element = element;
+  cache->display = gst_egl_display_ref (display);
+  cache->modifiers =
+      strstr (exts, "EGL_EXT_image_dma_buf_import_modifiers") != NULL;
+  cache->images = g_hash_table_new_full (gst_egl_dmabuf_image_hash,
+      gst_egl_dmabuf_image_equal, (GDestroyNotify) gst_egl_dmabuf_image_free,
+      NULL);
+
+  return cache;
+}
+
+/**
+ * @brief: 销毁所有缓存的 EGLImage（caps 改变或者停止时调用）
+*/
+void
+gst_egl_dmabuf_cache_clear (GstEglDmabufCache * cache)
+{
+  if (!cache)
+    return;
+
+  g_mutex_lock (&cache->lock);
+  g_hash_table_remove_all (cache->images);
+  g_mutex_unlock (&cache->lock);
+}
+
+void
+gst_egl_dmabuf_cache_free (GstEglDmabufCache * cache)
+{
+  if (!cache)
+    return;
+
+  /* 还活着的内存只持有缓存的引用，释放时在表中找不到自己的 EGLImage */
+  gst_egl_dmabuf_cache_clear (cache);
+  gst_egl_dmabuf_cache_unref (cache);
+}
+
+/**
+ * @brief: 导入 @buffer 的第 @plane 个平面，缓存中已经有同一个 dmabuf 区域时直接返回
+ * @param info: 视频信息（没有 GstVideoMeta 时使用其中的偏移和 stride）
+ * @param modifier: DRM modifier（DRM_FORMAT_MOD_LINEAR 为 0）
+ * @return: EGLImage 属于缓存，调用者不能销毁；失败时返回 EGL_NO_IMAGE_KHR
+*/
+EGLImageKHR
+gst_egl_dmabuf_cache_import (GstEglDmabufCache * cache, GstBuffer * buffer,
+    const GstVideoInfo * info, guint64 modifier, guint plane)
+{
+  GstEglDmabufImage key, *img;
+  GstVideoMeta *vmeta;
+  GstMemory *mem;
+  gsize offset, skip;
+  guint idx, length, comp;
+  gint fd, pstride = 0;
+  EGLint attribs[19];
+  gint n = 0;
+
+  memset (&key, 0, sizeof (key));
+
+  vmeta = gst_buffer_get_video_meta (buffer);
+  if (vmeta) {
+    offset = vmeta->offset[plane];
+    key.stride = vmeta->stride[plane];
+  } else {
+    offset = GST_VIDEO_INFO_PLANE_OFFSET (info, plane);
+    key.stride = GST_VIDEO_INFO_PLANE_STRIDE (info, plane);
+  }
+
+  for (comp = 0; comp < GST_VIDEO_INFO_N_COMPONENTS (info); comp++) {
+    if (GST_VIDEO_INFO_COMP_PLANE (info, comp) == plane) {
+      pstride = GST_VIDEO_INFO_COMP_PSTRIDE (info, comp);
+      key.width = GST_VIDEO_INFO_COMP_WIDTH (info, comp);
+      key.height = GST_VIDEO_INFO_COMP_HEIGHT (info, comp);
+      break;
+    }
+  }
+  key.fourcc = gst_egl_dmabuf_plane_fourcc (info, pstride);
+  key.modifier = modifier;
+  if (!key.fourcc) {
+    GST_ERROR_OBJECT (cache->element, "Plane %u has no DRM format", plane);
+    return EGL_NO_IMAGE_KHR;
+  }
+
+  /* 平面所在的 memory（多个平面可以在同一个 dmabuf 的不同偏移） */
+  if (!gst_buffer_find_memory (buffer, offset, 1, &idx, &length, &skip)) {
+    GST_ERROR_OBJECT (cache->element, "No memory for plane %u", plane);
+    return EGL_NO_IMAGE_KHR;
+  }
+  mem = gst_buffer_peek_memory (buffer, idx);
+  if (!gst_is_dmabuf_memory (mem)) {
+    GST_ERROR_OBJECT (cache->element, "Plane %u is not in a dmabuf", plane);
+    return EGL_NO_IMAGE_KHR;
+  }
+  fd = gst_dmabuf_memory_get_fd (mem);
+  key.offset = mem->offset + skip;
+  key.mem = mem->parent ? mem->parent : mem;
+
+  g_mutex_lock (&cache->lock);
+  img = g_hash_table_lookup (cache->images, &key);
+  g_mutex_unlock (&cache->lock);
+  if (img)
+    return img->image;
+
+  if (modifier != GST_EGL_DRM_FORMAT_MOD_LINEAR && !cache->modifiers) {
+    GST_ERROR_OBJECT (cache->element, "Modifier 0x%016" G_GINT64_MODIFIER
+        "x needs EGL_EXT_image_dma_buf_import_modifiers", modifier);
+    return EGL_NO_IMAGE_KHR;
+  }
+
+  attribs[n++] = EGL_WIDTH;
+  attribs[n++] = key.width;
+  attribs[n++] = EGL_HEIGHT;
+  attribs[n++] = key.height;
+  attribs[n++] = EGL_LINUX_DRM_FOURCC_EXT;
+  attribs[n++] = key.fourcc;
+  attribs[n++] = EGL_DMA_BUF_PLANE0_FD_EXT;
+  attribs[n++] = fd;
+  attribs[n++] = EGL_DMA_BUF_PLANE0_OFFSET_EXT;
+  attribs[n++] = key.offset;
+  attribs[n++] = EGL_DMA_BUF_PLANE0_PITCH_EXT;
+  attribs[n++] = key.stride;
+  if (modifier != GST_EGL_DRM_FORMAT_MOD_LINEAR) {
+    attribs[n++] = EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT;
+    attribs[n++] = modifier & 0xffffffff;
+    attribs[n++] = EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT;
+    attribs[n++] = modifier >> 32;
+  }
+  attribs[n] = EGL_NONE;
+
+  img = g_slice_new (GstEglDmabufImage);
+  *img = key;
+  img->display = cache->display;
+  img->image = gst_egl_display_image_create (cache->display, EGL_NO_CONTEXT,
+      EGL_LINUX_DMA_BUF_EXT, NULL, attribs);
+  if (img->image == EGL_NO_IMAGE_KHR) {
+    GST_ERROR_OBJECT (cache->element, "Couldn't import plane %u (fd %d, "
+        "%dx%d, stride %d, offset %" G_GUINT64_FORMAT "): 0x%x", plane, fd,
+        key.width, key.height, key.stride, key.offset, eglGetError ());
+    g_slice_free (GstEglDmabufImage, img);
+    return EGL_NO_IMAGE_KHR;
+  }
+
+  g_mutex_lock (&cache->lock);
+  if (g_hash_table_size (cache->images) >= GST_EGL_DMABUF_CACHE_MAX) {
+    GST_DEBUG_OBJECT (cache->element, "Too many dmabufs, clearing the cache");
+    g_hash_table_remove_all (cache->images);
+  }
+  g_hash_table_add (cache->images, img);
+  GST_DEBUG_OBJECT (cache->element, "Imported plane %u of dmabuf memory %p "
+      "(%u cached)", plane, img->mem, g_hash_table_size (cache->images));
+  g_mutex_unlock (&cache->lock);
+
+  gst_egl_dmabuf_cache_watch_memory (cache, img->mem);
+
+  return img->image;
+}
+
+#endif
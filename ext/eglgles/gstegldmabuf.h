@@ -0,0 +1,66 @@
+/*
+ * GStreamer EGL/GLES Sink DMABuf import
+ * Copyright (c) 2015-2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __GST_EGL_DMABUF_H__
+#define __GST_EGL_DMABUF_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include "gstegladaptation.h"
+
+G_BEGIN_DECLS
+
+/*
+ * DMABuf 导入
+ *
+ * 每个平面单独导入成一个 EGLImage（EGL_EXT_image_dma_buf_import），DRM 格式按平面的
+ * 像素跨度选择（R8/GR88/BGR888/ABGR8888/RGB565），采样得到的分量顺序和
+ * glTexImage2D 上传原始字节时一样，所以可以直接使用系统内存路径的着色程序。
+ * 创建的 EGLImage 按 (GstMemory, 偏移, stride, 尺寸, 格式) 缓存，
+ * 缓冲池循环使用的buffer第二次出现时不再创建 EGLImage；内存释放时（可能在任何线程）
+ * 它的 EGLImage 被销毁。
+ */
+
+#ifndef HAVE_IOS
+/* 支持导入的 drm-format（linear）：RGBA/BGRA/ARGB/ABGR、RGBx/BGRx/xRGB/xBGR、
+ * RGB/BGR、RGB16、I420/YV12/Y42B/Y444、NV12/NV21 */
+#define GST_EGL_DMABUF_DRM_FORMATS "{ " \
+    "AB24, AR24, BA24, RA24, XB24, XR24, BX24, RX24, " \
+    "BG24, RG24, RG16, YU12, YV12, YU16, YU24, NV12, NV21 }"
+
+typedef struct _GstEglDmabufCache GstEglDmabufCache;
+
+gboolean gst_egl_dmabuf_import_supported (GstEGLDisplay * display);
+GstEglDmabufCache *gst_egl_dmabuf_cache_new (GstElement * element,
+    GstEGLDisplay * display);
+void gst_egl_dmabuf_cache_clear (GstEglDmabufCache * cache);
+void gst_egl_dmabuf_cache_free (GstEglDmabufCache * cache);
+EGLImageKHR gst_egl_dmabuf_cache_import (GstEglDmabufCache * cache,
+    GstBuffer * buffer, const GstVideoInfo * info, guint64 modifier,
+    guint plane);
+#endif
+
+G_END_DECLS
+
+#endif /* __GST_EGL_DMABUF_H__ */
@@ -0,0 +1,324 @@
+/*
+ * GStreamer EGL/GLES Sink CPU pre-downscale
+ * Copyright (c) 2015-2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstegldownscale.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_DOWNSCALE_AVX2 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#define HAVE_DOWNSCALE_NEON 1
+#include <arm_neon.h>
+#endif
+
+/**
+ * GstEglDownscaleRowFunc:
+ * 一行 2x2 box：@s0/@s1 是相邻的两行源数据，@d 输出 @width 个像素，
+ * 每个像素 @pstride 个字节（每个字节单独平均，分量的顺序不影响结果）
+ */
+typedef void (*GstEglDownscaleRowFunc) (const guint8 * s0, const guint8 * s1,
+    guint8 * d, gint width, gint pstride);
+
+static void
+downscale_row_c (const guint8 * s0, const guint8 * s1, guint8 * d, gint width,
+    gint pstride)
+{
+  gint x, c;
+
+  for (x = 0; x < width; x++) {
+    for (c = 0; c < pstride; c++) {
+      gint i = 2 * x * pstride + c;
+
+      d[x * pstride + c] =
+          (s0[i] + s0[i + pstride] + s1[i] + s1[i + pstride] + 2) >> 2;
+    }
+  }
+}
+
+#ifdef HAVE_DOWNSCALE_AVX2
+/**
+ * @brief: 每次处理 32 个源字节（16 个输出字节）；pstride 为 2/4 时先在128位通道内重排，
+ *         让相邻两个像素的同一个分量挨在一起，然后和 pstride 1 一样两两相加
+ * @note: pstride 3（RGB）不是 16 的约数，使用C实现
+*/
+__attribute__ ((target ("avx2")))
+static void
+downscale_row_avx2 (const guint8 * s0, const guint8 * s1, guint8 * d,
+    gint width, gint pstride)
+{
+  const __m256i ones = _mm256_set1_epi8 (1);
+  const __m256i two = _mm256_set1_epi16 (2);
+  __m256i shuffle;
+  gint n = width * pstride;
+  gint i = 0;
+
+  if (pstride == 2)
+    shuffle = _mm256_setr_epi8 (0, 2, 1, 3, 4, 6, 5, 7, 8, 10, 9, 11, 12, 14,
+        13, 15, 0, 2, 1, 3, 4, 6, 5, 7, 8, 10, 9, 11, 12, 14, 13, 15);
+  else if (pstride == 4)
+    shuffle = _mm256_setr_epi8 (0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14,
+        11, 15, 0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+  else if (pstride == 1)
+    shuffle = _mm256_setr_epi8 (0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13,
+        14, 15, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  else {
+    downscale_row_c (s0, s1, d, width, pstride);
+    return;
+  }
+
+  for (; i + 16 <= n; i += 16) {
+    __m256i a = _mm256_loadu_si256 ((const __m256i *) (s0 + 2 * i));
+    __m256i b = _mm256_loadu_si256 ((const __m256i *) (s1 + 2 * i));
+    __m256i sum;
+
+    a = _mm256_shuffle_epi8 (a, shuffle);
+    b = _mm256_shuffle_epi8 (b, shuffle);
+    sum = _mm256_add_epi16 (_mm256_maddubs_epi16 (a, ones),
+        _mm256_maddubs_epi16 (b, ones));
+    sum = _mm256_srli_epi16 (_mm256_add_epi16 (sum, two), 2);
+    /* packus 在每个128位通道内打包，再把两个通道的低64位合并 */
+    sum = _mm256_permute4x64_epi64 (_mm256_packus_epi16 (sum, sum), 0xd8);
+    _mm_storeu_si128 ((__m128i *) (d + i), _mm256_castsi256_si128 (sum));
+  }
+
+  if (i < n)
+    downscale_row_c (s0 + 2 * i, s1 + 2 * i, d + i, (n - i) / pstride,
+        pstride);
+}
+#endif
+
+#ifdef HAVE_DOWNSCALE_NEON
+/**
+ * @brief: 每次输出 8 个像素；vldN 把分量分开，每个分量两两相加之后用 vstN 交错写回
+*/
+static void
+downscale_row_neon (const guint8 * s0, const guint8 * s1, guint8 * d,
+    gint width, gint pstride)
+{
+  gint x = 0;
+
+#define DOWNSCALE_NEON_COMP(va, vb) \
+  vrshrn_n_u16 (vpadalq_u8 (vpaddlq_u8 (va), vb), 2)
+
+  switch (pstride) {
+    case 1:
+      for (; x + 8 <= width; x += 8) {
+        uint8x16_t a = vld1q_u8 (s0 + 2 * x);
+        uint8x16_t b = vld1q_u8 (s1 + 2 * x);
+
+        vst1_u8 (d + x, DOWNSCALE_NEON_COMP (a, b));
+      }
+      break;
+    case 2:
+      for (; x + 8 <= width; x += 8) {
+        uint8x16x2_t a = vld2q_u8 (s0 + 4 * x);
+        uint8x16x2_t b = vld2q_u8 (s1 + 4 * x);
+        uint8x8x2_t r;
+
+        r.val[0] = DOWNSCALE_NEON_COMP (a.val[0], b.val[0]);
+        r.val[1] = DOWNSCALE_NEON_COMP (a.val[1], b.val[1]);
+        vst2_u8 (d + 2 * x, r);
+      }
+      break;
+    case 3:
+      for (; x + 8 <= width; x += 8) {
+        uint8x16x3_t a = vld3q_u8 (s0 + 6 * x);
+        uint8x16x3_t b = vld3q_u8 (s1 + 6 * x);
+        uint8x8x3_t r;
+
+        r.val[0] = DOWNSCALE_NEON_COMP (a.val[0], b.val[0]);
+        r.val[1] = DOWNSCALE_NEON_COMP (a.val[1], b.val[1]);
+        r.val[2] = DOWNSCALE_NEON_COMP (a.val[2], b.val[2]);
+        vst3_u8 (d + 3 * x, r);
+      }
+      break;
+    case 4:
+      for (; x + 8 <= width; x += 8) {
+        uint8x16x4_t a = vld4q_u8 (s0 + 8 * x);
+        uint8x16x4_t b = vld4q_u8 (s1 + 8 * x);
+        uint8x8x4_t r;
+
+        r.val[0] = DOWNSCALE_NEON_COMP (a.val[0], b.val[0]);
+        r.val[1] = DOWNSCALE_NEON_COMP (a.val[1], b.val[1]);
+        r.val[2] = DOWNSCALE_NEON_COMP (a.val[2], b.val[2]);
+        r.val[3] = DOWNSCALE_NEON_COMP (a.val[3], b.val[3]);
+        vst4_u8 (d + 4 * x, r);
+      }
+      break;
+    default:
+      break;
+  }
+
+#undef DOWNSCALE_NEON_COMP
+
+  if (x < width)
+    downscale_row_c (s0 + 2 * x * pstride, s1 + 2 * x * pstride,
+        d + x * pstride, width - x, pstride);
+}
+#endif
+
+/**
+ * @brief: 选择当前CPU可用的实现（只选择一次）
+*/
+static GstEglDownscaleRowFunc
+downscale_get_row_func (void)
+{
+  static gsize func = 0;
+
+  if (g_once_init_enter (&func)) {
+    GstEglDownscaleRowFunc f = downscale_row_c;
+
+#if defined(HAVE_DOWNSCALE_AVX2)
+    if (__builtin_cpu_supports ("avx2"))
+      f = downscale_row_avx2;
+#elif defined(HAVE_DOWNSCALE_NEON)
+    f = downscale_row_neon;
+#endif
+    g_once_init_leave (&func, (gsize) f);
+  }
+
+  return (GstEglDownscaleRowFunc) func;
+}
+
+/**
+ * @brief: 每个分量8位、分量按字节存放的格式（RGB16 的分量不是按字节存放）
+*/
+gboolean
+gst_egl_downscale_supported (GstVideoFormat format)
+{
+  switch (format) {
+    case GST_VIDEO_FORMAT_RGB:
+    case GST_VIDEO_FORMAT_BGR:
+    case GST_VIDEO_FORMAT_RGBA:
+    case GST_VIDEO_FORMAT_BGRA:
+    case GST_VIDEO_FORMAT_ARGB:
+    case GST_VIDEO_FORMAT_ABGR:
+    case GST_VIDEO_FORMAT_RGBx:
+    case GST_VIDEO_FORMAT_BGRx:
+    case GST_VIDEO_FORMAT_xRGB:
+    case GST_VIDEO_FORMAT_xBGR:
+    case GST_VIDEO_FORMAT_AYUV:
+    case GST_VIDEO_FORMAT_Y444:
+    case GST_VIDEO_FORMAT_I420:
+    case GST_VIDEO_FORMAT_YV12:
+    case GST_VIDEO_FORMAT_Y42B:
+    case GST_VIDEO_FORMAT_Y41B:
+    case GST_VIDEO_FORMAT_NV12:
+    case GST_VIDEO_FORMAT_NV21:
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+/**
+ * @brief: 缩小 @factor 倍之后的视频信息：宽向下取整到 4（Y41B 的色度是 1/4 宽），高取整到 2，
+ *         源尺寸不是整倍数时丢掉右/下边缘不足一个块的像素
+*/
+void
+gst_egl_downscale_info (const GstVideoInfo * info, gint factor,
+    GstVideoInfo * out)
+{
+  gint width = GST_VIDEO_INFO_WIDTH (info) / (4 * factor) * 4;
+  gint height = GST_VIDEO_INFO_HEIGHT (info) / (2 * factor) * 2;
+
+  gst_video_info_set_format (out, GST_VIDEO_INFO_FORMAT (info),
+      MAX (width, 4), MAX (height, 2));
+}
+
+/**
+ * @brief: 每个平面做 @factor x @factor box 缩小（2 的幂，每一级 2x2），
+ *         @dst 的尺寸由 gst_egl_downscale_info() 计算
+*/
+gboolean
+gst_egl_downscale_frame (const GstVideoFrame * src, GstVideoFrame * dst,
+    gint factor)
+{
+  GstEglDownscaleRowFunc row_func = downscale_get_row_func ();
+  guint plane, comp;
+  guint8 *tmp = NULL;
+  gsize tmp_size = 0;
+
+  g_return_val_if_fail (factor >= 2
+      && factor <= GST_EGL_DOWNSCALE_MAX_FACTOR
+      && (factor & (factor - 1)) == 0, FALSE);
+
+  for (plane = 0; plane < GST_VIDEO_FRAME_N_PLANES (dst); plane++) {
+    const guint8 *in;
+    gint in_stride, pstride = 0, width = 0, height = 0, level, y;
+
+    /* 找到这个平面的第一个分量，得到像素跨度和平面尺寸 */
+    for (comp = 0; comp < GST_VIDEO_FRAME_N_COMPONENTS (dst); comp++) {
+      if (GST_VIDEO_FRAME_COMP_PLANE (dst, comp) == plane) {
+        pstride = GST_VIDEO_FRAME_COMP_PSTRIDE (dst, comp);
+        width = GST_VIDEO_FRAME_COMP_WIDTH (dst, comp);
+        height = GST_VIDEO_FRAME_COMP_HEIGHT (dst, comp);
+        break;
+      }
+    }
+    if (!pstride)
+      return FALSE;
+
+    in = GST_VIDEO_FRAME_PLANE_DATA (src, plane);
+    in_stride = GST_VIDEO_FRAME_PLANE_STRIDE (src, plane);
+
+    /* 最后一级直接写到 @dst，前面的级写到临时缓冲 */
+    for (level = factor / 2; level >= 1; level /= 2) {
+      gint out_w = width * level, out_h = height * level;
+      gint out_stride;
+      guint8 *out;
+
+      if (level == 1) {
+        out = GST_VIDEO_FRAME_PLANE_DATA (dst, plane);
+        out_stride = GST_VIDEO_FRAME_PLANE_STRIDE (dst, plane);
+      } else {
+        /* 两级交替使用临时缓冲的前后两半 */
+        gsize half = (gsize) width * (factor / 2) * pstride * height *
+            (factor / 2);
+
+        if (tmp_size < 2 * half) {
+          g_free (tmp);
+          tmp_size = 2 * half;
+          tmp = g_malloc (tmp_size);
+        }
+        out_stride = out_w * pstride;
+        out = (in >= tmp && in < tmp + half) ? tmp + half : tmp;
+      }
+
+      for (y = 0; y < out_h; y++)
+        row_func (in + 2 * y * in_stride, in + (2 * y + 1) * in_stride,
+            out + y * out_stride, out_w, pstride);
+
+      in = out;
+      in_stride = out_stride;
+    }
+  }
+
+  g_free (tmp);
+
+  return TRUE;
+}
@@ -0,0 +1,42 @@
+/*
+ * GStreamer EGL/GLES Sink CPU pre-downscale
+ * Copyright (c) 2015-2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __GST_EGL_DOWNSCALE_H__
+#define __GST_EGL_DOWNSCALE_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+/* 最大的缩小倍数（2 的幂，每一级 2x2 box） */
+#define GST_EGL_DOWNSCALE_MAX_FACTOR 8
+
+gboolean gst_egl_downscale_supported (GstVideoFormat format);
+void gst_egl_downscale_info (const GstVideoInfo * info, gint factor,
+    GstVideoInfo * out);
+gboolean gst_egl_downscale_frame (const GstVideoFrame * src,
+    GstVideoFrame * dst, gint factor);
+
+G_END_DECLS
+#endif /* __GST_EGL_DOWNSCALE_H__ */
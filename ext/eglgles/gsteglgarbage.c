@@ -0,0 +1,211 @@
+/*
+ * GStreamer EGL/GLES Sink deferred GL object destruction
+ * Copyright (c) 2015-2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "gsteglgarbage.h"
+#include "gstegladaptation.h"
+
+#define GST_CAT_DEFAULT egladaption_debug
+
+typedef struct _GstEglGarbageItem GstEglGarbageItem;
+
+struct _GstEglGarbageItem
+{
+  GstEglGarbageItem *next;
+  GstEglGarbageType type;
+  guint epoch;
+  GLuint name;
+};
+
+/*
+ * 队列由 sink（GstEglAdaptationContext）和每个还持有 GL 对象的内存共同引用，
+ * 内存可能在 sink 释放之后才释放
+ */
+struct _GstEglGarbage
+{
+  gint ref_count;
+  GstElement *element; /* 用于日志 */
+  gpointer head; /* GstEglGarbageItem 单链表（无锁栈），任何线程压入 */
+
+  /* 只在渲染线程访问 */
+  guint epoch; /* 当前上下文的代数 */
+  gpointer share_context; /* 当前上下文的共享上下文，NULL 表示没有共享 */
+};
+
+/**
+ * @brief: 取出队列中的所有项（任何线程压入的和渲染线程取出的可以同时进行）
+*/
+static GstEglGarbageItem *
+gst_egl_garbage_steal (GstEglGarbage * garbage)
+{
+  gpointer head;
+
+  do {
+    head = g_atomic_pointer_get (&garbage->head);
+  } while (head
+      && !g_atomic_pointer_compare_and_exchange (&garbage->head, head, NULL));
+
+  return head;
+}
+
+static void
+gst_egl_garbage_free_items (GstEglGarbageItem * item)
+{
+  GstEglGarbageItem *next;
+
+  for (; item; item = next) {
+    next = item->next;
+    g_slice_free (GstEglGarbageItem, item);
+  }
+}
+
+GstEglGarbage *
+gst_egl_garbage_new (GstElement * element)
+{
+  GstEglGarbage *garbage;
+
+  garbage = g_slice_new0 (GstEglGarbage);
+  garbage->ref_count = 1;
+  garbage->element = element;
+
+  return garbage;
+}
+
+GstEglGarbage *
+gst_egl_garbage_ref (GstEglGarbage * garbage)
+{
+  g_atomic_int_inc (&garbage->ref_count);
+  return garbage;
+}
+
+/**
+ * @brief: 最后一个引用释放时 sink 已经销毁了上下文，剩下的项只释放内存
+ * @note: 共享上下文时，最后一个上下文销毁之后压入的对象还在共享组中，无法再删除，
+ *        这里统计并警告（sink 可能已经销毁，不使用 element 记录日志）
+*/
+void
+gst_egl_garbage_unref (GstEglGarbage * garbage)
+{
+  GstEglGarbageItem *items, *item;
+  guint n_leaked = 0;
+
+  if (!g_atomic_int_dec_and_test (&garbage->ref_count))
+    return;
+
+  items = gst_egl_garbage_steal (garbage);
+  for (item = items; item; item = item->next) {
+    if (garbage->share_context && item->epoch == garbage->epoch)
+      n_leaked++;
+  }
+  if (n_leaked > 0)
+    GST_WARNING ("%u GL objects were released after the last context was "
+        "destroyed and are leaked in the share group", n_leaked);
+
+  gst_egl_garbage_free_items (items);
+  g_slice_free (GstEglGarbage, garbage);
+}
+
+/**
+ * @brief: 渲染线程创建上下文之后调用，@share_context 为创建上下文时使用的共享上下文
+*/
+void
+gst_egl_garbage_attach (GstEglGarbage * garbage, gpointer share_context)
+{
+  if (!share_context || share_context != garbage->share_context)
+    garbage->epoch++;
+  garbage->share_context = share_context;
+}
+
+/**
+ * @brief: 当前上下文的代数（渲染线程创建 GL 对象时调用，释放时传给 gst_egl_garbage_push）
+*/
+guint
+gst_egl_garbage_get_epoch (GstEglGarbage * garbage)
+{
+  return garbage->epoch;
+}
+
+/**
+ * @brief: 把 GL 对象加入删除队列（任何线程，不需要当前上下文，不加锁）
+*/
+void
+gst_egl_garbage_push (GstEglGarbage * garbage, guint epoch,
+    GstEglGarbageType type, guint name)
+{
+  GstEglGarbageItem *item;
+
+  if (!name)
+    return;
+
+  item = g_slice_new (GstEglGarbageItem);
+  item->type = type;
+  item->epoch = epoch;
+  item->name = name;
+
+  do {
+    item->next = g_atomic_pointer_get (&garbage->head);
+  } while (!g_atomic_pointer_compare_and_exchange (&garbage->head,
+          item->next, item));
+}
+
+/**
+ * @brief: 删除队列中当前上下文的 GL 对象（渲染线程，上下文为当前上下文时调用），
+ *         旧上下文的项直接丢弃
+ * @return: 删除的对象个数
+*/
+guint
+gst_egl_garbage_drain (GstEglGarbage * garbage)
+{
+  GstEglGarbageItem *items, *item;
+  guint n_deleted = 0, n_dropped = 0;
+
+  items = gst_egl_garbage_steal (garbage);
+  if (!items)
+    return 0;
+
+  for (item = items; item; item = item->next) {
+    if (item->epoch != garbage->epoch) {
+      n_dropped++;
+      continue;
+    }
+
+    switch (item->type) {
+      case GST_EGL_GARBAGE_TEXTURE:
+        glDeleteTextures (1, &item->name);
+        break;
+      case GST_EGL_GARBAGE_BUFFER:
+        glDeleteBuffers (1, &item->name);
+        break;
+      case GST_EGL_GARBAGE_FRAMEBUFFER:
+        glDeleteFramebuffers (1, &item->name);
+        break;
+    }
+    n_deleted++;
+  }
+  gst_egl_garbage_free_items (items);
+
+  GST_LOG_OBJECT (garbage->element, "Deleted %u GL objects, dropped %u from "
+      "destroyed contexts", n_deleted, n_dropped);
+
+  return n_deleted;
+}
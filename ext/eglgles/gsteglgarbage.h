@@ -0,0 +1,64 @@
+/*
+ * GStreamer EGL/GLES Sink deferred GL object destruction
+ * Copyright (c) 2015-2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef __GST_EGL_GARBAGE_H__
+#define __GST_EGL_GARBAGE_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/*
+ * GL 对象延迟删除
+ *
+ * 持有纹理等 GL 对象的 GstMemory 可能在任何线程（streaming 线程、应用线程）释放，
+ * 这些线程不能把渲染线程的上下文设置为当前上下文。释放时只把对象压入无锁的删除队列，
+ * 渲染线程每帧在安全的位置（gst_egl_garbage_drain）统一删除。
+ *
+ * 每个对象记录创建时的上下文代数（epoch）：和 UI 共享上下文时所有上下文属于同一个
+ * 共享组，代数不变；没有共享上下文时每次创建上下文代数加一，旧上下文中的对象随上下文
+ * 一起销毁，队列中的对应项直接丢弃（同名对象可能已经属于新上下文）。
+ */
+
+typedef enum
+{
+  GST_EGL_GARBAGE_TEXTURE,
+  GST_EGL_GARBAGE_BUFFER,
+  GST_EGL_GARBAGE_FRAMEBUFFER
+} GstEglGarbageType;
+
+typedef struct _GstEglGarbage GstEglGarbage;
+
+GstEglGarbage *gst_egl_garbage_new (GstElement * element);
+GstEglGarbage *gst_egl_garbage_ref (GstEglGarbage * garbage);
+void gst_egl_garbage_unref (GstEglGarbage * garbage);
+void gst_egl_garbage_attach (GstEglGarbage * garbage, gpointer share_context);
+guint gst_egl_garbage_get_epoch (GstEglGarbage * garbage);
+void gst_egl_garbage_push (GstEglGarbage * garbage, guint epoch,
+    GstEglGarbageType type, guint name);
+guint gst_egl_garbage_drain (GstEglGarbage * garbage);
+
+G_END_DECLS
+
+#endif /* __GST_EGL_GARBAGE_H__ */
@@ -0,0 +1,1479 @@
+/*
+ * GStreamer EGL/GLES compositor
+ * Copyright (c) 2015-2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * SECTION:element-nveglglescompositor
+ *
+ * The compositor variant of nveglglessink. Every sink_%u request pad is one
+ * input of a video wall. All inputs share one EGL context, one render thread
+ * and one set of shader programs. The single context is created in the
+ * egl-share-context share group.
+ *
+ * <refsect2>
+ * <title>Composition</title>
+ * <para>
+ * Input pads only keep their newest frame. framerate times per second the
+ * render thread uploads the inputs that have a new frame. It then draws every
+ * input into egl-share-texture, sorted by zorder, and emits ui-render. Nothing
+ * is drawn in a period where no input has a new frame and no layout property
+ * changed. The output texture is allocated at output-width x output-height and
+ * uses GL texture coordinates (origin at the bottom left). Each input is placed
+ * at xpos, ypos (pixels from the top left corner of the output), scaled to
+ * width x height (0 keeps the video size), and blended with alpha.
+ * </para>
+ * <para>
+ * With sync (the default) each input waits for the running time of its
+ * buffers like a sink, and holds its frames while the element is PAUSED.
+ * The element is flagged as a sink and posts EOS once every input has
+ * received EOS.
+ * </para>
+ * </refsect2>
+ *
+ * <refsect2>
+ * <title>Example</title>
+ * |[
+ * nveglglescompositor name=wall sink_0::xpos=0 sink_1::xpos=960
+ *     videotestsrc ! video/x-raw,width=960,height=540 ! wall.sink_0
+ *     videotestsrc pattern=ball ! video/x-raw,format=NV12 ! wall.sink_1
+ * ]| The egl-* properties have to be set by the application that owns the UI
+ * context.
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "gsteglglescompositor.h"
+
+#ifndef HAVE_IOS
+
+GST_DEBUG_CATEGORY_STATIC (gst_eglglescompositor_debug);
+#define GST_CAT_DEFAULT gst_eglglescompositor_debug
+
+#define DEFAULT_PAD_XPOS 0
+#define DEFAULT_PAD_YPOS 0
+#define DEFAULT_PAD_WIDTH 0
+#define DEFAULT_PAD_HEIGHT 0
+#define DEFAULT_PAD_ZORDER 0
+#define DEFAULT_PAD_ALPHA 1.0
+
+#define DEFAULT_OUTPUT_WIDTH 1920
+#define DEFAULT_OUTPUT_HEIGHT 1080
+#define DEFAULT_FPS_N 30
+#define DEFAULT_FPS_D 1
+#define DEFAULT_SYNC TRUE
+
+/* 只支持每个分量8位、平面像素跨度等于分量个数的格式（上传时不需要转换） */
+static GstStaticPadTemplate gst_eglglescompositor_sink_template =
+    GST_STATIC_PAD_TEMPLATE ("sink_%u",
+    GST_PAD_SINK,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("{ "
+            "RGBA, BGRA, ARGB, ABGR, " "RGBx, BGRx, xRGB, xBGR, "
+            "AYUV, Y444, I420, YV12, " "NV12, NV21, Y42B, Y41B }")));
+
+enum
+{
+  UI_RENDER,
+  LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL] = { 0 };
+
+enum
+{
+  PROP_PAD_0,
+  PROP_PAD_XPOS,
+  PROP_PAD_YPOS,
+  PROP_PAD_WIDTH,
+  PROP_PAD_HEIGHT,
+  PROP_PAD_ZORDER,
+  PROP_PAD_ALPHA
+};
+
+enum
+{
+  PROP_0,
+  PROP_EGL_DISPLAY,
+  PROP_EGL_CONFIG,
+  PROP_EGL_SHARE_CONTEXT,
+  PROP_EGL_SHARE_TEXTURE,
+  PROP_OUTPUT_WIDTH,
+  PROP_OUTPUT_HEIGHT,
+  PROP_FRAMERATE,
+  PROP_SYNC,
+  PROP_PROGRAM_CACHE_DIR
+};
+
+/**
+ * GstEglCompositorProgram:
+ * 一种视频格式的转换程序（所有这种格式的输入共用）
+ */
+typedef struct
+{
+  GLuint prog;
+  gint n_textures;
+  GLint position_loc; /* attribute vec3 position */
+  GLint texpos_loc; /* attribute vec2 texpos */
+  GLint transform_loc; /* uniform mat4 u_transformation */
+  GLint tex_loc[3]; /* uniform sampler2D tex0..tex2 */
+  GLint tex_scale_loc[3]; /* uniform vec2 tex_scale0..tex_scale2 */
+} GstEglCompositorProgram;
+
+G_DEFINE_TYPE (GstEglGlesCompositorPad, gst_eglglescompositor_pad,
+    GST_TYPE_PAD);
+
+#define gst_eglglescompositor_parent_class parent_class
+G_DEFINE_TYPE (GstEglGlesCompositor, gst_eglglescompositor,
+    GST_TYPE_ELEMENT);
+
+/**
+ * @brief: 布局改变，下一个周期重新合成
+*/
+static void
+gst_eglglescompositor_mark_dirty (GstEglGlesCompositor * self)
+{
+  g_mutex_lock (&self->lock);
+  self->dirty = TRUE;
+  g_mutex_unlock (&self->lock);
+}
+
+static void
+gst_eglglescompositor_pad_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstEglGlesCompositorPad *cpad = GST_EGLGLESCOMPOSITOR_PAD (object);
+  GstElement *parent;
+
+  GST_OBJECT_LOCK (cpad);
+  switch (prop_id) {
+    case PROP_PAD_XPOS:
+      cpad->xpos = g_value_get_int (value);
+      break;
+    case PROP_PAD_YPOS:
+      cpad->ypos = g_value_get_int (value);
+      break;
+    case PROP_PAD_WIDTH:
+      cpad->width = g_value_get_int (value);
+      break;
+    case PROP_PAD_HEIGHT:
+      cpad->height = g_value_get_int (value);
+      break;
+    case PROP_PAD_ZORDER:
+      cpad->zorder = g_value_get_uint (value);
+      break;
+    case PROP_PAD_ALPHA:
+      cpad->alpha = g_value_get_double (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (cpad);
+
+  parent = gst_pad_get_parent_element (GST_PAD (cpad));
+  if (parent) {
+    gst_eglglescompositor_mark_dirty (GST_EGLGLESCOMPOSITOR (parent));
+    gst_object_unref (parent);
+  }
+}
+
+static void
+gst_eglglescompositor_pad_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstEglGlesCompositorPad *cpad = GST_EGLGLESCOMPOSITOR_PAD (object);
+
+  GST_OBJECT_LOCK (cpad);
+  switch (prop_id) {
+    case PROP_PAD_XPOS:
+      g_value_set_int (value, cpad->xpos);
+      break;
+    case PROP_PAD_YPOS:
+      g_value_set_int (value, cpad->ypos);
+      break;
+    case PROP_PAD_WIDTH:
+      g_value_set_int (value, cpad->width);
+      break;
+    case PROP_PAD_HEIGHT:
+      g_value_set_int (value, cpad->height);
+      break;
+    case PROP_PAD_ZORDER:
+      g_value_set_uint (value, cpad->zorder);
+      break;
+    case PROP_PAD_ALPHA:
+      g_value_set_double (value, cpad->alpha);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (cpad);
+}
+
+static void
+gst_eglglescompositor_pad_finalize (GObject * object)
+{
+  GstEglGlesCompositorPad *cpad = GST_EGLGLESCOMPOSITOR_PAD (object);
+
+  gst_buffer_replace (&cpad->pending, NULL);
+
+  G_OBJECT_CLASS (gst_eglglescompositor_pad_parent_class)->finalize (object);
+}
+
+static void
+gst_eglglescompositor_pad_class_init (GstEglGlesCompositorPadClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+
+  gobject_class->set_property = gst_eglglescompositor_pad_set_property;
+  gobject_class->get_property = gst_eglglescompositor_pad_get_property;
+  gobject_class->finalize = gst_eglglescompositor_pad_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_PAD_XPOS,
+      g_param_spec_int ("xpos", "X position",
+          "X position of the input in the output, in pixels",
+          G_MININT, G_MAXINT, DEFAULT_PAD_XPOS,
+          G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE |
+          G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PAD_YPOS,
+      g_param_spec_int ("ypos", "Y position",
+          "Y position of the input in the output, in pixels from the top",
+          G_MININT, G_MAXINT, DEFAULT_PAD_YPOS,
+          G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE |
+          G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PAD_WIDTH,
+      g_param_spec_int ("width", "Width",
+          "Width of the input in the output (0 = video width)",
+          0, G_MAXINT, DEFAULT_PAD_WIDTH,
+          G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE |
+          G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PAD_HEIGHT,
+      g_param_spec_int ("height", "Height",
+          "Height of the input in the output (0 = video height)",
+          0, G_MAXINT, DEFAULT_PAD_HEIGHT,
+          G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE |
+          G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PAD_ZORDER,
+      g_param_spec_uint ("zorder", "Z-Order",
+          "Z order of the input, higher values are drawn on top",
+          0, G_MAXUINT, DEFAULT_PAD_ZORDER,
+          G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE |
+          G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PAD_ALPHA,
+      g_param_spec_double ("alpha", "Alpha", "Alpha of the input",
+          0.0, 1.0, DEFAULT_PAD_ALPHA,
+          G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE |
+          G_PARAM_STATIC_STRINGS));
+}
+
+static void
+gst_eglglescompositor_pad_init (GstEglGlesCompositorPad * cpad)
+{
+  cpad->xpos = DEFAULT_PAD_XPOS;
+  cpad->ypos = DEFAULT_PAD_YPOS;
+  cpad->width = DEFAULT_PAD_WIDTH;
+  cpad->height = DEFAULT_PAD_HEIGHT;
+  cpad->zorder = DEFAULT_PAD_ZORDER;
+  cpad->alpha = DEFAULT_PAD_ALPHA;
+  cpad->format = GST_VIDEO_FORMAT_UNKNOWN;
+  gst_video_info_init (&cpad->info);
+  gst_segment_init (&cpad->segment, GST_FORMAT_TIME);
+}
+
+/**
+ * @brief: 同步时等到 @buf 的 running time；PAUSED 中先等到 PLAYING
+ * @return: FALSE 表示 flushing（或者元素正在停止），需要丢弃 @buf
+*/
+static gboolean
+gst_eglglescompositor_pad_wait (GstEglGlesCompositor * self,
+    GstEglGlesCompositorPad * cpad, GstBuffer * buf)
+{
+  GstClockTime running_time;
+  GstClockReturn ret;
+  GstClockID id;
+  GstClock *clock;
+
+  g_mutex_lock (&self->lock);
+  while (!self->playing && !cpad->flushing && self->running)
+    g_cond_wait (&self->cond, &self->lock);
+  if (cpad->flushing || !self->running) {
+    g_mutex_unlock (&self->lock);
+    return FALSE;
+  }
+  g_mutex_unlock (&self->lock);
+
+  running_time = gst_segment_to_running_time (&cpad->segment, GST_FORMAT_TIME,
+      GST_BUFFER_PTS (buf));
+  clock = gst_element_get_clock (GST_ELEMENT (self));
+  if (!clock || !GST_CLOCK_TIME_IS_VALID (running_time)) {
+    if (clock)
+      gst_object_unref (clock);
+    return TRUE;
+  }
+
+  id = gst_clock_new_single_shot_id (clock,
+      gst_element_get_base_time (GST_ELEMENT (self)) + running_time);
+  gst_object_unref (clock);
+
+  g_mutex_lock (&self->lock);
+  if (cpad->flushing || !self->running) {
+    g_mutex_unlock (&self->lock);
+    gst_clock_id_unref (id);
+    return FALSE;
+  }
+  cpad->clock_id = id;
+  g_mutex_unlock (&self->lock);
+
+  ret = gst_clock_id_wait (id, NULL);
+
+  g_mutex_lock (&self->lock);
+  cpad->clock_id = NULL;
+  g_mutex_unlock (&self->lock);
+  gst_clock_id_unref (id);
+
+  return ret != GST_CLOCK_UNSCHEDULED;
+}
+
+/**
+ * @brief: 只保存最新的一帧，由渲染线程在下一个周期上传
+*/
+static GstFlowReturn
+gst_eglglescompositor_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
+{
+  GstEglGlesCompositor *self = GST_EGLGLESCOMPOSITOR (parent);
+  GstEglGlesCompositorPad *cpad = GST_EGLGLESCOMPOSITOR_PAD (pad);
+
+  if (self->sync && !gst_eglglescompositor_pad_wait (self, cpad, buf)) {
+    gst_buffer_unref (buf);
+    return GST_FLOW_FLUSHING;
+  }
+
+  g_mutex_lock (&self->lock);
+  if (cpad->flushing) {
+    g_mutex_unlock (&self->lock);
+    gst_buffer_unref (buf);
+    return GST_FLOW_FLUSHING;
+  }
+  if (GST_VIDEO_INFO_FORMAT (&cpad->info) == GST_VIDEO_FORMAT_UNKNOWN) {
+    g_mutex_unlock (&self->lock);
+    gst_buffer_unref (buf);
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+  if (cpad->pending)
+    GST_LOG_OBJECT (cpad, "Dropping a frame that was never composited");
+  gst_buffer_replace (&cpad->pending, buf);
+  cpad->pending_info = cpad->info;
+  g_mutex_unlock (&self->lock);
+
+  gst_buffer_unref (buf);
+
+  return GST_FLOW_OK;
+}
+
+/**
+ * @brief: 所有输入都收到 EOS 之后发送 EOS 消息
+*/
+static void
+gst_eglglescompositor_check_eos (GstEglGlesCompositor * self)
+{
+  gboolean all_eos = TRUE;
+  GList *l;
+
+  GST_OBJECT_LOCK (self);
+  g_mutex_lock (&self->lock);
+  for (l = GST_ELEMENT (self)->sinkpads; l; l = l->next)
+    all_eos &= GST_EGLGLESCOMPOSITOR_PAD (l->data)->eos;
+  if (all_eos && self->eos_posted)
+    all_eos = FALSE;
+  else if (all_eos)
+    self->eos_posted = TRUE;
+  g_mutex_unlock (&self->lock);
+  GST_OBJECT_UNLOCK (self);
+
+  if (all_eos) {
+    GST_DEBUG_OBJECT (self, "All inputs are EOS");
+    gst_element_post_message (GST_ELEMENT (self),
+        gst_message_new_eos (GST_OBJECT (self)));
+  }
+}
+
+static gboolean
+gst_eglglescompositor_sink_event (GstPad * pad, GstObject * parent,
+    GstEvent * event)
+{
+  GstEglGlesCompositor *self = GST_EGLGLESCOMPOSITOR (parent);
+  GstEglGlesCompositorPad *cpad = GST_EGLGLESCOMPOSITOR_PAD (pad);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CAPS:{
+      GstVideoInfo info;
+      GstCaps *caps;
+
+      gst_event_parse_caps (event, &caps);
+      if (!gst_video_info_from_caps (&info, caps)) {
+        GST_ERROR_OBJECT (cpad, "Couldn't parse caps %" GST_PTR_FORMAT, caps);
+        gst_event_unref (event);
+        return FALSE;
+      }
+      g_mutex_lock (&self->lock);
+      cpad->info = info;
+      g_mutex_unlock (&self->lock);
+      break;
+    }
+    case GST_EVENT_SEGMENT:{
+      const GstSegment *segment;
+
+      gst_event_parse_segment (event, &segment);
+      if (segment->format != GST_FORMAT_TIME) {
+        GST_ERROR_OBJECT (cpad, "Only TIME segments are supported");
+        gst_event_unref (event);
+        return FALSE;
+      }
+      gst_segment_copy_into (segment, &cpad->segment);
+      break;
+    }
+    case GST_EVENT_FLUSH_START:
+      g_mutex_lock (&self->lock);
+      cpad->flushing = TRUE;
+      if (cpad->clock_id)
+        gst_clock_id_unschedule (cpad->clock_id);
+      gst_buffer_replace (&cpad->pending, NULL);
+      g_cond_broadcast (&self->cond);
+      g_mutex_unlock (&self->lock);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      gst_segment_init (&cpad->segment, GST_FORMAT_TIME);
+      g_mutex_lock (&self->lock);
+      cpad->flushing = FALSE;
+      cpad->eos = FALSE;
+      self->eos_posted = FALSE;
+      g_mutex_unlock (&self->lock);
+      break;
+    case GST_EVENT_STREAM_START:
+      g_mutex_lock (&self->lock);
+      cpad->eos = FALSE;
+      self->eos_posted = FALSE;
+      g_mutex_unlock (&self->lock);
+      break;
+    case GST_EVENT_EOS:
+      g_mutex_lock (&self->lock);
+      cpad->eos = TRUE;
+      g_mutex_unlock (&self->lock);
+      gst_event_unref (event);
+      gst_eglglescompositor_check_eos (self);
+      return TRUE;
+    default:
+      break;
+  }
+
+  return gst_pad_event_default (pad, parent, event);
+}
+
+static gboolean
+gst_eglglescompositor_sink_query (GstPad * pad, GstObject * parent,
+    GstQuery * query)
+{
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_CAPS:{
+      GstCaps *filter, *caps;
+
+      gst_query_parse_caps (query, &filter);
+      caps = gst_pad_get_pad_template_caps (pad);
+      if (filter) {
+        GstCaps *tmp = gst_caps_intersect_full (filter, caps,
+            GST_CAPS_INTERSECT_FIRST);
+
+        gst_caps_unref (caps);
+        caps = tmp;
+      }
+      gst_query_set_caps_result (query, caps);
+      gst_caps_unref (caps);
+      return TRUE;
+    }
+    case GST_QUERY_ALLOCATION:
+      /* 上传时按照每个平面的 stride 读取 */
+      gst_query_add_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL);
+      return TRUE;
+    default:
+      return gst_pad_query_default (pad, parent, query);
+  }
+}
+
+static GstPad *
+gst_eglglescompositor_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * req_name, const GstCaps * caps)
+{
+  GstEglGlesCompositor *self = GST_EGLGLESCOMPOSITOR (element);
+  GstEglGlesCompositorPad *cpad;
+  gchar *name;
+  guint id;
+
+  GST_OBJECT_LOCK (self);
+  if (req_name && sscanf (req_name, "sink_%u", &id) == 1) {
+    self->next_pad_id = MAX (self->next_pad_id, id + 1);
+  } else {
+    id = self->next_pad_id++;
+  }
+  GST_OBJECT_UNLOCK (self);
+
+  name = g_strdup_printf ("sink_%u", id);
+  cpad = g_object_new (GST_TYPE_EGLGLESCOMPOSITOR_PAD, "name", name,
+      "direction", GST_PAD_SINK, "template", templ, NULL);
+  g_free (name);
+
+  /* 默认后请求的输入绘制在上面 */
+  cpad->zorder = id;
+
+  gst_pad_set_chain_function (GST_PAD (cpad),
+      GST_DEBUG_FUNCPTR (gst_eglglescompositor_chain));
+  gst_pad_set_event_function (GST_PAD (cpad),
+      GST_DEBUG_FUNCPTR (gst_eglglescompositor_sink_event));
+  gst_pad_set_query_function (GST_PAD (cpad),
+      GST_DEBUG_FUNCPTR (gst_eglglescompositor_sink_query));
+  GST_PAD_SET_ACCEPT_TEMPLATE (GST_PAD (cpad));
+
+  if (!gst_element_add_pad (element, GST_PAD (cpad))) {
+    GST_WARNING_OBJECT (self, "Couldn't add pad sink_%u", id);
+    gst_object_unref (cpad);
+    return NULL;
+  }
+
+  gst_eglglescompositor_mark_dirty (self);
+
+  return GST_PAD (cpad);
+}
+
+static void
+gst_eglglescompositor_release_pad (GstElement * element, GstPad * pad)
+{
+  GstEglGlesCompositor *self = GST_EGLGLESCOMPOSITOR (element);
+  GstEglGlesCompositorPad *cpad = GST_EGLGLESCOMPOSITOR_PAD (pad);
+
+  g_mutex_lock (&self->lock);
+  cpad->flushing = TRUE;
+  if (cpad->clock_id)
+    gst_clock_id_unschedule (cpad->clock_id);
+  g_cond_broadcast (&self->cond);
+  g_mutex_unlock (&self->lock);
+
+  gst_element_remove_pad (element, pad);
+
+  /* 纹理只能在渲染线程中删除；渲染线程复制的 pad 列表中可能还有这个 pad，
+   * 清除 have_frame 之后它不再被绘制 */
+  g_mutex_lock (&self->lock);
+  gst_buffer_replace (&cpad->pending, NULL);
+  if (cpad->n_textures)
+    g_array_append_vals (self->stale_textures, cpad->texture,
+        cpad->n_textures);
+  cpad->n_textures = 0;
+  cpad->format = GST_VIDEO_FORMAT_UNKNOWN;
+  cpad->video_width = 0;
+  cpad->video_height = 0;
+  cpad->have_frame = FALSE;
+  self->dirty = TRUE;
+  g_mutex_unlock (&self->lock);
+
+  gst_eglglescompositor_check_eos (self);
+}
+
+/**
+ * @brief: 查找（没有时编译）@format 的转换程序
+*/
+static GstEglCompositorProgram *
+gst_eglglescompositor_get_program (GstEglGlesCompositor * self,
+    GstVideoFormat format)
+{
+  GstEglCompositorProgram *program;
+  const gchar *texnames[3] = { NULL, };
+  gchar *cache_dir;
+  GLuint prog;
+  gint i, n_textures;
+
+  program = g_hash_table_lookup (self->programs, GINT_TO_POINTER (format));
+  if (program)
+    return program;
+
+  GST_OBJECT_LOCK (self);
+  cache_dir = g_strdup (self->program_cache_dir);
+  GST_OBJECT_UNLOCK (self);
+
+  prog = gst_egl_adaptation_build_format_program (GST_ELEMENT (self),
+      cache_dir, format, &n_textures, texnames);
+  g_free (cache_dir);
+  if (!prog) {
+    GST_ERROR_OBJECT (self, "Couldn't build program for %s",
+        gst_video_format_to_string (format));
+    return NULL;
+  }
+
+  program = g_new0 (GstEglCompositorProgram, 1);
+  program->prog = prog;
+  program->n_textures = n_textures;
+  program->position_loc = glGetAttribLocation (prog, "position");
+  program->texpos_loc = glGetAttribLocation (prog, "texpos");
+  program->transform_loc = glGetUniformLocation (prog, "u_transformation");
+  for (i = 0; i < n_textures; i++) {
+    gchar *scale_name = g_strdup_printf ("tex_scale%d", i);
+
+    program->tex_loc[i] = glGetUniformLocation (prog, texnames[i]);
+    program->tex_scale_loc[i] = glGetUniformLocation (prog, scale_name);
+    g_free (scale_name);
+  }
+
+  g_hash_table_insert (self->programs, GINT_TO_POINTER (format), program);
+
+  return program;
+}
+
+/**
+ * @brief: 把 @buf 上传到 @cpad 的纹理；第 i 个纹理是第 i 个分量所在的平面
+ *         （I420/YV12 的 U/V 平面顺序不同，NV12 的 UV 平面只上传一次）
+ * @note: 纹理只在格式或者尺寸改变时重新分配，其他帧用 glTexSubImage2D 更新；
+ *        release_pad 在流线程中回收纹理，纹理相关的字段只在 self->lock 内读写
+*/
+static gboolean
+gst_eglglescompositor_upload (GstEglGlesCompositor * self,
+    GstEglGlesCompositorPad * cpad, GstBuffer * buf, GstVideoInfo * info)
+{
+  GstVideoFormat format = GST_VIDEO_INFO_FORMAT (info);
+  GstEglCompositorProgram *program;
+  GstVideoFrame frame;
+  GLuint texture[3];
+  gint i, n_textures, width, height;
+  gboolean realloc;
+
+  program = gst_eglglescompositor_get_program (self, format);
+  if (!program)
+    return FALSE;
+
+  if (!gst_video_frame_map (&frame, info, buf, GST_MAP_READ)) {
+    GST_WARNING_OBJECT (cpad, "Couldn't map frame");
+    return FALSE;
+  }
+  width = GST_VIDEO_FRAME_WIDTH (&frame);
+  height = GST_VIDEO_FRAME_HEIGHT (&frame);
+
+  g_mutex_lock (&self->lock);
+  if (cpad->flushing) {
+    /* 正在 flush 或者 pad 已经被释放 */
+    g_mutex_unlock (&self->lock);
+    gst_video_frame_unmap (&frame);
+    return FALSE;
+  }
+
+  realloc = cpad->format != format || cpad->video_width != width
+      || cpad->video_height != height;
+  if (cpad->format != format) {
+    if (cpad->n_textures)
+      glDeleteTextures (cpad->n_textures, cpad->texture);
+    cpad->n_textures = program->n_textures;
+    glGenTextures (cpad->n_textures, cpad->texture);
+    for (i = 0; i < cpad->n_textures; i++) {
+      glBindTexture (GL_TEXTURE_2D, cpad->texture[i]);
+      glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    cpad->format = format;
+    cpad->have_frame = FALSE;
+  }
+  n_textures = cpad->n_textures;
+  memcpy (texture, cpad->texture, sizeof (texture));
+  g_mutex_unlock (&self->lock);
+
+  if (got_gl_error ("glTexParameteri"))
+    goto HANDLE_ERROR;
+
+  /* 之后 release_pad 交给 stale_textures 的纹理在下一个周期开始时才删除，
+   * 这里继续上传是安全的 */
+  glActiveTexture (GL_TEXTURE0);
+  glPixelStorei (GL_UNPACK_ALIGNMENT, 1);
+  for (i = 0; i < n_textures; i++) {
+    gint plane = GST_VIDEO_FRAME_COMP_PLANE (&frame, i);
+    gint pstride = GST_VIDEO_FRAME_COMP_PSTRIDE (&frame, i);
+    gint comp_width = GST_VIDEO_FRAME_COMP_WIDTH (&frame, i);
+    gint comp_height = GST_VIDEO_FRAME_COMP_HEIGHT (&frame, i);
+    GLint internal_format;
+    GLenum gl_format;
+
+    if (pstride == 4) {
+      internal_format = GL_RGBA;
+      gl_format = GL_RGBA;
+    } else {
+      gst_egl_adaptation_plane_format (FALSE, pstride, &internal_format,
+          &gl_format);
+    }
+
+    glBindTexture (GL_TEXTURE_2D, texture[i]);
+    glPixelStorei (GL_UNPACK_ROW_LENGTH,
+        GST_VIDEO_FRAME_PLANE_STRIDE (&frame, plane) / pstride);
+    if (realloc)
+      glTexImage2D (GL_TEXTURE_2D, 0, internal_format, comp_width,
+          comp_height, 0, gl_format, GL_UNSIGNED_BYTE,
+          GST_VIDEO_FRAME_PLANE_DATA (&frame, plane));
+    else
+      glTexSubImage2D (GL_TEXTURE_2D, 0, 0, 0, comp_width, comp_height,
+          gl_format, GL_UNSIGNED_BYTE,
+          GST_VIDEO_FRAME_PLANE_DATA (&frame, plane));
+  }
+  glPixelStorei (GL_UNPACK_ROW_LENGTH, 0);
+  glPixelStorei (GL_UNPACK_ALIGNMENT, 4);
+
+  if (got_gl_error (realloc ? "glTexImage2D" : "glTexSubImage2D"))
+    goto HANDLE_ERROR;
+
+  gst_video_frame_unmap (&frame);
+
+  g_mutex_lock (&self->lock);
+  if (!cpad->flushing && cpad->format == format) {
+    cpad->video_width = width;
+    cpad->video_height = height;
+    cpad->have_frame = TRUE;
+  }
+  g_mutex_unlock (&self->lock);
+
+  return TRUE;
+
+HANDLE_ERROR:
+  gst_video_frame_unmap (&frame);
+
+  /* 下一帧重新分配纹理 */
+  g_mutex_lock (&self->lock);
+  cpad->video_width = 0;
+  cpad->video_height = 0;
+  g_mutex_unlock (&self->lock);
+
+  return FALSE;
+}
+
+static gint
+gst_eglglescompositor_pad_compare_zorder (gconstpointer a, gconstpointer b)
+{
+  GstEglGlesCompositorPad *pad_a = (GstEglGlesCompositorPad *) a;
+  GstEglGlesCompositorPad *pad_b = (GstEglGlesCompositorPad *) b;
+  guint zorder_a, zorder_b;
+
+  GST_OBJECT_LOCK (pad_a);
+  zorder_a = pad_a->zorder;
+  GST_OBJECT_UNLOCK (pad_a);
+  GST_OBJECT_LOCK (pad_b);
+  zorder_b = pad_b->zorder;
+  GST_OBJECT_UNLOCK (pad_b);
+
+  return zorder_a < zorder_b ? -1 : zorder_a > zorder_b;
+}
+
+/**
+ * @brief: 把一个输入绘制到输出（单位正方形通过 u_transformation 变换到输入的矩形）
+*/
+static gboolean
+gst_eglglescompositor_draw_pad (GstEglGlesCompositor * self,
+    GstEglGlesCompositorPad * cpad)
+{
+  GstEglCompositorProgram *program;
+  GstVideoFormat format;
+  GLuint texture[3];
+  gfloat matrix[16] = { 0, };
+  gdouble x1, x2, y1, y2, alpha;
+  gint xpos, ypos, width, height, video_width, video_height, n_textures, i;
+  gboolean have_frame;
+
+  /* 复制的 pad 列表中可能有已经释放的 pad（格式为 UNKNOWN，没有纹理） */
+  g_mutex_lock (&self->lock);
+  have_frame = cpad->have_frame;
+  format = cpad->format;
+  n_textures = cpad->n_textures;
+  memcpy (texture, cpad->texture, sizeof (texture));
+  video_width = cpad->video_width;
+  video_height = cpad->video_height;
+  g_mutex_unlock (&self->lock);
+
+  if (!have_frame || format == GST_VIDEO_FORMAT_UNKNOWN)
+    return TRUE;
+
+  GST_OBJECT_LOCK (cpad);
+  xpos = cpad->xpos;
+  ypos = cpad->ypos;
+  width = cpad->width ? cpad->width : video_width;
+  height = cpad->height ? cpad->height : video_height;
+  alpha = cpad->alpha;
+  GST_OBJECT_UNLOCK (cpad);
+
+  if (alpha <= 0 || width <= 0 || height <= 0)
+    return TRUE;
+
+  program = g_hash_table_lookup (self->programs, GINT_TO_POINTER (format));
+  g_assert (program != NULL);
+
+  /* 输出纹理使用GL纹理坐标，输入的 ypos 从上边开始计算 */
+  x1 = xpos * 2.0 / self->fbo_width - 1;
+  x2 = (xpos + width) * 2.0 / self->fbo_width - 1;
+  y1 = 1 - ypos * 2.0 / self->fbo_height;
+  y2 = 1 - (ypos + height) * 2.0 / self->fbo_height;
+
+  matrix[0] = x2 - x1;
+  matrix[5] = y2 - y1;
+  matrix[10] = 1;
+  matrix[12] = x1;
+  matrix[13] = y1;
+  matrix[15] = 1;
+
+  glUseProgram (program->prog);
+  for (i = 0; i < n_textures; i++) {
+    glActiveTexture (GL_TEXTURE0 + i);
+    glBindTexture (GL_TEXTURE_2D, texture[i]);
+    glUniform1i (program->tex_loc[i], i);
+    glUniform2f (program->tex_scale_loc[i], 1, 1);
+  }
+  glUniformMatrix4fv (program->transform_loc, 1, GL_FALSE, matrix);
+  glBlendColor (0, 0, 0, alpha);
+
+  glBindBuffer (GL_ARRAY_BUFFER, self->quad_buffer);
+  glEnableVertexAttribArray (program->position_loc);
+  glEnableVertexAttribArray (program->texpos_loc);
+  glVertexAttribPointer (program->position_loc, 3, GL_FLOAT, GL_FALSE,
+      5 * sizeof (GLfloat), (gpointer) 0);
+  glVertexAttribPointer (program->texpos_loc, 2, GL_FLOAT, GL_FALSE,
+      5 * sizeof (GLfloat), (gpointer) (3 * sizeof (GLfloat)));
+  glDrawArrays (GL_TRIANGLE_STRIP, 0, 4);
+  glDisableVertexAttribArray (program->position_loc);
+  glDisableVertexAttribArray (program->texpos_loc);
+
+  return !got_gl_error ("glDrawArrays");
+}
+
+/**
+ * @brief: 输出尺寸改变时重新分配 egl-share-texture（RGBA8）并绑定 fbo
+*/
+static gboolean
+gst_eglglescompositor_setup_output (GstEglGlesCompositor * self)
+{
+  gint width, height;
+  GLenum status;
+
+  GST_OBJECT_LOCK (self);
+  width = self->output_width;
+  height = self->output_height;
+  GST_OBJECT_UNLOCK (self);
+
+  glBindFramebuffer (GL_FRAMEBUFFER, self->fbo);
+  if (width == self->fbo_width && height == self->fbo_height)
+    return TRUE;
+
+  GST_DEBUG_OBJECT (self, "Resizing output texture %u to %dx%d",
+      self->egl_share_texture, width, height);
+
+  glBindTexture (GL_TEXTURE_2D, self->egl_share_texture);
+  glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
+      GL_UNSIGNED_BYTE, NULL);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  if (got_gl_error ("glTexImage2D"))
+    return FALSE;
+
+  glFramebufferTexture2D (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+      self->egl_share_texture, 0);
+  status = glCheckFramebufferStatus (GL_FRAMEBUFFER);
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    GST_ERROR_OBJECT (self, "Output fbo is incomplete: 0x%04x", status);
+    return FALSE;
+  }
+
+  self->fbo_width = width;
+  self->fbo_height = height;
+
+  return TRUE;
+}
+
+/**
+ * @brief: 一个输出周期：上传有新帧的输入，然后按 zorder 绘制所有输入
+ * @return: FALSE 表示GL错误
+*/
+static gboolean
+gst_eglglescompositor_composite (GstEglGlesCompositor * self)
+{
+  gboolean redraw, ret = TRUE;
+  GList *pads, *l;
+
+  GST_OBJECT_LOCK (self);
+  pads = g_list_copy_deep (GST_ELEMENT (self)->sinkpads,
+      (GCopyFunc) gst_object_ref, NULL);
+  GST_OBJECT_UNLOCK (self);
+
+  g_mutex_lock (&self->lock);
+  if (self->stale_textures->len) {
+    glDeleteTextures (self->stale_textures->len,
+        (GLuint *) self->stale_textures->data);
+    g_array_set_size (self->stale_textures, 0);
+  }
+  redraw = self->dirty;
+  self->dirty = FALSE;
+  g_mutex_unlock (&self->lock);
+
+  for (l = pads; l; l = l->next) {
+    GstEglGlesCompositorPad *cpad = l->data;
+    GstVideoInfo info;
+    GstBuffer *buf;
+
+    g_mutex_lock (&self->lock);
+    buf = cpad->pending;
+    info = cpad->pending_info;
+    cpad->pending = NULL;
+    g_mutex_unlock (&self->lock);
+
+    if (!buf)
+      continue;
+
+    if (gst_eglglescompositor_upload (self, cpad, buf, &info))
+      redraw = TRUE;
+    gst_buffer_unref (buf);
+  }
+
+  if (!redraw)
+    goto DONE;
+
+  if (!gst_eglglescompositor_setup_output (self)) {
+    ret = FALSE;
+    goto DONE;
+  }
+
+  pads = g_list_sort (pads, gst_eglglescompositor_pad_compare_zorder);
+
+  glViewport (0, 0, self->fbo_width, self->fbo_height);
+  glClearColor (0.0, 0.0, 0.0, 1.0);
+  glClear (GL_COLOR_BUFFER_BIT);
+
+  glEnable (GL_BLEND);
+  glBlendFunc (GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+  for (l = pads; l; l = l->next) {
+    GstEglGlesCompositorPad *cpad = l->data;
+
+    if (!gst_eglglescompositor_draw_pad (self, cpad)) {
+      ret = FALSE;
+      break;
+    }
+  }
+  glDisable (GL_BLEND);
+
+  /* UI线程的上下文需要看到这一次合成的结果 */
+  glFlush ();
+
+  if (ret)
+    g_signal_emit (self, signals[UI_RENDER], 0);
+
+DONE:
+  g_list_free_full (pads, gst_object_unref);
+  return ret;
+}
+
+/**
+ * @brief: 在渲染线程中创建共享 UI 上下文的 EGL 上下文，
+ *         支持 EGL_KHR_surfaceless_context 时不创建表面，否则使用 1x1 pbuffer
+*/
+static gboolean
+gst_eglglescompositor_gl_start (GstEglGlesCompositor * self)
+{
+  static const GLfloat quad[] = {
+    0, 0, 0, 0, 0,
+    1, 0, 0, 1, 0,
+    0, 1, 0, 0, 1,
+    1, 1, 0, 1, 1
+  };
+  EGLint con_attribs[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 3,
+    EGL_CONTEXT_MINOR_VERSION, 2,
+    EGL_NONE
+  };
+  EGLint surface_attrs[] = {
+    EGL_WIDTH, 1,
+    EGL_HEIGHT, 1,
+    EGL_NONE
+  };
+  const char *eglexts;
+
+  if (!self->egl_display || !self->egl_share_context
+      || !self->egl_share_texture) {
+    GST_ERROR_OBJECT (self, "egl-display, egl-share-context and "
+        "egl-share-texture have to be set");
+    return FALSE;
+  }
+
+  eglBindAPI (EGL_OPENGL_ES_API);
+  self->context = eglCreateContext (self->egl_display, self->egl_config,
+      self->egl_share_context, con_attribs);
+  if (self->context == EGL_NO_CONTEXT) {
+    got_egl_error ("eglCreateContext");
+    return FALSE;
+  }
+
+  eglexts = eglQueryString (self->egl_display, EGL_EXTENSIONS);
+  if (!eglexts || !strstr (eglexts, "EGL_KHR_surfaceless_context")) {
+    self->surface = eglCreatePbufferSurface (self->egl_display,
+        self->egl_config, surface_attrs);
+    if (self->surface == EGL_NO_SURFACE) {
+      got_egl_error ("eglCreatePbufferSurface");
+      return FALSE;
+    }
+  }
+
+  if (!eglMakeCurrent (self->egl_display, self->surface, self->surface,
+          self->context)) {
+    got_egl_error ("eglMakeCurrent");
+    return FALSE;
+  }
+
+  glGenFramebuffers (1, &self->fbo);
+  glGenBuffers (1, &self->quad_buffer);
+  glBindBuffer (GL_ARRAY_BUFFER, self->quad_buffer);
+  glBufferData (GL_ARRAY_BUFFER, sizeof (quad), quad, GL_STATIC_DRAW);
+  if (got_gl_error ("glBufferData"))
+    return FALSE;
+
+  self->programs = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+      NULL, g_free);
+
+  return TRUE;
+}
+
+static void
+gst_eglglescompositor_gl_stop (GstEglGlesCompositor * self)
+{
+  GHashTableIter iter;
+  GstEglCompositorProgram *program;
+  GList *l;
+
+  if (self->context == EGL_NO_CONTEXT)
+    return;
+
+  if (eglGetCurrentContext () == self->context) {
+    GST_OBJECT_LOCK (self);
+    g_mutex_lock (&self->lock);
+    for (l = GST_ELEMENT (self)->sinkpads; l; l = l->next) {
+      GstEglGlesCompositorPad *cpad = l->data;
+
+      if (cpad->n_textures)
+        glDeleteTextures (cpad->n_textures, cpad->texture);
+      cpad->n_textures = 0;
+      cpad->format = GST_VIDEO_FORMAT_UNKNOWN;
+      cpad->video_width = 0;
+      cpad->video_height = 0;
+      cpad->have_frame = FALSE;
+    }
+    if (self->stale_textures->len)
+      glDeleteTextures (self->stale_textures->len,
+          (GLuint *) self->stale_textures->data);
+    g_array_set_size (self->stale_textures, 0);
+    g_mutex_unlock (&self->lock);
+    GST_OBJECT_UNLOCK (self);
+
+    if (self->programs) {
+      g_hash_table_iter_init (&iter, self->programs);
+      while (g_hash_table_iter_next (&iter, NULL, (gpointer *) & program))
+        glDeleteProgram (program->prog);
+    }
+    if (self->fbo) {
+      glBindFramebuffer (GL_FRAMEBUFFER, 0);
+      glDeleteFramebuffers (1, &self->fbo);
+    }
+    if (self->quad_buffer)
+      glDeleteBuffers (1, &self->quad_buffer);
+
+    eglMakeCurrent (self->egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+        EGL_NO_CONTEXT);
+  }
+
+  if (self->programs) {
+    g_hash_table_unref (self->programs);
+    self->programs = NULL;
+  }
+  self->fbo = 0;
+  self->fbo_width = 0;
+  self->fbo_height = 0;
+  self->quad_buffer = 0;
+
+  if (self->surface != EGL_NO_SURFACE) {
+    eglDestroySurface (self->egl_display, self->surface);
+    self->surface = EGL_NO_SURFACE;
+  }
+  eglDestroyContext (self->egl_display, self->context);
+  self->context = EGL_NO_CONTEXT;
+  eglReleaseThread ();
+}
+
+/**
+ * @brief: 渲染线程：每个输出周期（framerate）合成一次
+*/
+static gpointer
+gst_eglglescompositor_render_thread_func (GstEglGlesCompositor * self)
+{
+  gint64 next_tick;
+
+  if (!gst_eglglescompositor_gl_start (self)) {
+    GST_ELEMENT_ERROR (self, RESOURCE, FAILED,
+        ("Couldn't set up the EGL context"), (NULL));
+    gst_eglglescompositor_gl_stop (self);
+    return NULL;
+  }
+
+  g_mutex_lock (&self->lock);
+  next_tick = g_get_monotonic_time ();
+  while (self->running) {
+    gint64 period, now;
+
+    GST_OBJECT_LOCK (self);
+    period = gst_util_uint64_scale_int (G_USEC_PER_SEC, self->fps_d,
+        self->fps_n);
+    GST_OBJECT_UNLOCK (self);
+
+    /* 落后超过一个周期时不补绘 */
+    now = g_get_monotonic_time ();
+    next_tick += period;
+    if (next_tick < now)
+      next_tick = now;
+
+    while (self->running && g_cond_wait_until (&self->cond, &self->lock,
+            next_tick));
+    if (!self->running)
+      break;
+
+    g_mutex_unlock (&self->lock);
+    if (!gst_eglglescompositor_composite (self))
+      GST_WARNING_OBJECT (self, "Composition failed");
+    g_mutex_lock (&self->lock);
+  }
+  g_mutex_unlock (&self->lock);
+
+  gst_eglglescompositor_gl_stop (self);
+
+  return NULL;
+}
+
+/**
+ * @brief: 唤醒所有在等待的输入（PAUSED 或者时钟）
+*/
+static void
+gst_eglglescompositor_unblock_pads (GstEglGlesCompositor * self)
+{
+  GList *l;
+
+  GST_OBJECT_LOCK (self);
+  g_mutex_lock (&self->lock);
+  for (l = GST_ELEMENT (self)->sinkpads; l; l = l->next) {
+    GstEglGlesCompositorPad *cpad = l->data;
+
+    if (cpad->clock_id)
+      gst_clock_id_unschedule (cpad->clock_id);
+  }
+  g_cond_broadcast (&self->cond);
+  g_mutex_unlock (&self->lock);
+  GST_OBJECT_UNLOCK (self);
+}
+
+static GstStateChangeReturn
+gst_eglglescompositor_change_state (GstElement * element,
+    GstStateChange transition)
+{
+  GstEglGlesCompositor *self = GST_EGLGLESCOMPOSITOR (element);
+  GstStateChangeReturn ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      g_mutex_lock (&self->lock);
+      self->running = TRUE;
+      self->eos_posted = FALSE;
+      self->dirty = TRUE;
+      g_mutex_unlock (&self->lock);
+      self->thread = g_thread_new ("eglglescompositor",
+          (GThreadFunc) gst_eglglescompositor_render_thread_func, self);
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
+      g_mutex_lock (&self->lock);
+      self->playing = TRUE;
+      g_cond_broadcast (&self->cond);
+      g_mutex_unlock (&self->lock);
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      /* 输入的流线程可能在等待，先唤醒，否则停用 pad 时会死锁 */
+      g_mutex_lock (&self->lock);
+      self->running = FALSE;
+      g_mutex_unlock (&self->lock);
+      gst_eglglescompositor_unblock_pads (self);
+      break;
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
+      g_mutex_lock (&self->lock);
+      self->playing = FALSE;
+      g_mutex_unlock (&self->lock);
+      gst_eglglescompositor_unblock_pads (self);
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      if (self->thread) {
+        g_thread_join (self->thread);
+        self->thread = NULL;
+      }
+      break;
+    default:
+      break;
+  }
+
+  return ret;
+}
+
+static void
+gst_eglglescompositor_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstEglGlesCompositor *self = GST_EGLGLESCOMPOSITOR (object);
+
+  switch (prop_id) {
+    case PROP_EGL_DISPLAY:
+      self->egl_display = g_value_get_pointer (value);
+      break;
+    case PROP_EGL_CONFIG:
+      self->egl_config = g_value_get_pointer (value);
+      break;
+    case PROP_EGL_SHARE_CONTEXT:
+      self->egl_share_context = g_value_get_pointer (value);
+      break;
+    case PROP_EGL_SHARE_TEXTURE:
+      self->egl_share_texture = g_value_get_uint (value);
+      break;
+    case PROP_OUTPUT_WIDTH:
+      GST_OBJECT_LOCK (self);
+      self->output_width = g_value_get_int (value);
+      GST_OBJECT_UNLOCK (self);
+      gst_eglglescompositor_mark_dirty (self);
+      break;
+    case PROP_OUTPUT_HEIGHT:
+      GST_OBJECT_LOCK (self);
+      self->output_height = g_value_get_int (value);
+      GST_OBJECT_UNLOCK (self);
+      gst_eglglescompositor_mark_dirty (self);
+      break;
+    case PROP_FRAMERATE:
+      GST_OBJECT_LOCK (self);
+      self->fps_n = gst_value_get_fraction_numerator (value);
+      self->fps_d = gst_value_get_fraction_denominator (value);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    case PROP_SYNC:
+      self->sync = g_value_get_boolean (value);
+      break;
+    case PROP_PROGRAM_CACHE_DIR:
+      GST_OBJECT_LOCK (self);
+      g_free (self->program_cache_dir);
+      self->program_cache_dir = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_eglglescompositor_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstEglGlesCompositor *self = GST_EGLGLESCOMPOSITOR (object);
+
+  switch (prop_id) {
+    case PROP_EGL_DISPLAY:
+      g_value_set_pointer (value, self->egl_display);
+      break;
+    case PROP_EGL_CONFIG:
+      g_value_set_pointer (value, self->egl_config);
+      break;
+    case PROP_EGL_SHARE_CONTEXT:
+      g_value_set_pointer (value, self->egl_share_context);
+      break;
+    case PROP_EGL_SHARE_TEXTURE:
+      g_value_set_uint (value, self->egl_share_texture);
+      break;
+    case PROP_OUTPUT_WIDTH:
+      GST_OBJECT_LOCK (self);
+      g_value_set_int (value, self->output_width);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    case PROP_OUTPUT_HEIGHT:
+      GST_OBJECT_LOCK (self);
+      g_value_set_int (value, self->output_height);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    case PROP_FRAMERATE:
+      GST_OBJECT_LOCK (self);
+      gst_value_set_fraction (value, self->fps_n, self->fps_d);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    case PROP_SYNC:
+      g_value_set_boolean (value, self->sync);
+      break;
+    case PROP_PROGRAM_CACHE_DIR:
+      GST_OBJECT_LOCK (self);
+      g_value_set_string (value, self->program_cache_dir);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_eglglescompositor_finalize (GObject * object)
+{
+  GstEglGlesCompositor *self = GST_EGLGLESCOMPOSITOR (object);
+
+  g_array_unref (self->stale_textures);
+  g_free (self->program_cache_dir);
+  g_mutex_clear (&self->lock);
+  g_cond_clear (&self->cond);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_eglglescompositor_class_init (GstEglGlesCompositorClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GstElementClass *gstelement_class = (GstElementClass *) klass;
+
+  GST_DEBUG_CATEGORY_INIT (gst_eglglescompositor_debug, "nveglglescompositor",
+      0, "EGL/GLES compositor");
+
+  gobject_class->set_property = gst_eglglescompositor_set_property;
+  gobject_class->get_property = gst_eglglescompositor_get_property;
+  gobject_class->finalize = gst_eglglescompositor_finalize;
+
+  gstelement_class->change_state = gst_eglglescompositor_change_state;
+  gstelement_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_eglglescompositor_request_new_pad);
+  gstelement_class->release_pad =
+      GST_DEBUG_FUNCPTR (gst_eglglescompositor_release_pad);
+
+  g_object_class_install_property (gobject_class, PROP_EGL_DISPLAY,
+      g_param_spec_pointer ("egl-display", "UI Thread EGL Dispaly",
+          "UI Thread EGL Dispaly",
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_EGL_CONFIG,
+      g_param_spec_pointer ("egl-config", "UI Thread EGL Config",
+          "UI Thread EGL Config",
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_EGL_SHARE_CONTEXT,
+      g_param_spec_pointer ("egl-share-context", "UI Thread EGL Share Context",
+          "UI Thread EGL Share Context",
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_EGL_SHARE_TEXTURE,
+      g_param_spec_uint ("egl-share-texture", "UI Thread share texture ID",
+          "Texture the inputs are composited into", 0, G_MAXUINT, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_OUTPUT_WIDTH,
+      g_param_spec_int ("output-width", "Output width",
+          "Width egl-share-texture is allocated with", 1, G_MAXINT,
+          DEFAULT_OUTPUT_WIDTH, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_OUTPUT_HEIGHT,
+      g_param_spec_int ("output-height", "Output height",
+          "Height egl-share-texture is allocated with", 1, G_MAXINT,
+          DEFAULT_OUTPUT_HEIGHT, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_FRAMERATE,
+      gst_param_spec_fraction ("framerate", "Framerate",
+          "How often the inputs are composited", 1, G_MAXINT, G_MAXINT, 1,
+          DEFAULT_FPS_N, DEFAULT_FPS_D, G_PARAM_READWRITE |
+          G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_SYNC,
+      g_param_spec_boolean ("sync", "Sync",
+          "Synchronize every input on the clock", DEFAULT_SYNC,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_PROGRAM_CACHE_DIR,
+      g_param_spec_string ("program-cache-dir", "Program cache directory",
+          "Directory where linked shader program binaries are cached and "
+          "reloaded from (NULL disables the cache)", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  signals[UI_RENDER] =
+    g_signal_new ("ui-render",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL, NULL,
+                  G_TYPE_NONE, 0);
+
+  gst_element_class_set_static_metadata (gstelement_class,
+      "EGL/GLES compositor",
+      "Sink/Video",
+      "Composites several video inputs into one shared texture with a single "
+      "EGL/GLES context", "NVIDIA Corporation");
+
+  gst_element_class_add_static_pad_template_with_gtype (gstelement_class,
+      &gst_eglglescompositor_sink_template, GST_TYPE_EGLGLESCOMPOSITOR_PAD);
+}
+
+static void
+gst_eglglescompositor_init (GstEglGlesCompositor * self)
+{
+  g_mutex_init (&self->lock);
+  g_cond_init (&self->cond);
+  self->stale_textures = g_array_new (FALSE, FALSE, sizeof (GLuint));
+
+  self->output_width = DEFAULT_OUTPUT_WIDTH;
+  self->output_height = DEFAULT_OUTPUT_HEIGHT;
+  self->fps_n = DEFAULT_FPS_N;
+  self->fps_d = DEFAULT_FPS_D;
+  self->sync = DEFAULT_SYNC;
+  self->context = EGL_NO_CONTEXT;
+  self->surface = EGL_NO_SURFACE;
+
+  GST_OBJECT_FLAG_SET (self, GST_ELEMENT_FLAG_SINK);
+}
+
+#endif
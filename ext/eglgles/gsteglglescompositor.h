@@ -0,0 +1,147 @@
+/*
+ * GStreamer EGL/GLES compositor
+ * Copyright (c) 2015-2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __GST_EGLGLESCOMPOSITOR_H__
+#define __GST_EGLGLESCOMPOSITOR_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include "gstegladaptation.h"
+
+G_BEGIN_DECLS
+
+#ifndef HAVE_IOS
+#define GST_TYPE_EGLGLESCOMPOSITOR_PAD \
+  (gst_eglglescompositor_pad_get_type())
+#define GST_EGLGLESCOMPOSITOR_PAD(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_EGLGLESCOMPOSITOR_PAD,GstEglGlesCompositorPad))
+#define GST_IS_EGLGLESCOMPOSITOR_PAD(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_EGLGLESCOMPOSITOR_PAD))
+
+#define GST_TYPE_EGLGLESCOMPOSITOR \
+  (gst_eglglescompositor_get_type())
+#define GST_EGLGLESCOMPOSITOR(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_EGLGLESCOMPOSITOR,GstEglGlesCompositor))
+#define GST_EGLGLESCOMPOSITOR_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_EGLGLESCOMPOSITOR,GstEglGlesCompositorClass))
+#define GST_IS_EGLGLESCOMPOSITOR(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_EGLGLESCOMPOSITOR))
+
+typedef struct _GstEglGlesCompositorPad GstEglGlesCompositorPad;
+typedef struct _GstEglGlesCompositorPadClass GstEglGlesCompositorPadClass;
+typedef struct _GstEglGlesCompositor GstEglGlesCompositor;
+typedef struct _GstEglGlesCompositorClass GstEglGlesCompositorClass;
+
+/*
+ * GstEglGlesCompositorPad:
+ * 每个输入的布局属性（GST_OBJECT_LOCK 保护）、流状态（compositor 的 lock 保护）
+ * 和纹理（只在渲染线程中使用）
+ */
+struct _GstEglGlesCompositorPad
+{
+  GstPad pad;
+
+  /* 属性 */
+  gint xpos; /* 在输出中的位置（像素，原点在左上） */
+  gint ypos;
+  gint width; /* 0 表示视频的宽度 */
+  gint height; /* 0 表示视频的高度 */
+  guint zorder; /* 小的先绘制 */
+  gdouble alpha; /* 整体透明度 */
+
+  /* 流状态 */
+  GstSegment segment; /* 只在流线程中使用 */
+  GstVideoInfo info; /* 当前caps */
+  GstBuffer *pending; /* 还没有上传的最新一帧 */
+  GstVideoInfo pending_info; /* @pending 的视频信息 */
+  GstClockID clock_id; /* 同步时正在等待的时钟 */
+  gboolean flushing;
+  gboolean eos;
+
+  /* 渲染线程写入，release_pad 回收；都在 compositor 的 lock 内 */
+  GstVideoFormat format; /* @texture 对应的格式，UNKNOWN 表示没有纹理 */
+  GLuint texture[3];
+  gint n_textures;
+  gint video_width; /* 上传的视频帧尺寸 */
+  gint video_height;
+  gboolean have_frame; /* 已经上传过一帧 */
+};
+
+struct _GstEglGlesCompositorPadClass
+{
+  GstPadClass parent_class;
+};
+
+/*
+ * GstEglGlesCompositor:
+ * 多个 sink_%u 输入共用一个 EGL 上下文和渲染线程，每个输出周期把有新帧的输入上传，
+ * 然后把所有输入绘制到 egl-share-texture（一次合成）
+ */
+struct _GstEglGlesCompositor
+{
+  GstElement element;
+
+  GMutex lock; /* 保护流状态、pad 的纹理字段、@running、@playing、@dirty */
+  GCond cond;
+  GThread *thread; /* 渲染线程 */
+  gboolean running;
+  gboolean playing; /* PLAYING 状态，同步时 PAUSED 中的输入等待 */
+  gboolean dirty; /* 布局属性改变，下一个周期需要重新合成 */
+  gboolean eos_posted;
+  GArray *stale_textures; /* 释放的 pad 留下的纹理，由渲染线程删除 */
+  guint next_pad_id;
+
+  /* 属性 */
+  EGLDisplay egl_display;
+  EGLConfig egl_config;
+  EGLContext egl_share_context; /* 来自UI线程的egl上下文 */
+  guint egl_share_texture; /* 合成的输出纹理 */
+  gint output_width;
+  gint output_height;
+  gint fps_n; /* 合成的频率 */
+  gint fps_d;
+  gboolean sync;
+  gchar *program_cache_dir;
+
+  /* 渲染线程写入，release_pad 回收；都在 compositor 的 lock 内 */
+  EGLContext context;
+  EGLSurface surface; /* 不支持 EGL_KHR_surfaceless_context 时的 1x1 pbuffer */
+  GLuint fbo; /* 颜色附件是 egl-share-texture */
+  gint fbo_width;
+  gint fbo_height;
+  GLuint quad_buffer; /* 单位正方形（position + texpos） */
+  GHashTable *programs; /* GstVideoFormat -> GstEglCompositorProgram */
+};
+
+struct _GstEglGlesCompositorClass
+{
+  GstElementClass parent_class;
+};
+
+GType gst_eglglescompositor_pad_get_type (void);
+GType gst_eglglescompositor_get_type (void);
+#endif
+
+G_END_DECLS
+#endif /* __GST_EGLGLESCOMPOSITOR_H__ */
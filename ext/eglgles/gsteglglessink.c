@@ -86,6 +86,270 @@
  * |[
  * gst-launch -v -m videotestsrc ! eglglessink force_aspect_ratio=FALSE
  * ]|
+ * <para>
+ * By default frames are scaled with a single bilinear draw. Setting the
+ * scaling-method property to bicubic or lanczos renders the frame in two
+ * separable passes (horizontal into an intermediate framebuffer sized to
+ * the display region, then vertical), widening the kernel when
+ * downscaling so small mosaic tiles don't alias.
+ * </para>
+ * </refsect2>
+ *
+ * <refsect2>
+ * <title>Rotation</title>
+ * <para>
+ * The sink implements the #GstVideoDirection interface. Rotations and flips
+ * are applied by permuting the texture coordinates of the frame quad, and the
+ * display aspect ratio follows the rotated geometry. With video-direction set
+ * to auto the image-orientation tag is honoured. A
+ * #GstVideoAffineTransformationMeta attached to a buffer is applied to the
+ * frame quad in the vertex shader.
+ * </para>
+ * |[
+ * gst-launch -v -m videotestsrc ! eglglessink video-direction=90r
+ * ]|
+ * </refsect2>
+ *
+ * <refsect2>
+ * <title>Deinterlacing</title>
+ * <para>
+ * Interleaved caps, and buffers flagged as interlaced in mixed mode, are
+ * deinterlaced in a fragment shader before scaling. bob doubles the lines of
+ * one field, linear interpolates the missing lines and blend filters both
+ * fields together. With deinterlace-field-rate enabled bob and linear render
+ * each field separately, the second one half a frame duration later.
+ * </para>
+ * |[
+ * gst-launch -v -m videotestsrc ! video/x-raw,interlace-mode=interleaved ! eglglessink deinterlace-method=linear deinterlace-field-rate=TRUE
+ * ]|
+ * </refsect2>
+ *
+ * <refsect2>
+ * <title>Overlays</title>
+ * <para>
+ * The sink accepts #GstVideoOverlayCompositionMeta, so text and subtitle
+ * overlay elements attach their rectangles instead of blending them into the
+ * frame on the CPU. Each rectangle is uploaded once into a texture cached by
+ * its sequence number and alpha-blended (premultiplied) over the video.
+ * </para>
+ * <para>
+ * With draw-roi enabled the #GstVideoRegionOfInterestMeta boxes of each frame
+ * are drawn in a single instanced draw call, colored by ROI type and
+ * roi-line-width pixels wide.
+ * </para>
+ * |[
+ * gst-launch -v -m videotestsrc ! timeoverlay ! eglglessink
+ * ]|
+ * </refsect2>
+ *
+ * <refsect2>
+ * <title>Output texture</title>
+ * <para>
+ * When EGL_KHR_surfaceless_context is available the sink creates no EGL
+ * surface at all; otherwise it falls back to a pbuffer that is only used to
+ * make the context current. Input that cannot be shown directly (YUV,
+ * multi-planar or OES frames) is uploaded into textures owned by the sink and
+ * rendered as RGBA into an output texture of its own through a framebuffer
+ * object. After each frame that texture is copied into egl-share-texture. The
+ * sink allocates the storage of both at the cropped and rotated frame size,
+ * or at output-width x output-height when set. The same happens for RGB
+ * input when an output size or mosaic is set, passthrough is FALSE, or a
+ * frame needs deinterlacing, rotation, an affine transform, overlays or ROI
+ * boxes. An RGB stream that was uploaded directly switches to this path with
+ * the first such frame and keeps it until the caps change. The copy is
+ * flipped vertically, so the first row of the frame is at t=0 in
+ * egl-share-texture for every path, as with a direct upload. Extra outputs
+ * use GL texture coordinates instead (first row at t=1).
+ * </para>
+ * <para>
+ * ui-render is emitted once a frame has been rendered into egl-share-texture,
+ * the extra outputs and the atlas, and its GL commands have been flushed.
+ * The streaming thread does not wait for the GPU: the signal carries a GLsync
+ * fence for the frame, and the handler takes ownership of it. The UI
+ * context should call glWaitSync (sync, 0, GL_TIMEOUT_IGNORED) before
+ * sampling and then glDeleteSync (sync). The fence is NULL for passthrough
+ * frames (egl-share-texture was written by the upload itself), without fence
+ * support, and when no handler was connected at render time. Connect a
+ * single handler, since only one can own the fence. With field-rate
+ * deinterlacing it is emitted for every field.
+ * </para>
+ * </refsect2>
+ *
+ * <refsect2>
+ * <title>DMABuf import</title>
+ * <para>
+ * With GStreamer 1.24 or newer and EGL_EXT_image_dma_buf_import, the sink
+ * accepts video/x-raw(memory:DMABuf) caps with format=DMA_DRM and a linear
+ * drm-format. Typical sources are V4L2 capture, VA-API and V4L2 stateless
+ * decoders. Each plane is imported as its own EGLImage with an R8, GR88,
+ * RGB565, BGR888 or ABGR8888 layout. The image is bound to the plane texture,
+ * so frames are not copied and the same conversion programs as system memory
+ * are used. Imported images are cached by GstMemory, offset and stride, and
+ * are destroyed when the memory is freed.
+ * Pooled buffers are therefore only imported the first time they are seen.
+ * The cache is dropped when the caps change. The planes are always rendered
+ * into a texture of the sink and copied into egl-share-texture (see Output
+ * texture), never bound to egl-share-texture directly, because upstream
+ * reuses the dmabuf once it gets the buffer back. The sink keeps the last
+ * imported buffer until the next one has been imported.
+ * </para>
+ * <para>
+ * For system memory caps the sink can also hand out GPU visible buffers.
+ * This needs /dev/udmabuf, EGL_EXT_image_dma_buf_import and OpenGL ES 3.0.
+ * The offered buffer pool then allocates memfd pages exported through
+ * udmabuf. The pages are mapped for upstream and imported as an EGLImage, and
+ * row pitches are aligned to 64 bytes. Map and unmap issue DMA_BUF_IOCTL_SYNC,
+ * so software decoders and videotestsrc write straight into memory that the
+ * GPU samples, without an upload copy.
+ * </para>
+ * <para>
+ * memory:EGLImage buffers, from this pool or from upstream, get one texture
+ * per GstMemory. That texture is bound to the EGLImage the first time the
+ * memory is seen. Recycled pool buffers then only select their texture, and
+ * glEGLImageTargetTexture2DOES is not called again. A texture is deleted on
+ * the render thread after its memory is freed. When frames are uploaded
+ * straight into egl-share-texture (passthrough), the image is bound to that
+ * texture every frame instead.
+ * </para>
+ * <para>
+ * Buffers freed by the EGLImage pool are kept on a recycle list for their
+ * EGLDisplay, up to 16 buffers. This happens on seeks, reconnects and caps
+ * changes. A later pool that asks for the same format and size takes them
+ * back, so no EGLImage, udmabuf or texture is created again. Any sink on the
+ * display can take udmabuf-backed buffers. A buffer whose EGLImage wraps a
+ * texture belongs to the GL context of the sink that allocated it. Only that
+ * sink takes it back, and only while the context has not been recreated.
+ * These buffers are freed when that sink's render thread exits. The list
+ * is dropped when the last sink on that display is closed.
+ * </para>
+ * </refsect2>
+ *
+ * <refsect2>
+ * <title>Buffer pool</title>
+ * <para>
+ * min-buffers and max-buffers set the depth of the pool that is offered
+ * upstream and used as the sink's own pool. The default is at least 2
+ * buffers and no upper limit, because the sink keeps the displayed buffer
+ * until the next frame is rendered. Decoders with deep reorder queues may
+ * need more buffers. A limit saves memory on 4K streams. With preallocate
+ * (the default), min-buffers buffers are allocated when the pool is
+ * activated. Otherwise they are allocated on the first acquires. The values
+ * apply to the next pool, which is created when the caps change.
+ * </para>
+ * <para>
+ * pool-stats returns a GstStructure for the current pool. It holds the
+ * buffers allocated, the acquires, the acquires that had to wait because
+ * max-buffers buffers were in use, the total time spent waiting (in
+ * nanoseconds) and the highest number of buffers in use at the same time.
+ * A pool can then be sized from measured values.
+ * </para>
+ * </refsect2>
+ *
+ * <refsect2>
+ * <title>Texture atlas</title>
+ * <para>
+ * Several sinks can share one egl-share-texture, so the UI draws a whole
+ * video wall with a single texture bind. Give each sink its place in the
+ * atlas with atlas-x and atlas-y, in GL texture coordinates, and its size with
+ * output-width and output-height. A GstContext of type
+ * "gst.egl.atlas-region" set on the sink does the same. Its structure holds
+ * "texture" (guint, optional), "x", "y", "width" and "height" (gint). The
+ * application allocates the atlas storage. The sink renders into a texture of
+ * its own as described under Output texture. After each frame it copies the
+ * result, flipped in the same way, into its region with glBlitFramebuffer, so
+ * it never writes outside that region. Atlas mode is chosen when the textures are created, so set it
+ * before the first frame. The position can be changed while playing.
+ * </para>
+ * </refsect2>
+ *
+ * <refsect2>
+ * <title>Passthrough</title>
+ * <para>
+ * RGB frames in a single plane are uploaded straight into egl-share-texture.
+ * When the upload already holds the final pixels, the sink
+ * skips all drawing, including border clears and VBO updates. That requires
+ * no rotation or affine transform, no
+ * deinterlacing, no overlays and no ROI boxes. Extra outputs are still
+ * rendered. Frames that need any of these switch the sink to rendering into
+ * egl-share-texture, as does setting passthrough to FALSE (see Output
+ * texture).
+ * </para>
+ * </refsect2>
+ *
+ * <refsect2>
+ * <title>Mosaic</title>
+ * <para>
+ * With mosaic set and a rows x columns grid larger than one tile, every
+ * rendered frame goes into the next tile, left to right and top to bottom.
+ * Tiles are layers of one texture array. Only the tile being updated is
+ * cleared, and the whole grid is drawn into egl-share-texture with a single
+ * instanced call. The per-tile rectangle, texture layer and crop live in an
+ * instance buffer that is rebuilt only when the layout changes. Mosaic needs
+ * OpenGL ES 3.0.
+ * </para>
+ * <para>
+ * The output texture keeps its content between frames. The grid composite is
+ * scissored to the tile that changed, and black borders are only redrawn
+ * after a layout change or an expose. The changed area is passed to
+ * eglSwapBuffersWithDamage when the display supports it.
+ * </para>
+ * <para>
+ * With tile-renegotiation (the default) and more than one tile, the sink
+ * checks the on-screen size of the frame in a tile. When it is at most half
+ * the negotiated width and height, the sink sends a reconfigure event
+ * upstream. It then offers caps with the tile size first, so a decoder or
+ * scaler can deliver frames of the displayed size. The full caps stay
+ * available after them. Going back to a single tile drops the preferred size
+ * and renegotiates again. This is skipped when the output texture size
+ * follows the video size, because the tiles would then shrink with it.
+ * </para>
+ * <para>
+ * When upstream cannot renegotiate, predownscale shrinks frames from system
+ * memory on the CPU before upload. The frame is shown at half its size or
+ * less in both directions, so the sink box-filters every plane by 2, 4 or 8
+ * in the streaming thread, with AVX2 or NEON when available. Less data is
+ * then uploaded. It only replaces bilinear scaling. It is off for the
+ * high-quality scaling methods, interlaced video and RGB16.
+ * </para>
+ * </refsect2>
+ *
+ * <refsect2>
+ * <title>Extra outputs</title>
+ * <para>
+ * extra-outputs lists textures that are filled from the same upload as the
+ * main output, for example a thumbnail or an overview tile. Each entry is
+ * TEXTURE:WIDTHxHEIGHT[:FORMAT][:mipmap]. TEXTURE is created by the
+ * application in the egl-share-context share group, and the sink allocates
+ * its storage. FORMAT is rgba8 or rgb565. With mipmap, a mipmap chain is
+ * generated after every frame so the application can minify it cheaply. The
+ * outputs hold the cropped, rotated and deinterlaced frame without overlays.
+ * </para>
+ * </refsect2>
+ *
+ * <refsect2>
+ * <title>Shader program cache</title>
+ * <para>
+ * When program-cache-dir is set, linked shader programs are stored there with
+ * glGetProgramBinary, keyed by the GL vendor/renderer/version strings and
+ * the shader sources, and reloaded with glProgramBinary on the next caps
+ * configuration or start. Entries rejected by the driver are deleted and the
+ * program is compiled again.
+ * </para>
+ * <para>
+ * When the application provides egl-display, egl-config and
+ * egl-share-context, the conversion programs of all supported formats are
+ * compiled at open on a background context in the same share group, in
+ * parallel if GL_KHR_parallel_shader_compile is available. Caps configuration
+ * then only picks up an already linked program.
+ * </para>
+ * <para>
+ * Conversion programs are generated from a per-format table (planes, swizzle,
+ * color matrix). Within one egl-share-context share group, a
+ * program with identical sources is linked once. Its binary is then shared,
+ * and every sink instance creates its own program object from it with
+ * glProgramBinary, so uniforms are never shared between sinks. Sharing
+ * needs at least one program binary format.
+ * </para>
  * </refsect2>
  */
 
@@ -105,6 +369,7 @@
 #include <gst/video/gstvideometa.h>
 #include <gst/video/gstvideopool.h>
 #include <gst/video/videooverlay.h>
+#include <gst/allocators/allocators.h>
 
 #include <X11/Xlib.h>
 
@@ -116,7 +381,9 @@
 #endif
 
 #include "gsteglglessink.h"
+#include "gsteglglescompositor.h"
 #include "gstegljitter.h"
+#include "gstegldownscale.h"
 
 
 #ifdef IS_DESKTOP
@@ -131,6 +398,30 @@ GST_DEBUG_CATEGORY_STATIC (gst_eglglessink_debug);
 #ifdef IS_DESKTOP
 #define DEFAULT_GPU_ID 0
 #endif
+#define DEFAULT_SCALING_METHOD GST_EGL_SCALING_METHOD_BILINEAR
+#define DEFAULT_VIDEO_DIRECTION GST_VIDEO_ORIENTATION_IDENTITY
+#define DEFAULT_DEINTERLACE_METHOD GST_EGL_DEINTERLACE_METHOD_LINEAR
+#define DEFAULT_DEINTERLACE_FIELD_RATE FALSE
+#define DEFAULT_DRAW_ROI FALSE
+#define DEFAULT_ROI_LINE_WIDTH 2
+#define DEFAULT_PASSTHROUGH TRUE
+#define DEFAULT_OUTPUT_WIDTH 0
+#define DEFAULT_OUTPUT_HEIGHT 0
+#define DEFAULT_MOSAIC FALSE
+#define DEFAULT_TILE_RENEGOTIATION TRUE
+#define DEFAULT_PREDOWNSCALE FALSE
+#define DEFAULT_ATLAS_X -1
+#define DEFAULT_ATLAS_Y -1
+#define DEFAULT_MIN_BUFFERS 2 /* 至少2个，最后一个buffer在下一帧渲染完成之前一直持有 */
+#define DEFAULT_MAX_BUFFERS 0
+#define DEFAULT_PREALLOCATE TRUE
+
+/* 旋转90°/270°或者沿对角线翻转时，视频的宽高需要交换 */
+#define GST_EGLGLESSINK_METHOD_IS_TRANSPOSED(method) \
+    ((method) == GST_VIDEO_ORIENTATION_90R || \
+     (method) == GST_VIDEO_ORIENTATION_90L || \
+     (method) == GST_VIDEO_ORIENTATION_UL_LR || \
+     (method) == GST_VIDEO_ORIENTATION_UR_LL)
 
 GST_DEBUG_CATEGORY_EXTERN (GST_CAT_PERFORMANCE);
 
@@ -151,6 +442,12 @@ static GstStaticPadTemplate gst_eglglessink_sink_template_factory =
             "{ " "RGBA, BGRA, ARGB, ABGR, " "RGBx, BGRx, xRGB, xBGR, "
             "AYUV, Y444, I420, YV12, " "NV12, NV21, Y42B, Y41B, "
             "RGB, BGR, RGB16 }") ";"
+        GST_VIDEO_CAPS_MAKE_WITH_FEATURES
+        (GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY ", "
+            GST_CAPS_FEATURE_META_GST_VIDEO_OVERLAY_COMPOSITION,
+            "{ " "RGBA, BGRA, ARGB, ABGR, " "RGBx, BGRx, xRGB, xBGR, "
+            "AYUV, Y444, I420, YV12, " "NV12, NV21, Y42B, Y41B, "
+            "RGB, BGR, RGB16 }") ";"
         GST_VIDEO_CAPS_MAKE ("{ "
             "RGBA, BGRA, ARGB, ABGR, " "RGBx, BGRx, xRGB, xBGR, "
             "AYUV, Y444, I420, YV12, " "NV12, NV21, Y42B, Y41B, "
@@ -158,6 +455,11 @@ static GstStaticPadTemplate gst_eglglessink_sink_template_factory =
             ";"
         GST_VIDEO_CAPS_MAKE_WITH_FEATURES ("memory:NVMM",
             "{ " "BGRx, RGBA, I420, NV12, BGR, RGB }")
+#if !defined(HAVE_IOS) && GST_CHECK_VERSION(1,24,0)
+        ";"
+        GST_VIDEO_DMA_DRM_CAPS_MAKE ", drm-format = (string) "
+            GST_EGL_DMABUF_DRM_FORMATS
+#endif
         ));
 
 /* Filter signals and args */
@@ -194,7 +496,27 @@ enum
   PROP_EGL_DISPLAY,
   PROP_EGL_CONFIG,
   PROP_EGL_SHARE_CONTEXT,
-  PROP_EGL_SHARE_TEXTURE
+  PROP_EGL_SHARE_TEXTURE,
+  PROP_SCALING_METHOD,
+  PROP_VIDEO_DIRECTION,
+  PROP_DEINTERLACE_METHOD,
+  PROP_DEINTERLACE_FIELD_RATE,
+  PROP_DRAW_ROI,
+  PROP_ROI_LINE_WIDTH,
+  PROP_PROGRAM_CACHE_DIR,
+  PROP_EXTRA_OUTPUTS,
+  PROP_PASSTHROUGH,
+  PROP_OUTPUT_WIDTH,
+  PROP_OUTPUT_HEIGHT,
+  PROP_MOSAIC,
+  PROP_TILE_RENEGOTIATION,
+  PROP_PREDOWNSCALE,
+  PROP_ATLAS_X,
+  PROP_ATLAS_Y,
+  PROP_MIN_BUFFERS,
+  PROP_MAX_BUFFERS,
+  PROP_PREALLOCATE,
+  PROP_POOL_STATS
 };
 
 static void gst_eglglessink_finalize (GObject * object);
@@ -215,11 +537,16 @@ static GstCaps *gst_eglglessink_getcaps (GstBaseSink * bsink, GstCaps * filter);
 static gboolean gst_eglglessink_propose_allocation (GstBaseSink * bsink,
     GstQuery * query);
 static gboolean gst_eglglessink_query (GstBaseSink * bsink, GstQuery * query);
+static gboolean gst_eglglessink_event (GstBaseSink * bsink, GstEvent * event);
 
 /* VideoOverlay interface cruft */
 static void gst_eglglessink_videooverlay_init (GstVideoOverlayInterface *
     iface);
 
+/* VideoDirection interface cruft */
+static void gst_eglglessink_video_direction_init (GstVideoDirectionInterface *
+    iface);
+
 /* Actual VideoOverlay interface funcs */
 static void gst_eglglessink_expose (GstVideoOverlay * overlay);
 static void gst_eglglessink_set_window_handle (GstVideoOverlay * overlay,
@@ -231,6 +558,16 @@ static void gst_eglglessink_set_render_rectangle (GstVideoOverlay * overlay,
 static gboolean gst_eglglessink_create_window (GstEglGlesSink *
     eglglessink, gint width, gint height);
 static gboolean gst_eglglessink_setup_vbo (GstEglGlesSink * eglglessink);
+static void gst_eglglessink_set_overlay_composition (GstEglGlesSink *
+    eglglessink, GstVideoOverlayComposition * composition);
+static void gst_eglglessink_clear_extra_outputs (GstEglGlesSink *
+    eglglessink);
+static gboolean gst_eglglessink_needs_output_fbo (GstEglGlesSink *
+    eglglessink);
+#ifndef HAVE_IOS
+static void gst_eglglessink_collect_roi (GstEglGlesSink * eglglessink,
+    GstBuffer * buf);
+#endif
 static gboolean
 gst_eglglessink_configure_caps (GstEglGlesSink * eglglessink, GstCaps * caps);
 static gboolean
@@ -253,6 +590,48 @@ static const gchar *supportedPlatforms[] = {
  "wayland"
 #endif
 };
+GType
+gst_eglglessink_scaling_method_get_type (void)
+{
+  static GType scaling_method_type = 0;
+  static const GEnumValue scaling_methods[] = {
+    {GST_EGL_SCALING_METHOD_BILINEAR, "Bilinear (single pass)", "bilinear"},
+    {GST_EGL_SCALING_METHOD_BICUBIC, "Bicubic (two pass, Catmull-Rom)",
+        "bicubic"},
+    {GST_EGL_SCALING_METHOD_LANCZOS, "Lanczos (two pass, 3 lobes)",
+        "lanczos"},
+    {0, NULL, NULL}
+  };
+
+  if (!scaling_method_type) {
+    scaling_method_type =
+        g_enum_register_static ("GstEglGlesSinkScalingMethod",
+        scaling_methods);
+  }
+  return scaling_method_type;
+}
+
+GType
+gst_eglglessink_deinterlace_method_get_type (void)
+{
+  static GType deinterlace_method_type = 0;
+  static const GEnumValue deinterlace_methods[] = {
+    {GST_EGL_DEINTERLACE_METHOD_NONE, "No deinterlacing (weave)", "none"},
+    {GST_EGL_DEINTERLACE_METHOD_BOB, "Bob (line doubling)", "bob"},
+    {GST_EGL_DEINTERLACE_METHOD_LINEAR, "Linear interpolation of one field",
+        "linear"},
+    {GST_EGL_DEINTERLACE_METHOD_BLEND, "Blend both fields", "blend"},
+    {0, NULL, NULL}
+  };
+
+  if (!deinterlace_method_type) {
+    deinterlace_method_type =
+        g_enum_register_static ("GstEglGlesSinkDeinterlaceMethod",
+        deinterlace_methods);
+  }
+  return deinterlace_method_type;
+}
+
 gboolean isPlatformSupported (gchar* winsys);
 
 #ifndef HAVE_IOS
@@ -269,7 +648,19 @@ typedef struct
   GstVideoInfo info;  /* 视频帧的格式，长宽等信息 */
   gboolean add_metavideo;
   gboolean want_eglimage;
-  GstBuffer *last_buffer;
+  GstBuffer *last_buffer; /* 正在显示的buffer，持有引用直到下一帧渲染完成，上游不会写入GPU正在采样的内存 */
+  gboolean preallocate; /* 激活时分配 min-buffers 个buffer */
+  guint max_buffers; /* 配置的最大buffer个数，0 表示不限制 */
+
+  /* 统计（属性 pool-stats），stats_lock 保护 */
+  GMutex stats_lock;
+  guint outstanding; /* 被上游或 sink 占用的buffer个数 */
+  guint max_outstanding;
+  guint allocations;
+  guint acquires;
+  guint acquire_waits; /* 开始 acquire 时所有 max_buffers 个buffer都被占用的次数 */
+  GstClockTime acquire_wait_time; /* 这些 acquire 等待的总时间 */
+
   GstEGLImageBufferPoolSendBlockingAllocate send_blocking_allocate_func;
   gpointer send_blocking_allocate_data;
   GDestroyNotify send_blocking_allocate_destroy;
@@ -279,6 +670,9 @@ typedef GstVideoBufferPoolClass GstEGLImageBufferPoolClass;
 
 #define GST_EGL_IMAGE_BUFFER_POOL(p) ((GstEGLImageBufferPool*)(p))
 
+/* 缓冲池配置中的 gboolean，gst_eglglessink_pool_config_init 根据 preallocate 属性设置 */
+#define GST_EGL_IMAGE_BUFFER_POOL_CONFIG_PREALLOCATE "eglglessink-preallocate"
+
 GType gst_egl_image_buffer_pool_get_type (void);
 
 /* 定义了一个继承于 GstVideoBufferPool 的 GstEGLImageBufferPool 对象 */
@@ -390,6 +784,7 @@ gst_egl_image_buffer_pool_set_config (GstBufferPool * bpool,
   GstEGLImageBufferPool *pool = GST_EGL_IMAGE_BUFFER_POOL (bpool);
   GstCaps *caps;
   GstVideoInfo info;
+  guint max_buffers;
 
   if (pool->allocator)
     gst_object_unref (pool->allocator);
@@ -399,8 +794,8 @@ gst_egl_image_buffer_pool_set_config (GstBufferPool * bpool,
       (gst_egl_image_buffer_pool_parent_class)->set_config (bpool, config))
     return FALSE;
 
-  if (!gst_buffer_pool_config_get_params (config, &caps, NULL, NULL, NULL)
-      || !caps)
+  if (!gst_buffer_pool_config_get_params (config, &caps, NULL, NULL,
+          &max_buffers) || !caps)
     return FALSE;
 
   if (!gst_video_info_from_caps (&info, caps))
@@ -418,13 +813,134 @@ gst_egl_image_buffer_pool_set_config (GstBufferPool * bpool,
       && g_strcmp0 (pool->allocator->mem_type, GST_EGL_IMAGE_MEMORY_TYPE) == 0);
 
   pool->info = info;
+  pool->max_buffers = max_buffers;
+  if (!gst_structure_get_boolean (config,
+          GST_EGL_IMAGE_BUFFER_POOL_CONFIG_PREALLOCATE, &pool->preallocate))
+    pool->preallocate = TRUE;
 
   return TRUE;
 }
 
+/**
+ * @brief: 不预分配时跳过父类的 start（父类在激活时分配 min-buffers 个buffer），
+ *         buffer 在 acquire 时按需分配
+*/
+static gboolean
+gst_egl_image_buffer_pool_start (GstBufferPool * bpool)
+{
+  GstEGLImageBufferPool *pool = GST_EGL_IMAGE_BUFFER_POOL (bpool);
+
+  if (!pool->preallocate) {
+    GST_DEBUG_OBJECT (pool, "not preallocating buffers");
+    return TRUE;
+  }
+
+  return GST_BUFFER_POOL_CLASS (gst_egl_image_buffer_pool_parent_class)->start
+      (bpool);
+}
 
+/**
+ * @brief: 统计 acquire 的次数和等待时间。父类只在所有 max_buffers 个buffer都被占用时阻塞，
+ *         这种情况下计时
+*/
 static GstFlowReturn
-gst_egl_image_buffer_pool_alloc_buffer (GstBufferPool * bpool,
+gst_egl_image_buffer_pool_acquire_buffer (GstBufferPool * bpool,
+    GstBuffer ** buffer, GstBufferPoolAcquireParams * params)
+{
+  GstEGLImageBufferPool *pool = GST_EGL_IMAGE_BUFFER_POOL (bpool);
+  GstClockTime start = 0;
+  GstFlowReturn ret;
+  gboolean wait;
+
+  g_mutex_lock (&pool->stats_lock);
+  wait = pool->max_buffers && pool->outstanding >= pool->max_buffers &&
+      !(params && (params->flags & GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT));
+  g_mutex_unlock (&pool->stats_lock);
+
+  if (wait)
+    start = gst_util_get_timestamp ();
+
+  ret =
+      GST_BUFFER_POOL_CLASS
+      (gst_egl_image_buffer_pool_parent_class)->acquire_buffer (bpool, buffer,
+      params);
+
+  g_mutex_lock (&pool->stats_lock);
+  if (wait) {
+    pool->acquire_waits++;
+    pool->acquire_wait_time += gst_util_get_timestamp () - start;
+  }
+  if (ret == GST_FLOW_OK) {
+    pool->acquires++;
+    pool->outstanding++;
+    pool->max_outstanding = MAX (pool->max_outstanding, pool->outstanding);
+  }
+  g_mutex_unlock (&pool->stats_lock);
+
+  return ret;
+}
+
+static void
+gst_egl_image_buffer_pool_release_buffer (GstBufferPool * bpool,
+    GstBuffer * buffer)
+{
+  GstEGLImageBufferPool *pool = GST_EGL_IMAGE_BUFFER_POOL (bpool);
+
+  g_mutex_lock (&pool->stats_lock);
+  if (pool->outstanding)
+    pool->outstanding--;
+  g_mutex_unlock (&pool->stats_lock);
+
+  GST_BUFFER_POOL_CLASS (gst_egl_image_buffer_pool_parent_class)->release_buffer
+      (bpool, buffer);
+}
+
+/**
+ * @brief: 属性 pool-stats 的内容
+*/
+static GstStructure *
+gst_egl_image_buffer_pool_get_stats (GstEGLImageBufferPool * pool)
+{
+  GstStructure *stats;
+
+  g_mutex_lock (&pool->stats_lock);
+  stats = gst_structure_new ("GstEglGlesSinkPoolStats",
+      "allocations", G_TYPE_UINT, pool->allocations,
+      "acquires", G_TYPE_UINT, pool->acquires,
+      "acquire-waits", G_TYPE_UINT, pool->acquire_waits,
+      "acquire-wait-time", G_TYPE_UINT64, pool->acquire_wait_time,
+      "max-outstanding", G_TYPE_UINT, pool->max_outstanding,
+      "max-buffers", G_TYPE_UINT, pool->max_buffers, NULL);
+  g_mutex_unlock (&pool->stats_lock);
+
+  return stats;
+}
+
+
+/**
+ * @brief: EGLImage 分配器不能通过 gst_allocator_alloc 分配，不能导入成可映射的 EGLImage 时
+ *         回退到系统内存（父类的 alloc_buffer 会使用配置的 EGLImage 分配器）
+*/
+static GstFlowReturn
+gst_egl_image_buffer_pool_alloc_sysmem (GstEGLImageBufferPool * pool,
+    GstBuffer ** buffer)
+{
+  GstVideoInfo *info = &pool->info;
+
+  *buffer = gst_buffer_new_allocate (NULL, info->size, NULL);
+  if (!*buffer)
+    return GST_FLOW_ERROR;
+
+  gst_buffer_add_video_meta_full (*buffer, GST_VIDEO_FRAME_FLAG_NONE,
+      GST_VIDEO_INFO_FORMAT (info), GST_VIDEO_INFO_WIDTH (info),
+      GST_VIDEO_INFO_HEIGHT (info), GST_VIDEO_INFO_N_PLANES (info),
+      info->offset, info->stride);
+
+  return GST_FLOW_OK;
+}
+
+static GstFlowReturn
+gst_egl_image_buffer_pool_alloc_frame (GstBufferPool * bpool,
     GstBuffer ** buffer, GstBufferPoolAcquireParams * params) {
   
   GstEGLImageBufferPool *pool = GST_EGL_IMAGE_BUFFER_POOL (bpool);
@@ -465,22 +981,23 @@ gst_egl_image_buffer_pool_alloc_buffer (GstBufferPool * bpool,
         *buffer = pool->send_blocking_allocate_func (bpool,
             pool->send_blocking_allocate_data);
 
+      /* 纹理创建的 EGLImage 不能映射，上游无法写入 */
+      if (*buffer && GST_MEMORY_FLAG_IS_SET (gst_buffer_peek_memory (*buffer,
+                  0), GST_MEMORY_FLAG_NOT_MAPPABLE)) {
+        gst_buffer_unref (*buffer);
+        *buffer = NULL;
+      }
+
       if (!*buffer) {
         GST_WARNING ("Fallback memory allocation");
-        return
-            GST_BUFFER_POOL_CLASS
-            (gst_egl_image_buffer_pool_parent_class)->alloc_buffer (bpool,
-            buffer, params);
+        return gst_egl_image_buffer_pool_alloc_sysmem (pool, buffer);
       }
 
       return GST_FLOW_OK;
       break;
     }
     default:
-      return
-          GST_BUFFER_POOL_CLASS
-          (gst_egl_image_buffer_pool_parent_class)->alloc_buffer (bpool,
-          buffer, params);
+      return gst_egl_image_buffer_pool_alloc_sysmem (pool, buffer);
       break;
   }
 
@@ -488,38 +1005,37 @@ gst_egl_image_buffer_pool_alloc_buffer (GstBufferPool * bpool,
 }
 
 static GstFlowReturn
-gst_egl_image_buffer_pool_acquire_buffer (GstBufferPool * bpool,
+gst_egl_image_buffer_pool_alloc_buffer (GstBufferPool * bpool,
     GstBuffer ** buffer, GstBufferPoolAcquireParams * params)
 {
+  GstEGLImageBufferPool *pool = GST_EGL_IMAGE_BUFFER_POOL (bpool);
   GstFlowReturn ret;
-  GstEGLImageBufferPool *pool;
-
-  ret =
-      GST_BUFFER_POOL_CLASS
-      (gst_egl_image_buffer_pool_parent_class)->acquire_buffer (bpool,
-      buffer, params);
-  if (ret != GST_FLOW_OK || !*buffer)
-    return ret;
-
-  pool = GST_EGL_IMAGE_BUFFER_POOL (bpool);
-
-  /* XXX: Don't return the memory we just rendered, glEGLImageTargetTexture2DOES()
-   * keeps the EGLImage unmappable until the next one is uploaded
-   */
-  if (*buffer && *buffer == pool->last_buffer) {
-    GstBuffer *oldbuf = *buffer;
 
-    ret =
-        GST_BUFFER_POOL_CLASS
-        (gst_egl_image_buffer_pool_parent_class)->acquire_buffer (bpool,
-        buffer, params);
-    gst_object_replace ((GstObject **) & oldbuf->pool, (GstObject *) pool);
-    gst_buffer_unref (oldbuf);
+  ret = gst_egl_image_buffer_pool_alloc_frame (bpool, buffer, params);
+  if (ret == GST_FLOW_OK) {
+    g_mutex_lock (&pool->stats_lock);
+    pool->allocations++;
+    g_mutex_unlock (&pool->stats_lock);
   }
 
   return ret;
 }
 
+/**
+ * @brief: 缓冲池缩小、停止或者销毁时释放 buffer，EGLImage buffer 交给回收列表，
+ *         之后的缓冲池（seek、重新连接、caps 改变）复用
+*/
+static void
+gst_egl_image_buffer_pool_free_buffer (GstBufferPool * bpool,
+    GstBuffer * buffer)
+{
+  if (gst_egl_image_allocator_recycle_buffer (buffer))
+    return;
+
+  GST_BUFFER_POOL_CLASS (gst_egl_image_buffer_pool_parent_class)->free_buffer
+      (bpool, buffer);
+}
+
 static void
 gst_egl_image_buffer_pool_finalize (GObject * object)
 {
@@ -536,6 +1052,8 @@ gst_egl_image_buffer_pool_finalize (GObject * object)
   pool->send_blocking_allocate_destroy = NULL;
   pool->send_blocking_allocate_data = NULL;
 
+  g_mutex_clear (&pool->stats_lock);
+
   G_OBJECT_CLASS (gst_egl_image_buffer_pool_parent_class)->finalize (object);
 }
 
@@ -548,14 +1066,20 @@ gst_egl_image_buffer_pool_class_init (GstEGLImageBufferPoolClass * klass)
   gobject_class->finalize = gst_egl_image_buffer_pool_finalize;
   gstbufferpool_class->get_options = gst_egl_image_buffer_pool_get_options;
   gstbufferpool_class->set_config = gst_egl_image_buffer_pool_set_config;
-  gstbufferpool_class->alloc_buffer = gst_egl_image_buffer_pool_alloc_buffer;
+  gstbufferpool_class->start = gst_egl_image_buffer_pool_start;
   gstbufferpool_class->acquire_buffer =
       gst_egl_image_buffer_pool_acquire_buffer;
+  gstbufferpool_class->release_buffer =
+      gst_egl_image_buffer_pool_release_buffer;
+  gstbufferpool_class->alloc_buffer = gst_egl_image_buffer_pool_alloc_buffer;
+  gstbufferpool_class->free_buffer = gst_egl_image_buffer_pool_free_buffer;
 }
 
 static void
 gst_egl_image_buffer_pool_init (GstEGLImageBufferPool * pool)
 {
+  g_mutex_init (&pool->stats_lock);
+  pool->preallocate = TRUE;
 }
 #endif
 
@@ -564,7 +1088,9 @@ gst_egl_image_buffer_pool_init (GstEGLImageBufferPool * pool)
 #define parent_class gst_eglglessink_parent_class
 G_DEFINE_TYPE_WITH_CODE (GstEglGlesSink, gst_eglglessink, GST_TYPE_VIDEO_SINK,
     G_IMPLEMENT_INTERFACE (GST_TYPE_VIDEO_OVERLAY,
-        gst_eglglessink_videooverlay_init));
+        gst_eglglessink_videooverlay_init);
+    G_IMPLEMENT_INTERFACE (GST_TYPE_VIDEO_DIRECTION,
+        gst_eglglessink_video_direction_init));
 
 gboolean isPlatformSupported (gchar* winsys)
 {
@@ -631,6 +1157,9 @@ render_thread_func (GstEglGlesSink * eglglessink)
   GValue val = { 0 };
   GstDataQueueItem *item = NULL;
   GstFlowReturn last_flow = GST_FLOW_OK;
+#ifndef HAVE_IOS
+  GstBufferPool *pool;
+#endif
 
   cudaError_t CUerr = cudaSuccess;
   GST_LOG_OBJECT (eglglessink, "SETTING CUDA DEVICE = %d in eglglessink func=%s\n", eglglessink->gpu_id, __func__);
@@ -687,7 +1216,8 @@ render_thread_func (GstEglGlesSink * eglglessink)
             gst_egl_image_allocator_alloc_eglimage (GST_EGL_IMAGE_BUFFER_POOL
             (eglglessink->pool)->allocator, eglglessink->egl_context->display,
             gst_egl_adaptation_context_get_egl_context
-            (eglglessink->egl_context), format, width, height);
+            (eglglessink->egl_context), eglglessink->egl_context->garbage,
+            format, width, height);
         g_value_init (&v, G_TYPE_POINTER);
         g_value_set_pointer (&v, buffer);
         gst_structure_set_value (s, "buffer", &v);
@@ -702,8 +1232,6 @@ render_thread_func (GstEglGlesSink * eglglessink)
 
       if (eglglessink->configured_caps) {
         last_flow = gst_eglglessink_upload (eglglessink, buf); /* 将GPU内部的纹理更新到我们创建的纹理 eglglessink->egl_context->texture[0] */
-        if (last_flow == GST_FLOW_OK)
-          g_signal_emit (eglglessink, signals[UI_RENDER], 0);
       } else {
         last_flow = GST_FLOW_OK;
         GST_DEBUG_OBJECT (eglglessink,
@@ -713,6 +1241,15 @@ render_thread_func (GstEglGlesSink * eglglessink)
       if (eglglessink->configured_caps) {
         last_flow = gst_eglglessink_render (eglglessink);  /* 绘制OpenGL ES顶点 */
 
+        /* 这一帧（场频输出时包括第二场）已经绘制到输出纹理并且提交，通知UI线程，
+         * fence 的所有权交给处理函数 */
+        if (last_flow == GST_FLOW_OK)
+          g_signal_emit (eglglessink, signals[UI_RENDER], 0,
+              eglglessink->frame_sync);
+        else if (eglglessink->frame_sync)
+          glDeleteSync ((GLsync) eglglessink->frame_sync);
+        eglglessink->frame_sync = NULL;
+
       if (eglglessink->last_uploaded_buffer && eglglessink->pool) {
         gst_egl_image_buffer_pool_replace_last_buffer (GST_EGL_IMAGE_BUFFER_POOL
             (eglglessink->pool), eglglessink->last_uploaded_buffer);
@@ -733,6 +1270,8 @@ render_thread_func (GstEglGlesSink * eglglessink)
           gst_memory_unmap (mem, &map);
       }
 
+        /* 上一帧释放的 buffer 持有的 GL 对象（可能在其他线程释放）在这里统一删除 */
+        gst_egl_garbage_drain (eglglessink->egl_context->garbage);
 
         /*
         * gst_eglglessink_render returns error if window has been changed.
@@ -803,7 +1342,30 @@ render_thread_func (GstEglGlesSink * eglglessink)
   if (eglglessink->using_cuda) {
     gst_eglglessink_cuda_cleanup(eglglessink);
   }
+#ifndef HAVE_IOS
+  /* 缓冲池中空闲的 buffer 持有这个上下文中的纹理，在 cleanup 最后一次删除之前释放，
+   * 上下文销毁之后才释放的纹理在共享组中泄漏 */
+  GST_OBJECT_LOCK (eglglessink);
+  pool = eglglessink->pool;
+  eglglessink->pool = NULL;
+  GST_OBJECT_UNLOCK (eglglessink);
+  if (pool) {
+    gst_buffer_pool_set_active (pool, FALSE);
+    gst_object_unref (pool);
+  }
+  /* 停止的缓冲池把用纹理创建的 buffer 交给了回收列表，同样要在这里释放 */
+  gst_egl_image_allocator_drop_recycled (eglglessink->egl_context->garbage);
+
+  gst_buffer_replace (&eglglessink->dmabuf_buffer, NULL);
+  gst_egl_dmabuf_cache_free (eglglessink->dmabuf_cache);
+  eglglessink->dmabuf_cache = NULL;
+  gst_egl_image_texture_cache_free (eglglessink->image_texture_cache);
+  eglglessink->image_texture_cache = NULL;
+#endif
 
+  gst_eglglessink_set_overlay_composition (eglglessink, NULL);
+  g_hash_table_remove_all (eglglessink->overlay_textures);
+  gst_eglglessink_clear_extra_outputs (eglglessink);
   gst_egl_adaptation_cleanup (eglglessink->egl_context);
 
   if (eglglessink->configured_caps) {
@@ -936,6 +1498,35 @@ gst_eglglessink_videooverlay_init (GstVideoOverlayInterface * iface)
   iface->set_render_rectangle = gst_eglglessink_set_render_rectangle;
 }
 
+/**
+ * @brief: GstVideoDirection接口没有虚函数，只需要实现 video-direction 属性
+*/
+static void
+gst_eglglessink_video_direction_init (GstVideoDirectionInterface * iface)
+{
+}
+
+/**
+ * @brief: 根据 video-direction 属性和 image-orientation 标签更新 rotate_method
+ * @note: 调用前需要持有 GST_OBJECT_LOCK
+*/
+static void
+gst_eglglessink_update_rotate_method (GstEglGlesSink * eglglessink)
+{
+  GstVideoOrientationMethod method = eglglessink->video_direction;
+
+  if (method == GST_VIDEO_ORIENTATION_AUTO)
+    method = eglglessink->tag_direction;
+
+  if (method != eglglessink->rotate_method) {
+    GST_DEBUG_OBJECT (eglglessink, "Rotate method changed %d -> %d",
+        eglglessink->rotate_method, method);
+    eglglessink->rotate_method = method;
+    /* 下一帧重新计算 display_region 和 VBO */
+    eglglessink->render_region_changed = TRUE;
+  }
+}
+
 
 /**
  * @brief: X11窗口事件处理线程
@@ -1017,31 +1608,129 @@ gst_eglglessink_expose (GstVideoOverlay * overlay)
   eglglessink = GST_EGLGLESSINK (overlay);
   GST_DEBUG_OBJECT (eglglessink, "Expose catched, redisplay");
 
+  /* 窗口内容可能已经损坏，边框和所有格子都要重绘 */
+  GST_OBJECT_LOCK (eglglessink);
+  eglglessink->full_damage = TRUE;
+  GST_OBJECT_UNLOCK (eglglessink);
+
   /* 渲染最近的一次图像 */
   ret = gst_eglglessink_queue_object (eglglessink, NULL);
   if (ret == GST_FLOW_ERROR)
     GST_ERROR_OBJECT (eglglessink, "Redisplay failed");
 }
 
+/**
+ * @brief: 把屏幕上的归一化位置 (u, v) 映射到源视频（裁剪区域）中的归一化位置 (s, t)
+ *         u 从左到右，v 从上到下
+*/
+static void
+gst_eglglessink_orient_texpos (GstVideoOrientationMethod method,
+    gdouble u, gdouble v, gdouble * s, gdouble * t)
+{
+  switch (method) {
+    case GST_VIDEO_ORIENTATION_90R:
+      *s = v;
+      *t = 1 - u;
+      break;
+    case GST_VIDEO_ORIENTATION_180:
+      *s = 1 - u;
+      *t = 1 - v;
+      break;
+    case GST_VIDEO_ORIENTATION_90L:
+      *s = 1 - v;
+      *t = u;
+      break;
+    case GST_VIDEO_ORIENTATION_HORIZ:
+      *s = 1 - u;
+      *t = v;
+      break;
+    case GST_VIDEO_ORIENTATION_VERT:
+      *s = u;
+      *t = 1 - v;
+      break;
+    case GST_VIDEO_ORIENTATION_UL_LR:
+      *s = v;
+      *t = u;
+      break;
+    case GST_VIDEO_ORIENTATION_UR_LL:
+      *s = 1 - v;
+      *t = 1 - u;
+      break;
+    default:
+      *s = u;
+      *t = v;
+      break;
+  }
+}
+
+/**
+ * @brief: 第一次调用时创建顶点/索引缓冲和每个四边形的VAO，
+ *         之后布局（render_region、裁剪、旋转）改变时只用 glBufferSubData 更新顶点
+*/
 static gboolean
-gst_eglglessink_setup_vbo (GstEglGlesSink * eglglessink)
+gst_eglglessink_create_vbo (GstEglGlesSink * eglglessink)
 {
-  gdouble render_width, render_height;
-  gdouble texture_width, texture_height;
-  gdouble x1, x2, y1, y2;
-  gdouble tx1, tx2, ty1, ty2;
+  GstEglAdaptationContext *ctx = eglglessink->egl_context;
+  guint i;
 
-  GST_INFO_OBJECT (eglglessink, "VBO setup. have_vbo:%d",
-      eglglessink->egl_context->have_vbo);
+  ctx->index_array[0] = 0;
+  ctx->index_array[1] = 1;
+  ctx->index_array[2] = 2;
+  ctx->index_array[3] = 3;
 
-  if (eglglessink->egl_context->have_vbo) {
-    glDeleteBuffers (1, &eglglessink->egl_context->position_buffer);
-    glDeleteBuffers (1, &eglglessink->egl_context->index_buffer);
-    eglglessink->egl_context->have_vbo = FALSE;
-  }
+  glGenBuffers (1, &ctx->position_buffer);
+  glGenBuffers (1, &ctx->index_buffer);
+  glGenVertexArrays (G_N_ELEMENTS (ctx->quad_vao), ctx->quad_vao);
+  if (got_gl_error ("glGenBuffers"))
+    return FALSE;
 
-  render_width = eglglessink->render_region.w;
-  render_height = eglglessink->render_region.h;
+  glBindBuffer (GL_ARRAY_BUFFER, ctx->position_buffer);
+  glBufferData (GL_ARRAY_BUFFER, sizeof (ctx->position_array),
+      ctx->position_array, GL_DYNAMIC_DRAW);
+  if (got_gl_error ("glBufferData position_buffer"))
+    return FALSE;
+
+  for (i = 0; i < G_N_ELEMENTS (ctx->quad_vao); i++) {
+    glBindVertexArray (ctx->quad_vao[i]);
+    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, ctx->index_buffer);
+    glEnableVertexAttribArray (GST_EGL_POSITION_ATTRIB);
+    glEnableVertexAttribArray (GST_EGL_TEXPOS_ATTRIB);
+    glVertexAttribPointer (GST_EGL_POSITION_ATTRIB, 3, GL_FLOAT, GL_FALSE,
+        sizeof (coord5), (gpointer) (4 * i * sizeof (coord5)));
+    glVertexAttribPointer (GST_EGL_TEXPOS_ATTRIB, 2, GL_FLOAT, GL_FALSE,
+        sizeof (coord5), (gpointer) (4 * i * sizeof (coord5) +
+            3 * sizeof (gfloat)));
+  }
+  glBindVertexArray (0);
+  if (got_gl_error ("glVertexAttribPointer"))
+    return FALSE;
+
+  /* 叠加层、ROI框和拼接在默认VAO中设置自己的属性，也使用这个索引缓冲 */
+  glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, ctx->index_buffer);
+  glBufferData (GL_ELEMENT_ARRAY_BUFFER, sizeof (ctx->index_array),
+      ctx->index_array, GL_STATIC_DRAW);
+  if (got_gl_error ("glBufferData index_buffer"))
+    return FALSE;
+
+  ctx->have_vbo = TRUE;
+
+  return TRUE;
+}
+
+static gboolean
+gst_eglglessink_setup_vbo (GstEglGlesSink * eglglessink)
+{
+  gdouble render_width, render_height;
+  gdouble texture_width, texture_height;
+  gdouble x1, x2, y1, y2;
+  gdouble tx1, tx2, ty1, ty2;
+  gint i;
+
+  GST_INFO_OBJECT (eglglessink, "VBO setup. have_vbo:%d",
+      eglglessink->egl_context->have_vbo);
+
+  render_width = eglglessink->render_region.w;
+  render_height = eglglessink->render_region.h;
 
   texture_width = eglglessink->configured_info.width;
   texture_height = eglglessink->configured_info.height;
@@ -1060,55 +1749,39 @@ gst_eglglessink_setup_vbo (GstEglGlesSink * eglglessink)
   ty1 = (eglglessink->crop.y / texture_height);
   ty2 = ((eglglessink->crop.y + eglglessink->crop.h) / texture_height);
 
-  /* X-normal, Y-normal orientation */
+  /* X-normal, Y-normal orientation，纹理坐标在下面根据 rotate_method 计算 */
   eglglessink->egl_context->position_array[0].x = x2;
   eglglessink->egl_context->position_array[0].y = y2;
   eglglessink->egl_context->position_array[0].z = 0;
-  eglglessink->egl_context->position_array[0].a = tx2;
-  eglglessink->egl_context->position_array[0].b = ty1;
 
   eglglessink->egl_context->position_array[1].x = x2;
   eglglessink->egl_context->position_array[1].y = y1;
   eglglessink->egl_context->position_array[1].z = 0;
-  eglglessink->egl_context->position_array[1].a = tx2;
-  eglglessink->egl_context->position_array[1].b = ty2;
 
   eglglessink->egl_context->position_array[2].x = x1;
   eglglessink->egl_context->position_array[2].y = y2;
   eglglessink->egl_context->position_array[2].z = 0;
-  eglglessink->egl_context->position_array[2].a = tx1;
-  eglglessink->egl_context->position_array[2].b = ty1;
 
   eglglessink->egl_context->position_array[3].x = x1;
   eglglessink->egl_context->position_array[3].y = y1;
   eglglessink->egl_context->position_array[3].z = 0;
-  eglglessink->egl_context->position_array[3].a = tx1;
-  eglglessink->egl_context->position_array[3].b = ty2;
 
   /* X-normal, Y-flip orientation */
   eglglessink->egl_context->position_array[4 + 0].x = x2;
   eglglessink->egl_context->position_array[4 + 0].y = y2;
   eglglessink->egl_context->position_array[4 + 0].z = 0;
-  eglglessink->egl_context->position_array[4 + 0].a = tx2;
-  eglglessink->egl_context->position_array[4 + 0].b = ty2;
 
   eglglessink->egl_context->position_array[4 + 1].x = x2;
   eglglessink->egl_context->position_array[4 + 1].y = y1;
   eglglessink->egl_context->position_array[4 + 1].z = 0;
-  eglglessink->egl_context->position_array[4 + 1].a = tx2;
-  eglglessink->egl_context->position_array[4 + 1].b = ty1;
 
   eglglessink->egl_context->position_array[4 + 2].x = x1;
   eglglessink->egl_context->position_array[4 + 2].y = y2;
   eglglessink->egl_context->position_array[4 + 2].z = 0;
-  eglglessink->egl_context->position_array[4 + 2].a = tx1;
-  eglglessink->egl_context->position_array[4 + 2].b = ty2;
 
   eglglessink->egl_context->position_array[4 + 3].x = x1;
   eglglessink->egl_context->position_array[4 + 3].y = y1;
   eglglessink->egl_context->position_array[4 + 3].z = 0;
-  eglglessink->egl_context->position_array[4 + 3].a = tx1;
-  eglglessink->egl_context->position_array[4 + 3].b = ty1;
 
 
   if (eglglessink->display_region.x == 0) {
@@ -1181,38 +1854,57 @@ gst_eglglessink_setup_vbo (GstEglGlesSink * eglglessink)
     eglglessink->egl_context->position_array[12 + 3].z = 0;
   }
 
-  eglglessink->egl_context->index_array[0] = 0;
-  eglglessink->egl_context->index_array[1] = 1;
-  eglglessink->egl_context->index_array[2] = 2;
-  eglglessink->egl_context->index_array[3] = 3;
-
-  glGenBuffers (1, &eglglessink->egl_context->position_buffer);
-  glGenBuffers (1, &eglglessink->egl_context->index_buffer);
-  if (got_gl_error ("glGenBuffers"))
-    goto HANDLE_ERROR_LOCKED;
-
-  glBindBuffer (GL_ARRAY_BUFFER, eglglessink->egl_context->position_buffer);
-  if (got_gl_error ("glBindBuffer position_buffer"))
-    goto HANDLE_ERROR_LOCKED;
-
-  glBufferData (GL_ARRAY_BUFFER,
-      sizeof (eglglessink->egl_context->position_array),
-      eglglessink->egl_context->position_array, GL_STATIC_DRAW);
-  if (got_gl_error ("glBufferData position_buffer"))
-    goto HANDLE_ERROR_LOCKED;
-
-  glBindBuffer (GL_ELEMENT_ARRAY_BUFFER,
-      eglglessink->egl_context->index_buffer);
-  if (got_gl_error ("glBindBuffer index_buffer"))
-    goto HANDLE_ERROR_LOCKED;
+  /* 离屏渲染（FBO）使用的四边形，顶点顺序和上面一致：右上、右下、左上、左下
+   * 16: 铺满整个FBO，纹理坐标为裁剪区域（x-normal,y-normal，已经旋转）
+   * 20: 铺满整个FBO，纹理坐标为裁剪区域（x-normal,y-flip，已经旋转）
+   * 24: 铺满整个FBO，纹理坐标和顶点一一对应（FBO纹理之间拷贝）
+   * 28: display_region，纹理坐标和顶点一一对应（FBO纹理绘制到surface） */
+  for (i = 0; i < 4; i++) {
+    gboolean right = (i < 2);
+    gboolean top = (i % 2 == 0);
+    coord5 *quad = &eglglessink->egl_context->position_array[16];
+
+    quad[0 + i].x = quad[4 + i].x = quad[8 + i].x = right ? 1 : -1;
+    quad[0 + i].y = quad[4 + i].y = quad[8 + i].y = top ? 1 : -1;
+    quad[0 + i].z = quad[4 + i].z = quad[8 + i].z = 0;
+    quad[8 + i].a = right ? 1 : 0;
+    quad[8 + i].b = top ? 1 : 0;
+
+    quad[12 + i].x = right ? x2 : x1;
+    quad[12 + i].y = top ? y2 : y1;
+    quad[12 + i].z = 0;
+    quad[12 + i].a = right ? 1 : 0;
+    quad[12 + i].b = top ? 1 : 0;
+  }
 
-  glBufferData (GL_ELEMENT_ARRAY_BUFFER,
-      sizeof (eglglessink->egl_context->index_array),
-      eglglessink->egl_context->index_array, GL_STATIC_DRAW);
-  if (got_gl_error ("glBufferData index_buffer"))
-    goto HANDLE_ERROR_LOCKED;
+  /* 视频帧四边形（0、4、16、20）的纹理坐标：
+   * 先按 rotate_method 把屏幕上的位置映射回源视频中的位置，y-flip 的纹理再上下翻转 */
+  for (i = 0; i < 4; i++) {
+    gboolean right = (i < 2);
+    gboolean top = (i % 2 == 0);
+    coord5 *pos = eglglessink->egl_context->position_array;
+    gdouble s, t;
+
+    gst_eglglessink_orient_texpos (eglglessink->rotate_method,
+        right ? 1 : 0, top ? 0 : 1, &s, &t);
+
+    pos[0 + i].a = pos[4 + i].a = pos[16 + i].a = pos[20 + i].a =
+        tx1 + s * (tx2 - tx1);
+    pos[0 + i].b = pos[16 + i].b = ty1 + t * (ty2 - ty1);
+    pos[4 + i].b = pos[20 + i].b = ty2 - t * (ty2 - ty1);
+  }
 
-  eglglessink->egl_context->have_vbo = TRUE;
+  if (!eglglessink->egl_context->have_vbo) {
+    if (!gst_eglglessink_create_vbo (eglglessink))
+      goto HANDLE_ERROR_LOCKED;
+  } else {
+    glBindBuffer (GL_ARRAY_BUFFER, eglglessink->egl_context->position_buffer);
+    glBufferSubData (GL_ARRAY_BUFFER, 0,
+        sizeof (eglglessink->egl_context->position_array),
+        eglglessink->egl_context->position_array);
+    if (got_gl_error ("glBufferSubData position_buffer"))
+      goto HANDLE_ERROR_LOCKED;
+  }
 
   GST_DEBUG_OBJECT (eglglessink, "VBO setup done");
 
@@ -1352,19 +2044,81 @@ gst_eglglessink_crop_changed (GstEglGlesSink * eglglessink,
       eglglessink->crop.h != eglglessink->configured_info.height);
 }
 
+#ifndef HAVE_IOS
+/**
+ * @brief: 把 dmabuf 的每个平面导入成 EGLImage（有缓存，缓冲池的buffer只在第一次出现时导入）
+ *         并绑定到 texture[i]，和系统内存路径使用同样的纹理和着色程序，不拷贝数据
+*/
+static gboolean
+gst_eglglessink_import_dmabuf (GstEglGlesSink * eglglessink, GstBuffer * buf)
+{
+  GstEglAdaptationContext *ctx = eglglessink->egl_context;
+  guint i, n_planes = GST_VIDEO_INFO_N_PLANES (&eglglessink->configured_info);
+  EGLImageKHR image;
+
+  if (!eglglessink->glEGLImageTargetTexture2DOES) {
+    GST_ERROR_OBJECT (eglglessink,
+        "glEGLImageTargetTexture2DOES not supported");
+    return FALSE;
+  }
+
+  for (i = 0; i < n_planes; i++) {
+    image = gst_egl_dmabuf_cache_import (eglglessink->dmabuf_cache, buf,
+        &eglglessink->configured_info, eglglessink->dmabuf_modifier, i);
+    if (image == EGL_NO_IMAGE_KHR)
+      return FALSE;
+
+    glActiveTexture (GL_TEXTURE0 + i);
+    glBindTexture (GL_TEXTURE_2D, ctx->texture[i]);
+    eglglessink->glEGLImageTargetTexture2DOES (GL_TEXTURE_2D, image);
+    if (got_gl_error ("glEGLImageTargetTexture2DOES"))
+      return FALSE;
+  }
+
+  eglglessink->orientation = GST_VIDEO_GL_TEXTURE_ORIENTATION_X_NORMAL_Y_NORMAL;
+  eglglessink->stride[0] = 1;
+  eglglessink->stride[1] = 1;
+  eglglessink->stride[2] = 1;
+
+  /* 纹理直接采样 dmabuf，上游拿回 buffer 之后会重用它，保持引用直到下一帧导入 */
+  gst_buffer_replace (&eglglessink->dmabuf_buffer, buf);
+  eglglessink->last_uploaded_buffer = buf;
+
+  return TRUE;
+}
+#endif
+
+/* 预先缩小的buffer上附带的视频信息（GstVideoInfo，尺寸和 configured_info 不同） */
+#define GST_EGLGLESSINK_PREDOWNSCALE_QUARK \
+    g_quark_from_static_string ("GstEglGlesSinkPredownscaleInfo")
+
 static gboolean
 gst_eglglessink_fill_texture (GstEglGlesSink * eglglessink, GstBuffer * buf)
 {
   GstVideoFrame vframe;
+  GstVideoInfo *info;
 #ifndef GST_DISABLE_GST_DEBUG
   gint w;
 #endif
   gint h;
+  GLint l_internal, la_internal;
+  GLenum l_format, la_format;
 
   memset (&vframe, 0, sizeof (vframe));
 
-  if (!gst_video_frame_map (&vframe, &eglglessink->configured_info, buf,
-          GST_MAP_READ)) {
+  /* GLES3 时单/双通道平面使用 R8/RG8 */
+  gst_egl_adaptation_plane_format (eglglessink->egl_context->texture_swizzle,
+      1, &l_internal, &l_format);
+  gst_egl_adaptation_plane_format (eglglessink->egl_context->texture_swizzle,
+      2, &la_internal, &la_format);
+
+  /* 预先缩小的帧使用附带的视频信息 */
+  info = gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (buf),
+      GST_EGLGLESSINK_PREDOWNSCALE_QUARK);
+  if (!info)
+    info = &eglglessink->configured_info;
+
+  if (!gst_video_frame_map (&vframe, info, buf, GST_MAP_READ)) {
     GST_ERROR_OBJECT (eglglessink, "Couldn't map frame");
     goto HANDLE_ERROR;
   }
@@ -1377,7 +2131,7 @@ gst_eglglessink_fill_texture (GstEglGlesSink * eglglessink, GstBuffer * buf)
       "Got buffer %p: %dx%d size %" G_GSIZE_FORMAT, buf, w, h,
       gst_buffer_get_size (buf));
 
-  switch (eglglessink->configured_info.finfo->format) {
+  switch (info->finfo->format) {
     case GST_VIDEO_FORMAT_BGR:
     case GST_VIDEO_FORMAT_RGB:{
       gint stride;
@@ -1586,10 +2340,10 @@ gst_eglglessink_fill_texture (GstEglGlesSink * eglglessink, GstBuffer * buf)
       eglglessink->stride[0] = ((gdouble) stride_width) / ((gdouble) c_w);
 
       glBindTexture (GL_TEXTURE_2D, eglglessink->egl_context->texture[0]);
-      glTexImage2D (GL_TEXTURE_2D, 0, GL_LUMINANCE,
+      glTexImage2D (GL_TEXTURE_2D, 0, l_internal,
           stride_width,
           GST_VIDEO_FRAME_COMP_HEIGHT (&vframe, 0),
-          0, GL_LUMINANCE, GL_UNSIGNED_BYTE,
+          0, l_format, GL_UNSIGNED_BYTE,
           GST_VIDEO_FRAME_COMP_DATA (&vframe, 0));
 
 
@@ -1628,10 +2382,10 @@ gst_eglglessink_fill_texture (GstEglGlesSink * eglglessink, GstBuffer * buf)
       eglglessink->stride[1] = ((gdouble) stride_width) / ((gdouble) c_w);
 
       glBindTexture (GL_TEXTURE_2D, eglglessink->egl_context->texture[1]);
-      glTexImage2D (GL_TEXTURE_2D, 0, GL_LUMINANCE,
+      glTexImage2D (GL_TEXTURE_2D, 0, l_internal,
           stride_width,
           GST_VIDEO_FRAME_COMP_HEIGHT (&vframe, 1),
-          0, GL_LUMINANCE, GL_UNSIGNED_BYTE,
+          0, l_format, GL_UNSIGNED_BYTE,
           GST_VIDEO_FRAME_COMP_DATA (&vframe, 1));
 
 
@@ -1670,10 +2424,10 @@ gst_eglglessink_fill_texture (GstEglGlesSink * eglglessink, GstBuffer * buf)
       eglglessink->stride[2] = ((gdouble) stride_width) / ((gdouble) c_w);
 
       glBindTexture (GL_TEXTURE_2D, eglglessink->egl_context->texture[2]);
-      glTexImage2D (GL_TEXTURE_2D, 0, GL_LUMINANCE,
+      glTexImage2D (GL_TEXTURE_2D, 0, l_internal,
           stride_width,
           GST_VIDEO_FRAME_COMP_HEIGHT (&vframe, 2),
-          0, GL_LUMINANCE, GL_UNSIGNED_BYTE,
+          0, l_format, GL_UNSIGNED_BYTE,
           GST_VIDEO_FRAME_COMP_DATA (&vframe, 2));
       break;
     }
@@ -1718,10 +2472,10 @@ gst_eglglessink_fill_texture (GstEglGlesSink * eglglessink, GstBuffer * buf)
       eglglessink->stride[0] = ((gdouble) stride_width) / ((gdouble) c_w);
 
       glBindTexture (GL_TEXTURE_2D, eglglessink->egl_context->texture[0]);
-      glTexImage2D (GL_TEXTURE_2D, 0, GL_LUMINANCE,
+      glTexImage2D (GL_TEXTURE_2D, 0, l_internal,
           stride_width,
           GST_VIDEO_FRAME_COMP_HEIGHT (&vframe, 0),
-          0, GL_LUMINANCE, GL_UNSIGNED_BYTE,
+          0, l_format, GL_UNSIGNED_BYTE,
           GST_VIDEO_FRAME_PLANE_DATA (&vframe, 0));
 
 
@@ -1756,10 +2510,10 @@ gst_eglglessink_fill_texture (GstEglGlesSink * eglglessink, GstBuffer * buf)
       eglglessink->stride[1] = ((gdouble) stride_width) / ((gdouble) c_w);
 
       glBindTexture (GL_TEXTURE_2D, eglglessink->egl_context->texture[1]);
-      glTexImage2D (GL_TEXTURE_2D, 0, GL_LUMINANCE_ALPHA,
+      glTexImage2D (GL_TEXTURE_2D, 0, la_internal,
           stride_width,
           GST_VIDEO_FRAME_COMP_HEIGHT (&vframe, 1),
-          0, GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE,
+          0, la_format, GL_UNSIGNED_BYTE,
           GST_VIDEO_FRAME_PLANE_DATA (&vframe, 1));
       break;
     }
@@ -2028,6 +2782,61 @@ HANDLE_ERROR:
 }
 
 /* 更新纹理*/
+/**
+ * @brief: 替换当前帧的叠加层（在渲染线程中调用）
+*/
+static void
+gst_eglglessink_set_overlay_composition (GstEglGlesSink * eglglessink,
+    GstVideoOverlayComposition * composition)
+{
+  if (composition)
+    gst_video_overlay_composition_ref (composition);
+  if (eglglessink->overlay_composition)
+    gst_video_overlay_composition_unref (eglglessink->overlay_composition);
+  eglglessink->overlay_composition = composition;
+}
+
+/**
+ * @brief: 根据caps的 interlace-mode 和 buffer 的场标志，决定当前帧是否需要去隔行以及先输出哪一场
+*/
+static void
+gst_eglglessink_update_deinterlace (GstEglGlesSink * eglglessink,
+    GstBuffer * buf)
+{
+  GstVideoInfo *info = &eglglessink->configured_info;
+  gboolean interlaced, tff, onefield;
+
+  switch (GST_VIDEO_INFO_INTERLACE_MODE (info)) {
+    case GST_VIDEO_INTERLACE_MODE_INTERLEAVED:
+      interlaced = TRUE;
+      break;
+    case GST_VIDEO_INTERLACE_MODE_MIXED:
+      interlaced =
+          GST_BUFFER_FLAG_IS_SET (buf, GST_VIDEO_BUFFER_FLAG_INTERLACED);
+      break;
+    default:
+      /* progressive；alternate/fields 每个buffer只有一场，按逐行处理 */
+      interlaced = FALSE;
+      break;
+  }
+
+  tff = GST_BUFFER_FLAG_IS_SET (buf, GST_VIDEO_BUFFER_FLAG_TFF) ||
+      GST_VIDEO_INFO_FIELD_ORDER (info) ==
+      GST_VIDEO_FIELD_ORDER_TOP_FIELD_FIRST;
+  onefield = GST_BUFFER_FLAG_IS_SET (buf, GST_VIDEO_BUFFER_FLAG_ONEFIELD);
+
+  eglglessink->deinterlacing = interlaced &&
+      eglglessink->deinterlace_method != GST_EGL_DEINTERLACE_METHOD_NONE;
+  eglglessink->deinterlace_field = tff ? 0 : 1;
+  eglglessink->second_field = FALSE;
+  eglglessink->second_field_pending = eglglessink->deinterlacing &&
+      eglglessink->deinterlace_field_rate && !onefield &&
+      (eglglessink->deinterlace_method == GST_EGL_DEINTERLACE_METHOD_BOB ||
+      eglglessink->deinterlace_method == GST_EGL_DEINTERLACE_METHOD_LINEAR) &&
+      GST_CLOCK_TIME_IS_VALID (GST_BUFFER_PTS (buf)) &&
+      GST_CLOCK_TIME_IS_VALID (GST_BUFFER_DURATION (buf));
+}
+
 static GstFlowReturn
 gst_eglglessink_upload (GstEglGlesSink * eglglessink, GstBuffer * buf) {
   
@@ -2042,11 +2851,42 @@ gst_eglglessink_upload (GstEglGlesSink * eglglessink, GstBuffer * buf) {
     #endif
 
     GstVideoGLTextureUploadMeta *upload_meta;
+    GstVideoAffineTransformationMeta *affine_meta;
+    GstVideoOverlayCompositionMeta *overlay_meta;
 
     crop = gst_buffer_get_video_crop_meta (buf);
 
     upload_meta = gst_buffer_get_video_gl_texture_upload_meta (buf);
 
+#ifndef HAVE_IOS
+    /* 只有 EGLImage 输入采样缓存中的纹理，其他路径上传到 texture[i] */
+    memset (eglglessink->egl_context->image_texture, 0,
+        sizeof (eglglessink->egl_context->image_texture));
+#endif
+
+    gst_eglglessink_update_deinterlace (eglglessink, buf);
+
+#ifndef HAVE_IOS
+    gst_eglglessink_collect_roi (eglglessink, buf);
+#endif
+
+    overlay_meta = gst_buffer_get_video_overlay_composition_meta (buf);
+    gst_eglglessink_set_overlay_composition (eglglessink,
+        overlay_meta ? overlay_meta->overlay : NULL);
+
+    affine_meta = gst_buffer_get_video_affine_transformation_meta (buf);
+    eglglessink->have_transform = affine_meta != NULL;
+    if (affine_meta)
+      memcpy (eglglessink->transform, affine_meta->matrix,
+          sizeof (eglglessink->transform));
+
+    /* 这一帧需要重新绘制时不能再直接上传到 egl-share-texture */
+    if (eglglessink->egl_context->direct_upload &&
+        gst_eglglessink_needs_output_fbo (eglglessink) &&
+        !gst_egl_adaptation_leave_direct_upload (eglglessink->egl_context,
+            GST_VIDEO_INFO_FORMAT (&eglglessink->configured_info)))
+      goto HANDLE_ERROR;
+
     if (gst_eglglessink_crop_changed (eglglessink, crop)) {
       if (crop) {
         eglglessink->crop.x = crop->x;
@@ -2168,9 +3008,23 @@ gst_eglglessink_upload (GstEglGlesSink * eglglessink, GstBuffer * buf) {
                (mem = gst_buffer_peek_memory (buf, 0)) && \
                 gst_is_egl_image_memory (mem)) {
       guint n, i;
+      gboolean use_cache;
 
       n = gst_buffer_n_memory (buf);
 
+      if (!eglglessink->glEGLImageTargetTexture2DOES) {
+        GST_ERROR_OBJECT (eglglessink,
+            "glEGLImageTargetTexture2DOES not supported");
+        return GST_FLOW_ERROR;
+      }
+
+      /* 上传的纹理就是 egl-share-texture（passthrough）时，EGLImage 必须绑定到它上面 */
+      use_cache = !eglglessink->egl_context->direct_upload;
+      if (use_cache && !eglglessink->image_texture_cache)
+        eglglessink->image_texture_cache =
+            gst_egl_image_texture_cache_new (GST_ELEMENT (eglglessink),
+            eglglessink->egl_context->garbage);
+
       for (i = 0; i < n; i++) {
         mem = gst_buffer_peek_memory (buf, i);
 
@@ -2183,19 +3037,24 @@ gst_eglglessink_upload (GstEglGlesSink * eglglessink, GstBuffer * buf) {
         else if (i == 2)
           glActiveTexture (GL_TEXTURE2);
 
-        glBindTexture (GL_TEXTURE_2D, eglglessink->egl_context->texture[i]);
-
-        if (eglglessink->glEGLImageTargetTexture2DOES) {
+        if (use_cache) {
+          /* 每个内存只绑定一次，之后只需要选择纹理 */
+          eglglessink->egl_context->image_texture[i] =
+              gst_egl_image_texture_cache_get
+              (eglglessink->image_texture_cache, eglglessink->egl_context,
+              mem, GST_VIDEO_INFO_FORMAT (&eglglessink->configured_info), i,
+              eglglessink->glEGLImageTargetTexture2DOES);
+          if (!eglglessink->egl_context->image_texture[i])
+            goto HANDLE_ERROR;
+        } else {
+          glBindTexture (GL_TEXTURE_2D, eglglessink->egl_context->texture[i]);
           eglglessink->glEGLImageTargetTexture2DOES (GL_TEXTURE_2D,
               gst_egl_image_memory_get_image (mem));
           if (got_gl_error ("glEGLImageTargetTexture2DOES"))
             goto HANDLE_ERROR;
-        } else {
-          GST_ERROR_OBJECT (eglglessink,
-              "glEGLImageTargetTexture2DOES not supported");
-          return GST_FLOW_ERROR;
         }
 
+
         eglglessink->orientation = gst_egl_image_memory_get_orientation (mem);
         if (eglglessink->orientation !=
             GST_VIDEO_GL_TEXTURE_ORIENTATION_X_NORMAL_Y_NORMAL
@@ -2217,6 +3076,11 @@ gst_eglglessink_upload (GstEglGlesSink * eglglessink, GstBuffer * buf) {
       if (!gst_eglglessink_cuda_buffer_copy(eglglessink, buf)) {
         goto HANDLE_ERROR;
       }
+#ifndef HAVE_IOS
+    } else if (eglglessink->using_dmabuf) {
+      if (!gst_eglglessink_import_dmabuf (eglglessink, buf))
+        goto HANDLE_ERROR;
+#endif
     } else {
       eglglessink->orientation =
           GST_VIDEO_GL_TEXTURE_ORIENTATION_X_NORMAL_Y_NORMAL;
@@ -2236,207 +3100,1601 @@ HANDLE_ERROR:
 }
 
 /**
- * @brief: gl顶点相关，绘制
+ * @brief: 列主序 4x4 矩阵相乘 result = a * b（result 可以和 a、b 相同）
 */
-static GstFlowReturn
-gst_eglglessink_render (GstEglGlesSink * eglglessink)
+static void
+gst_eglglessink_multiply_matrix4 (const gfloat * a, const gfloat * b,
+    gfloat * result)
 {
-  guint dar_n, dar_d;
-  gint i;
+  gfloat tmp[16];
+  gint r, c, k;
+
+  for (c = 0; c < 4; c++) {
+    for (r = 0; r < 4; r++) {
+      tmp[c * 4 + r] = 0;
+      for (k = 0; k < 4; k++)
+        tmp[c * 4 + r] += a[k * 4 + r] * b[c * 4 + k];
+    }
+  }
 
-  /* If no one has set a display rectangle on us initialize
-   * a sane default. According to the docs on the xOverlay
-   * interface we are supposed to fill the overlay 100%. We
-   * do this trying to take PAR/DAR into account unless the
-   * calling party explicitly ask us not to by setting
-   * force_aspect_ratio to FALSE.
-   */
-  if (gst_egl_adaptation_update_surface_dimensions (eglglessink->egl_context) ||
-      eglglessink->render_region_changed ||
-      !eglglessink->display_region.w || !eglglessink->display_region.h ||
-      eglglessink->crop_changed) {
-    GST_OBJECT_LOCK (eglglessink);
+  memcpy (result, tmp, sizeof (tmp));
+}
 
-    if (!eglglessink->render_region_user) {
-      eglglessink->render_region.x = 0;
-      eglglessink->render_region.y = 0;
-      eglglessink->render_region.w = eglglessink->egl_context->surface_width / eglglessink->rows;
-      eglglessink->render_region.h = eglglessink->egl_context->surface_height / eglglessink->columns;
-    }
-    eglglessink->render_region_changed = FALSE;
-    eglglessink->crop_changed = FALSE;
+/**
+ * @brief: 设置顶点着色器中的 u_transformation
+ * @param display: TRUE 表示绘制到 display_region，需要应用当前帧的仿射变换；
+ *                 FALSE（FBO中间结果）使用单位矩阵
+ * @note: 仿射变换矩阵定义在视频坐标（[0,1]，y 轴向下）中，这里转换到
+ *        display_region 对应的 NDC，使变换以视频区域为参考而不是整个surface
+*/
+static gboolean
+gst_eglglessink_set_transform (GstEglGlesSink * eglglessink, GLint loc,
+    gboolean display)
+{
+  static const gfloat identity[16] = {
+    1, 0, 0, 0,
+    0, 1, 0, 0,
+    0, 0, 1, 0,
+    0, 0, 0, 1
+  };
+  gfloat matrix[16];
 
-    if (!eglglessink->force_aspect_ratio) {
-      eglglessink->display_region.x = 0;
-      eglglessink->display_region.y = 0;
-      eglglessink->display_region.w = eglglessink->render_region.w;
-      eglglessink->display_region.h = eglglessink->render_region.h;
-    } else {
-      GstVideoRectangle frame;
+  if (!display || !eglglessink->have_transform) {
+    glUniformMatrix4fv (loc, 1, GL_FALSE, identity);
+  } else {
+    gfloat render_width = eglglessink->render_region.w;
+    gfloat render_height = eglglessink->render_region.h;
+    gfloat hx = eglglessink->display_region.w / render_width;
+    gfloat hy = eglglessink->display_region.h / render_height;
+    gfloat cx = (eglglessink->display_region.x / render_width) * 2.0 - 1 + hx;
+    gfloat cy = (eglglessink->display_region.y / render_height) * 2.0 - 1 + hy;
+    /* NDC -> 视频坐标 */
+    gfloat to_video[16] = {
+      1 / (2 * hx), 0, 0, 0,
+      0, -1 / (2 * hy), 0, 0,
+      0, 0, 1, 0,
+      0.5 - cx / (2 * hx), 0.5 + cy / (2 * hy), 0, 1
+    };
+    /* 视频坐标 -> NDC */
+    gfloat from_video[16] = {
+      2 * hx, 0, 0, 0,
+      0, -2 * hy, 0, 0,
+      0, 0, 1, 0,
+      cx - hx, cy + hy, 0, 1
+    };
+
+    gst_eglglessink_multiply_matrix4 (eglglessink->transform, to_video, matrix);
+    gst_eglglessink_multiply_matrix4 (from_video, matrix, matrix);
+    glUniformMatrix4fv (loc, 1, GL_FALSE, matrix);
+  }
 
-      frame.x = 0;
-      frame.y = 0;
+  if (got_gl_error ("glUniformMatrix4fv"))
+    return FALSE;
 
-      if (!gst_video_calculate_display_ratio (&dar_n, &dar_d,
-              eglglessink->crop.w, eglglessink->crop.h,
-              eglglessink->configured_info.par_n,
-              eglglessink->configured_info.par_d,
-              eglglessink->egl_context->pixel_aspect_ratio_n,
-              eglglessink->egl_context->pixel_aspect_ratio_d)) {
-        GST_WARNING_OBJECT (eglglessink, "Could not compute resulting DAR");
-        frame.w = eglglessink->crop.w;
-        frame.h = eglglessink->crop.h;
-      } else {
-        /* Find suitable matching new size acording to dar & par
-         * rationale for prefering leaving the height untouched
-         * comes from interlacing considerations.
-         * XXX: Move this to gstutils?
-         */
-        if (eglglessink->crop.h % dar_d == 0) {
-          frame.w =
-              gst_util_uint64_scale_int (eglglessink->crop.h, dar_n, dar_d);
-          frame.h = eglglessink->crop.h;
-        } else if (eglglessink->crop.w % dar_n == 0) {
-          frame.h =
-              gst_util_uint64_scale_int (eglglessink->crop.w, dar_d, dar_n);
-          frame.w = eglglessink->crop.w;
-        } else {
-          /* Neither width nor height can be precisely scaled.
-           * Prefer to leave height untouched. See comment above.
-           */
-          frame.w =
-              gst_util_uint64_scale_int (eglglessink->crop.h, dar_n, dar_d);
-          frame.h = eglglessink->crop.h;
-        }
-      }
+  return TRUE;
+}
 
-      gst_video_sink_center_rect (frame, eglglessink->render_region,
-          &eglglessink->display_region, TRUE);
-    }
+/**
+ * @brief: 当前视频帧平面 @plane 的纹理：EGLImage 输入时是纹理缓存中绑定该内存的纹理
+*/
+static inline GLuint
+gst_eglglessink_frame_texture (GstEglAdaptationContext * ctx, gint plane)
+{
+  return ctx->image_texture[plane] ? ctx->image_texture[plane] :
+      ctx->texture[plane];
+}
+
+/**
+ * @brief: 使用 glslprogram[0] 把当前视频帧绘制到 position_array 中的四边形上
+ * @param quad: 四边形的起始下标（0: display_region，16: 铺满FBO），
+ *              y-flip 方向的纹理会自动使用 quad + 4
+*/
+static gboolean
+gst_eglglessink_draw_frame (GstEglGlesSink * eglglessink, gint quad)
+{
+  GstEglAdaptationContext *ctx = eglglessink->egl_context;
+  GLenum target;
+  gint i;
 
-    glViewport (eglglessink->render_region.x +
-                    (eglglessink->change_port % eglglessink->rows) * eglglessink->render_region.w,
-                eglglessink->egl_context->surface_height - eglglessink->render_region.h -
-                    (eglglessink->render_region.y +
-                        ((eglglessink->change_port / eglglessink->columns) % eglglessink->columns) *
-                            eglglessink->render_region.h),
-                eglglessink->render_region.w,
-                eglglessink->render_region.h);
+  if (eglglessink->orientation ==
+      GST_VIDEO_GL_TEXTURE_ORIENTATION_X_NORMAL_Y_FLIP) {
+    quad += 4;
+  } else if (eglglessink->orientation !=
+      GST_VIDEO_GL_TEXTURE_ORIENTATION_X_NORMAL_Y_NORMAL) {
+    g_assert_not_reached ();
+  }
 
-    /* Clear the surface once if its content is preserved */
-    if (eglglessink->egl_context->buffer_preserved ||
-        eglglessink->change_port % (eglglessink->rows * eglglessink->columns) == 0) {
-      glClearColor (0.0, 0.0, 0.0, 1.0);
-      glClear (GL_COLOR_BUFFER_BIT);
-      eglglessink->egl_context->buffer_preserved = FALSE;
-    }
+  glUseProgram (ctx->glslprogram[0]);
 
-    if (!gst_eglglessink_setup_vbo (eglglessink)) {
-      GST_OBJECT_UNLOCK (eglglessink);
-      GST_ERROR_OBJECT (eglglessink, "VBO setup failed");
-      goto HANDLE_ERROR;
+  for (i = 0; i < 3; i++) {
+    if (ctx->tex_scale[i] != eglglessink->stride[i]) {
+      glUniform2f (ctx->tex_scale_loc[0][i], eglglessink->stride[i], 1);
+      ctx->tex_scale[i] = eglglessink->stride[i];
     }
-    GST_OBJECT_UNLOCK (eglglessink);
   }
 
-  if (!eglglessink->egl_context->buffer_preserved) {
-    /* Draw black borders */
-    GST_DEBUG_OBJECT (eglglessink, "Drawing black border 1");
-    glUseProgram (eglglessink->egl_context->glslprogram[1]);
+  /* 仿射变换只作用在最终绘制到 display_region 的四边形上 */
+  if (!gst_eglglessink_set_transform (eglglessink, ctx->transform_loc[0],
+          quad < 8))
+    return FALSE;
 
-    glEnableVertexAttribArray (eglglessink->egl_context->position_loc[1]);
-    if (got_gl_error ("glEnableVertexAttribArray"))
-      goto HANDLE_ERROR;
+  /* 其它着色程序（例如缩放）会占用纹理单元，这里重新绑定视频帧纹理 */
+  target = eglglessink->using_nvbufsurf ? GL_TEXTURE_EXTERNAL_OES :
+      GL_TEXTURE_2D;
+  for (i = 0; i < ctx->n_textures; i++) {
+    glActiveTexture (GL_TEXTURE0 + i);
+    glBindTexture (target, gst_eglglessink_frame_texture (ctx, i));
+  }
+  if (got_gl_error ("glBindTexture"))
+    return FALSE;
 
-    glVertexAttribPointer (eglglessink->egl_context->position_loc[1], 3,
-        GL_FLOAT, GL_FALSE, sizeof (coord5), (gpointer) (8 * sizeof (coord5)));
-    if (got_gl_error ("glVertexAttribPointer"))
-      goto HANDLE_ERROR;
+  glBindVertexArray (ctx->quad_vao[quad / 4]);
+  glDrawElements (GL_TRIANGLE_STRIP, 4, GL_UNSIGNED_SHORT, 0);
+  glBindVertexArray (0);
+  if (got_gl_error ("glDrawElements"))
+    return FALSE;
 
-    glDrawElements (GL_TRIANGLE_STRIP, 4, GL_UNSIGNED_SHORT, 0);
-    if (got_gl_error ("glDrawElements"))
-      goto HANDLE_ERROR;
+  return TRUE;
+}
 
-    GST_DEBUG_OBJECT (eglglessink, "Drawing black border 2");
+/**
+ * @brief: 使用 glslprogram[index] 绘制 position_array[quad] 开始的四边形
+ *         （调用前需要设置好着色程序和 uniform）
+*/
+static gboolean
+gst_eglglessink_draw_quad (GstEglGlesSink * eglglessink, gint index,
+    gint quad)
+{
+  GstEglAdaptationContext *ctx = eglglessink->egl_context;
 
-    glVertexAttribPointer (eglglessink->egl_context->position_loc[1], 3,
-        GL_FLOAT, GL_FALSE, sizeof (coord5), (gpointer) (12 * sizeof (coord5)));
-    if (got_gl_error ("glVertexAttribPointer"))
-      goto HANDLE_ERROR;
+  glBindVertexArray (ctx->quad_vao[quad / 4]);
+  glDrawElements (GL_TRIANGLE_STRIP, 4, GL_UNSIGNED_SHORT, 0);
+  glBindVertexArray (0);
+  if (got_gl_error ("glDrawElements"))
+    return FALSE;
 
-    glDrawElements (GL_TRIANGLE_STRIP, 4, GL_UNSIGNED_SHORT, 0);
-    if (got_gl_error ("glDrawElements"))
-      goto HANDLE_ERROR;
+  return TRUE;
+}
 
-    glDisableVertexAttribArray (eglglessink->egl_context->position_loc[1]);
-  }
+/**
+ * @brief: 可分离滤波的一遍，把 @texture 绘制到 position_array[quad] 上
+ * @param tex_scale: 纹理的stride缩放（只对水平方向有效）
+ * @param texel_x, texel_y: 源纹理一个像素对应的纹理坐标大小
+ * @param dir_x, dir_y: 滤波方向
+ * @param factor: 该方向上的缩小倍数（源尺寸 / 目标尺寸）
+*/
+static gboolean
+gst_eglglessink_draw_scale_pass (GstEglGlesSink * eglglessink, GLuint texture,
+    gint quad, gfloat tex_scale, gfloat texel_x, gfloat texel_y,
+    gfloat dir_x, gfloat dir_y, gfloat factor)
+{
+  GstEglAdaptationContext *ctx = eglglessink->egl_context;
+
+  glUseProgram (ctx->glslprogram[2]);
+
+  glActiveTexture (GL_TEXTURE0);
+  glBindTexture (GL_TEXTURE_2D, texture);
+  glUniform1i (ctx->scale_tex_loc, 0);
+  glUniform2f (ctx->scale_tex_scale_loc, tex_scale, 1);
+  glUniform2f (ctx->scale_texel_loc, texel_x, texel_y);
+  glUniform2f (ctx->scale_dir_loc, dir_x, dir_y);
+  /* 放大时滤波核保持原始宽度 */
+  glUniform1f (ctx->scale_factor_loc, CLAMP (factor, 1.0,
+          GST_EGL_SCALE_MAX_FACTOR));
+  if (got_gl_error ("glUniform"))
+    return FALSE;
 
-  /* Draw video frame */
-  GST_DEBUG_OBJECT (eglglessink, "Drawing video frame");
+  if (!gst_eglglessink_set_transform (eglglessink, ctx->transform_loc[2],
+          quad == 28))
+    return FALSE;
 
-  glUseProgram (eglglessink->egl_context->glslprogram[0]);
+  return gst_eglglessink_draw_quad (eglglessink, 2, quad);
+}
 
-  glUniform2f (eglglessink->egl_context->tex_scale_loc[0][0],
-      eglglessink->stride[0], 1);
-  glUniform2f (eglglessink->egl_context->tex_scale_loc[0][1],
-      eglglessink->stride[1], 1);
-  glUniform2f (eglglessink->egl_context->tex_scale_loc[0][2],
-      eglglessink->stride[2], 1);
+/**
+ * @brief: 去隔行
+ *         1. 视频帧以裁剪（旋转）后的原始尺寸转换到 fbo[0]
+ *         2. 按 deinterlace_method 和 deinterlace_field 处理到 fbo[2]
+ * @note: 行号总是按源视频计算，所以旋转之后（场在fbo[0]中可能是列）也能正确去隔行
+*/
+static gboolean
+gst_eglglessink_deinterlace (GstEglGlesSink * eglglessink)
+{
+  GstEglAdaptationContext *ctx = eglglessink->egl_context;
+  gboolean transposed =
+      GST_EGLGLESSINK_METHOD_IS_TRANSPOSED (eglglessink->rotate_method);
+  gint src_w = transposed ? eglglessink->crop.h : eglglessink->crop.w;
+  gint src_h = transposed ? eglglessink->crop.w : eglglessink->crop.h;
+  gdouble s, t0, tx, ty;
+
+  if (!gst_egl_adaptation_init_deinterlace (ctx))
+    return FALSE;
 
-  for (i = 0; i < eglglessink->egl_context->n_textures; i++) {
-    glUniform1i (eglglessink->egl_context->tex_loc[0][i], i);
-    if (got_gl_error ("glUniform1i"))
-      goto HANDLE_ERROR;
-  }
+  if (!gst_egl_adaptation_setup_fbo (ctx, 0, src_w, src_h, GL_NEAREST) ||
+      !gst_egl_adaptation_setup_fbo (ctx, 2, src_w, src_h, GL_LINEAR))
+    return FALSE;
 
-  glEnableVertexAttribArray (eglglessink->egl_context->position_loc[0]);
-  if (got_gl_error ("glEnableVertexAttribArray"))
-    goto HANDLE_ERROR;
+  glBindFramebuffer (GL_FRAMEBUFFER, ctx->fbo[0]);
+  glViewport (0, 0, src_w, src_h);
+  if (!gst_eglglessink_draw_frame (eglglessink, 16))
+    return FALSE;
 
-  glEnableVertexAttribArray (eglglessink->egl_context->texpos_loc[0]);
-  if (got_gl_error ("glEnableVertexAttribArray"))
-    goto HANDLE_ERROR;
+  /* fbo[0] 的纹理坐标 (x, y) 对应屏幕上的 (u, v) = (x, 1 - y)，
+   * 源视频中的行位置 t = t0 + tx * x + ty * y */
+  gst_eglglessink_orient_texpos (eglglessink->rotate_method, 0, 1, &s, &t0);
+  gst_eglglessink_orient_texpos (eglglessink->rotate_method, 1, 1, &s, &tx);
+  gst_eglglessink_orient_texpos (eglglessink->rotate_method, 0, 0, &s, &ty);
+  tx -= t0;
+  ty -= t0;
+
+  glBindFramebuffer (GL_FRAMEBUFFER, ctx->fbo[2]);
+  glUseProgram (ctx->glslprogram[3]);
+
+  glActiveTexture (GL_TEXTURE0);
+  glBindTexture (GL_TEXTURE_2D, ctx->fbo_texture[0]);
+  glUniform1i (ctx->deint_tex_loc, 0);
+  glUniform3f (ctx->deint_line_coef_loc, tx, ty, t0);
+  if (tx != 0)
+    glUniform2f (ctx->deint_line_step_loc, 1.0 / (tx * eglglessink->crop.h), 0);
+  else
+    glUniform2f (ctx->deint_line_step_loc, 0, 1.0 / (ty * eglglessink->crop.h));
+  glUniform1f (ctx->deint_lines_loc, eglglessink->crop.h);
+  glUniform1f (ctx->deint_line_offset_loc, eglglessink->crop.y);
+  glUniform1f (ctx->deint_field_loc, eglglessink->deinterlace_field);
+  glUniform1f (ctx->deint_mode_loc, eglglessink->deinterlace_method);
+  if (got_gl_error ("glUniform"))
+    return FALSE;
 
-  if (eglglessink->orientation ==
-      GST_VIDEO_GL_TEXTURE_ORIENTATION_X_NORMAL_Y_NORMAL) {
-    glVertexAttribPointer (eglglessink->egl_context->position_loc[0], 3,
-        GL_FLOAT, GL_FALSE, sizeof (coord5), (gpointer) (0 * sizeof (coord5)));
-    if (got_gl_error ("glVertexAttribPointer"))
-      goto HANDLE_ERROR;
+  if (!gst_eglglessink_set_transform (eglglessink, ctx->transform_loc[3],
+          FALSE))
+    return FALSE;
+
+  if (!gst_eglglessink_draw_quad (eglglessink, 3, 24))
+    return FALSE;
+
+  glBindFramebuffer (GL_FRAMEBUFFER, ctx->target_fbo);
+  glViewport (eglglessink->viewport.x, eglglessink->viewport.y,
+      eglglessink->viewport.w, eglglessink->viewport.h);
+
+  return TRUE;
+}
+
+/**
+ * @brief: 把去隔行之后的 fbo[2] 直接绘制（GL_LINEAR 缩放）到 display_region
+*/
+static gboolean
+gst_eglglessink_draw_deinterlaced (GstEglGlesSink * eglglessink)
+{
+  GstEglAdaptationContext *ctx = eglglessink->egl_context;
+
+  glUseProgram (ctx->glslprogram[3]);
+
+  glActiveTexture (GL_TEXTURE0);
+  glBindTexture (GL_TEXTURE_2D, ctx->fbo_texture[2]);
+  glUniform1i (ctx->deint_tex_loc, 0);
+  glUniform1f (ctx->deint_mode_loc, GST_EGL_DEINTERLACE_METHOD_NONE);
+  if (got_gl_error ("glUniform"))
+    return FALSE;
+
+  if (!gst_eglglessink_set_transform (eglglessink, ctx->transform_loc[3],
+          TRUE))
+    return FALSE;
+
+  return gst_eglglessink_draw_quad (eglglessink, 3, 28);
+}
+
+/**
+ * @brief: 把视频帧中的矩形（像素，相对于caps的宽高）映射到 display_region 中
+ * @param s, t: 输出，矩形在视频（裁剪区域）中的归一化位置 [左, 右]、[上, 下]
+ * @param u, v: 输出，旋转之后矩形在 display_region 中的归一化位置（从小到大）
+*/
+static void
+gst_eglglessink_map_video_rect (GstEglGlesSink * eglglessink, gint x, gint y,
+    guint w, guint h, gdouble s[2], gdouble t[2], gdouble u[2], gdouble v[2])
+{
+  gdouble s0, t0, su, tu, sv, tv;
+  gint i;
+
+  s[0] = (gdouble) (x - eglglessink->crop.x) / eglglessink->crop.w;
+  s[1] = (gdouble) (x + (gint) w - eglglessink->crop.x) / eglglessink->crop.w;
+  t[0] = (gdouble) (y - eglglessink->crop.y) / eglglessink->crop.h;
+  t[1] = (gdouble) (y + (gint) h - eglglessink->crop.y) / eglglessink->crop.h;
+
+  /* 屏幕 (u, v) -> 视频 (s, t) 是正交变换，它的逆就是转置 */
+  gst_eglglessink_orient_texpos (eglglessink->rotate_method, 0, 0, &s0, &t0);
+  gst_eglglessink_orient_texpos (eglglessink->rotate_method, 1, 0, &su, &tu);
+  gst_eglglessink_orient_texpos (eglglessink->rotate_method, 0, 1, &sv, &tv);
+  su -= s0;
+  tu -= t0;
+  sv -= s0;
+  tv -= t0;
+
+  for (i = 0; i < 2; i++) {
+    u[i] = su * (s[i] - s0) + tu * (t[i] - t0);
+    v[i] = sv * (s[i] - s0) + tv * (t[i] - t0);
+  }
+  if (u[0] > u[1]) {
+    gdouble tmp = u[0];
+    u[0] = u[1];
+    u[1] = tmp;
+  }
+  if (v[0] > v[1]) {
+    gdouble tmp = v[0];
+    v[0] = v[1];
+    v[1] = tmp;
+  }
+}
+
+#ifndef HAVE_IOS
+/**
+ * GstEglRoiBox:
+ * 从 GstVideoRegionOfInterestMeta 中取出的框（像素，相对于caps的宽高）
+ */
+typedef struct
+{
+  gint x, y;
+  guint w, h;
+  GQuark roi_type;
+} GstEglRoiBox;
+
+/* 按 roi_type 选择框的颜色（quark 是递增分配的，不同类型得到不同颜色） */
+static const GLfloat roi_palette[][4] = {
+  {0.0, 1.0, 0.0, 1.0},
+  {1.0, 0.0, 0.0, 1.0},
+  {0.0, 0.5, 1.0, 1.0},
+  {1.0, 1.0, 0.0, 1.0},
+  {1.0, 0.0, 1.0, 1.0},
+  {0.0, 1.0, 1.0, 1.0},
+  {1.0, 0.5, 0.0, 1.0},
+  {1.0, 1.0, 1.0, 1.0}
+};
+
+/**
+ * @brief: 记录 @buf 中所有 GstVideoRegionOfInterestMeta 的框（在渲染线程中调用）
+*/
+static void
+gst_eglglessink_collect_roi (GstEglGlesSink * eglglessink, GstBuffer * buf)
+{
+  GstVideoRegionOfInterestMeta *roi;
+  gpointer state = NULL;
+
+  g_array_set_size (eglglessink->roi_boxes, 0);
+  if (!eglglessink->draw_roi)
+    return;
+
+  while ((roi = (GstVideoRegionOfInterestMeta *)
+          gst_buffer_iterate_meta_filtered (buf, &state,
+              GST_VIDEO_REGION_OF_INTEREST_META_API_TYPE))) {
+    GstEglRoiBox box;
+
+    box.x = roi->x;
+    box.y = roi->y;
+    box.w = roi->w;
+    box.h = roi->h;
+    box.roi_type = roi->roi_type;
+    g_array_append_val (eglglessink->roi_boxes, box);
+  }
+}
+
+/**
+ * @brief: 实例化绘制所有 ROI 框（一次 glDrawArraysInstanced）
+ *         每个实例 8 个float：box（左、下、右、上，NDC）+ color
+*/
+static gboolean
+gst_eglglessink_draw_roi (GstEglGlesSink * eglglessink)
+{
+  GstEglAdaptationContext *ctx = eglglessink->egl_context;
+  GArray *boxes = eglglessink->roi_boxes;
+  GLfloat *instances;
+  gdouble x1, x2, y1, y2;
+  guint i;
+
+  if (!eglglessink->draw_roi || boxes->len == 0)
+    return TRUE;
+
+  if (!gst_egl_adaptation_init_roi (ctx))
+    return FALSE;
+
+  x1 = (eglglessink->display_region.x / (gdouble) eglglessink->render_region.w)
+      * 2.0 - 1;
+  y1 = (eglglessink->display_region.y / (gdouble) eglglessink->render_region.h)
+      * 2.0 - 1;
+  x2 = ((eglglessink->display_region.x + eglglessink->display_region.w) /
+      (gdouble) eglglessink->render_region.w) * 2.0 - 1;
+  y2 = ((eglglessink->display_region.y + eglglessink->display_region.h) /
+      (gdouble) eglglessink->render_region.h) * 2.0 - 1;
+
+  instances = g_new (GLfloat, 8 * boxes->len);
+  for (i = 0; i < boxes->len; i++) {
+    GstEglRoiBox *box = &g_array_index (boxes, GstEglRoiBox, i);
+    GLfloat *instance = &instances[8 * i];
+    gdouble s[2], t[2], u[2], v[2];
+
+    gst_eglglessink_map_video_rect (eglglessink, box->x, box->y, box->w,
+        box->h, s, t, u, v);
+    instance[0] = x1 + u[0] * (x2 - x1);
+    instance[1] = y2 - v[1] * (y2 - y1);
+    instance[2] = x1 + u[1] * (x2 - x1);
+    instance[3] = y2 - v[0] * (y2 - y1);
+    memcpy (&instance[4],
+        roi_palette[box->roi_type % G_N_ELEMENTS (roi_palette)],
+        4 * sizeof (GLfloat));
+  }
+
+  glBindBuffer (GL_ARRAY_BUFFER, ctx->roi_instance_buffer);
+  glBufferData (GL_ARRAY_BUFFER, 8 * boxes->len * sizeof (GLfloat), instances,
+      GL_STREAM_DRAW);
+  g_free (instances);
+  if (got_gl_error ("glBufferData"))
+    return FALSE;
+
+  glUseProgram (ctx->glslprogram[5]);
+  glUniform2f (ctx->roi_line_width_loc,
+      2.0 * eglglessink->roi_line_width / eglglessink->render_region.w,
+      2.0 * eglglessink->roi_line_width / eglglessink->render_region.h);
+
+  glEnableVertexAttribArray (ctx->roi_box_loc);
+  glEnableVertexAttribArray (ctx->roi_color_loc);
+  glVertexAttribPointer (ctx->roi_box_loc, 4, GL_FLOAT, GL_FALSE,
+      8 * sizeof (GLfloat), (gpointer) 0);
+  glVertexAttribPointer (ctx->roi_color_loc, 4, GL_FLOAT, GL_FALSE,
+      8 * sizeof (GLfloat), (gpointer) (4 * sizeof (GLfloat)));
+  glVertexAttribDivisor (ctx->roi_box_loc, 1);
+  glVertexAttribDivisor (ctx->roi_color_loc, 1);
+
+  glBindBuffer (GL_ARRAY_BUFFER, ctx->roi_corner_buffer);
+  glEnableVertexAttribArray (ctx->position_loc[5]);
+  glVertexAttribPointer (ctx->position_loc[5], 3, GL_FLOAT, GL_FALSE,
+      3 * sizeof (GLfloat), (gpointer) 0);
+  if (got_gl_error ("glVertexAttribPointer"))
+    return FALSE;
+
+  glEnable (GL_SCISSOR_TEST);
+  glScissor (eglglessink->viewport.x + eglglessink->display_region.x,
+      eglglessink->viewport.y + eglglessink->display_region.y,
+      eglglessink->display_region.w, eglglessink->display_region.h);
+
+  glDrawArraysInstanced (GL_TRIANGLE_STRIP, 0, 10, boxes->len);
+
+  glDisable (GL_SCISSOR_TEST);
+  /* 没有VAO，属性的 divisor 是全局状态，需要恢复 */
+  glVertexAttribDivisor (ctx->roi_box_loc, 0);
+  glVertexAttribDivisor (ctx->roi_color_loc, 0);
+  glDisableVertexAttribArray (ctx->roi_box_loc);
+  glDisableVertexAttribArray (ctx->roi_color_loc);
+  glDisableVertexAttribArray (ctx->position_loc[5]);
+  glBindBuffer (GL_ARRAY_BUFFER, ctx->position_buffer);
+
+  return !got_gl_error ("glDrawArraysInstanced");
+}
+#endif
+
+/**
+ * GstEglOverlayTexture:
+ * overlay_textures 中缓存的叠加层纹理（以 GstVideoOverlayRectangle 的 seqnum 为键），
+ * 矩形内容不变时不需要重新上传
+ * @used: 当前帧是否使用，绘制完之后没有使用的纹理会被删除
+ */
+typedef struct
+{
+  GLuint texture;
+  gboolean used;
+} GstEglOverlayTexture;
+
+static void
+gst_eglglessink_overlay_texture_free (gpointer data)
+{
+  GstEglOverlayTexture *entry = data;
+
+  glDeleteTextures (1, &entry->texture);
+  g_slice_free (GstEglOverlayTexture, entry);
+}
+
+static gboolean
+gst_eglglessink_overlay_texture_unused (gpointer key, gpointer value,
+    gpointer user_data)
+{
+  GstEglOverlayTexture *entry = value;
+  gboolean unused = !entry->used;
+
+  entry->used = FALSE;
+  return unused;
+}
+
+/**
+ * @brief: 获取叠加层矩形对应的纹理，缓存中没有时上传像素（预乘alpha的ARGB）
+*/
+static GstEglOverlayTexture *
+gst_eglglessink_get_overlay_texture (GstEglGlesSink * eglglessink,
+    GstVideoOverlayRectangle * rect)
+{
+  GstEglOverlayTexture *entry;
+  GstBuffer *pixels;
+  GstVideoMeta *vmeta;
+  GstMapInfo map;
+  guint seqnum, row;
+
+  seqnum = gst_video_overlay_rectangle_get_seqnum (rect);
+  entry = g_hash_table_lookup (eglglessink->overlay_textures,
+      GUINT_TO_POINTER (seqnum));
+  if (entry) {
+    entry->used = TRUE;
+    return entry;
+  }
+
+  /* 全局透明度在着色器中处理，避免每次修改 global-alpha 都在CPU上重新计算像素 */
+  pixels = gst_video_overlay_rectangle_get_pixels_unscaled_argb (rect,
+      GST_VIDEO_OVERLAY_FORMAT_FLAG_PREMULTIPLIED_ALPHA |
+      GST_VIDEO_OVERLAY_FORMAT_FLAG_GLOBAL_ALPHA);
+  if (!pixels || !(vmeta = gst_buffer_get_video_meta (pixels))) {
+    GST_WARNING_OBJECT (eglglessink, "Overlay rectangle without pixels");
+    return NULL;
+  }
+
+  if (!gst_buffer_map (pixels, &map, GST_MAP_READ)) {
+    GST_WARNING_OBJECT (eglglessink, "Couldn't map overlay pixels");
+    return NULL;
+  }
+
+  entry = g_slice_new0 (GstEglOverlayTexture);
+  glGenTextures (1, &entry->texture);
+  glBindTexture (GL_TEXTURE_2D, entry->texture);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glPixelStorei (GL_UNPACK_ALIGNMENT, 4);
+
+  if (vmeta->stride[0] == (gint) vmeta->width * 4) {
+    glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA, vmeta->width, vmeta->height, 0,
+        GL_RGBA, GL_UNSIGNED_BYTE, map.data + vmeta->offset[0]);
+  } else {
+    /* GLES2 没有 GL_UNPACK_ROW_LENGTH，按行上传 */
+    glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA, vmeta->width, vmeta->height, 0,
+        GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    for (row = 0; row < vmeta->height; row++)
+      glTexSubImage2D (GL_TEXTURE_2D, 0, 0, row, vmeta->width, 1, GL_RGBA,
+          GL_UNSIGNED_BYTE, map.data + vmeta->offset[0] +
+          row * vmeta->stride[0]);
+  }
+  gst_buffer_unmap (pixels, &map);
+
+  if (got_gl_error ("glTexImage2D")) {
+    gst_eglglessink_overlay_texture_free (entry);
+    return NULL;
+  }
+
+  GST_DEBUG_OBJECT (eglglessink, "Uploaded overlay rectangle %u (%ux%u)",
+      seqnum, vmeta->width, vmeta->height);
+
+  entry->used = TRUE;
+  g_hash_table_insert (eglglessink->overlay_textures,
+      GUINT_TO_POINTER (seqnum), entry);
+
+  return entry;
+}
+
+/**
+ * @brief: 在视频帧之上混合 GstVideoOverlayCompositionMeta 中的矩形（字幕/OSD）
+ * @note: 矩形的位置是相对于视频帧（caps的宽高）的，和视频一样做裁剪和旋转，
+ *        超出 display_region 的部分用 scissor 裁掉；仿射变换不作用于叠加层
+*/
+static gboolean
+gst_eglglessink_draw_overlays (GstEglGlesSink * eglglessink)
+{
+  GstEglAdaptationContext *ctx = eglglessink->egl_context;
+  GstVideoOverlayComposition *composition = eglglessink->overlay_composition;
+  GstEglOverlayTexture **textures;
+  coord5 *vertices;
+  gdouble render_width, render_height;
+  gdouble x1, x2, y1, y2;
+  gdouble s, t;
+  guint i, j, n;
+  gboolean ret = FALSE;
+
+  n = composition ? gst_video_overlay_composition_n_rectangles (composition) : 0;
+  if (n == 0) {
+    g_hash_table_remove_all (eglglessink->overlay_textures);
+    return TRUE;
+  }
+
+  if (!gst_egl_adaptation_init_overlay (ctx))
+    return FALSE;
+
+  render_width = eglglessink->render_region.w;
+  render_height = eglglessink->render_region.h;
+  x1 = (eglglessink->display_region.x / render_width) * 2.0 - 1;
+  y1 = (eglglessink->display_region.y / render_height) * 2.0 - 1;
+  x2 = ((eglglessink->display_region.x +
+          eglglessink->display_region.w) / render_width) * 2.0 - 1;
+  y2 = ((eglglessink->display_region.y +
+          eglglessink->display_region.h) / render_height) * 2.0 - 1;
+
+  textures = g_new0 (GstEglOverlayTexture *, n);
+  vertices = g_new0 (coord5, 4 * n);
+
+  for (i = 0; i < n; i++) {
+    GstVideoOverlayRectangle *rect =
+        gst_video_overlay_composition_get_rectangle (composition, i);
+    gint rx, ry;
+    guint rw, rh;
+    gdouble rs[2], rt[2], ru[2], rv[2];
+
+    textures[i] = gst_eglglessink_get_overlay_texture (eglglessink, rect);
+    if (!textures[i] ||
+        !gst_video_overlay_rectangle_get_render_rectangle (rect, &rx, &ry,
+            &rw, &rh) || rw == 0 || rh == 0) {
+      textures[i] = NULL;
+      continue;
+    }
+
+    gst_eglglessink_map_video_rect (eglglessink, rx, ry, rw, rh, rs, rt, ru,
+        rv);
+
+    /* 顶点顺序和 position_array 一样：右上，右下，左上，左下 */
+    for (j = 0; j < 4; j++) {
+      gdouble u = j < 2 ? ru[1] : ru[0];
+      gdouble v = j % 2 == 0 ? rv[0] : rv[1];
+      coord5 *vertex = &vertices[4 * i + j];
+
+      gst_eglglessink_orient_texpos (eglglessink->rotate_method, u, v, &s,
+          &t);
+      vertex->x = x1 + u * (x2 - x1);
+      vertex->y = y2 - v * (y2 - y1);
+      vertex->z = 0;
+      vertex->a = (s - rs[0]) / (rs[1] - rs[0]);
+      vertex->b = (t - rt[0]) / (rt[1] - rt[0]);
+    }
+  }
+
+  glBindBuffer (GL_ARRAY_BUFFER, ctx->overlay_buffer);
+  glBufferData (GL_ARRAY_BUFFER, 4 * n * sizeof (coord5), vertices,
+      GL_STREAM_DRAW);
+  if (got_gl_error ("glBufferData"))
+    goto done;
+
+  glUseProgram (ctx->glslprogram[4]);
+  if (!gst_eglglessink_set_transform (eglglessink, ctx->transform_loc[4],
+          FALSE))
+    goto done;
+  glUniform1i (ctx->overlay_tex_loc, 0);
+  glActiveTexture (GL_TEXTURE0);
+
+  glEnable (GL_BLEND);
+  glBlendFunc (GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+  glEnable (GL_SCISSOR_TEST);
+  glScissor (eglglessink->viewport.x + eglglessink->display_region.x,
+      eglglessink->viewport.y + eglglessink->display_region.y,
+      eglglessink->display_region.w, eglglessink->display_region.h);
+
+  glEnableVertexAttribArray (ctx->position_loc[4]);
+  glEnableVertexAttribArray (ctx->texpos_loc[4]);
+
+  for (i = 0; i < n; i++) {
+    if (!textures[i])
+      continue;
+
+    glBindTexture (GL_TEXTURE_2D, textures[i]->texture);
+    glUniform1f (ctx->overlay_alpha_loc,
+        gst_video_overlay_rectangle_get_global_alpha
+        (gst_video_overlay_composition_get_rectangle (composition, i)));
+
+    glVertexAttribPointer (ctx->position_loc[4], 3, GL_FLOAT, GL_FALSE,
+        sizeof (coord5), (gpointer) (4 * i * sizeof (coord5)));
+    glVertexAttribPointer (ctx->texpos_loc[4], 2, GL_FLOAT, GL_FALSE,
+        sizeof (coord5), (gpointer) (4 * i * sizeof (coord5) +
+            3 * sizeof (gfloat)));
+    glDrawElements (GL_TRIANGLE_STRIP, 4, GL_UNSIGNED_SHORT, 0);
+  }
+
+  glDisableVertexAttribArray (ctx->position_loc[4]);
+  glDisableVertexAttribArray (ctx->texpos_loc[4]);
+  glDisable (GL_SCISSOR_TEST);
+  glDisable (GL_BLEND);
+  glBindBuffer (GL_ARRAY_BUFFER, ctx->position_buffer);
+
+  ret = !got_gl_error ("glDrawElements");
+
+done:
+  /* 删除这一帧没有使用的纹理 */
+  g_hash_table_foreach_remove (eglglessink->overlay_textures,
+      gst_eglglessink_overlay_texture_unused, NULL);
+  g_free (textures);
+  g_free (vertices);
+
+  return ret;
+}
+
+/**
+ * @brief: 高质量缩放（bicubic/lanczos 两遍可分离滤波）
+ *         1. 需要格式转换的视频帧（YUV、通道重排、OES）或者需要交换宽高的旋转，
+ *            先以裁剪（旋转）后的原始尺寸转换到 fbo[0]
+ *         2. 水平滤波到 fbo[1]（display_region.w x 裁剪高度）
+ *         3. 垂直滤波到 display_region
+ * @param method: 渲染开始时读取的 scaling-method
+*/
+static gboolean
+gst_eglglessink_draw_frame_scaled (GstEglGlesSink * eglglessink,
+    GstEglScalingMethod method)
+{
+  GstEglAdaptationContext *ctx = eglglessink->egl_context;
+  gboolean transposed =
+      GST_EGLGLESSINK_METHOD_IS_TRANSPOSED (eglglessink->rotate_method);
+  /* 滤波在旋转之后的坐标系中进行 */
+  gint src_w = transposed ? eglglessink->crop.h : eglglessink->crop.w;
+  gint src_h = transposed ? eglglessink->crop.w : eglglessink->crop.h;
+  gint dst_w = eglglessink->display_region.w;
+  gint dst_h = eglglessink->display_region.h;
+  GLuint src_texture;
+  gint src_quad;
+  gfloat tex_scale, texel_x, texel_y;
+
+  if (!gst_egl_adaptation_init_scaler (ctx, method))
+    return FALSE;
+
+  if (eglglessink->deinterlacing) {
+    /* 已经去隔行（fbo[2]，裁剪旋转后的原始尺寸） */
+    src_texture = ctx->fbo_texture[2];
+    src_quad = 24;
+    tex_scale = 1;
+    texel_x = 1.0 / src_w;
+    texel_y = 1.0 / src_h;
+  } else if (ctx->direct_rgb && !transposed) {
+    /* RGB纹理直接滤波，纹理坐标为裁剪区域（翻转不影响滤波方向） */
+    src_texture = gst_eglglessink_frame_texture (ctx, 0);
+    src_quad = eglglessink->orientation ==
+        GST_VIDEO_GL_TEXTURE_ORIENTATION_X_NORMAL_Y_FLIP ? 20 : 16;
+    tex_scale = eglglessink->stride[0];
+    texel_x = 1.0 / (eglglessink->configured_info.width * eglglessink->stride[0]);
+    texel_y = 1.0 / eglglessink->configured_info.height;
+  } else {
+    if (!gst_egl_adaptation_setup_fbo (ctx, 0, src_w, src_h, GL_NEAREST))
+      return FALSE;
+
+    glBindFramebuffer (GL_FRAMEBUFFER, ctx->fbo[0]);
+    glViewport (0, 0, src_w, src_h);
+    if (!gst_eglglessink_draw_frame (eglglessink, 16))
+      return FALSE;
+
+    src_texture = ctx->fbo_texture[0];
+    src_quad = 24;
+    tex_scale = 1;
+    texel_x = 1.0 / src_w;
+    texel_y = 1.0 / src_h;
+  }
+
+  /* 水平滤波 */
+  if (!gst_egl_adaptation_setup_fbo (ctx, 1, dst_w, src_h, GL_NEAREST))
+    return FALSE;
+
+  glBindFramebuffer (GL_FRAMEBUFFER, ctx->fbo[1]);
+  glViewport (0, 0, dst_w, src_h);
+  if (!gst_eglglessink_draw_scale_pass (eglglessink, src_texture, src_quad,
+          tex_scale, texel_x, texel_y, 1, 0, (gfloat) src_w / dst_w))
+    return FALSE;
+
+  /* 垂直滤波，输出到 display_region */
+  glBindFramebuffer (GL_FRAMEBUFFER, ctx->target_fbo);
+  glViewport (eglglessink->viewport.x, eglglessink->viewport.y,
+      eglglessink->viewport.w, eglglessink->viewport.h);
+  if (!gst_eglglessink_draw_scale_pass (eglglessink, ctx->fbo_texture[1], 28,
+          1, 1.0 / dst_w, 1.0 / src_h, 0, 1, (gfloat) src_h / dst_h))
+    return FALSE;
+
+  return TRUE;
+}
+
+/**
+ * GstEglExtraOutput:
+ * 属性 extra-outputs 中的一个输出：每一帧除了正常绘制之外，
+ * 还把视频帧（裁剪、旋转、去隔行之后）缩放绘制到 @texture 中
+ * @texture: UI线程创建的纹理（和 egl-share-texture 一样在同一个共享组中）
+ * @internal_format, @format, @type: 纹理存储格式（RGBA8 或者 RGB565）
+ * @mipmap: 每一帧绘制之后 glGenerateMipmap，UI 缩小采样时不会出现锯齿
+ * @fbo: 绑定 @texture 的 FBO（渲染线程的上下文中创建）
+ */
+typedef struct
+{
+  GLuint texture;
+  gint width, height;
+  GLint internal_format;
+  GLenum format, type;
+  gboolean mipmap;
+  GLuint fbo;
+} GstEglExtraOutput;
+
+/**
+ * @brief: 解析 extra-outputs 的一项：TEXTURE:WIDTHxHEIGHT[:FORMAT][:mipmap]
+*/
+static gboolean
+gst_eglglessink_parse_extra_output (const gchar * desc,
+    GstEglExtraOutput * output)
+{
+  gchar **fields;
+  guint i, n;
+  gboolean ret = FALSE;
+  gchar *end;
+
+  memset (output, 0, sizeof (GstEglExtraOutput));
+  output->internal_format = GL_RGBA8;
+  output->format = GL_RGBA;
+  output->type = GL_UNSIGNED_BYTE;
+
+  fields = g_strsplit (desc, ":", -1);
+  n = g_strv_length (fields);
+  if (n < 2)
+    goto done;
+
+  output->texture = g_ascii_strtoull (g_strstrip (fields[0]), &end, 10);
+  if (*end != '\0' || output->texture == 0)
+    goto done;
+
+  if (sscanf (fields[1], "%dx%d", &output->width, &output->height) != 2 ||
+      output->width <= 0 || output->height <= 0)
+    goto done;
+
+  for (i = 2; i < n; i++) {
+    const gchar *field = g_strstrip (fields[i]);
+
+    if (!g_ascii_strcasecmp (field, "rgba8")) {
+      output->internal_format = GL_RGBA8;
+      output->format = GL_RGBA;
+      output->type = GL_UNSIGNED_BYTE;
+    } else if (!g_ascii_strcasecmp (field, "rgb565")) {
+      output->internal_format = GL_RGB565;
+      output->format = GL_RGB;
+      output->type = GL_UNSIGNED_SHORT_5_6_5;
+    } else if (!g_ascii_strcasecmp (field, "mipmap")) {
+      output->mipmap = TRUE;
+    } else {
+      goto done;
+    }
+  }
+  ret = TRUE;
+
+done:
+  g_strfreev (fields);
+  return ret;
+}
+
+/**
+ * @brief: 删除额外输出的 FBO（纹理属于UI线程，不删除），上下文重建后需要重新创建
+*/
+static void
+gst_eglglessink_clear_extra_outputs (GstEglGlesSink * eglglessink)
+{
+  guint i;
+
+  for (i = 0; i < eglglessink->extra_outputs->len; i++) {
+    GstEglExtraOutput *output =
+        &g_array_index (eglglessink->extra_outputs, GstEglExtraOutput, i);
+
+    if (output->fbo)
+      glDeleteFramebuffers (1, &output->fbo);
+  }
+  g_array_set_size (eglglessink->extra_outputs, 0);
+
+  GST_OBJECT_LOCK (eglglessink);
+  eglglessink->extra_outputs_changed = TRUE;
+  GST_OBJECT_UNLOCK (eglglessink);
+}
+
+/**
+ * @brief: extra-outputs 改变后重新分配输出纹理的存储并创建 FBO
+*/
+static void
+gst_eglglessink_setup_extra_outputs (GstEglGlesSink * eglglessink)
+{
+  gchar **descs = NULL;
+  guint i;
+
+  GST_OBJECT_LOCK (eglglessink);
+  if (!eglglessink->extra_outputs_changed) {
+    GST_OBJECT_UNLOCK (eglglessink);
+    return;
+  }
+  GST_OBJECT_UNLOCK (eglglessink);
+
+  gst_eglglessink_clear_extra_outputs (eglglessink);
+
+  GST_OBJECT_LOCK (eglglessink);
+  eglglessink->extra_outputs_changed = FALSE;
+  if (eglglessink->extra_outputs_desc)
+    descs = g_strsplit (eglglessink->extra_outputs_desc, ",", -1);
+  GST_OBJECT_UNLOCK (eglglessink);
+
+  for (i = 0; descs && descs[i]; i++) {
+    GstEglExtraOutput output;
+
+    if (!*g_strstrip (descs[i]))
+      continue;
+
+    if (!gst_eglglessink_parse_extra_output (descs[i], &output)) {
+      GST_WARNING_OBJECT (eglglessink, "Invalid extra output \"%s\"",
+          descs[i]);
+      continue;
+    }
+
+    glBindTexture (GL_TEXTURE_2D, output.texture);
+    glTexImage2D (GL_TEXTURE_2D, 0, output.internal_format, output.width,
+        output.height, 0, output.format, output.type, NULL);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+        output.mipmap ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    if (got_gl_error ("glTexImage2D")) {
+      GST_WARNING_OBJECT (eglglessink, "Couldn't allocate extra output %u",
+          output.texture);
+      continue;
+    }
+
+    glGenFramebuffers (1, &output.fbo);
+    glBindFramebuffer (GL_FRAMEBUFFER, output.fbo);
+    glFramebufferTexture2D (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_TEXTURE_2D, output.texture, 0);
+    if (glCheckFramebufferStatus (GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+      GST_WARNING_OBJECT (eglglessink, "Extra output %u is incomplete",
+          output.texture);
+      glBindFramebuffer (GL_FRAMEBUFFER, 0);
+      glDeleteFramebuffers (1, &output.fbo);
+      continue;
+    }
+    glBindFramebuffer (GL_FRAMEBUFFER, 0);
+
+    GST_DEBUG_OBJECT (eglglessink, "Extra output %u: %dx%d%s", output.texture,
+        output.width, output.height, output.mipmap ? " (mipmapped)" : "");
+    g_array_append_val (eglglessink->extra_outputs, output);
+  }
+
+  g_strfreev (descs);
+}
+
+/**
+ * @brief: 把当前帧绘制到所有额外输出（和正常绘制使用同一次上传的纹理）
+ *         去隔行时使用 fbo[2]，否则直接从视频帧纹理转换缩放
+ * @note: 输出纹理使用GL纹理坐标（原点在左下），不包含叠加层和ROI框
+*/
+static gboolean
+gst_eglglessink_draw_extra_outputs (GstEglGlesSink * eglglessink)
+{
+  GstEglAdaptationContext *ctx = eglglessink->egl_context;
+  guint i;
+
+  if (eglglessink->extra_outputs->len == 0)
+    return TRUE;
+
+  for (i = 0; i < eglglessink->extra_outputs->len; i++) {
+    GstEglExtraOutput *output =
+        &g_array_index (eglglessink->extra_outputs, GstEglExtraOutput, i);
+
+    glBindFramebuffer (GL_FRAMEBUFFER, output->fbo);
+    glViewport (0, 0, output->width, output->height);
+
+    if (eglglessink->deinterlacing) {
+      glUseProgram (ctx->glslprogram[3]);
+      glActiveTexture (GL_TEXTURE0);
+      glBindTexture (GL_TEXTURE_2D, ctx->fbo_texture[2]);
+      glUniform1i (ctx->deint_tex_loc, 0);
+      glUniform1f (ctx->deint_mode_loc, GST_EGL_DEINTERLACE_METHOD_NONE);
+      if (!gst_eglglessink_set_transform (eglglessink, ctx->transform_loc[3],
+              FALSE) || !gst_eglglessink_draw_quad (eglglessink, 3, 24))
+        goto HANDLE_ERROR;
+    } else if (!gst_eglglessink_draw_frame (eglglessink, 16)) {
+      goto HANDLE_ERROR;
+    }
+
+    if (output->mipmap) {
+      glBindTexture (GL_TEXTURE_2D, output->texture);
+      glGenerateMipmap (GL_TEXTURE_2D);
+      if (got_gl_error ("glGenerateMipmap"))
+        goto HANDLE_ERROR;
+    }
+  }
+
+  glBindFramebuffer (GL_FRAMEBUFFER, ctx->target_fbo);
+  glViewport (eglglessink->viewport.x, eglglessink->viewport.y,
+      eglglessink->viewport.w, eglglessink->viewport.h);
+
+  return TRUE;
+
+HANDLE_ERROR:
+  glBindFramebuffer (GL_FRAMEBUFFER, ctx->target_fbo);
+  glViewport (eglglessink->viewport.x, eglglessink->viewport.y,
+      eglglessink->viewport.w, eglglessink->viewport.h);
+  return FALSE;
+}
+
+/**
+ * @brief: 上传的帧不能直接作为 egl-share-texture 的最终画面，需要通过输出FBO重新绘制
+ *         （关闭了 passthrough、指定了输出尺寸、拼接、去隔行、旋转、变换、叠加层或者ROI框）
+*/
+static gboolean
+gst_eglglessink_needs_output_fbo (GstEglGlesSink * eglglessink)
+{
+  gboolean needed;
+
+  GST_OBJECT_LOCK (eglglessink);
+  needed = !eglglessink->passthrough || eglglessink->mosaic ||
+      eglglessink->output_width || eglglessink->output_height ||
+      eglglessink->rotate_method != GST_VIDEO_ORIENTATION_IDENTITY ||
+      (eglglessink->draw_roi && eglglessink->roi_boxes->len > 0);
+  GST_OBJECT_UNLOCK (eglglessink);
+
+  return needed || eglglessink->deinterlacing ||
+      eglglessink->have_transform || eglglessink->overlay_composition;
+}
+
+/**
+ * @brief: 上传的纹理（texture[0]）就是UI线程的 egl-share-texture，并且已经是最终的画面时，
+ *         不需要再绘制到 EGLSurface（pbuffer 没有被使用）
+ * @note: surfaceless 并且没有输出FBO时没有可以绘制的目标，总是跳过
+*/
+static gboolean
+gst_eglglessink_can_passthrough (GstEglGlesSink * eglglessink)
+{
+  GstEglAdaptationContext *ctx = eglglessink->egl_context;
+
+  if (ctx->surfaceless && !ctx->output_fbo)
+    return TRUE;
+
+  return ctx->direct_upload && !gst_eglglessink_needs_output_fbo (eglglessink);
+}
+
+/**
+ * @brief: 第 @tile 个格子在输出中的矩形（原点在左下）
+ * @note: 格子从左上开始按行排列，每行 columns 个，共 rows 行；
+ *        拼接的实例缓冲和不拼接时的 viewport 都由这里计算
+*/
+static void
+gst_eglglessink_tile_rect (GstEglGlesSink * eglglessink, gint tile,
+    GstVideoRectangle * rect)
+{
+  tile %= eglglessink->rows * eglglessink->columns;
+
+  rect->w = eglglessink->render_region.w;
+  rect->h = eglglessink->render_region.h;
+  rect->x = eglglessink->render_region.x +
+      (tile % eglglessink->columns) * rect->w;
+  rect->y = eglglessink->egl_context->surface_height - rect->h -
+      (eglglessink->render_region.y + (tile / eglglessink->columns) * rect->h);
+}
+
+#ifndef HAVE_IOS
+/**
+ * @brief: 拼接网格的格子数，0 表示不拼接（没有设置 mosaic，网格只有一个格子，
+ *         或者 surfaceless 并且没有输出FBO）
+*/
+static gint
+gst_eglglessink_mosaic_tiles (GstEglGlesSink * eglglessink)
+{
+  GstEglAdaptationContext *ctx = eglglessink->egl_context;
+  gint tiles = eglglessink->rows * eglglessink->columns;
+
+  if (!eglglessink->mosaic || tiles <= 1 ||
+      (ctx->surfaceless && !ctx->output_fbo))
+    return 0;
+
+  return tiles;
+}
+
+/**
+ * @brief: 拼接布局（格子数、render_region 或者输出尺寸）改变时调用：
+ *         准备纹理数组，重新填充实例缓冲（每个格子：输出中的矩形、纹理层中的区域、层）
+ * @note: 格子按行从左上开始排列，和 change_port 计算 viewport 的方式相同
+*/
+static gboolean
+gst_eglglessink_setup_mosaic (GstEglGlesSink * eglglessink, gint tiles)
+{
+  GstEglAdaptationContext *ctx = eglglessink->egl_context;
+  gint tile_w = eglglessink->render_region.w;
+  gint tile_h = eglglessink->render_region.h;
+  gdouble surface_w = ctx->surface_width;
+  gdouble surface_h = ctx->surface_height;
+  GLfloat *instances;
+  gint i;
+
+  if (!gst_egl_adaptation_init_mosaic (ctx) ||
+      !gst_egl_adaptation_setup_mosaic (ctx, tiles, tile_w, tile_h))
+    return FALSE;
+
+  instances = g_new (GLfloat, 9 * tiles);
+  for (i = 0; i < tiles; i++) {
+    GLfloat *instance = &instances[9 * i];
+    GstVideoRectangle rect;
+
+    gst_eglglessink_tile_rect (eglglessink, i, &rect);
+    instance[0] = rect.x / surface_w * 2.0 - 1;
+    instance[1] = rect.y / surface_h * 2.0 - 1;
+    instance[2] = (rect.x + tile_w) / surface_w * 2.0 - 1;
+    instance[3] = (rect.y + tile_h) / surface_h * 2.0 - 1;
+    instance[4] = 0;
+    instance[5] = 0;
+    instance[6] = (gdouble) tile_w / ctx->mosaic_width;
+    instance[7] = (gdouble) tile_h / ctx->mosaic_height;
+    instance[8] = i;
+  }
+
+  glBindBuffer (GL_ARRAY_BUFFER, ctx->mosaic_instance_buffer);
+  glBufferData (GL_ARRAY_BUFFER, 9 * tiles * sizeof (GLfloat), instances,
+      GL_STATIC_DRAW);
+  glBindBuffer (GL_ARRAY_BUFFER, ctx->position_buffer);
+  g_free (instances);
+  if (got_gl_error ("glBufferData"))
+    return FALSE;
+
+  /* 网格不一定覆盖整个输出（不能整除），只在布局改变时清除一次 */
+  glClearColor (0.0, 0.0, 0.0, 1.0);
+  glClear (GL_COLOR_BUFFER_BIT);
+
+  return TRUE;
+}
+
+/**
+ * @brief: 把这一帧要更新的格子（纹理数组的第 change_port 层）设为绘制目标，
+ *         只清除这一个格子
+*/
+static void
+gst_eglglessink_bind_mosaic_tile (GstEglGlesSink * eglglessink)
+{
+  GstEglAdaptationContext *ctx = eglglessink->egl_context;
+
+  ctx->target_fbo = ctx->mosaic_fbo;
+  glBindFramebuffer (GL_FRAMEBUFFER, ctx->mosaic_fbo);
+  glFramebufferTextureLayer (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+      ctx->mosaic_texture, 0, eglglessink->change_port);
+  glViewport (eglglessink->viewport.x, eglglessink->viewport.y,
+      eglglessink->viewport.w, eglglessink->viewport.h);
+  glClearColor (0.0, 0.0, 0.0, 1.0);
+  glClear (GL_COLOR_BUFFER_BIT);
+}
+
+/**
+ * @brief: 一次实例化绘制整个网格（每个实例一个格子，从纹理数组采样）
+ * @param full_damage: FALSE 时只有这一帧更新的格子改变，用 scissor 只写这个格子的像素
+*/
+static gboolean
+gst_eglglessink_draw_mosaic (GstEglGlesSink * eglglessink, gint tiles,
+    gboolean full_damage)
+{
+  GstEglAdaptationContext *ctx = eglglessink->egl_context;
+  GstVideoRectangle rect;
+
+  ctx->target_fbo = ctx->output_fbo;
+  glBindFramebuffer (GL_FRAMEBUFFER, ctx->target_fbo);
+  glViewport (0, 0, ctx->surface_width, ctx->surface_height);
+
+  if (full_damage) {
+    gst_egl_adaptation_add_damage (ctx, 0, 0, ctx->surface_width,
+        ctx->surface_height);
+  } else {
+    gst_eglglessink_tile_rect (eglglessink, eglglessink->change_port,
+        &rect);
+    glEnable (GL_SCISSOR_TEST);
+    glScissor (rect.x, rect.y, rect.w, rect.h);
+    gst_egl_adaptation_add_damage (ctx, rect.x, rect.y, rect.w, rect.h);
+  }
+
+  glUseProgram (ctx->glslprogram[6]);
+  glActiveTexture (GL_TEXTURE0);
+  glBindTexture (GL_TEXTURE_2D_ARRAY, ctx->mosaic_texture);
+  glUniform1i (ctx->mosaic_tex_loc, 0);
+
+  glBindBuffer (GL_ARRAY_BUFFER, ctx->mosaic_instance_buffer);
+  glEnableVertexAttribArray (ctx->mosaic_rect_loc);
+  glEnableVertexAttribArray (ctx->mosaic_crop_loc);
+  glEnableVertexAttribArray (ctx->mosaic_layer_loc);
+  glVertexAttribPointer (ctx->mosaic_rect_loc, 4, GL_FLOAT, GL_FALSE,
+      9 * sizeof (GLfloat), (gpointer) 0);
+  glVertexAttribPointer (ctx->mosaic_crop_loc, 4, GL_FLOAT, GL_FALSE,
+      9 * sizeof (GLfloat), (gpointer) (4 * sizeof (GLfloat)));
+  glVertexAttribPointer (ctx->mosaic_layer_loc, 1, GL_FLOAT, GL_FALSE,
+      9 * sizeof (GLfloat), (gpointer) (8 * sizeof (GLfloat)));
+  glVertexAttribDivisor (ctx->mosaic_rect_loc, 1);
+  glVertexAttribDivisor (ctx->mosaic_crop_loc, 1);
+  glVertexAttribDivisor (ctx->mosaic_layer_loc, 1);
+
+  glBindBuffer (GL_ARRAY_BUFFER, ctx->mosaic_corner_buffer);
+  glEnableVertexAttribArray (ctx->position_loc[6]);
+  glVertexAttribPointer (ctx->position_loc[6], 2, GL_FLOAT, GL_FALSE,
+      2 * sizeof (GLfloat), (gpointer) 0);
+  if (got_gl_error ("glVertexAttribPointer")) {
+    glDisable (GL_SCISSOR_TEST);
+    return FALSE;
+  }
+
+  glDrawArraysInstanced (GL_TRIANGLE_STRIP, 0, 4, tiles);
+  glDisable (GL_SCISSOR_TEST);
+
+  /* 没有VAO，属性的 divisor 是全局状态，需要恢复 */
+  glVertexAttribDivisor (ctx->mosaic_rect_loc, 0);
+  glVertexAttribDivisor (ctx->mosaic_crop_loc, 0);
+  glVertexAttribDivisor (ctx->mosaic_layer_loc, 0);
+  glDisableVertexAttribArray (ctx->mosaic_rect_loc);
+  glDisableVertexAttribArray (ctx->mosaic_crop_loc);
+  glDisableVertexAttribArray (ctx->mosaic_layer_loc);
+  glDisableVertexAttribArray (ctx->position_loc[6]);
+  glBindBuffer (GL_ARRAY_BUFFER, ctx->position_buffer);
+
+  return !got_gl_error ("glDrawArraysInstanced");
+}
+#endif
+
+/**
+ * @brief: 多格子布局中，格子上显示的视频尺寸（display_region）不到协商尺寸的一半时，
+ *         记录它作为 getcaps 优先的尺寸，并发送 RECONFIGURE 让上游（解码器/缩放）重新协商；
+ *         回到单格子布局（或者关闭属性）时取消偏好，重新协商回原来的尺寸
+ * @note: 偏好一旦设置，只跟随格子尺寸变化，不再和协商尺寸比较（否则协商之后会立刻取消）；
+ *        输出尺寸跟随视频尺寸时（输出纹理没有设置 output-width/output-height）不重新协商，
+ *        否则格子会随着视频一起变小
+*/
+static void
+gst_eglglessink_update_preferred_size (GstEglGlesSink * eglglessink)
+{
+  GstEglAdaptationContext *ctx = eglglessink->egl_context;
+  gint tile_w = eglglessink->display_region.w;
+  gint tile_h = eglglessink->display_region.h;
+  gint width = 0, height = 0;
+  gboolean changed;
+
+  if (GST_EGLGLESSINK_METHOD_IS_TRANSPOSED (eglglessink->rotate_method)) {
+    tile_w = eglglessink->display_region.h;
+    tile_h = eglglessink->display_region.w;
+  }
+
+  GST_OBJECT_LOCK (eglglessink);
+  if (eglglessink->tile_renegotiation &&
+      eglglessink->rows * eglglessink->columns > 1 &&
+      !((ctx->output_texture || ctx->surfaceless) &&
+          (!eglglessink->output_width || !eglglessink->output_height)) &&
+      tile_w > 0 && tile_h > 0) {
+    if (eglglessink->preferred_width ||
+        (tile_w * 2 <= GST_VIDEO_INFO_WIDTH (&eglglessink->configured_info) &&
+            tile_h * 2 <=
+            GST_VIDEO_INFO_HEIGHT (&eglglessink->configured_info))) {
+      width = GST_ROUND_UP_2 (tile_w);
+      height = GST_ROUND_UP_2 (tile_h);
+    }
+  }
+  changed = width != eglglessink->preferred_width ||
+      height != eglglessink->preferred_height;
+  eglglessink->preferred_width = width;
+  eglglessink->preferred_height = height;
+  GST_OBJECT_UNLOCK (eglglessink);
+
+  if (!changed)
+    return;
+
+  GST_DEBUG_OBJECT (eglglessink, "Preferred size is now %dx%d, "
+      "asking upstream to renegotiate", width, height);
+  gst_pad_push_event (GST_BASE_SINK_PAD (eglglessink),
+      gst_event_new_reconfigure ());
+}
+
+/**
+ * @brief: 计算系统内存帧在CPU上预先缩小的倍数：裁剪区域在两个方向上都至少是 display_region 的
+ *         factor 倍时使用 factor（2 的幂，最大 GST_EGL_DOWNSCALE_MAX_FACTOR），
+ *         下一个 prepare 按这个倍数缩小之后再上传
+ * @note: box 滤波只替代双线性缩放；高质量缩放、去隔行（按行区分场）、RGB16 不预先缩小
+*/
+static void
+gst_eglglessink_update_predownscale (GstEglGlesSink * eglglessink)
+{
+  gint dst_w = eglglessink->display_region.w;
+  gint dst_h = eglglessink->display_region.h;
+  gint factor = 1;
+
+  if (GST_EGLGLESSINK_METHOD_IS_TRANSPOSED (eglglessink->rotate_method)) {
+    dst_w = eglglessink->display_region.h;
+    dst_h = eglglessink->display_region.w;
+  }
+
+  GST_OBJECT_LOCK (eglglessink);
+  if (eglglessink->predownscale && !eglglessink->deinterlacing &&
+      eglglessink->scaling_method == GST_EGL_SCALING_METHOD_BILINEAR &&
+      !eglglessink->using_cuda && !eglglessink->using_nvbufsurf &&
+      !eglglessink->using_dmabuf && gst_egl_downscale_supported (GST_VIDEO_INFO_FORMAT
+          (&eglglessink->configured_info)) && dst_w > 0 && dst_h > 0) {
+    while (factor < GST_EGL_DOWNSCALE_MAX_FACTOR &&
+        dst_w * factor * 2 <= eglglessink->crop.w &&
+        dst_h * factor * 2 <= eglglessink->crop.h)
+      factor *= 2;
+  }
+  if (factor != eglglessink->predownscale_factor)
+    GST_DEBUG_OBJECT (eglglessink, "Pre-downscale factor is now %d", factor);
+  eglglessink->predownscale_factor = factor;
+  GST_OBJECT_UNLOCK (eglglessink);
+}
+
+/**
+ * @brief: 计算输出尺寸（属性 output-width/output-height，为0时使用旋转之后的裁剪尺寸），
+ *         使用输出FBO时绑定它，后面的绘制都输出到 egl-share-texture
+*/
+static gboolean
+gst_eglglessink_setup_output (GstEglGlesSink * eglglessink)
+{
+  gboolean transposed =
+      GST_EGLGLESSINK_METHOD_IS_TRANSPOSED (eglglessink->rotate_method);
+  gint width, height;
+
+  GST_OBJECT_LOCK (eglglessink);
+  width = eglglessink->output_width;
+  height = eglglessink->output_height;
+  GST_OBJECT_UNLOCK (eglglessink);
+
+  if (!width)
+    width = transposed ? eglglessink->crop.h : eglglessink->crop.w;
+  if (!height)
+    height = transposed ? eglglessink->crop.w : eglglessink->crop.h;
+
+  return gst_egl_adaptation_setup_output (eglglessink->egl_context, width,
+      height);
+}
+
+/**
+ * @brief: 在这一帧的 GL 命令之后插入 fence 并提交，渲染线程不等待GPU完成。
+ *         fence 通过 ui-render 交给UI线程，UI的上下文用 glWaitSync 在GPU上等待，
+ *         共享组中的其他上下文在这之后才一定能看到共享纹理的新内容
+ * @note: 没有 ui-render 的处理函数时不创建 fence，只 glFlush
+*/
+static void
+gst_eglglessink_fence_frame (GstEglGlesSink * eglglessink)
+{
+#ifndef HAVE_IOS
+  if (g_signal_has_handler_pending (eglglessink, signals[UI_RENDER], 0, FALSE))
+    eglglessink->frame_sync = glFenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
+  glFlush ();
+}
+
+/**
+ * @brief: gl顶点相关，绘制
+ * @note: passthrough 时跳过边框、视频帧、ROI框和叠加层的绘制，
+ *        没有额外输出时连 display_region 和 VBO 的更新也跳过；
+ *        拼接时视频帧绘制到纹理数组中的一个格子，然后一次绘制整个网格
+*/
+static GstFlowReturn
+gst_eglglessink_render (GstEglGlesSink * eglglessink)
+{
+  GstEglAdaptationContext *ctx = eglglessink->egl_context;
+  guint dar_n, dar_d;
+  gboolean passthrough, full_damage;
+  GstEglScalingMethod scaling_method;
+  gint tiles = 0;
+
+  GST_OBJECT_LOCK (eglglessink);
+  full_damage = eglglessink->full_damage;
+  eglglessink->full_damage = FALSE;
+  /* 属性可能在其他线程改变，这一帧使用同一个值 */
+  scaling_method = eglglessink->scaling_method;
+  GST_OBJECT_UNLOCK (eglglessink);
+
+  gst_eglglessink_setup_extra_outputs (eglglessink);
+  if (!gst_eglglessink_setup_output (eglglessink)) {
+    GST_ERROR_OBJECT (eglglessink, "Output setup failed");
+    goto HANDLE_ERROR;
+  }
+#ifndef HAVE_IOS
+  tiles = gst_eglglessink_mosaic_tiles (eglglessink);
+  if (tiles)
+    eglglessink->change_port = (eglglessink->change_port + 1) % tiles;
+#endif
+  passthrough = !tiles && gst_eglglessink_can_passthrough (eglglessink);
+  if (passthrough && eglglessink->extra_outputs->len == 0) {
+    GST_LOG_OBJECT (eglglessink, "Passthrough, nothing to draw");
+    /* 共享纹理已经在上传时更新，不需要 fence */
+    glFlush ();
+    goto DONE;
+  }
+
+  /* If no one has set a display rectangle on us initialize
+   * a sane default. According to the docs on the xOverlay
+   * interface we are supposed to fill the overlay 100%. We
+   * do this trying to take PAR/DAR into account unless the
+   * calling party explicitly ask us not to by setting
+   * force_aspect_ratio to FALSE.
+   */
+  if (gst_egl_adaptation_update_surface_dimensions (eglglessink->egl_context) ||
+      eglglessink->render_region_changed ||
+      !eglglessink->display_region.w || !eglglessink->display_region.h ||
+      eglglessink->crop_changed ||
+      (tiles && !eglglessink->egl_context->mosaic_texture)) {
+    GST_OBJECT_LOCK (eglglessink);
+
+    if (!eglglessink->render_region_user) {
+      eglglessink->render_region.x = 0;
+      eglglessink->render_region.y = 0;
+      eglglessink->render_region.w = eglglessink->egl_context->surface_width / eglglessink->columns;
+      eglglessink->render_region.h = eglglessink->egl_context->surface_height / eglglessink->rows;
+    }
+    eglglessink->render_region_changed = FALSE;
+    eglglessink->crop_changed = FALSE;
+    full_damage = TRUE;
+
+    if (!eglglessink->force_aspect_ratio) {
+      eglglessink->display_region.x = 0;
+      eglglessink->display_region.y = 0;
+      eglglessink->display_region.w = eglglessink->render_region.w;
+      eglglessink->display_region.h = eglglessink->render_region.h;
+    } else {
+      GstVideoRectangle frame;
+      gint crop_w = eglglessink->crop.w;
+      gint crop_h = eglglessink->crop.h;
+      gint par_n = eglglessink->configured_info.par_n;
+      gint par_d = eglglessink->configured_info.par_d;
+
+      /* 旋转90°/270°之后，视频的宽高和PAR都需要交换 */
+      if (GST_EGLGLESSINK_METHOD_IS_TRANSPOSED (eglglessink->rotate_method)) {
+        crop_w = eglglessink->crop.h;
+        crop_h = eglglessink->crop.w;
+        par_n = eglglessink->configured_info.par_d;
+        par_d = eglglessink->configured_info.par_n;
+      }
+
+      frame.x = 0;
+      frame.y = 0;
+
+      if (!gst_video_calculate_display_ratio (&dar_n, &dar_d,
+              crop_w, crop_h, par_n, par_d,
+              eglglessink->egl_context->pixel_aspect_ratio_n,
+              eglglessink->egl_context->pixel_aspect_ratio_d)) {
+        GST_WARNING_OBJECT (eglglessink, "Could not compute resulting DAR");
+        frame.w = crop_w;
+        frame.h = crop_h;
+      } else {
+        /* Find suitable matching new size acording to dar & par
+         * rationale for prefering leaving the height untouched
+         * comes from interlacing considerations.
+         * XXX: Move this to gstutils?
+         */
+        if (crop_h % dar_d == 0) {
+          frame.w = gst_util_uint64_scale_int (crop_h, dar_n, dar_d);
+          frame.h = crop_h;
+        } else if (crop_w % dar_n == 0) {
+          frame.h = gst_util_uint64_scale_int (crop_w, dar_d, dar_n);
+          frame.w = crop_w;
+        } else {
+          /* Neither width nor height can be precisely scaled.
+           * Prefer to leave height untouched. See comment above.
+           */
+          frame.w = gst_util_uint64_scale_int (crop_h, dar_n, dar_d);
+          frame.h = crop_h;
+        }
+      }
+
+      gst_video_sink_center_rect (frame, eglglessink->render_region,
+          &eglglessink->display_region, TRUE);
+    }
+
+    if (tiles) {
+      /* 拼接：在纹理数组的一层中绘制，格子的位置由实例缓冲决定 */
+      eglglessink->viewport.x = 0;
+      eglglessink->viewport.y = 0;
+      eglglessink->viewport.w = eglglessink->render_region.w;
+      eglglessink->viewport.h = eglglessink->render_region.h;
+    } else {
+      gst_eglglessink_tile_rect (eglglessink, eglglessink->change_port,
+          &eglglessink->viewport);
+    }
+    glViewport (eglglessink->viewport.x, eglglessink->viewport.y,
+        eglglessink->viewport.w, eglglessink->viewport.h);
+
+    /* Clear the surface once if its content is preserved */
+    if (!tiles && (eglglessink->egl_context->buffer_preserved ||
+        eglglessink->change_port % (eglglessink->rows * eglglessink->columns) == 0)) {
+      glClearColor (0.0, 0.0, 0.0, 1.0);
+      glClear (GL_COLOR_BUFFER_BIT);
+      eglglessink->egl_context->buffer_preserved = FALSE;
+    }
+
+#ifndef HAVE_IOS
+    if (tiles && !gst_eglglessink_setup_mosaic (eglglessink, tiles)) {
+      GST_OBJECT_UNLOCK (eglglessink);
+      GST_ERROR_OBJECT (eglglessink, "Mosaic setup failed");
+      goto HANDLE_ERROR;
+    }
+#endif
+
+    if (!gst_eglglessink_setup_vbo (eglglessink)) {
+      GST_OBJECT_UNLOCK (eglglessink);
+      GST_ERROR_OBJECT (eglglessink, "VBO setup failed");
+      goto HANDLE_ERROR;
+    }
+    GST_OBJECT_UNLOCK (eglglessink);
+
+    gst_eglglessink_update_preferred_size (eglglessink);
+    gst_eglglessink_update_predownscale (eglglessink);
+  }
+
+  if (passthrough)
+    goto DRAW_EXTRA_OUTPUTS;
+
+  if (tiles) {
+#ifndef HAVE_IOS
+    gst_eglglessink_bind_mosaic_tile (eglglessink);
+#endif
+  } else if (!ctx->buffer_preserved && (full_damage || !ctx->target_fbo)) {
+    /* 输出FBO的内容会保留，边框只在布局改变或者 expose 之后重绘 */
+    gst_egl_adaptation_add_damage (ctx, eglglessink->viewport.x,
+        eglglessink->viewport.y, eglglessink->viewport.w,
+        eglglessink->viewport.h);
+
+    /* Draw black borders */
+    GST_DEBUG_OBJECT (eglglessink, "Drawing black border 1");
+    glUseProgram (eglglessink->egl_context->glslprogram[1]);
+
+    if (!gst_eglglessink_draw_quad (eglglessink, 1, 8))
+      goto HANDLE_ERROR;
+
+    GST_DEBUG_OBJECT (eglglessink, "Drawing black border 2");
+
+    if (!gst_eglglessink_draw_quad (eglglessink, 1, 12))
+      goto HANDLE_ERROR;
+  }
+
+  /* Draw video frame */
+  GST_DEBUG_OBJECT (eglglessink, "Drawing video frame");
+
+  if (!tiles)
+    gst_egl_adaptation_add_damage (ctx,
+        eglglessink->viewport.x + eglglessink->display_region.x,
+        eglglessink->viewport.y + eglglessink->display_region.y,
+        eglglessink->display_region.w, eglglessink->display_region.h);
+
+  if (eglglessink->deinterlacing && !gst_eglglessink_deinterlace (eglglessink))
+    goto HANDLE_ERROR;
+
+  if (scaling_method != GST_EGL_SCALING_METHOD_BILINEAR) {
+    if (!gst_eglglessink_draw_frame_scaled (eglglessink, scaling_method))
+      goto HANDLE_ERROR;
+  } else if (eglglessink->deinterlacing) {
+    if (!gst_eglglessink_draw_deinterlaced (eglglessink))
+      goto HANDLE_ERROR;
+  } else if (!gst_eglglessink_draw_frame (eglglessink, 0)) {
+    goto HANDLE_ERROR;
+  }
+
+#ifndef HAVE_IOS
+  if (!gst_eglglessink_draw_roi (eglglessink))
+    goto HANDLE_ERROR;
+#endif
+
+  if (!gst_eglglessink_draw_overlays (eglglessink))
+    goto HANDLE_ERROR;
+
+DRAW_EXTRA_OUTPUTS:
+  if (!gst_eglglessink_draw_extra_outputs (eglglessink))
+    goto HANDLE_ERROR;
+
+#ifndef HAVE_IOS
+  if (tiles && !gst_eglglessink_draw_mosaic (eglglessink, tiles, full_damage))
+    goto HANDLE_ERROR;
+#endif
 
-    glVertexAttribPointer (eglglessink->egl_context->texpos_loc[0], 2,
-        GL_FLOAT, GL_FALSE, sizeof (coord5), (gpointer) (3 * sizeof (gfloat)));
-    if (got_gl_error ("glVertexAttribPointer"))
-      goto HANDLE_ERROR;
-  } else if (eglglessink->orientation ==
-      GST_VIDEO_GL_TEXTURE_ORIENTATION_X_NORMAL_Y_FLIP) {
-    glVertexAttribPointer (eglglessink->egl_context->position_loc[0], 3,
-        GL_FLOAT, GL_FALSE, sizeof (coord5), (gpointer) (4 * sizeof (coord5)));
-    if (got_gl_error ("glVertexAttribPointer"))
-      goto HANDLE_ERROR;
+  if (ctx->share_texture) {
+    gint atlas_x = 0, atlas_y = 0;
+
+    if (ctx->atlas) {
+      GST_OBJECT_LOCK (eglglessink);
+      atlas_x = MAX (eglglessink->atlas_x, 0);
+      atlas_y = MAX (eglglessink->atlas_y, 0);
+      GST_OBJECT_UNLOCK (eglglessink);
+    }
 
-    glVertexAttribPointer (eglglessink->egl_context->texpos_loc[0], 2,
-        GL_FLOAT, GL_FALSE, sizeof (coord5),
-        (gpointer) (4 * sizeof (coord5) + 3 * sizeof (gfloat)));
-    if (got_gl_error ("glVertexAttribPointer"))
+    if (!gst_egl_adaptation_blit_output (ctx, atlas_x, atlas_y))
       goto HANDLE_ERROR;
-  } else {
-    g_assert_not_reached ();
   }
 
-  glDrawElements (GL_TRIANGLE_STRIP, 4, GL_UNSIGNED_SHORT, 0);
-  if (got_gl_error ("glDrawElements"))
-    goto HANDLE_ERROR;
-
-  glDisableVertexAttribArray (eglglessink->egl_context->position_loc[0]);
-  glDisableVertexAttribArray (eglglessink->egl_context->texpos_loc[0]);
-
   // if (!gst_egl_adaptation_context_swap_buffers (eglglessink->egl_context, eglglessink->winsys,
   //             &eglglessink->own_window_data, eglglessink->last_uploaded_buffer,
   //             eglglessink->show_latency)) {
   //   goto HANDLE_ERROR;
   // }
 
+  /* UI线程的上下文需要看到这一帧的结果（输出纹理、额外输出和图集） */
+  gst_eglglessink_fence_frame (eglglessink);
+
+DONE:
   if (eglglessink->profile)
     GstEglJitterToolAddPoint(eglglessink->pDeliveryJitter);
 
@@ -2448,6 +4706,7 @@ HANDLE_ERROR:
   glDisableVertexAttribArray (eglglessink->egl_context->position_loc[0]);
   glDisableVertexAttribArray (eglglessink->egl_context->texpos_loc[0]);
   glDisableVertexAttribArray (eglglessink->egl_context->position_loc[1]);
+  glBindFramebuffer (GL_FRAMEBUFFER, 0);
 
   GST_ERROR_OBJECT (eglglessink, "Rendering disabled for this frame");
 
@@ -2455,6 +4714,77 @@ HANDLE_ERROR:
 }
 
 
+/**
+ * @brief: 按 predownscale_factor 把系统内存的帧缩小到新的buffer，复制时间戳、标志和meta
+ *         （GstVideoMeta 除外，它描述的是原始尺寸的布局）
+ * @return: 缩小之后的buffer，不需要缩小（或者缩小失败）时返回NULL，上传原始的帧
+*/
+static GstBuffer *
+gst_eglglessink_predownscale (GstEglGlesSink * eglglessink, GstBuffer * buf)
+{
+  GstVideoInfo info, *small_info;
+  GstVideoFrame src, dst;
+  GstVideoMeta *vmeta;
+  GstBuffer *small;
+  gint factor;
+
+  GST_OBJECT_LOCK (eglglessink);
+  factor = eglglessink->predownscale_factor;
+  info = eglglessink->configured_info;
+  GST_OBJECT_UNLOCK (eglglessink);
+
+  if (factor < 2 || gst_buffer_n_memory (buf) == 0 ||
+      gst_buffer_get_video_gl_texture_upload_meta (buf))
+    return NULL;
+#ifndef HAVE_IOS
+  if (gst_is_egl_image_memory (gst_buffer_peek_memory (buf, 0)))
+    return NULL;
+#endif
+
+  if (!gst_video_frame_map (&src, &info, buf, GST_MAP_READ)) {
+    GST_WARNING_OBJECT (eglglessink, "Couldn't map frame for pre-downscale");
+    return NULL;
+  }
+
+  small_info = gst_video_info_new ();
+  gst_egl_downscale_info (&info, factor, small_info);
+  small = gst_buffer_new_allocate (NULL, GST_VIDEO_INFO_SIZE (small_info),
+      NULL);
+  if (!small || !gst_video_frame_map (&dst, small_info, small, GST_MAP_WRITE)) {
+    GST_WARNING_OBJECT (eglglessink, "Couldn't allocate pre-downscale frame");
+    gst_video_frame_unmap (&src);
+    gst_video_info_free (small_info);
+    if (small)
+      gst_buffer_unref (small);
+    return NULL;
+  }
+
+  if (!gst_egl_downscale_frame (&src, &dst, factor)) {
+    gst_video_frame_unmap (&dst);
+    gst_video_frame_unmap (&src);
+    gst_video_info_free (small_info);
+    gst_buffer_unref (small);
+    return NULL;
+  }
+  gst_video_frame_unmap (&dst);
+  gst_video_frame_unmap (&src);
+
+  gst_buffer_copy_into (small, buf, GST_BUFFER_COPY_FLAGS |
+      GST_BUFFER_COPY_TIMESTAMPS | GST_BUFFER_COPY_META, 0, -1);
+  while ((vmeta = gst_buffer_get_video_meta (small)))
+    gst_buffer_remove_meta (small, (GstMeta *) vmeta);
+
+  gst_mini_object_set_qdata (GST_MINI_OBJECT_CAST (small),
+      GST_EGLGLESSINK_PREDOWNSCALE_QUARK, small_info,
+      (GDestroyNotify) gst_video_info_free);
+
+  GST_LOG_OBJECT (eglglessink, "Pre-downscaled %dx%d to %dx%d",
+      GST_VIDEO_INFO_WIDTH (&info), GST_VIDEO_INFO_HEIGHT (&info),
+      GST_VIDEO_INFO_WIDTH (small_info), GST_VIDEO_INFO_HEIGHT (small_info));
+
+  return small;
+}
+
 /**
  * @brief: 这个函数会在show frame之前调用，把Buffer发送到队列中，以供渲染
  * @note: 这个函数会在 GstBaseSink 的chain函数中调用
@@ -2463,13 +4793,56 @@ static GstFlowReturn
 gst_eglglessink_prepare (GstBaseSink * bsink, GstBuffer * buf)
 {
   GstEglGlesSink *eglglessink;
+  GstBuffer *small;
+  GstFlowReturn ret;
 
   g_return_val_if_fail (buf != NULL, GST_FLOW_ERROR);
 
   eglglessink = GST_EGLGLESSINK (bsink);
   GST_DEBUG_OBJECT (eglglessink, "Got buffer: %p", buf);
 
-  return gst_eglglessink_queue_object (eglglessink, GST_MINI_OBJECT_CAST (buf));
+  /* 缩小之后上传的数据量减少 factor² 倍（在流线程中完成，不占用渲染线程） */
+  small = gst_eglglessink_predownscale (eglglessink, buf);
+  if (!small)
+    return gst_eglglessink_queue_object (eglglessink,
+        GST_MINI_OBJECT_CAST (buf));
+
+  ret = gst_eglglessink_queue_object (eglglessink, GST_MINI_OBJECT_CAST (small));
+  gst_buffer_unref (small);
+
+  return ret;
+}
+
+/**
+ * @brief: 场频输出时，等到帧时长的一半再渲染第二场
+ * @note: 在 show_frame 中调用（持有 PREROLL_LOCK）
+*/
+static GstFlowReturn
+gst_eglglessink_show_second_field (GstEglGlesSink * eglglessink,
+    GstBuffer * buf)
+{
+  GstBaseSink *bsink = GST_BASE_SINK (eglglessink);
+  GstClockTime running_time;
+  GstFlowReturn ret;
+
+  eglglessink->second_field_pending = FALSE;
+
+  running_time = gst_segment_to_running_time (&bsink->segment,
+      GST_FORMAT_TIME, GST_BUFFER_PTS (buf) + GST_BUFFER_DURATION (buf) / 2);
+  if (GST_CLOCK_TIME_IS_VALID (running_time) &&
+      gst_base_sink_wait_clock (bsink, running_time,
+          NULL) == GST_CLOCK_UNSCHEDULED) {
+    GST_DEBUG_OBJECT (eglglessink, "Unscheduled, dropping second field");
+    return GST_FLOW_OK;
+  }
+
+  /* 渲染线程此时是空闲的（queue_object 是同步的） */
+  eglglessink->deinterlace_field ^= 1;
+  eglglessink->second_field = TRUE;
+  ret = gst_eglglessink_queue_object (eglglessink, NULL);
+  eglglessink->second_field = FALSE;
+
+  return ret;
 }
 
 /**
@@ -2480,13 +4853,19 @@ static GstFlowReturn
 gst_eglglessink_show_frame (GstVideoSink * vsink, GstBuffer * buf)
 {
   GstEglGlesSink *eglglessink;
+  GstFlowReturn ret;
 
   g_return_val_if_fail (buf != NULL, GST_FLOW_ERROR);
 
   eglglessink = GST_EGLGLESSINK (vsink);
   GST_DEBUG_OBJECT (eglglessink, "Got buffer: %p", buf);
 
-  return gst_eglglessink_queue_object (eglglessink, NULL);
+  ret = gst_eglglessink_queue_object (eglglessink, NULL);
+
+  if (ret == GST_FLOW_OK && eglglessink->second_field_pending)
+    ret = gst_eglglessink_show_second_field (eglglessink, buf);
+
+  return ret;
 }
 
 static GstCaps *
@@ -2494,6 +4873,7 @@ gst_eglglessink_getcaps (GstBaseSink * bsink, GstCaps * filter)
 {
   GstEglGlesSink *eglglessink;
   GstCaps *ret = NULL;
+  gint width, height;
 
   eglglessink = GST_EGLGLESSINK (bsink);
 
@@ -2505,11 +4885,29 @@ gst_eglglessink_getcaps (GstBaseSink * bsink, GstCaps * filter)
         gst_caps_copy (gst_pad_get_pad_template_caps (GST_BASE_SINK_PAD
             (bsink)));
   }
+  width = eglglessink->preferred_width;
+  height = eglglessink->preferred_height;
   GST_OBJECT_UNLOCK (eglglessink);
 
+  /* 格子尺寸的caps放在前面，上游不能缩放时仍然可以使用后面的完整caps */
+  if (width && height) {
+    GstCaps *preferred = gst_caps_copy (ret);
+
+    gst_caps_set_simple (preferred, "width", G_TYPE_INT, width,
+        "height", G_TYPE_INT, height, "pixel-aspect-ratio", GST_TYPE_FRACTION,
+        eglglessink->egl_context->pixel_aspect_ratio_n,
+        eglglessink->egl_context->pixel_aspect_ratio_d, NULL);
+    ret = gst_caps_merge (preferred, ret);
+  }
+
   if (filter) {
-    GstCaps *tmp =
-        gst_caps_intersect_full (filter, ret, GST_CAPS_INTERSECT_FIRST);
+    GstCaps *tmp;
+
+    /* 有偏好时按照自己的顺序，否则上游的顺序优先 */
+    if (width && height)
+      tmp = gst_caps_intersect_full (ret, filter, GST_CAPS_INTERSECT_FIRST);
+    else
+      tmp = gst_caps_intersect_full (filter, ret, GST_CAPS_INTERSECT_FIRST);
 
     gst_caps_unref (ret);
     ret = tmp;
@@ -2556,15 +4954,94 @@ gst_eglglessink_query (GstBaseSink * bsink, GstQuery * query)
   }
 }
 
+/**
+ * @brief: 处理 image-orientation 标签（video-direction 为 auto 时使用），
+ *         新的流（STREAM_START）不再使用之前的标签
+*/
+static gboolean
+gst_eglglessink_event (GstBaseSink * bsink, GstEvent * event)
+{
+  GstEglGlesSink *eglglessink = GST_EGLGLESSINK (bsink);
+  GstTagList *taglist;
+  GstVideoOrientationMethod method;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_TAG:
+      gst_event_parse_tag (event, &taglist);
+      if (gst_video_orientation_from_tag (taglist, &method)) {
+        GST_DEBUG_OBJECT (eglglessink, "Got image-orientation tag %d", method);
+        GST_OBJECT_LOCK (eglglessink);
+        eglglessink->tag_direction = method;
+        gst_eglglessink_update_rotate_method (eglglessink);
+        GST_OBJECT_UNLOCK (eglglessink);
+      }
+      break;
+    case GST_EVENT_STREAM_START:
+      /* 新的流的标签之后才到达；flush 不影响流的标签 */
+      GST_OBJECT_LOCK (eglglessink);
+      eglglessink->tag_direction = GST_VIDEO_ORIENTATION_IDENTITY;
+      gst_eglglessink_update_rotate_method (eglglessink);
+      GST_OBJECT_UNLOCK (eglglessink);
+      break;
+    default:
+      break;
+  }
+
+  return GST_BASE_SINK_CLASS (parent_class)->event (bsink, event);
+}
+
+/**
+ * @brief: 应用设置的图集区域（GST_EGLGLESSINK_ATLAS_CONTEXT_TYPE），等同于设置
+ *         egl-share-texture、atlas-x/atlas-y 和 output-width/output-height
+*/
+static void
+gst_eglglessink_set_atlas_context (GstEglGlesSink * eglglessink,
+    GstContext * context)
+{
+  const GstStructure *s = gst_context_get_structure (context);
+  guint texture = 0;
+  gint x, y, width, height;
+
+  if (!gst_structure_get_int (s, "x", &x) ||
+      !gst_structure_get_int (s, "y", &y) ||
+      !gst_structure_get_int (s, "width", &width) ||
+      !gst_structure_get_int (s, "height", &height) ||
+      x < 0 || y < 0 || width <= 0 || height <= 0) {
+    GST_WARNING_OBJECT (eglglessink, "Invalid atlas region context %"
+        GST_PTR_FORMAT, s);
+    return;
+  }
+  gst_structure_get_uint (s, "texture", &texture);
+
+  GST_DEBUG_OBJECT (eglglessink, "Atlas region %dx%d at %d,%d in texture %u",
+      width, height, x, y, texture);
+
+  GST_OBJECT_LOCK (eglglessink);
+  if (texture)
+    eglglessink->egl_share_texture = texture;
+  eglglessink->atlas_x = x;
+  eglglessink->atlas_y = y;
+  eglglessink->output_width = width;
+  eglglessink->output_height = height;
+  GST_OBJECT_UNLOCK (eglglessink);
+}
+
 static void
 gst_eglglessink_set_context (GstElement * element, GstContext * context)
 {
-#ifndef HAVE_IOS
   GstEglGlesSink *eglglessink;
+#ifndef HAVE_IOS
   GstEGLDisplay *display = NULL;
+#endif
 
   eglglessink = GST_EGLGLESSINK (element);
 
+  if (g_strcmp0 (gst_context_get_context_type (context),
+          GST_EGLGLESSINK_ATLAS_CONTEXT_TYPE) == 0) {
+    gst_eglglessink_set_atlas_context (eglglessink, context);
+    return;
+  }
+#ifndef HAVE_IOS
   if (gst_context_get_egl_display (context, &display)) {
     GST_OBJECT_LOCK (eglglessink);
     if (eglglessink->egl_context->set_display)
@@ -2575,6 +5052,95 @@ gst_eglglessink_set_context (GstElement * element, GstContext * context)
 #endif
 }
 
+/**
+ * @brief: 从caps得到视频信息；DMABuf caps（format=DMA_DRM）转换成 drm-format 对应的普通格式
+ * @param modifier: 返回 DRM modifier，不是 DMABuf caps 时为 0（linear）
+*/
+static gboolean
+gst_eglglessink_video_info_from_caps (GstVideoInfo * info,
+    const GstCaps * caps, guint64 * modifier)
+{
+  *modifier = 0;
+
+#if !defined(HAVE_IOS) && GST_CHECK_VERSION(1,24,0)
+  if (gst_video_is_dma_drm_caps (caps)) {
+    GstVideoInfoDmaDrm drm_info;
+
+    if (!gst_video_info_dma_drm_from_caps (&drm_info, caps) ||
+        !gst_video_info_dma_drm_to_video_info (&drm_info, info))
+      return FALSE;
+
+    *modifier = drm_info.drm_modifier;
+    return TRUE;
+  }
+#endif
+
+  return gst_video_info_from_caps (info, caps);
+}
+
+/**
+ * @brief: 设置缓冲池的参数和分配器。支持 udmabuf、dmabuf 导入和纹理 swizzle 时使用 EGLImage 分配器，
+ *         池里的buffer是 CPU 可以映射的 udmabuf EGLImage，上游直接写入 GPU 采样的内存，
+ *         上传时只需要绑定 EGLImage，没有拷贝；否则使用系统内存
+ *         buffer 个数由 min-buffers/max-buffers 属性决定
+ * @param size(out): buffer 大小，EGLImage 内存每个平面的行按 GST_EGL_IMAGE_MEMORY_STRIDE_ALIGN 对齐
+ * @param min_buffers(out), max_buffers(out): 缓冲池的 buffer 个数（max_buffers 为 0 表示不限制）
+*/
+static void
+gst_eglglessink_pool_config_init (GstEglGlesSink * eglglessink,
+    GstStructure * config, GstCaps * caps, const GstVideoInfo * info,
+    GstAllocationParams * params, guint * size, guint * min_buffers,
+    guint * max_buffers)
+{
+  GstAllocator *allocator;
+  GstVideoAlignment align;
+  GstVideoInfo ainfo = *info;
+  gboolean preallocate;
+  guint i;
+
+  *size = info->size;
+
+  GST_OBJECT_LOCK (eglglessink);
+  *min_buffers = eglglessink->min_buffers;
+  *max_buffers = eglglessink->max_buffers;
+  preallocate = eglglessink->preallocate;
+  GST_OBJECT_UNLOCK (eglglessink);
+
+  if (*max_buffers && *max_buffers < *min_buffers) {
+    GST_WARNING_OBJECT (eglglessink, "max-buffers %u is less than "
+        "min-buffers %u, using %u", *max_buffers, *min_buffers, *min_buffers);
+    *max_buffers = *min_buffers;
+  }
+
+  gst_structure_set (config, GST_EGL_IMAGE_BUFFER_POOL_CONFIG_PREALLOCATE,
+      G_TYPE_BOOLEAN, preallocate, NULL);
+
+  if (!gst_egl_image_memory_is_mappable () ||
+      !eglglessink->egl_context->texture_swizzle ||
+      !gst_egl_dmabuf_import_supported (eglglessink->egl_context->display)) {
+    gst_buffer_pool_config_set_params (config, caps, *size, *min_buffers,
+        *max_buffers);
+    gst_buffer_pool_config_set_allocator (config, NULL, params);
+    return;
+  }
+
+  /* 和 gst_egl_image_allocator_alloc 的布局一致，缓冲池按这个大小回收buffer */
+  gst_video_alignment_reset (&align);
+  for (i = 0; i < GST_VIDEO_MAX_PLANES; i++)
+    align.stride_align[i] = GST_EGL_IMAGE_MEMORY_STRIDE_ALIGN - 1;
+  gst_video_info_align (&ainfo, &align);
+  *size = ainfo.size;
+
+  gst_buffer_pool_config_set_params (config, caps, *size, *min_buffers,
+      *max_buffers);
+  allocator = gst_egl_image_allocator_obtain ();
+  gst_buffer_pool_config_set_allocator (config, allocator, params);
+  gst_buffer_pool_config_add_option (config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+  gst_object_unref (allocator);
+
+  GST_DEBUG_OBJECT (eglglessink, "pool allocates mappable EGLImage memory");
+}
+
 static gboolean
 gst_eglglessink_propose_allocation (GstBaseSink * bsink, GstQuery * query)
 {
@@ -2585,9 +5151,10 @@ gst_eglglessink_propose_allocation (GstBaseSink * bsink, GstQuery * query)
   GstCaps *caps;
   GstVideoInfo info;
   gboolean need_pool;
-  guint size;
+  guint size, min_buffers, max_buffers;
   GstAllocator *allocator;
   GstAllocationParams params;
+  guint64 modifier;
 
   eglglessink = GST_EGLGLESSINK (bsink);
 
@@ -2599,11 +5166,19 @@ gst_eglglessink_propose_allocation (GstBaseSink * bsink, GstQuery * query)
     return FALSE;
   }
 
-  if (!gst_video_info_from_caps (&info, caps)) {
+  if (!gst_eglglessink_video_info_from_caps (&info, caps, &modifier)) {
     GST_ERROR_OBJECT (eglglessink, "allocation query with invalid caps");
     return FALSE;
   }
 
+  /* dmabuf 由上游（V4L2/VA-API）分配，只需要它的布局（GstVideoMeta） */
+  if (gst_caps_features_contains (gst_caps_get_features (caps, 0),
+          GST_CAPS_FEATURE_MEMORY_DMABUF)) {
+    gst_query_add_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL);
+    gst_query_add_allocation_meta (query, GST_VIDEO_CROP_META_API_TYPE, NULL);
+    return TRUE;
+  }
+
   GST_OBJECT_LOCK (eglglessink);
   pool = eglglessink->pool ? gst_object_ref (eglglessink->pool) : NULL;
   GST_OBJECT_UNLOCK (eglglessink);
@@ -2614,7 +5189,8 @@ gst_eglglessink_propose_allocation (GstBaseSink * bsink, GstQuery * query)
     /* we had a pool, check caps */
     GST_DEBUG_OBJECT (eglglessink, "check existing pool caps");
     config = gst_buffer_pool_get_config (pool);
-    gst_buffer_pool_config_get_params (config, &pcaps, &size, NULL, NULL);
+    gst_buffer_pool_config_get_params (config, &pcaps, &size, &min_buffers,
+        &max_buffers);
 
     if (!gst_caps_is_equal (caps, pcaps)) {
       GST_DEBUG_OBJECT (eglglessink, "pool has different caps");
@@ -2641,13 +5217,9 @@ gst_eglglessink_propose_allocation (GstBaseSink * bsink, GstQuery * query)
         gst_object_ref (eglglessink),
         gst_eglglessink_egl_image_buffer_pool_on_destroy);
 
-    /* the normal size of a frame */
-    size = info.size;
-
     config = gst_buffer_pool_get_config (pool);
-    /* we need at least 2 buffer because we hold on to the last one */
-    gst_buffer_pool_config_set_params (config, caps, size, 2, 0);
-    gst_buffer_pool_config_set_allocator (config, NULL, &params);
+    gst_eglglessink_pool_config_init (eglglessink, config, caps, &info,
+        &params, &size, &min_buffers, &max_buffers);
     if (!gst_buffer_pool_set_config (pool, config)) {
       gst_object_unref (pool);
       GST_ERROR_OBJECT (eglglessink, "failed to set pool configuration");
@@ -2656,21 +5228,19 @@ gst_eglglessink_propose_allocation (GstBaseSink * bsink, GstQuery * query)
   }
 
   if (pool) {
-    /* we need at least 2 buffer because we hold on to the last one */
-    gst_query_add_allocation_pool (query, pool, size, 2, 0);
+    gst_query_add_allocation_pool (query, pool, size, min_buffers,
+        max_buffers);
     gst_object_unref (pool);
   }
 
-  /* First the default allocator */
-  if (!gst_egl_image_memory_is_mappable ()) {
-    allocator = gst_allocator_find (NULL);
-    gst_query_add_allocation_param (query, allocator, &params);
-    gst_object_unref (allocator);
-  }
+  /* First the default allocator. EGLImage 分配器不能通过 gst_allocator_alloc 分配，
+   * 可以映射的 EGLImage 内存只由上面的缓冲池提供 */
+  allocator = gst_allocator_find (NULL);
+  gst_query_add_allocation_param (query, allocator, &params);
+  gst_object_unref (allocator);
 
   allocator = gst_egl_image_allocator_obtain ();
-  if (!gst_egl_image_memory_is_mappable ())
-    params.flags |= GST_MEMORY_FLAG_NOT_MAPPABLE;
+  params.flags |= GST_MEMORY_FLAG_NOT_MAPPABLE;
   gst_query_add_allocation_param (query, allocator, &params);
   gst_object_unref (allocator);
 
@@ -2680,6 +5250,9 @@ gst_eglglessink_propose_allocation (GstBaseSink * bsink, GstQuery * query)
 
   gst_query_add_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL);
   gst_query_add_allocation_meta (query, GST_VIDEO_CROP_META_API_TYPE, NULL);
+  /* 字幕/OSD 由sink在GPU上混合，上游不需要在CPU上修改视频帧 */
+  gst_query_add_allocation_meta (query,
+      GST_VIDEO_OVERLAY_COMPOSITION_META_API_TYPE, NULL);
 
   return TRUE;
 }
@@ -2696,6 +5269,14 @@ gst_eglglessink_cuda_init (GstEglGlesSink * eglglessink) {
   int i;
   guint width, height, pstride;
   GstVideoFormat videoFormat;
+  GLint l_internal, la_internal;
+  GLenum l_format, la_format;
+
+  /* GLES3 时单/双通道平面使用 R8/RG8（CUDA 也支持注册这两种格式的纹理） */
+  gst_egl_adaptation_plane_format (eglglessink->egl_context->texture_swizzle,
+      1, &l_internal, &l_format);
+  gst_egl_adaptation_plane_format (eglglessink->egl_context->texture_swizzle,
+      2, &la_internal, &la_format);
 
   cuInit(0);
   result = cuCtxCreate(&pctx, 0, 0); /* 创建CUDA上下文 */
@@ -2763,7 +5344,7 @@ gst_eglglessink_cuda_init (GstEglGlesSink * eglglessink) {
             height = GST_VIDEO_INFO_COMP_HEIGHT(&(eglglessink->configured_info), i);
 
             glBindTexture(GL_TEXTURE_2D, eglglessink->egl_context->texture[i]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, width, height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, NULL);
+            glTexImage2D(GL_TEXTURE_2D, 0, l_internal, width, height, 0, l_format, GL_UNSIGNED_BYTE, NULL);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
             glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -2794,9 +5375,9 @@ gst_eglglessink_cuda_init (GstEglGlesSink * eglglessink) {
             pstride = GST_VIDEO_INFO_COMP_PSTRIDE(&(eglglessink->configured_info), i);
 
             if (i == 0)
-              glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, width*pstride, height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, NULL);
+              glTexImage2D(GL_TEXTURE_2D, 0, l_internal, width*pstride, height, 0, l_format, GL_UNSIGNED_BYTE, NULL);
             else if ( i == 1)
-              glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE_ALPHA, width*pstride, height, 0, GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, NULL);
+              glTexImage2D(GL_TEXTURE_2D, 0, la_internal, width*pstride, height, 0, la_format, GL_UNSIGNED_BYTE, NULL);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
             glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -2862,7 +5443,8 @@ gst_eglglessink_configure_caps (GstEglGlesSink * eglglessink, GstCaps * caps)
   g_print ("gst_eglglessink_configure_caps\n");
 
   gst_video_info_init (&info);
-  if (!(ret = gst_video_info_from_caps (&info, caps))) {
+  if (!(ret = gst_eglglessink_video_info_from_caps (&info, caps,
+              &eglglessink->dmabuf_modifier))) {
     GST_ERROR_OBJECT (eglglessink, "Couldn't parse caps");
     goto HANDLE_ERROR;
   }
@@ -2884,6 +5466,13 @@ gst_eglglessink_configure_caps (GstEglGlesSink * eglglessink, GstCaps * caps)
     if (eglglessink->using_cuda) {
       gst_eglglessink_cuda_cleanup(eglglessink);
     }
+#ifndef HAVE_IOS
+    gst_buffer_replace (&eglglessink->dmabuf_buffer, NULL);
+    gst_egl_dmabuf_cache_clear (eglglessink->dmabuf_cache);
+    gst_egl_image_texture_cache_clear (eglglessink->image_texture_cache);
+#endif
+    g_hash_table_remove_all (eglglessink->overlay_textures);
+    gst_eglglessink_clear_extra_outputs (eglglessink);
     gst_egl_adaptation_cleanup (eglglessink->egl_context);
     gst_caps_unref (eglglessink->configured_caps);
     eglglessink->configured_caps = NULL;
@@ -2939,6 +5528,23 @@ gst_eglglessink_configure_caps (GstEglGlesSink * eglglessink, GstCaps * caps)
 
   gst_egl_adaptation_init_exts (eglglessink->egl_context);
 
+#ifndef HAVE_IOS
+  /* dmabuf 的平面直接导入成 EGLImage，不经过 fill_texture 的拷贝；
+   * 双通道平面（GR88）需要 GLES3 的纹理 swizzle 模拟 LUMINANCE_ALPHA */
+  if (eglglessink->using_dmabuf) {
+    if (!eglglessink->dmabuf_cache)
+      eglglessink->dmabuf_cache =
+          gst_egl_dmabuf_cache_new (GST_ELEMENT (eglglessink),
+          eglglessink->egl_context->display);
+    if (!eglglessink->dmabuf_cache ||
+        !eglglessink->egl_context->texture_swizzle) {
+      GST_ERROR_OBJECT (eglglessink, "DMABuf import needs "
+          "EGL_EXT_image_dma_buf_import and OpenGL ES 3.0");
+      goto HANDLE_ERROR;
+    }
+  }
+#endif
+
   /* gl纹理创建CUDA访问句柄 */
   if (eglglessink->using_cuda) {
     if (!gst_eglglessink_cuda_init(eglglessink)) {
@@ -2964,10 +5570,12 @@ gst_eglglessink_setcaps (GstBaseSink * bsink, GstCaps * caps)
   GstEglGlesSink *eglglessink;
   GstVideoInfo info;
   GstCapsFeatures *features;
+  guint64 modifier;
 #ifndef HAVE_IOS
   GstBufferPool *newpool, *oldpool;
   GstStructure *config;
   GstAllocationParams params = { 0, };
+  guint size, min_buffers, max_buffers;
 #endif
 
   eglglessink = GST_EGLGLESSINK (bsink);
@@ -2984,6 +5592,8 @@ gst_eglglessink_setcaps (GstBaseSink * bsink, GstCaps * caps)
     eglglessink->using_cuda = TRUE; /* GPU CUDA */
 #endif
   }
+  eglglessink->using_dmabuf =
+      gst_caps_features_contains (features, GST_CAPS_FEATURE_MEMORY_DMABUF);
 
   if (gst_eglglessink_queue_object (eglglessink,
           GST_MINI_OBJECT_CAST (caps)) != GST_FLOW_OK) {
@@ -2991,21 +5601,20 @@ gst_eglglessink_setcaps (GstBaseSink * bsink, GstCaps * caps)
     return FALSE;
   }
 
-  if (!gst_video_info_from_caps (&info, caps)) {
+  if (!gst_eglglessink_video_info_from_caps (&info, caps, &modifier)) {
     GST_ERROR_OBJECT (eglglessink, "Invalid caps %" GST_PTR_FORMAT, caps);
     return FALSE;
   }
 #ifndef HAVE_IOS
-  if (!eglglessink->using_cuda) {
+  if (!eglglessink->using_cuda && !eglglessink->using_dmabuf) {
   newpool =
       gst_egl_image_buffer_pool_new
       (gst_eglglessink_egl_image_buffer_pool_send_blocking,
       gst_object_ref (eglglessink),
       gst_eglglessink_egl_image_buffer_pool_on_destroy);
   config = gst_buffer_pool_get_config (newpool);
-  /* we need at least 2 buffer because we hold on to the last one */
-  gst_buffer_pool_config_set_params (config, caps, info.size, 2, 0);
-  gst_buffer_pool_config_set_allocator (config, NULL, &params);
+  gst_eglglessink_pool_config_init (eglglessink, config, caps, &info,
+      &params, &size, &min_buffers, &max_buffers);
   if (!gst_buffer_pool_set_config (newpool, config)) {
     gst_object_unref (newpool);
     GST_ERROR_OBJECT (eglglessink, "Failed to set buffer pool configuration");
@@ -3039,6 +5648,13 @@ gst_eglglessink_open (GstEglGlesSink * eglglessink)
     return FALSE;
   }
 
+#ifndef HAVE_IOS
+  /* 后台编译所有格式的着色程序，configure_caps 时直接使用 */
+  gst_egl_adaptation_precompile_start (eglglessink->egl_context);
+  /* 缓冲池释放的 EGLImage buffer 在关闭之前保留给之后的缓冲池 */
+  gst_egl_image_allocator_enable_recycling (eglglessink->egl_context->display);
+#endif
+
   if (eglglessink->profile) {
     eglglessink->pDeliveryJitter = GstEglAllocJitterTool("frame delivery", 100);
     GstEglJitterToolSetShow(eglglessink->pDeliveryJitter, 0 /*eglglessink->profile*/);
@@ -3068,6 +5684,8 @@ gst_eglglessink_close (GstEglGlesSink * eglglessink)
     eglglessink->thread = NULL;
   }
 
+  gst_egl_adaptation_precompile_stop (eglglessink->egl_context);
+
   if (eglglessink->using_own_window) {
     g_mutex_lock (&eglglessink->window_lock);
     gst_egl_adaptation_destroy_native_window (eglglessink->egl_context,
@@ -3078,6 +5696,7 @@ gst_eglglessink_close (GstEglGlesSink * eglglessink)
   eglglessink->egl_context->used_window = 0;
 
   if (eglglessink->egl_context->display) {
+    gst_egl_image_allocator_release_recycled (eglglessink->egl_context->display);
     gst_egl_display_unref (eglglessink->egl_context->display);
     eglglessink->egl_context->display = NULL;
   }
@@ -3180,6 +5799,14 @@ gst_eglglessink_finalize (GObject * object)
     g_object_unref (eglglessink->queue);
   eglglessink->queue = NULL;
 
+  if (eglglessink->overlay_composition)
+    gst_video_overlay_composition_unref (eglglessink->overlay_composition);
+  eglglessink->overlay_composition = NULL;
+  g_hash_table_unref (eglglessink->overlay_textures);
+  g_array_free (eglglessink->roi_boxes, TRUE);
+  g_array_free (eglglessink->extra_outputs, TRUE);
+  g_free (eglglessink->extra_outputs_desc);
+
   g_mutex_clear (&eglglessink->window_lock);
   g_cond_clear (&eglglessink->render_cond);
   g_cond_clear (&eglglessink->render_exit_cond);
@@ -3232,12 +5859,18 @@ gst_eglglessink_set_property (GObject * object, guint prop_id,
       eglglessink->show_latency = g_value_get_boolean (value);
       break;
     case PROP_ROWS:
+      GST_OBJECT_LOCK (eglglessink);
       eglglessink->rows = g_value_get_uint (value);
       eglglessink->change_port = -1;
+      eglglessink->render_region_changed = TRUE;
+      GST_OBJECT_UNLOCK (eglglessink);
       break;
     case PROP_COLUMNS:
+      GST_OBJECT_LOCK (eglglessink);
       eglglessink->columns = g_value_get_uint (value);
       eglglessink->change_port = -1;
+      eglglessink->render_region_changed = TRUE;
+      GST_OBJECT_UNLOCK (eglglessink);
       break;
 #ifdef IS_DESKTOP
     case PROP_GPU_DEVICE_ID:
@@ -3267,6 +5900,96 @@ gst_eglglessink_set_property (GObject * object, guint prop_id,
       eglglessink->egl_share_texture = g_value_get_uint (value);
       g_print ("PROP       eglglessink->egl_share_texture = %d\n", eglglessink->egl_share_texture);
       break;
+    case PROP_SCALING_METHOD:
+      GST_OBJECT_LOCK (eglglessink);
+      eglglessink->scaling_method = g_value_get_enum (value);
+      GST_OBJECT_UNLOCK (eglglessink);
+      break;
+    case PROP_DEINTERLACE_METHOD:
+      eglglessink->deinterlace_method = g_value_get_enum (value);
+      break;
+    case PROP_DEINTERLACE_FIELD_RATE:
+      eglglessink->deinterlace_field_rate = g_value_get_boolean (value);
+      break;
+    case PROP_DRAW_ROI:
+      eglglessink->draw_roi = g_value_get_boolean (value);
+      break;
+    case PROP_ROI_LINE_WIDTH:
+      eglglessink->roi_line_width = g_value_get_uint (value);
+      break;
+    case PROP_PROGRAM_CACHE_DIR:
+      GST_OBJECT_LOCK (eglglessink);
+      g_free (eglglessink->egl_context->program_cache_dir);
+      eglglessink->egl_context->program_cache_dir = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (eglglessink);
+      break;
+    case PROP_PASSTHROUGH:
+      eglglessink->passthrough = g_value_get_boolean (value);
+      break;
+    case PROP_OUTPUT_WIDTH:
+      GST_OBJECT_LOCK (eglglessink);
+      eglglessink->output_width = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (eglglessink);
+      break;
+    case PROP_OUTPUT_HEIGHT:
+      GST_OBJECT_LOCK (eglglessink);
+      eglglessink->output_height = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (eglglessink);
+      break;
+    case PROP_MOSAIC:
+      eglglessink->mosaic = g_value_get_boolean (value);
+      break;
+    case PROP_TILE_RENEGOTIATION:
+      eglglessink->tile_renegotiation = g_value_get_boolean (value);
+      break;
+    case PROP_PREDOWNSCALE:
+      eglglessink->predownscale = g_value_get_boolean (value);
+      break;
+    case PROP_ATLAS_X:
+      GST_OBJECT_LOCK (eglglessink);
+      eglglessink->atlas_x = g_value_get_int (value);
+      GST_OBJECT_UNLOCK (eglglessink);
+      break;
+    case PROP_ATLAS_Y:
+      GST_OBJECT_LOCK (eglglessink);
+      eglglessink->atlas_y = g_value_get_int (value);
+      GST_OBJECT_UNLOCK (eglglessink);
+      break;
+    case PROP_MIN_BUFFERS:
+      GST_OBJECT_LOCK (eglglessink);
+      eglglessink->min_buffers = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (eglglessink);
+      break;
+    case PROP_MAX_BUFFERS:
+      GST_OBJECT_LOCK (eglglessink);
+      eglglessink->max_buffers = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (eglglessink);
+      break;
+    case PROP_PREALLOCATE:
+      GST_OBJECT_LOCK (eglglessink);
+      eglglessink->preallocate = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (eglglessink);
+      break;
+    case PROP_EXTRA_OUTPUTS:
+      GST_OBJECT_LOCK (eglglessink);
+      g_free (eglglessink->extra_outputs_desc);
+      eglglessink->extra_outputs_desc = g_value_dup_string (value);
+      eglglessink->extra_outputs_changed = TRUE;
+      GST_OBJECT_UNLOCK (eglglessink);
+      break;
+    case PROP_VIDEO_DIRECTION:{
+      GstVideoOrientationMethod method = g_value_get_enum (value);
+
+      if (method == GST_VIDEO_ORIENTATION_CUSTOM) {
+        GST_WARNING_OBJECT (eglglessink, "Unsupported custom video direction");
+        break;
+      }
+      GST_OBJECT_LOCK (eglglessink);
+      eglglessink->video_direction = method;
+      gst_eglglessink_update_rotate_method (eglglessink);
+      GST_OBJECT_UNLOCK (eglglessink);
+      break;
+    }
 
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -3274,6 +5997,32 @@ gst_eglglessink_set_property (GObject * object, guint prop_id,
   }
 }
 
+/**
+ * @brief: 属性 pool-stats，当前缓冲池（setcaps 创建，提供给上游）的统计，
+ *         没有缓冲池时返回没有字段的结构体
+*/
+static GstStructure *
+gst_eglglessink_get_pool_stats (GstEglGlesSink * eglglessink)
+{
+#ifndef HAVE_IOS
+  GstBufferPool *pool;
+  GstStructure *stats;
+
+  GST_OBJECT_LOCK (eglglessink);
+  pool = eglglessink->pool ? gst_object_ref (eglglessink->pool) : NULL;
+  GST_OBJECT_UNLOCK (eglglessink);
+
+  if (pool) {
+    stats = gst_egl_image_buffer_pool_get_stats (GST_EGL_IMAGE_BUFFER_POOL
+        (pool));
+    gst_object_unref (pool);
+    return stats;
+  }
+#endif
+
+  return gst_structure_new_empty ("GstEglGlesSinkPoolStats");
+}
+
 static void
 gst_eglglessink_get_property (GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec)
@@ -3346,6 +6095,86 @@ gst_eglglessink_get_property (GObject * object, guint prop_id,
     case PROP_EGL_SHARE_TEXTURE:
       g_value_set_uint (value, eglglessink->egl_share_texture);
       break;
+    case PROP_SCALING_METHOD:
+      GST_OBJECT_LOCK (eglglessink);
+      g_value_set_enum (value, eglglessink->scaling_method);
+      GST_OBJECT_UNLOCK (eglglessink);
+      break;
+    case PROP_VIDEO_DIRECTION:
+      g_value_set_enum (value, eglglessink->video_direction);
+      break;
+    case PROP_DEINTERLACE_METHOD:
+      g_value_set_enum (value, eglglessink->deinterlace_method);
+      break;
+    case PROP_DEINTERLACE_FIELD_RATE:
+      g_value_set_boolean (value, eglglessink->deinterlace_field_rate);
+      break;
+    case PROP_DRAW_ROI:
+      g_value_set_boolean (value, eglglessink->draw_roi);
+      break;
+    case PROP_ROI_LINE_WIDTH:
+      g_value_set_uint (value, eglglessink->roi_line_width);
+      break;
+    case PROP_PROGRAM_CACHE_DIR:
+      GST_OBJECT_LOCK (eglglessink);
+      g_value_set_string (value, eglglessink->egl_context->program_cache_dir);
+      GST_OBJECT_UNLOCK (eglglessink);
+      break;
+    case PROP_PASSTHROUGH:
+      g_value_set_boolean (value, eglglessink->passthrough);
+      break;
+    case PROP_OUTPUT_WIDTH:
+      GST_OBJECT_LOCK (eglglessink);
+      g_value_set_uint (value, eglglessink->output_width);
+      GST_OBJECT_UNLOCK (eglglessink);
+      break;
+    case PROP_OUTPUT_HEIGHT:
+      GST_OBJECT_LOCK (eglglessink);
+      g_value_set_uint (value, eglglessink->output_height);
+      GST_OBJECT_UNLOCK (eglglessink);
+      break;
+    case PROP_MOSAIC:
+      g_value_set_boolean (value, eglglessink->mosaic);
+      break;
+    case PROP_TILE_RENEGOTIATION:
+      g_value_set_boolean (value, eglglessink->tile_renegotiation);
+      break;
+    case PROP_PREDOWNSCALE:
+      g_value_set_boolean (value, eglglessink->predownscale);
+      break;
+    case PROP_ATLAS_X:
+      GST_OBJECT_LOCK (eglglessink);
+      g_value_set_int (value, eglglessink->atlas_x);
+      GST_OBJECT_UNLOCK (eglglessink);
+      break;
+    case PROP_ATLAS_Y:
+      GST_OBJECT_LOCK (eglglessink);
+      g_value_set_int (value, eglglessink->atlas_y);
+      GST_OBJECT_UNLOCK (eglglessink);
+      break;
+    case PROP_MIN_BUFFERS:
+      GST_OBJECT_LOCK (eglglessink);
+      g_value_set_uint (value, eglglessink->min_buffers);
+      GST_OBJECT_UNLOCK (eglglessink);
+      break;
+    case PROP_MAX_BUFFERS:
+      GST_OBJECT_LOCK (eglglessink);
+      g_value_set_uint (value, eglglessink->max_buffers);
+      GST_OBJECT_UNLOCK (eglglessink);
+      break;
+    case PROP_PREALLOCATE:
+      GST_OBJECT_LOCK (eglglessink);
+      g_value_set_boolean (value, eglglessink->preallocate);
+      GST_OBJECT_UNLOCK (eglglessink);
+      break;
+    case PROP_POOL_STATS:
+      g_value_take_boxed (value, gst_eglglessink_get_pool_stats (eglglessink));
+      break;
+    case PROP_EXTRA_OUTPUTS:
+      GST_OBJECT_LOCK (eglglessink);
+      g_value_set_string (value, eglglessink->extra_outputs_desc);
+      GST_OBJECT_UNLOCK (eglglessink);
+      break;
 
     
     default:
@@ -3381,6 +6210,7 @@ gst_eglglessink_class_init (GstEglGlesSinkClass * klass)
       GST_DEBUG_FUNCPTR (gst_eglglessink_propose_allocation);
   gstbasesink_class->prepare = GST_DEBUG_FUNCPTR (gst_eglglessink_prepare);  /* 先调用该函数 */
   gstbasesink_class->query = GST_DEBUG_FUNCPTR (gst_eglglessink_query);
+  gstbasesink_class->event = GST_DEBUG_FUNCPTR (gst_eglglessink_event);
 
   gstvideosink_class->show_frame =
       GST_DEBUG_FUNCPTR (gst_eglglessink_show_frame); /* 再调用该函数 */
@@ -3483,6 +6313,144 @@ gst_eglglessink_class_init (GstEglGlesSinkClass * klass)
           (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
           GST_PARAM_MUTABLE_READY)));
 
+  g_object_class_install_property (gobject_class, PROP_SCALING_METHOD,
+      g_param_spec_enum ("scaling-method", "Scaling method",
+          "Filter used when scaling the video into the display region. "
+          "bicubic and lanczos run two separable passes through an "
+          "intermediate framebuffer",
+          GST_TYPE_EGLGLESSINK_SCALING_METHOD, DEFAULT_SCALING_METHOD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_override_property (gobject_class, PROP_VIDEO_DIRECTION,
+      "video-direction");
+
+  g_object_class_install_property (gobject_class, PROP_DEINTERLACE_METHOD,
+      g_param_spec_enum ("deinterlace-method", "Deinterlace method",
+          "Deinterlacing applied to interlaced caps or buffers flagged "
+          "as interlaced",
+          GST_TYPE_EGLGLESSINK_DEINTERLACE_METHOD, DEFAULT_DEINTERLACE_METHOD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DEINTERLACE_FIELD_RATE,
+      g_param_spec_boolean ("deinterlace-field-rate",
+          "Deinterlace at field rate",
+          "Render each field of an interlaced frame separately (bob and "
+          "linear only), doubling the output rate",
+          DEFAULT_DEINTERLACE_FIELD_RATE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DRAW_ROI,
+      g_param_spec_boolean ("draw-roi", "Draw ROI",
+          "Draw the GstVideoRegionOfInterestMeta boxes of each frame, "
+          "colored by ROI type",
+          DEFAULT_DRAW_ROI, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ROI_LINE_WIDTH,
+      g_param_spec_uint ("roi-line-width", "ROI line width",
+          "Line width of the ROI boxes in pixels", 1, 64,
+          DEFAULT_ROI_LINE_WIDTH, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PROGRAM_CACHE_DIR,
+      g_param_spec_string ("program-cache-dir", "Program cache directory",
+          "Directory where linked shader program binaries are cached and "
+          "reloaded from (NULL disables the cache)", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_PASSTHROUGH,
+      g_param_spec_boolean ("passthrough", "Passthrough",
+          "Upload RGB frames straight into egl-share-texture and skip drawing "
+          "when they already are the final frame (no rotation, "
+          "deinterlacing, overlays or ROI boxes); FALSE renders into "
+          "egl-share-texture instead", DEFAULT_PASSTHROUGH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_EXTRA_OUTPUTS,
+      g_param_spec_string ("extra-outputs", "Extra outputs",
+          "Additional textures filled with every rendered frame, as a comma "
+          "separated list of TEXTURE:WIDTHxHEIGHT[:FORMAT][:mipmap], where "
+          "TEXTURE is a texture id in the egl-share-context share group and "
+          "FORMAT is rgba8 (default) or rgb565 (NULL disables)", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_OUTPUT_WIDTH,
+      g_param_spec_uint ("output-width", "Output width",
+          "Width egl-share-texture is allocated with when the frame is "
+          "rendered into it (0 = cropped frame width)", 0, G_MAXINT,
+          DEFAULT_OUTPUT_WIDTH, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_OUTPUT_HEIGHT,
+      g_param_spec_uint ("output-height", "Output height",
+          "Height egl-share-texture is allocated with when the frame is "
+          "rendered into it (0 = cropped frame height)", 0, G_MAXINT,
+          DEFAULT_OUTPUT_HEIGHT, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_MOSAIC,
+      g_param_spec_boolean ("mosaic", "Mosaic",
+          "Fill the rows x columns grid with successive frames, one tile per "
+          "frame, and draw the whole grid with a single instanced call",
+          DEFAULT_MOSAIC, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_TILE_RENEGOTIATION,
+      g_param_spec_boolean ("tile-renegotiation", "Tile renegotiation",
+          "Ask upstream for frames of the on-screen tile size when the "
+          "rows x columns tiles are much smaller than the negotiated size",
+          DEFAULT_TILE_RENEGOTIATION, G_PARAM_READWRITE |
+          G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_PREDOWNSCALE,
+      g_param_spec_boolean ("predownscale", "Pre-downscale",
+          "Box-downscale system memory frames on the CPU before upload when "
+          "the video is drawn at half its size or less",
+          DEFAULT_PREDOWNSCALE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_ATLAS_X,
+      g_param_spec_int ("atlas-x", "Atlas x",
+          "Column of egl-share-texture the output-width x output-height "
+          "output is copied to when the texture is an atlas shared with "
+          "other sinks (-1 = the sink owns the whole texture)", -1, G_MAXINT,
+          DEFAULT_ATLAS_X, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_ATLAS_Y,
+      g_param_spec_int ("atlas-y", "Atlas y",
+          "Row of egl-share-texture (GL texture coordinates, origin at the "
+          "bottom) the output is copied to in atlas mode (-1 = no atlas)",
+          -1, G_MAXINT, DEFAULT_ATLAS_Y, G_PARAM_READWRITE |
+          G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_MIN_BUFFERS,
+      g_param_spec_uint ("min-buffers", "Minimum pool buffers",
+          "Minimum number of buffers in the proposed buffer pool, applied "
+          "to the next pool (the sink holds on to the last buffer)",
+          2, G_MAXUINT, DEFAULT_MIN_BUFFERS, G_PARAM_READWRITE |
+          G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_BUFFERS,
+      g_param_spec_uint ("max-buffers", "Maximum pool buffers",
+          "Maximum number of buffers in the proposed buffer pool, applied "
+          "to the next pool (0 = unlimited)", 0, G_MAXUINT,
+          DEFAULT_MAX_BUFFERS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_PREALLOCATE,
+      g_param_spec_boolean ("preallocate", "Preallocate",
+          "Allocate min-buffers buffers when the pool is activated instead "
+          "of on first use", DEFAULT_PREALLOCATE, G_PARAM_READWRITE |
+          G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_POOL_STATS,
+      g_param_spec_boxed ("pool-stats", "Pool statistics",
+          "Statistics of the current buffer pool: allocations, acquires, "
+          "acquire-waits, acquire-wait-time (ns), max-outstanding and "
+          "max-buffers", GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_property (gobject_class, PROP_IVI_SURF_ID,
       g_param_spec_uint ("ivisurf-id", "Wayland IVI surface ID",
           "Set Wayland IVI surface ID, only available for Wayland IVI shell",
@@ -3496,7 +6464,7 @@ gst_eglglessink_class_init (GstEglGlesSinkClass * klass)
                   G_SIGNAL_RUN_LAST,
                   0,
                   NULL, NULL, NULL,
-                  G_TYPE_NONE, 0);
+                  G_TYPE_NONE, 1, G_TYPE_POINTER);
   
   gst_element_class_set_static_metadata (gstelement_class,
       "EGL/GLES vout Sink",
@@ -3537,6 +6505,7 @@ gst_eglglessink_init (GstEglGlesSink * eglglessink)
   eglglessink->egl_started = FALSE;
   eglglessink->using_own_window = FALSE;
   eglglessink->using_cuda = FALSE;
+  eglglessink->using_dmabuf = FALSE;
   eglglessink->using_nvbufsurf = FALSE;
   eglglessink->nvbuf_api_version_new = DEFAULT_NVBUF_API_VERSION_NEW;
 
@@ -3547,6 +6516,26 @@ gst_eglglessink_init (GstEglGlesSink * eglglessink)
   eglglessink->force_aspect_ratio = TRUE;
   eglglessink->winsys = "x11";
 
+  eglglessink->overlay_textures = g_hash_table_new_full (g_direct_hash,
+      g_direct_equal, NULL, gst_eglglessink_overlay_texture_free);
+  eglglessink->draw_roi = DEFAULT_DRAW_ROI;
+  eglglessink->roi_line_width = DEFAULT_ROI_LINE_WIDTH;
+  eglglessink->roi_boxes = g_array_new (FALSE, FALSE, sizeof (GstEglRoiBox));
+  eglglessink->passthrough = DEFAULT_PASSTHROUGH;
+  eglglessink->output_width = DEFAULT_OUTPUT_WIDTH;
+  eglglessink->output_height = DEFAULT_OUTPUT_HEIGHT;
+  eglglessink->mosaic = DEFAULT_MOSAIC;
+  eglglessink->tile_renegotiation = DEFAULT_TILE_RENEGOTIATION;
+  eglglessink->predownscale = DEFAULT_PREDOWNSCALE;
+  eglglessink->predownscale_factor = 1;
+  eglglessink->atlas_x = DEFAULT_ATLAS_X;
+  eglglessink->atlas_y = DEFAULT_ATLAS_Y;
+  eglglessink->min_buffers = DEFAULT_MIN_BUFFERS;
+  eglglessink->max_buffers = DEFAULT_MAX_BUFFERS;
+  eglglessink->preallocate = DEFAULT_PREALLOCATE;
+  eglglessink->extra_outputs = g_array_new (FALSE, FALSE,
+      sizeof (GstEglExtraOutput));
+
   g_mutex_init (&eglglessink->render_lock);
   g_cond_init (&eglglessink->render_cond);
   g_cond_init (&eglglessink->render_exit_cond);
@@ -3572,6 +6561,16 @@ gst_eglglessink_init (GstEglGlesSink * eglglessink)
   eglglessink->cuResource[1] = NULL;
   eglglessink->cuResource[2] = NULL;
   eglglessink->gpu_id = 0;
+  eglglessink->scaling_method = DEFAULT_SCALING_METHOD;
+  eglglessink->video_direction = DEFAULT_VIDEO_DIRECTION;
+  eglglessink->tag_direction = GST_VIDEO_ORIENTATION_IDENTITY;
+  eglglessink->rotate_method = GST_VIDEO_ORIENTATION_IDENTITY;
+  eglglessink->have_transform = FALSE;
+  eglglessink->deinterlace_method = DEFAULT_DEINTERLACE_METHOD;
+  eglglessink->deinterlace_field_rate = DEFAULT_DEINTERLACE_FIELD_RATE;
+  eglglessink->deinterlacing = FALSE;
+  eglglessink->second_field_pending = FALSE;
+  eglglessink->second_field = FALSE;
 
 }
 
@@ -3615,8 +6614,17 @@ eglglessink_plugin_init (GstPlugin * plugin)
   bcm_host_init ();
 #endif
 
-  return gst_element_register (plugin, "nveglglessink", GST_RANK_SECONDARY,
-      GST_TYPE_EGLGLESSINK);
+  if (!gst_element_register (plugin, "nveglglessink", GST_RANK_SECONDARY,
+          GST_TYPE_EGLGLESSINK))
+    return FALSE;
+
+#ifndef HAVE_IOS
+  if (!gst_element_register (plugin, "nveglglescompositor", GST_RANK_NONE,
+          GST_TYPE_EGLGLESCOMPOSITOR))
+    return FALSE;
+#endif
+
+  return TRUE;
 }
 
 /**
@@ -12,6 +12,8 @@
 
 #include "gstegladaptation.h"
 #include "gstegljitter.h"
+#include "gstegldmabuf.h"
+#include "gsteglimagecache.h"
 
 G_BEGIN_DECLS
 #define GST_TYPE_EGLGLESSINK \
@@ -66,8 +68,28 @@ struct _GstEglGlesSink
   GstVideoInfo configured_info;
   gfloat stride[3];
   GstVideoGLTextureOrientation orientation;
+  GstVideoRectangle viewport; /* 当前 glViewport，离屏渲染（FBO）之后需要恢复 */
+  /* 旋转/翻转：video_direction 为 AUTO 时使用 image-orientation 标签 */
+  GstVideoOrientationMethod video_direction; /* 属性 video-direction */
+  GstVideoOrientationMethod tag_direction; /* 来自 image-orientation 标签 */
+  GstVideoOrientationMethod rotate_method; /* 实际使用的旋转/翻转方式 */
+  gfloat transform[16]; /* GstVideoAffineTransformationMeta 的矩阵（列主序，视频坐标 [0,1]） */
+  gboolean have_transform; /* 当前帧是否带有仿射变换 */
+  gboolean deinterlacing; /* 当前帧是否需要去隔行（由caps和buffer标志决定） */
+  gint deinterlace_field; /* 当前输出的场（0: 顶场，1: 底场） */
+  gboolean second_field_pending; /* 场频输出时，show_frame 还需要输出第二场 */
+  gboolean second_field; /* 当前渲染的是第二场 */
+  GstVideoOverlayComposition *overlay_composition; /* 当前帧的叠加层（字幕/OSD） */
+  GHashTable *overlay_textures; /* 叠加层纹理缓存：矩形seqnum -> GstEglOverlayTexture */
+  GArray *roi_boxes; /* 当前帧的 ROI 框（GstEglRoiBox） */
+  GArray *extra_outputs; /* 额外输出纹理（GstEglExtraOutput），只在渲染线程中使用 */
+  gboolean extra_outputs_changed; /* 属性 extra-outputs 改变（或者上下文重建）后需要重新创建 FBO */
+  gpointer frame_sync; /* render() 为这一帧创建的 GLsync，随 ui-render 交给处理函数，只在渲染线程中使用 */
 #ifndef HAVE_IOS
   GstBufferPool *pool;
+  GstEglDmabufCache *dmabuf_cache; /* 导入的 dmabuf 平面（EGLImage），只在渲染线程中使用 */
+  GstBuffer *dmabuf_buffer; /* 最后导入的 dmabuf buffer，持有引用直到下一帧导入，只在渲染线程中使用 */
+  GstEglImageTextureCache *image_texture_cache; /* memory:EGLImage 输入的纹理，只在渲染线程中使用 */
 #endif
 
   GstEglAdaptationContext *egl_context;
@@ -87,6 +109,8 @@ struct _GstEglGlesSink
   gboolean is_closing; /* egl是否关闭flag */
   gboolean using_cuda; /* GPU CUDA */
   gboolean using_nvbufsurf; /* Jetson */
+  gboolean using_dmabuf; /* memory:DMABuf，每个平面导入成 EGLImage */
+  guint64 dmabuf_modifier; /* 协商的 DRM modifier（0 是 linear） */
 
   gpointer own_window_data; /* X11窗口下的 Display */
   GMutex window_lock;
@@ -112,6 +136,27 @@ struct _GstEglGlesSink
   gboolean force_aspect_ratio;
   gchar* winsys; /* 使用了那个窗口类型，比如 winsys = "x11" */
   gboolean show_latency;
+  GstEglScalingMethod scaling_method; /* 缩放到 display_region 时的滤波方式 */
+  GstEglDeinterlaceMethod deinterlace_method; /* 隔行视频的去隔行方式 */
+  gboolean deinterlace_field_rate; /* bob/linear 时按场频输出（每一场渲染一次） */
+  gboolean draw_roi; /* 是否绘制 GstVideoRegionOfInterestMeta 的框 */
+  guint roi_line_width; /* ROI 框的线宽（像素） */
+  gchar *extra_outputs_desc; /* 属性 extra-outputs */
+  gboolean passthrough; /* egl-share-texture 已经是最终画面时跳过绘制 */
+  guint output_width; /* 输出FBO（egl-share-texture）的宽度，0 表示视频帧的宽度 */
+  guint output_height; /* 输出FBO（egl-share-texture）的高度，0 表示视频帧的高度 */
+  gboolean mosaic; /* rows x columns 拼接：每一帧更新一个格子，一次实例化绘制整个网格 */
+  gboolean tile_renegotiation; /* 格子远小于协商的尺寸时，要求上游按格子尺寸重新协商 */
+  gint preferred_width; /* getcaps 优先的宽度（视频方向，0 表示没有偏好），GST_OBJECT_LOCK 保护 */
+  gint preferred_height;
+  gboolean predownscale; /* 系统内存的帧在上传之前先在CPU上按格子尺寸缩小 */
+  gint predownscale_factor; /* 当前的缩小倍数（1 表示不缩小），GST_OBJECT_LOCK 保护 */
+  gint atlas_x; /* 在图集（egl-share-texture）中的位置，-1 表示不使用图集，GST_OBJECT_LOCK 保护 */
+  gint atlas_y;
+  guint min_buffers; /* 缓冲池的 buffer 个数，GST_OBJECT_LOCK 保护 */
+  guint max_buffers; /* 0 表示不限制 */
+  gboolean preallocate; /* 缓冲池激活时分配 min_buffers 个buffer */
+  gboolean full_damage; /* 整个绘制目标需要重绘（expose），GST_OBJECT_LOCK 保护 */
 
   PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES;
 
@@ -143,6 +188,13 @@ struct _GstEglGlesSinkClass
 };
 
 GType gst_eglglessink_get_type (void);
+GType gst_eglglessink_scaling_method_get_type (void);
+#define GST_TYPE_EGLGLESSINK_SCALING_METHOD (gst_eglglessink_scaling_method_get_type ())
+GType gst_eglglessink_deinterlace_method_get_type (void);
+#define GST_TYPE_EGLGLESSINK_DEINTERLACE_METHOD (gst_eglglessink_deinterlace_method_get_type ())
+
+/* 图集区域的 GstContext（每个sink单独设置）："texture"（guint）、"x"、"y"、"width"、"height"（gint） */
+#define GST_EGLGLESSINK_ATLAS_CONTEXT_TYPE "gst.egl.atlas-region"
 
 G_END_DECLS
 #endif /* __GST_EGLGLESSINK_H__ */
@@ -0,0 +1,255 @@
+/*
+ * GStreamer EGL/GLES Sink EGLImage texture cache
+ * Copyright (c) 2015-2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "gsteglimagecache.h"
+
+#ifndef HAVE_IOS
+
+#define GST_CAT_DEFAULT egladaption_debug
+
+/*
+ * 缓存由 sink 和每个记录了纹理的 GstMemory 共同引用，
+ * 内存可能在缓存释放之后才释放
+ */
+struct _GstEglImageTextureCache
+{
+  gint ref_count;
+  GMutex lock;
+  GstElement *element; /* 用于日志 */
+  GHashTable *textures; /* GstMemory* -> GstEglImageTexture（不持有） */
+  GstEglGarbage *garbage; /* 内存已经释放的纹理由渲染线程删除 */
+};
+
+/*
+ * GstMemory 的 qdata：所有缓存共用一个 quark，qdata 是 GstEglImageTexture 的链表，
+ * 每个缓存一项，多个 sink 看到同一个内存时各自记录自己的纹理
+ */
+typedef struct
+{
+  GstEglImageTextureCache *cache;
+  GstMemory *mem;
+  EGLImageKHR image;
+  GLuint texture;
+  guint epoch; /* 创建纹理时的上下文代数 */
+} GstEglImageTexture;
+
+static GMutex textures_lock; /* 保护内存 qdata 中的链表 */
+
+static GQuark
+gst_egl_image_texture_quark (void)
+{
+  static GQuark quark = 0;
+
+  if (!quark)
+    quark = g_quark_from_static_string ("GstEglImageTexture");
+
+  return quark;
+}
+
+static void
+gst_egl_image_texture_cache_unref (GstEglImageTextureCache * cache)
+{
+  if (!g_atomic_int_dec_and_test (&cache->ref_count))
+    return;
+
+  g_hash_table_unref (cache->textures);
+  gst_egl_garbage_unref (cache->garbage);
+  g_mutex_clear (&cache->lock);
+  g_slice_free (GstEglImageTextureCache, cache);
+}
+
+/**
+ * @brief: GstMemory 释放时调用（任何线程），纹理只能在渲染线程删除，这里只记录下来
+*/
+static void
+gst_egl_image_texture_free (GstEglImageTexture * tex)
+{
+  GstEglImageTextureCache *cache = tex->cache;
+
+  g_mutex_lock (&cache->lock);
+  if (g_hash_table_lookup (cache->textures, tex->mem) == tex) {
+    g_hash_table_remove (cache->textures, tex->mem);
+    gst_egl_garbage_push (cache->garbage, tex->epoch, GST_EGL_GARBAGE_TEXTURE,
+        tex->texture);
+  }
+  g_mutex_unlock (&cache->lock);
+
+  gst_egl_image_texture_cache_unref (cache);
+  g_slice_free (GstEglImageTexture, tex);
+}
+
+static void
+gst_egl_image_texture_list_free (GSList * list)
+{
+  g_slist_free_full (list, (GDestroyNotify) gst_egl_image_texture_free);
+}
+
+/**
+ * @brief: 把 @tex 记录到内存的 qdata 中，替换同一个缓存之前（已经 clear）留下的记录，
+ *         其他缓存的记录不受影响
+*/
+static void
+gst_egl_image_texture_attach (GstEglImageTexture * tex)
+{
+  GstMiniObject *obj = GST_MINI_OBJECT_CAST (tex->mem);
+  GQuark quark = gst_egl_image_texture_quark ();
+  GstEglImageTexture *old = NULL;
+  GSList *list, *l;
+
+  g_mutex_lock (&textures_lock);
+  /* 替换 qdata 会调用旧值的 destroy，先取出链表 */
+  list = gst_mini_object_steal_qdata (obj, quark);
+  for (l = list; l; l = l->next) {
+    if (((GstEglImageTexture *) l->data)->cache == tex->cache) {
+      old = l->data;
+      list = g_slist_delete_link (list, l);
+      break;
+    }
+  }
+  list = g_slist_prepend (list, tex);
+  gst_mini_object_set_qdata (obj, quark, list,
+      (GDestroyNotify) gst_egl_image_texture_list_free);
+  g_mutex_unlock (&textures_lock);
+
+  /* 表中已经是新的纹理，旧的记录只释放缓存的引用 */
+  if (old)
+    gst_egl_image_texture_free (old);
+}
+
+GstEglImageTextureCache *
+gst_egl_image_texture_cache_new (GstElement * element, GstEglGarbage * garbage)
+{
+  GstEglImageTextureCache *cache;
+
+  cache = g_slice_new0 (GstEglImageTextureCache);
+  cache->ref_count = 1;
+  g_mutex_init (&cache->lock);
+  cache->element = element;
+  cache->textures = g_hash_table_new (g_direct_hash, g_direct_equal);
+  cache->garbage = gst_egl_garbage_ref (garbage);
+
+  return cache;
+}
+
+/**
+ * @brief: 删除所有纹理（渲染线程，caps 改变时调用）。还活着的内存的 qdata 不再有效，
+ *         下次出现时重新绑定
+*/
+void
+gst_egl_image_texture_cache_clear (GstEglImageTextureCache * cache)
+{
+  GHashTableIter iter;
+  gpointer value;
+  GArray *textures;
+
+  if (!cache)
+    return;
+
+  textures = g_array_new (FALSE, FALSE, sizeof (GLuint));
+  g_mutex_lock (&cache->lock);
+  g_hash_table_iter_init (&iter, cache->textures);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    g_array_append_val (textures, ((GstEglImageTexture *) value)->texture);
+  g_hash_table_remove_all (cache->textures);
+  g_mutex_unlock (&cache->lock);
+
+  if (textures->len)
+    glDeleteTextures (textures->len, (GLuint *) textures->data);
+  g_array_free (textures, TRUE);
+}
+
+void
+gst_egl_image_texture_cache_free (GstEglImageTextureCache * cache)
+{
+  if (!cache)
+    return;
+
+  /* 之后释放的内存在表中找不到自己的记录，只释放引用 */
+  gst_egl_image_texture_cache_clear (cache);
+  gst_egl_image_texture_cache_unref (cache);
+}
+
+/**
+ * @brief: 返回绑定了 @mem 的 EGLImage 的纹理，第一次出现时创建纹理并绑定
+ *         （纹理参数和 texture[@plane] 相同）
+ * @return: 纹理属于缓存；失败返回 0
+*/
+GLuint
+gst_egl_image_texture_cache_get (GstEglImageTextureCache * cache,
+    GstEglAdaptationContext * ctx, GstMemory * mem, GstVideoFormat format,
+    gint plane, PFNGLEGLIMAGETARGETTEXTURE2DOESPROC image_target_texture)
+{
+  GstEglImageTexture *tex;
+  EGLImageKHR image;
+  GLuint texture;
+
+  if (mem->parent)
+    mem = mem->parent;
+
+  image = gst_egl_image_memory_get_image (mem);
+
+  g_mutex_lock (&cache->lock);
+  tex = g_hash_table_lookup (cache->textures, mem);
+  texture = tex && tex->image == image ? tex->texture : 0;
+  if (tex && !texture) {
+    /* 同一个内存换了 EGLImage，旧纹理不再使用 */
+    g_hash_table_remove (cache->textures, mem);
+    gst_egl_garbage_push (cache->garbage, tex->epoch, GST_EGL_GARBAGE_TEXTURE,
+        tex->texture);
+  }
+  g_mutex_unlock (&cache->lock);
+
+  if (texture)
+    return texture;
+
+  glGenTextures (1, &texture);
+  glBindTexture (GL_TEXTURE_2D, texture);
+  gst_egl_adaptation_init_plane_texture (ctx, format, plane, GL_TEXTURE_2D);
+  image_target_texture (GL_TEXTURE_2D, image);
+  if (got_gl_error ("glEGLImageTargetTexture2DOES")) {
+    glDeleteTextures (1, &texture);
+    return 0;
+  }
+
+  GST_DEBUG_OBJECT (cache->element, "Bound EGLImage %p of memory %p to "
+      "texture %u", image, mem, texture);
+
+  tex = g_slice_new (GstEglImageTexture);
+  tex->cache = cache;
+  tex->mem = mem;
+  tex->image = image;
+  tex->texture = texture;
+  tex->epoch = gst_egl_garbage_get_epoch (cache->garbage);
+  g_atomic_int_inc (&cache->ref_count);
+
+  g_mutex_lock (&cache->lock);
+  g_hash_table_insert (cache->textures, mem, tex);
+  g_mutex_unlock (&cache->lock);
+
+  gst_egl_image_texture_attach (tex);
+
+  return texture;
+}
+
+#endif
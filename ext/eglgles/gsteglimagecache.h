@@ -0,0 +1,58 @@
+/*
+ * GStreamer EGL/GLES Sink EGLImage texture cache
+ * Copyright (c) 2015-2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef __GST_EGL_IMAGE_CACHE_H__
+#define __GST_EGL_IMAGE_CACHE_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include "gstegladaptation.h"
+
+G_BEGIN_DECLS
+
+/*
+ * EGLImage 纹理缓存
+ *
+ * memory:EGLImage 输入的每个 GstMemory 绑定到自己的纹理，只在第一次出现时调用一次
+ * glEGLImageTargetTexture2DOES，缓冲池循环使用的 buffer 之后只需要选择对应的纹理。
+ * 纹理记录在 GstMemory 的 qdata 中，内存释放（可能在任何线程）时纹理加入 GstEglGarbage，
+ * 由渲染线程删除。
+ */
+
+#ifndef HAVE_IOS
+typedef struct _GstEglImageTextureCache GstEglImageTextureCache;
+
+GstEglImageTextureCache *gst_egl_image_texture_cache_new (GstElement * element,
+    GstEglGarbage * garbage);
+void gst_egl_image_texture_cache_clear (GstEglImageTextureCache * cache);
+void gst_egl_image_texture_cache_free (GstEglImageTextureCache * cache);
+GLuint gst_egl_image_texture_cache_get (GstEglImageTextureCache * cache,
+    GstEglAdaptationContext * ctx, GstMemory * mem, GstVideoFormat format,
+    gint plane, PFNGLEGLIMAGETARGETTEXTURE2DOESPROC image_target_texture);
+#endif
+
+G_END_DECLS
+
+#endif /* __GST_EGL_IMAGE_CACHE_H__ */
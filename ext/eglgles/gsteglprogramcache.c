@@ -0,0 +1,265 @@
+/*
+ * GStreamer EGL/GLES Sink shader program binary cache
+ * Copyright (c) 2015-2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "gsteglprogramcache.h"
+
+#include <errno.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#ifndef HAVE_IOS
+
+#define GST_CAT_DEFAULT egladaption_debug
+
+/* 缓存文件格式：magic + binary format + 程序二进制 */
+#define PROGRAM_CACHE_MAGIC 0x50474c45  /* "ELGP" */
+
+typedef struct
+{
+  guint32 magic;
+  guint32 format;
+} GstEglProgramCacheHeader;
+
+/**
+ * @brief: 当前上下文是否支持程序二进制（GLES3 核心功能，但驱动可以不提供任何格式）
+*/
+gboolean
+gst_egl_program_cache_supported (void)
+{
+  GLint n_formats = 0;
+
+  glGetIntegerv (GL_NUM_PROGRAM_BINARY_FORMATS, &n_formats);
+  got_gl_error ("glGetIntegerv GL_NUM_PROGRAM_BINARY_FORMATS");
+
+  return n_formats > 0;
+}
+
+/**
+ * @brief: 计算缓存键（SHA-256 十六进制字符串），需要在当前线程绑定了上下文时调用
+*/
+gchar *
+gst_egl_program_cache_key (const gchar * vert_text, const gchar * frag_text)
+{
+  static const GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+  GChecksum *checksum;
+  gchar *key;
+  guint i;
+
+  checksum = g_checksum_new (G_CHECKSUM_SHA256);
+
+  for (i = 0; i < G_N_ELEMENTS (strings); i++) {
+    const gchar *str = (const gchar *) glGetString (strings[i]);
+
+    if (str)
+      g_checksum_update (checksum, (const guchar *) str, -1);
+    g_checksum_update (checksum, (const guchar *) "\n", 1);
+  }
+
+  /* 属性位置在链接前绑定，保存在二进制中；绑定改变时旧的二进制不能再使用。
+   * 之前预编译路径保存的二进制没有绑定属性位置，加上版本让这些缓存失效 */
+  g_checksum_update (checksum, (const guchar *) "position=0 texpos=1 v2\n",
+      -1);
+
+  g_checksum_update (checksum, (const guchar *) vert_text, -1);
+  g_checksum_update (checksum, (const guchar *) "\n", 1);
+  g_checksum_update (checksum, (const guchar *) frag_text, -1);
+
+  key = g_strdup (g_checksum_get_string (checksum));
+  g_checksum_free (checksum);
+
+  return key;
+}
+
+static gchar *
+gst_egl_program_cache_path (const gchar * dir, const gchar * key)
+{
+  gchar *name, *path;
+
+  name = g_strconcat (key, ".bin", NULL);
+  path = g_build_filename (dir, name, NULL);
+  g_free (name);
+
+  return path;
+}
+
+/**
+ * @brief: 取出链接成功的着色程序的二进制（链接前需要设置 GL_PROGRAM_BINARY_RETRIEVABLE_HINT），
+ *         内容和缓存文件相同（header + 程序二进制）
+ * @return: 不支持时返回 NULL
+*/
+GBytes *
+gst_egl_program_binary_get (GLuint prog)
+{
+  GstEglProgramCacheHeader header;
+  GLint length = 0;
+  GLenum format = 0;
+  gchar *contents;
+
+  glGetProgramiv (prog, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (got_gl_error ("glGetProgramiv GL_PROGRAM_BINARY_LENGTH") || length <= 0)
+    return NULL;
+
+  contents = g_malloc (sizeof (header) + length);
+  glGetProgramBinary (prog, length, &length, &format,
+      contents + sizeof (header));
+  if (got_gl_error ("glGetProgramBinary")) {
+    g_free (contents);
+    return NULL;
+  }
+
+  header.magic = PROGRAM_CACHE_MAGIC;
+  header.format = format;
+  memcpy (contents, &header, sizeof (header));
+
+  return g_bytes_new_take (contents, sizeof (header) + length);
+}
+
+/**
+ * @brief: 用 gst_egl_program_binary_get 取出的二进制在当前上下文中创建着色程序
+ * @return: 链接成功的程序ID，格式不对或者驱动不接受时返回 0
+*/
+GLuint
+gst_egl_program_binary_load (GBytes * binary)
+{
+  GstEglProgramCacheHeader header;
+  const gchar *contents;
+  gsize length;
+  GLuint prog;
+  GLint status = GL_FALSE;
+  GLenum error;
+
+  contents = g_bytes_get_data (binary, &length);
+  if (length <= sizeof (header))
+    return 0;
+
+  memcpy (&header, contents, sizeof (header));
+  if (header.magic != PROGRAM_CACHE_MAGIC)
+    return 0;
+
+  /* 之前调用留下的错误不属于 glProgramBinary */
+  error = glGetError ();
+  if (error != GL_NO_ERROR)
+    GST_WARNING ("GL error 0x%x pending before loading a program binary",
+        error);
+
+  prog = glCreateProgram ();
+  /* 这个程序的二进制也可能再共享给其他上下文 */
+  glProgramParameteri (prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  glProgramBinary (prog, header.format, contents + sizeof (header),
+      length - sizeof (header));
+  /* 驱动不接受时 glProgramBinary 会产生 GL_INVALID_ENUM，不当作错误，只看链接状态 */
+  error = glGetError ();
+  if (error != GL_NO_ERROR)
+    GST_DEBUG ("glProgramBinary rejected the binary: 0x%x", error);
+  glGetProgramiv (prog, GL_LINK_STATUS, &status);
+
+  if (status == GL_FALSE) {
+    glDeleteProgram (prog);
+    return 0;
+  }
+
+  return prog;
+}
+
+/**
+ * @brief: 从缓存加载着色程序
+ * @return: 链接成功的程序ID，没有缓存或者缓存过期时返回 0
+*/
+GLuint
+gst_egl_program_cache_load (GstElement * element, const gchar * dir,
+    const gchar * key)
+{
+  gchar *path, *contents = NULL;
+  gsize length = 0;
+  GBytes *binary;
+  GLuint prog;
+
+  path = gst_egl_program_cache_path (dir, key);
+
+  if (!g_file_get_contents (path, &contents, &length, NULL)) {
+    g_free (path);
+    return 0;
+  }
+
+  binary = g_bytes_new_take (contents, length);
+  prog = gst_egl_program_binary_load (binary);
+  g_bytes_unref (binary);
+
+  if (prog) {
+    GST_DEBUG_OBJECT (element, "Loaded program %u from cache %s", prog, path);
+  } else {
+    GST_INFO_OBJECT (element, "Program cache entry %s is invalid or stale",
+        path);
+    g_unlink (path);
+  }
+  g_free (path);
+
+  return prog;
+}
+
+/**
+ * @brief: 保存链接成功的着色程序到缓存（链接前需要设置 GL_PROGRAM_BINARY_RETRIEVABLE_HINT）
+ *         先写临时文件再重命名，多个sink同时写同一个文件也不会读到不完整的内容
+*/
+void
+gst_egl_program_cache_store (GstElement * element, const gchar * dir,
+    const gchar * key, GLuint prog)
+{
+  GBytes *binary;
+
+  binary = gst_egl_program_binary_get (prog);
+  if (!binary)
+    return;
+
+  gst_egl_program_cache_store_binary (element, dir, key, binary);
+  g_bytes_unref (binary);
+}
+
+/**
+ * @brief: 保存 gst_egl_program_binary_get 取出的二进制到缓存
+*/
+void
+gst_egl_program_cache_store_binary (GstElement * element, const gchar * dir,
+    const gchar * key, GBytes * binary)
+{
+  gchar *path;
+  gconstpointer contents;
+  gsize length;
+  GError *error = NULL;
+
+  contents = g_bytes_get_data (binary, &length);
+  path = gst_egl_program_cache_path (dir, key);
+
+  if (g_mkdir_with_parents (dir, 0755) != 0 ||
+      !g_file_set_contents (path, contents, length, &error)) {
+    GST_WARNING_OBJECT (element, "Couldn't write program cache %s: %s", path,
+        error ? error->message : g_strerror (errno));
+    g_clear_error (&error);
+  } else {
+    GST_DEBUG_OBJECT (element, "Stored program in cache %s", path);
+  }
+
+  g_free (path);
+}
+
+#endif /* HAVE_IOS */
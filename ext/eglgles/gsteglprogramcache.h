@@ -0,0 +1,58 @@
+/*
+ * GStreamer EGL/GLES Sink shader program binary cache
+ * Copyright (c) 2015-2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __GST_EGL_PROGRAM_CACHE_H__
+#define __GST_EGL_PROGRAM_CACHE_H__
+
+#include "gstegladaptation.h"
+
+G_BEGIN_DECLS
+
+/*
+ * 着色程序二进制缓存
+ *
+ * 编译好的着色程序用 glGetProgramBinary 保存在缓存目录中，文件名由驱动
+ * （GL_VENDOR/GL_RENDERER/GL_VERSION）和着色程序源代码的哈希决定，
+ * 下次用 glProgramBinary 直接加载，跳过编译和链接。
+ * 驱动不接受缓存的二进制（过期）时删除该文件，由调用者重新编译。
+ * 同一共享组中的 sink 也通过二进制共享链接结果，每个上下文创建自己的程序对象
+ * （uniform 是程序对象的状态，不能在 sink 之间共用）。
+ */
+
+#ifndef HAVE_IOS
+gboolean gst_egl_program_cache_supported (void);
+gchar *gst_egl_program_cache_key (const gchar * vert_text,
+    const gchar * frag_text);
+GLuint gst_egl_program_cache_load (GstElement * element, const gchar * dir,
+    const gchar * key);
+void gst_egl_program_cache_store (GstElement * element, const gchar * dir,
+    const gchar * key, GLuint prog);
+void gst_egl_program_cache_store_binary (GstElement * element,
+    const gchar * dir, const gchar * key, GBytes * binary);
+GBytes *gst_egl_program_binary_get (GLuint prog);
+GLuint gst_egl_program_binary_load (GBytes * binary);
+#endif
+
+G_END_DECLS
+
+#endif /* __GST_EGL_PROGRAM_CACHE_H__ */
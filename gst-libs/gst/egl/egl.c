@@ -36,6 +36,16 @@
 #include <gst/egl/egl.h>
 #include <string.h>
 
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/dma-buf.h>
+#endif
+
 #if defined (USE_EGL_RPI) && defined(__GNUC__)
 #pragma GCC reset_options
 #pragma GCC diagnostic pop
@@ -62,14 +72,80 @@ typedef struct
 
   gpointer user_data;
   GDestroyNotify user_data_destroy;
+
+  /* gst_egl_image_allocator_alloc 分配的内存：udmabuf 导出的 dmabuf 和它的 CPU 映射，
+   * gst_egl_image_allocator_wrap 包装的内存 fd 为 -1，不能映射 */
+  gint dmabuf_fd;
+  gpointer data;
+  gsize mapped_size;
 } GstEGLImageMemory;
 
 #define GST_EGL_IMAGE_MEMORY(mem) ((GstEGLImageMemory*)(mem))
 
+#ifdef __linux__
+/* linux/udmabuf.h（4.20），旧的内核头文件里没有，这里按相同的布局定义 */
+struct gst_egl_udmabuf_create
+{
+  guint32 memfd;
+  guint32 flags;
+  guint64 offset;
+  guint64 size;
+};
+#define GST_EGL_UDMABUF_FLAGS_CLOEXEC 0x01
+#define GST_EGL_UDMABUF_CREATE _IOW('u', 0x42, struct gst_egl_udmabuf_create)
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#endif
+#ifndef F_SEAL_SHRINK
+#define F_SEAL_SHRINK 0x0002
+#endif
+
+#define GST_EGL_UDMABUF_DEVICE "/dev/udmabuf"
+
+/* DRM fourcc（和 drm_fourcc.h 的 fourcc_code 相同），按 glTexImage2D 上传原始字节时的
+ * 分量顺序选择，采样结果和纹理路径一致 */
+#define GST_EGL_DRM_FORMAT_R8 GST_MAKE_FOURCC ('R', '8', ' ', ' ')
+#define GST_EGL_DRM_FORMAT_GR88 GST_MAKE_FOURCC ('G', 'R', '8', '8')
+#define GST_EGL_DRM_FORMAT_RGB565 GST_MAKE_FOURCC ('R', 'G', '1', '6')
+#define GST_EGL_DRM_FORMAT_BGR888 GST_MAKE_FOURCC ('B', 'G', '2', '4')
+#define GST_EGL_DRM_FORMAT_ABGR8888 GST_MAKE_FOURCC ('A', 'B', '2', '4')
+
+static void
+gst_egl_image_memory_dmabuf_sync (GstEGLImageMemory * emem, guint64 flags)
+{
+  struct dma_buf_sync sync = { flags };
+
+  while (ioctl (emem->dmabuf_fd, DMA_BUF_IOCTL_SYNC, &sync) < 0 &&
+      (errno == EINTR || errno == EAGAIN));
+}
+#endif
+
+/**
+ * @brief: 当 /dev/udmabuf 可用时，gst_egl_image_allocator_alloc 分配的内存可以被 CPU 映射
+ *         （wrap 包装的纹理 EGLImage 仍然不能映射，带 GST_MEMORY_FLAG_NOT_MAPPABLE）
+*/
 gboolean
 gst_egl_image_memory_is_mappable (void)
 {
+#if defined (__linux__) && defined (SYS_memfd_create)
+  static gsize usable = 0; /* 1: 可用，2: 不可用 */
+
+  if (g_once_init_enter (&usable)) {
+    g_once_init_leave (&usable,
+        access (GST_EGL_UDMABUF_DEVICE, R_OK | W_OK) == 0 ? 1 : 2);
+  }
+
+  return usable == 1;
+#else
   return FALSE;
+#endif
 }
 
 gboolean
@@ -165,21 +241,71 @@ gst_egl_image_allocator_free_vfunc (GstAllocator * allocator, GstMemory * mem)
     if (emem->user_data_destroy)
       emem->user_data_destroy (emem->user_data);
 
+#ifdef __linux__
+    if (emem->data)
+      munmap (emem->data, emem->mapped_size);
+    if (emem->dmabuf_fd >= 0)
+      close (emem->dmabuf_fd);
+#endif
+
     gst_egl_display_unref (emem->display);
   }
 
   g_slice_free (GstEGLImageMemory, emem);
 }
 
+/**
+ * @brief: 映射 udmabuf 内存，DMA_BUF_IOCTL_SYNC 开始 CPU 访问（GPU 之前的写入对 CPU 可见）
+*/
 static gpointer
-gst_egl_image_mem_map (GstMemory * mem, gsize maxsize, GstMapFlags flags)
+gst_egl_image_mem_map_full (GstMemory * mem, GstMapInfo * info, gsize maxsize)
 {
+#ifdef __linux__
+  GstEGLImageMemory *emem;
+  guint64 flags = DMA_BUF_SYNC_START;
+
+  if (mem->parent)
+    mem = mem->parent;
+  emem = GST_EGL_IMAGE_MEMORY (mem);
+
+  if (!emem->data)
+    return NULL;
+
+  if (info->flags & GST_MAP_READ)
+    flags |= DMA_BUF_SYNC_READ;
+  if (info->flags & GST_MAP_WRITE)
+    flags |= DMA_BUF_SYNC_WRITE;
+  gst_egl_image_memory_dmabuf_sync (emem, flags);
+
+  return emem->data;
+#else
   return NULL;
+#endif
 }
 
+/**
+ * @brief: 结束 CPU 访问，刷新 CPU 缓存，之后 GPU 采样的是上游写入的内容
+*/
 static void
-gst_egl_image_mem_unmap (GstMemory * mem)
+gst_egl_image_mem_unmap_full (GstMemory * mem, GstMapInfo * info)
 {
+#ifdef __linux__
+  GstEGLImageMemory *emem;
+  guint64 flags = DMA_BUF_SYNC_END;
+
+  if (mem->parent)
+    mem = mem->parent;
+  emem = GST_EGL_IMAGE_MEMORY (mem);
+
+  if (!emem->data)
+    return;
+
+  if (info->flags & GST_MAP_READ)
+    flags |= DMA_BUF_SYNC_READ;
+  if (info->flags & GST_MAP_WRITE)
+    flags |= DMA_BUF_SYNC_WRITE;
+  gst_egl_image_memory_dmabuf_sync (emem, flags);
+#endif
 }
 
 static GstMemory *
@@ -211,10 +337,41 @@ gst_egl_image_mem_share (GstMemory * mem, gssize offset, gssize size)
   return sub;
 }
 
+/**
+ * @brief: 拷贝到系统内存。只有 udmabuf 内存可以映射，包装的 EGLImage 返回 NULL
+*/
 static GstMemory *
 gst_egl_image_mem_copy (GstMemory * mem, gssize offset, gssize size)
 {
-  return NULL;
+  GstMemory *copy = NULL;
+  GstMapInfo src, dest;
+
+  if (!gst_memory_map (mem, &src, GST_MAP_READ))
+    return NULL;
+
+  if (offset < 0 || (gsize) offset > src.size)
+    goto done;
+  if (size == -1)
+    size = src.size - offset;
+  if ((gsize) (offset + size) > src.size)
+    goto done;
+
+  copy = gst_allocator_alloc (NULL, size, NULL);
+  if (!copy)
+    goto done;
+
+  if (!gst_memory_map (copy, &dest, GST_MAP_WRITE)) {
+    gst_memory_unref (copy);
+    copy = NULL;
+    goto done;
+  }
+  memcpy (dest.data, src.data + offset, size);
+  gst_memory_unmap (copy, &dest);
+
+done:
+  gst_memory_unmap (mem, &src);
+
+  return copy;
 }
 
 static gboolean
@@ -247,8 +404,8 @@ gst_egl_image_allocator_init (GstEGLImageAllocator * allocator)
   GstAllocator *alloc = GST_ALLOCATOR_CAST (allocator);
 
   alloc->mem_type = GST_EGL_IMAGE_MEMORY_TYPE;
-  alloc->mem_map = gst_egl_image_mem_map;
-  alloc->mem_unmap = gst_egl_image_mem_unmap;
+  alloc->mem_map_full = gst_egl_image_mem_map_full;
+  alloc->mem_unmap_full = gst_egl_image_mem_unmap_full;
   alloc->mem_share = gst_egl_image_mem_share;
   alloc->mem_copy = gst_egl_image_mem_copy;
   alloc->mem_is_span = gst_egl_image_mem_is_span;
@@ -271,12 +428,181 @@ gst_egl_image_allocator_obtain (void)
   return GST_ALLOCATOR (g_object_ref (allocator));
 }
 
+#ifdef __linux__
+/**
+ * @brief: 分配 memfd，通过 /dev/udmabuf 导出成 dmabuf
+ * @return: dmabuf fd，失败返回 -1
+*/
+static gint
+gst_egl_udmabuf_new (gsize size)
+{
+  struct gst_egl_udmabuf_create create = { 0, };
+  gint memfd = -1, devfd = -1, fd = -1;
+
+#ifdef SYS_memfd_create
+  memfd = syscall (SYS_memfd_create, "gst-egl-image",
+      MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+  errno = ENOSYS;
+#endif
+  if (memfd < 0)
+    goto done;
+
+  /* udmabuf 要求 memfd 不能再缩小 */
+  if (ftruncate (memfd, size) < 0 || fcntl (memfd, F_ADD_SEALS, F_SEAL_SHRINK) < 0)
+    goto done;
+
+  devfd = open (GST_EGL_UDMABUF_DEVICE, O_RDWR | O_CLOEXEC);
+  if (devfd < 0)
+    goto done;
+
+  create.memfd = memfd;
+  create.flags = GST_EGL_UDMABUF_FLAGS_CLOEXEC;
+  create.offset = 0;
+  create.size = size;
+  fd = ioctl (devfd, GST_EGL_UDMABUF_CREATE, &create);
+
+done:
+  if (fd < 0)
+    GST_WARNING ("Failed to create udmabuf of size %" G_GSIZE_FORMAT ": %s",
+        size, g_strerror (errno));
+  if (devfd >= 0)
+    close (devfd);
+  /* dmabuf 持有 memfd 的页，memfd 本身可以关闭 */
+  if (memfd >= 0)
+    close (memfd);
+
+  return fd < 0 ? -1 : fd;
+}
+#endif
+
+/**
+ * @brief: 分配 CPU 可以映射、GPU 可以直接采样的 EGLImage 内存：memfd 页经 udmabuf 导出成
+ *         linear dmabuf，mmap 给上游写入，同一个 dmabuf 通过 EGL_EXT_image_dma_buf_import
+ *         导入成 EGLImage，省掉上传时的拷贝
+ * @param size(out): 有效数据大小（stride * height）
+ * @return: 不支持 udmabuf 或 dmabuf 导入时返回 NULL，调用者回退到纹理创建的 EGLImage
+*/
 GstMemory *
 gst_egl_image_allocator_alloc (GstAllocator * allocator,
     GstEGLDisplay * display, GstVideoGLTextureType type, gint width,
     gint height, gsize * size)
 {
+#ifdef __linux__
+  GstEGLImageMemory *mem;
+  EGLImageKHR image;
+  EGLint attribs[13];
+  guint32 fourcc;
+  gint bpp, stride;
+  gsize data_size, alloc_size;
+  gint fd;
+  gpointer data;
+  const gchar *exts;
+
+  g_return_val_if_fail (display != NULL, NULL);
+  g_return_val_if_fail (width > 0 && height > 0, NULL);
+
+  if (!gst_egl_image_memory_is_mappable ())
+    return NULL;
+
+  exts = eglQueryString (gst_egl_display_get (display), EGL_EXTENSIONS);
+  if (!exts || !strstr (exts, "EGL_EXT_image_dma_buf_import"))
+    return NULL;
+
+  switch (type) {
+    case GST_VIDEO_GL_TEXTURE_TYPE_LUMINANCE:
+    case GST_VIDEO_GL_TEXTURE_TYPE_R:
+      fourcc = GST_EGL_DRM_FORMAT_R8;
+      bpp = 1;
+      break;
+    case GST_VIDEO_GL_TEXTURE_TYPE_LUMINANCE_ALPHA:
+    case GST_VIDEO_GL_TEXTURE_TYPE_RG:
+      fourcc = GST_EGL_DRM_FORMAT_GR88;
+      bpp = 2;
+      break;
+    case GST_VIDEO_GL_TEXTURE_TYPE_RGB16:
+      fourcc = GST_EGL_DRM_FORMAT_RGB565;
+      bpp = 2;
+      break;
+    case GST_VIDEO_GL_TEXTURE_TYPE_RGB:
+      fourcc = GST_EGL_DRM_FORMAT_BGR888;
+      bpp = 3;
+      break;
+    case GST_VIDEO_GL_TEXTURE_TYPE_RGBA:
+      fourcc = GST_EGL_DRM_FORMAT_ABGR8888;
+      bpp = 4;
+      break;
+    default:
+      return NULL;
+  }
+
+  stride = GST_ROUND_UP_N (width * bpp, GST_EGL_IMAGE_MEMORY_STRIDE_ALIGN);
+  data_size = (gsize) stride * height;
+  alloc_size = GST_ROUND_UP_N (data_size, (gsize) sysconf (_SC_PAGESIZE));
+
+  fd = gst_egl_udmabuf_new (alloc_size);
+  if (fd < 0)
+    return NULL;
+
+  data = mmap (NULL, alloc_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    GST_WARNING ("Failed to mmap udmabuf: %s", g_strerror (errno));
+    close (fd);
+    return NULL;
+  }
+
+  attribs[0] = EGL_WIDTH;
+  attribs[1] = width;
+  attribs[2] = EGL_HEIGHT;
+  attribs[3] = height;
+  attribs[4] = EGL_LINUX_DRM_FOURCC_EXT;
+  attribs[5] = fourcc;
+  attribs[6] = EGL_DMA_BUF_PLANE0_FD_EXT;
+  attribs[7] = fd;
+  attribs[8] = EGL_DMA_BUF_PLANE0_OFFSET_EXT;
+  attribs[9] = 0;
+  attribs[10] = EGL_DMA_BUF_PLANE0_PITCH_EXT;
+  attribs[11] = stride;
+  attribs[12] = EGL_NONE;
+
+  image = gst_egl_display_image_create (display, EGL_NO_CONTEXT,
+      EGL_LINUX_DMA_BUF_EXT, NULL, attribs);
+  if (image == EGL_NO_IMAGE_KHR) {
+    GST_WARNING ("Failed to import udmabuf as EGLImage: 0x%x", eglGetError ());
+    munmap (data, alloc_size);
+    close (fd);
+    return NULL;
+  }
+
+  mem = g_slice_new (GstEGLImageMemory);
+  if (allocator) {
+    gst_memory_init (GST_MEMORY_CAST (mem), 0, allocator, NULL, alloc_size,
+        0, 0, data_size);
+  } else {
+    /* gst_memory_init 持有自己的引用 */
+    allocator = gst_egl_image_allocator_obtain ();
+    gst_memory_init (GST_MEMORY_CAST (mem), 0, allocator, NULL, alloc_size,
+        0, 0, data_size);
+    gst_object_unref (allocator);
+  }
+
+  mem->display = gst_egl_display_ref (display);
+  mem->image = image;
+  mem->type = type;
+  mem->orientation = GST_VIDEO_GL_TEXTURE_ORIENTATION_X_NORMAL_Y_NORMAL;
+  mem->user_data = NULL;
+  mem->user_data_destroy = NULL;
+  mem->dmabuf_fd = fd;
+  mem->data = data;
+  mem->mapped_size = alloc_size;
+
+  if (size)
+    *size = data_size;
+
+  return GST_MEMORY_CAST (mem);
+#else
   return NULL;
+#endif
 }
 
 GstMemory *
@@ -305,6 +631,9 @@ gst_egl_image_allocator_wrap (GstAllocator * allocator,
 
   mem->user_data = user_data;
   mem->user_data_destroy = user_data_destroy;
+  mem->dmabuf_fd = -1;
+  mem->data = NULL;
+  mem->mapped_size = 0;
 
   return GST_MEMORY_CAST (mem);
 }
@@ -395,6 +724,13 @@ gst_egl_display_image_create (GstEGLDisplay * display,
       buffer, attrib_list);
 }
 
+void
+gst_egl_display_image_destroy (GstEGLDisplay * display, EGLImageKHR image)
+{
+  if (display->eglDestroyImage && image != EGL_NO_IMAGE_KHR)
+    display->eglDestroyImage (gst_egl_display_get (display), image);
+}
+
 G_DEFINE_BOXED_TYPE (GstEGLDisplay, gst_egl_display,
     (GBoxedCopyFunc) gst_egl_display_ref,
     (GBoxedFreeFunc) gst_egl_display_unref);
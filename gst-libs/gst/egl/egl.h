@@ -33,6 +33,9 @@ G_BEGIN_DECLS
 
 #define GST_CAPS_FEATURE_MEMORY_EGL_IMAGE "memory:EGLImage"
 
+/* Row pitch alignment of mappable memory from gst_egl_image_allocator_alloc() */
+#define GST_EGL_IMAGE_MEMORY_STRIDE_ALIGN 64
+
 typedef struct _GstEGLDisplay GstEGLDisplay;
 
 /* EGLImage GstMemory handling */
@@ -45,7 +48,8 @@ GstVideoGLTextureOrientation gst_egl_image_memory_get_orientation (GstMemory * m
 void gst_egl_image_memory_set_orientation (GstMemory * mem,
     GstVideoGLTextureOrientation orientation);
 
-/* Generic EGLImage allocator that doesn't support mapping, copying or anything */
+/* Generic EGLImage allocator. Memory from gst_egl_image_allocator_alloc() is
+ * udmabuf backed and CPU mappable, wrapped memory can't be mapped or copied */
 GstAllocator *gst_egl_image_allocator_obtain (void);
 GstMemory *gst_egl_image_allocator_alloc (GstAllocator * allocator,
     GstEGLDisplay * display, GstVideoGLTextureType type, gint width, gint height,
@@ -71,6 +75,8 @@ EGLDisplay gst_egl_display_get (GstEGLDisplay * display);
 EGLImageKHR gst_egl_display_image_create (GstEGLDisplay * display,
     EGLContext ctx, EGLenum target, EGLClientBuffer buffer,
     const EGLint * attrib_list);
+void gst_egl_display_image_destroy (GstEGLDisplay * display,
+    EGLImageKHR image);
 
 G_END_DECLS
 #endif /* __GST_EGL_H__ */